@@ -36,10 +36,22 @@ FILE(GLOB AvsCore_Sources RELATIVE "${CMAKE_CURRENT_SOURCE_DIR}"
   "filters/AviSource/*.h"
 )
 
-# Export definitions in general are not needed on x64 and only cause warnings,
-# unfortunately we still must need a .def file for some COM functions.
-if(CMAKE_SIZEOF_VOID_P EQUAL 8)
-  LIST(APPEND AvsCore_Sources "core/avisynth64.def")
+if(WIN32)
+  # Export definitions in general are not needed on x64 and only cause warnings,
+  # unfortunately we still must need a .def file for some COM functions.
+  if(CMAKE_SIZEOF_VOID_P EQUAL 8)
+    LIST(APPEND AvsCore_Sources "core/avisynth64.def")
+  else()
+    LIST(APPEND AvsCore_Sources "core/avisynth.def")
+  endif()
 else()
-  LIST(APPEND AvsCore_Sources "core/avisynth.def")
+  # The VfW frontend and AVISource are built on Video for Windows, the
+  # resources only make sense in a DLL and there are no SEH exceptions.
+  # The AVISource read-ahead is plain C++ and stays in, for its test.
+  foreach(FILE ${AvsCore_Sources})
+    if ("${FILE}" MATCHES "^filters/AviSource/|^core/main\\.cpp$|^core/initguid\\.cpp$|^core/exception\\.cpp$|\\.rc$"
+        AND NOT "${FILE}" MATCHES "^filters/AviSource/ReadAhead\\.(cpp|h)$")
+      LIST(REMOVE_ITEM AvsCore_Sources "${FILE}")
+    endif()
+  endforeach()
 endif() 
\ No newline at end of file
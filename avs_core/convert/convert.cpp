@@ -53,6 +53,10 @@ extern const AVSFunction Convert_filters[] = {       // matrix can be "rec601",
   { "ConvertToRGB",   BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::Create },
   { "ConvertToRGB24", BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::Create24 },
   { "ConvertToRGB32", BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::Create32 },
+  { "ConvertToRGB48", BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::Create48 },
+  { "ConvertToRGB64", BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::Create64 },
+  { "ConvertToPlanarRGB",  BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::CreatePlanarRGB },
+  { "ConvertToPlanarRGBA", BUILTIN_FUNC_PREFIX, "c[matrix]s[interlaced]b[ChromaInPlacement]s[chromaresample]s", ConvertToRGB::CreatePlanarRGBA },
   { "ConvertToY8",    BUILTIN_FUNC_PREFIX, "c[matrix]s", ConvertToY8::Create },
   { "ConvertToYV12",  BUILTIN_FUNC_PREFIX, "c[interlaced]b[matrix]s[ChromaInPlacement]s[chromaresample]s[ChromaOutPlacement]s", ConvertToYV12::Create },
   { "ConvertToYV24",  BUILTIN_FUNC_PREFIX, "c[interlaced]b[matrix]s[ChromaInPlacement]s[chromaresample]s", ConvertToPlanarGeneric::CreateYUV444},
@@ -571,6 +575,27 @@ PVideoFrame __stdcall ConvertToRGB::GetFrame(int n, IScriptEnvironment* env)
 }
 
 
+// Planar YUV/Y source. 4:2:0 and 4:2:2 are upsampled and converted in one pass,
+// everything else goes through ConvertToYUV444.
+// pixel_step as in ConvertYV24ToRGB: 3, 4: RGB24/32, 6, 8: RGB48/64, 0: planar RGB, -1: planar RGBA
+static AVSValue ConvertPlanarToRGB(AVSValue& args, int pixel_step, IScriptEnvironment* env)
+{
+  PClip clip = args[0].AsClip();
+  const VideoInfo& vi = clip->GetVideoInfo();
+  const int matrix = getMatrix(args[1].AsString(0), env);
+
+  // 8 bit planar RGB is repacked as it is, without the round trip through YUV
+  if ((vi.IsPlanarRGB() || vi.IsPlanarRGBA()) && vi.ComponentSize() == 1 && (pixel_step == 3 || pixel_step == 4))
+    return new PlanarRGBtoPacked(clip, pixel_step == 4);
+
+  if ((vi.Is420() || vi.Is422()) && !vi.IsYUVA() && !args[2].AsBool(false))
+    return new ConvertYUVToRGBResampled(clip, matrix, pixel_step, args[3], args[4], env);
+
+  AVSValue new_args[5] = { clip, args[2], args[1], args[3], args[4] };
+  clip = ConvertToPlanarGeneric::CreateYUV444(AVSValue(new_args, 5), NULL, env).AsClip();
+  return new ConvertYV24ToRGB(clip, matrix, pixel_step, env);
+}
+
 AVSValue __cdecl ConvertToRGB::Create(AVSValue args, void*, IScriptEnvironment* env)
 {
   const bool haveOpts = args[3].Defined() || args[4].Defined();
@@ -579,9 +604,7 @@ AVSValue __cdecl ConvertToRGB::Create(AVSValue args, void*, IScriptEnvironment*
   const VideoInfo& vi = clip->GetVideoInfo();
 
   if (vi.IsPlanar()) {
-    AVSValue new_args[5] = { clip, args[2], args[1], args[3], args[4] };
-    clip = ConvertToPlanarGeneric::CreateYUV444(AVSValue(new_args, 5), NULL, env).AsClip();
-    return new ConvertYV24ToRGB(clip, getMatrix(matrix, env), 4 , env);
+    return ConvertPlanarToRGB(args, 4, env);
   }
 
   if (haveOpts)
@@ -602,9 +625,7 @@ AVSValue __cdecl ConvertToRGB::Create32(AVSValue args, void*, IScriptEnvironment
   const VideoInfo vi = clip->GetVideoInfo();
 
   if (vi.IsPlanar()) {
-    AVSValue new_args[5] = { clip, args[2], args[1], args[3], args[4] };
-    clip = ConvertToPlanarGeneric::CreateYUV444(AVSValue(new_args, 5), NULL, env).AsClip();
-    return new ConvertYV24ToRGB(clip, getMatrix(matrix, env), 4 , env);
+    return ConvertPlanarToRGB(args, 4, env);
   }
 
   if (haveOpts)
@@ -628,9 +649,7 @@ AVSValue __cdecl ConvertToRGB::Create24(AVSValue args, void*, IScriptEnvironment
   const VideoInfo& vi = clip->GetVideoInfo();
 
   if (vi.IsPlanar()) {
-    AVSValue new_args[5] = { clip, args[2], args[1], args[3], args[4] };
-    clip = ConvertToPlanarGeneric::CreateYUV444(AVSValue(new_args, 5), NULL, env).AsClip();
-    return new ConvertYV24ToRGB(clip, getMatrix(matrix, env), 3 , env);
+    return ConvertPlanarToRGB(args, 3, env);
   }
 
   if (haveOpts)
@@ -645,6 +664,44 @@ AVSValue __cdecl ConvertToRGB::Create24(AVSValue args, void*, IScriptEnvironment
   return clip;
 }
 
+// RGB48/64 and planar RGB(A) targets
+static AVSValue CreateHighBitDepthRGB(AVSValue& args, int pixel_step, const char* filter, IScriptEnvironment* env)
+{
+  PClip clip = args[0].AsClip();
+  const VideoInfo& vi = clip->GetVideoInfo();
+
+  if ((pixel_step == 6 && vi.IsRGB48()) || (pixel_step == 8 && vi.IsRGB64()) ||
+      (pixel_step == 0 && vi.IsPlanarRGB()) || (pixel_step == -1 && vi.IsPlanarRGBA()))
+    return clip;
+
+  if (!vi.IsPlanar() || vi.IsRGB())
+    env->ThrowError("%s: Can only convert from Planar YUV.", filter);
+  if (pixel_step > 0 && vi.ComponentSize() != 2)
+    env->ThrowError("%s: Source must be 10-16 bit.", filter);
+
+  return ConvertPlanarToRGB(args, pixel_step, env);
+}
+
+AVSValue __cdecl ConvertToRGB::Create48(AVSValue args, void*, IScriptEnvironment* env)
+{
+  return CreateHighBitDepthRGB(args, 6, "ConvertToRGB48", env);
+}
+
+AVSValue __cdecl ConvertToRGB::Create64(AVSValue args, void*, IScriptEnvironment* env)
+{
+  return CreateHighBitDepthRGB(args, 8, "ConvertToRGB64", env);
+}
+
+AVSValue __cdecl ConvertToRGB::CreatePlanarRGB(AVSValue args, void*, IScriptEnvironment* env)
+{
+  return CreateHighBitDepthRGB(args, 0, "ConvertToPlanarRGB", env);
+}
+
+AVSValue __cdecl ConvertToRGB::CreatePlanarRGBA(AVSValue args, void*, IScriptEnvironment* env)
+{
+  return CreateHighBitDepthRGB(args, -1, "ConvertToPlanarRGBA", env);
+}
+
 /**********************************
 *******   Convert to YV12   ******
 *********************************/
@@ -83,6 +83,10 @@ public:
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);  
   static AVSValue __cdecl Create32(AVSValue args, void*, IScriptEnvironment* env);
   static AVSValue __cdecl Create24(AVSValue args, void*, IScriptEnvironment* env);
+  static AVSValue __cdecl Create48(AVSValue args, void*, IScriptEnvironment* env);
+  static AVSValue __cdecl Create64(AVSValue args, void*, IScriptEnvironment* env);
+  static AVSValue __cdecl CreatePlanarRGB(AVSValue args, void*, IScriptEnvironment* env);
+  static AVSValue __cdecl CreatePlanarRGBA(AVSValue args, void*, IScriptEnvironment* env);
 
 private:
   int theMatrix;
@@ -35,6 +35,23 @@
 #ifndef __Convert_Audio_H__
 #define __Convert_Audio_H__
 
+#include <avisynth.h>
+
+// Converts count samples (all channels) from one packed sample format to another.
+typedef void (*AudioConvertFunc)(const void* src, void* dst, size_t count);
+
+// Row/column of a sample type in the direct conversion tables, -1 if unknown.
+static __inline int audio_format_index(int sample_type) {
+  switch (sample_type) {
+  case SAMPLE_INT8:  return 0;
+  case SAMPLE_INT16: return 1;
+  case SAMPLE_INT24: return 2;
+  case SAMPLE_INT32: return 3;
+  case SAMPLE_FLOAT: return 4;
+  default:           return -1;
+  }
+}
+
 
 class ConvertAudio : public GenericVideoFilter
 /**
@@ -56,27 +73,11 @@ public:
   virtual ~ConvertAudio();
 
 private:
-  void convertToFloat(char* inbuf, float* outbuf, int sample_type, int count);
-  void convertToFloat_3DN(char* inbuf, float* outbuf, int sample_type, int count);
-  void convertToFloat_SSE(char* inbuf, float* outbuf, int sample_type, int count);
-  void convertToFloat_SSE2(char* inbuf, float* outbuf, int sample_type, int count);
-  void convertFromFloat(float* inbuf, void* outbuf, int sample_type, int count);
-  void convertFromFloat_3DN(float* inbuf, void* outbuf, int sample_type, int count);
-  void convertFromFloat_SSE(float* inbuf, void* outbuf, int sample_type, int count);
-  void convertFromFloat_SSE2(float* inbuf, void* outbuf, int sample_type, int count);
-
-  __inline int Saturate_int8(float n);
-  __inline short Saturate_int16(float n);
-  __inline int Saturate_int24(float n);
-  __inline int Saturate_int32(float n);
-
   int src_format;
   int dst_format;
   int src_bps;
   int tempbuffer_size;
   char *tempbuffer;
-  int floatbuffer_size;
-  SFLOAT *floatbuffer;
 };
 
 #endif //__Convert_Audio_H__
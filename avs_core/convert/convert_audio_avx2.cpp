@@ -0,0 +1,200 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// This file is compiled with AVX2 enabled, see CMakeLists.txt.
+
+#include "convert_audio_avx2.h"
+#include <immintrin.h>
+#include <string.h>
+
+
+/*****************************************
+ ***  Direct sample type conversions   ***
+ *****************************************/
+
+// Same scheme and results as the C and SSSE3 versions in convert_audio.cpp,
+// with 8 samples per vector and 32 per block.
+
+static __forceinline size_t audio_sample_size(int sample_type) {
+  switch (sample_type) {
+  case SAMPLE_INT8:  return 1;
+  case SAMPLE_INT16: return 2;
+  case SAMPLE_INT24: return 3;
+  default:           return 4;
+  }
+}
+
+static __forceinline void load_samples_avx2(const BYTE* src, int src_format, int dst_format, __m256i v[4]) {
+  switch (src_format) {
+  case SAMPLE_INT8:
+    for (int i = 0; i < 4; i++) {
+      const __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 8 * i));
+      v[i] = _mm256_slli_epi32(_mm256_cvtepi8_epi32(_mm_xor_si128(raw, _mm_set1_epi8(-128))), 24);
+      if (dst_format == SAMPLE_INT16) // 0xff -> 0x7fff, 0x00 -> 0x8000
+        v[i] = _mm256_or_si256(v[i], _mm256_slli_epi32(_mm256_cvtepu8_epi32(raw), 16));
+    }
+    break;
+  case SAMPLE_INT16:
+    for (int i = 0; i < 4; i++)
+      v[i] = _mm256_slli_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16 * i))), 16);
+    break;
+  case SAMPLE_INT24: {
+    // upper lane loads from 8 bytes in, so nothing past the block is read
+    const __m256i shuf = _mm256_setr_epi8(
+      -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+      -1, 4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15);
+    for (int i = 0; i < 4; i++) {
+      const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24 * i));
+      const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24 * i + 8));
+      v[i] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), shuf);
+    }
+    break;
+  }
+  case SAMPLE_INT32:
+    for (int i = 0; i < 4; i++)
+      v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32 * i));
+    break;
+  case SAMPLE_FLOAT:
+    for (int i = 0; i < 4; i++) {
+      __m256 f = _mm256_loadu_ps(reinterpret_cast<const float*>(src + 32 * i));
+      switch (dst_format) {
+      case SAMPLE_INT8:
+        f = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(f, _mm256_set1_ps(128.0f)), _mm256_set1_ps(-128.0f)), _mm256_set1_ps(127.0f));
+        v[i] = _mm256_slli_epi32(_mm256_cvtps_epi32(f), 24);
+        break;
+      case SAMPLE_INT16:
+        f = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(f, _mm256_set1_ps(32768.0f)), _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+        v[i] = _mm256_slli_epi32(_mm256_cvtps_epi32(f), 16);
+        break;
+      case SAMPLE_INT24:
+        f = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(f, _mm256_set1_ps(8388608.0f)), _mm256_set1_ps(-8388608.0f)), _mm256_set1_ps(8388607.0f));
+        v[i] = _mm256_slli_epi32(_mm256_cvtps_epi32(f), 8);
+        break;
+      default: {
+        // positive overflow: 0x80000000 -> 0x7fffffff
+        f = _mm256_mul_ps(f, _mm256_set1_ps(2147483648.0f));
+        const __m256i over = _mm256_castps_si256(_mm256_cmp_ps(f, _mm256_set1_ps(2147483648.0f), _CMP_GE_OQ));
+        v[i] = _mm256_xor_si256(_mm256_cvtps_epi32(f), over);
+        break;
+      }
+      }
+    }
+    break;
+  }
+}
+
+static __forceinline void store_12_bytes(BYTE* dst, __m128i x) {
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), x);
+  *reinterpret_cast<int*>(dst + 8) = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+}
+
+static __forceinline void store_samples_avx2(BYTE* dst, int dst_format, const __m256i v[4]) {
+  switch (dst_format) {
+  case SAMPLE_INT8: {
+    // packs work within lanes, the permute puts the dwords back in order
+    const __m256i a = _mm256_packs_epi32(_mm256_srai_epi32(v[0], 24), _mm256_srai_epi32(v[1], 24));
+    const __m256i b = _mm256_packs_epi32(_mm256_srai_epi32(v[2], 24), _mm256_srai_epi32(v[3], 24));
+    __m256i r = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(a, b), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_xor_si256(r, _mm256_set1_epi8(-128)));
+    break;
+  }
+  case SAMPLE_INT16:
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+      _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srai_epi32(v[0], 16), _mm256_srai_epi32(v[1], 16)), 0xD8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32),
+      _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srai_epi32(v[2], 16), _mm256_srai_epi32(v[3], 16)), 0xD8));
+    break;
+  case SAMPLE_INT24: {
+    const __m256i shuf = _mm256_setr_epi8(
+      1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+      1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+    for (int i = 0; i < 4; i++) {
+      const __m256i p = _mm256_shuffle_epi8(v[i], shuf);
+      store_12_bytes(dst + 24 * i, _mm256_castsi256_si128(p));
+      store_12_bytes(dst + 24 * i + 12, _mm256_extracti128_si256(p, 1));
+    }
+    break;
+  }
+  case SAMPLE_INT32:
+    for (int i = 0; i < 4; i++)
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32 * i), v[i]);
+    break;
+  case SAMPLE_FLOAT:
+    for (int i = 0; i < 4; i++)
+      _mm256_storeu_ps(reinterpret_cast<float*>(dst + 32 * i), _mm256_mul_ps(_mm256_cvtepi32_ps(v[i]), _mm256_set1_ps(1.0f / 2147483648.0f)));
+    break;
+  }
+}
+
+template<int src_format, int dst_format>
+static void convert_audio_avx2(const void* src, void* dst, size_t count) {
+  const size_t src_size = audio_sample_size(src_format);
+  const size_t dst_size = audio_sample_size(dst_format);
+  const BYTE* srcp = reinterpret_cast<const BYTE*>(src);
+  BYTE* dstp = reinterpret_cast<BYTE*>(dst);
+  __m256i v[4];
+
+  const size_t mod32 = count & ~(size_t)31;
+  for (size_t i = 0; i < mod32; i += 32) {
+    load_samples_avx2(srcp + i * src_size, src_format, dst_format, v);
+    store_samples_avx2(dstp + i * dst_size, dst_format, v);
+  }
+
+  const size_t rest = count - mod32;
+  if (rest) {
+    BYTE src_tail[32 * 4] = { 0 };
+    BYTE dst_tail[32 * 4];
+    memcpy(src_tail, srcp + mod32 * src_size, rest * src_size);
+    load_samples_avx2(src_tail, src_format, dst_format, v);
+    store_samples_avx2(dst_tail, dst_format, v);
+    memcpy(dstp + mod32 * dst_size, dst_tail, rest * dst_size);
+  }
+}
+
+#define AUDIO_CONVERT_ROW(func, src) \
+  { func<src, SAMPLE_INT8>, func<src, SAMPLE_INT16>, func<src, SAMPLE_INT24>, func<src, SAMPLE_INT32>, func<src, SAMPLE_FLOAT> }
+
+static const AudioConvertFunc audio_convert_avx2[5][5] = {
+  AUDIO_CONVERT_ROW(convert_audio_avx2, SAMPLE_INT8),
+  AUDIO_CONVERT_ROW(convert_audio_avx2, SAMPLE_INT16),
+  AUDIO_CONVERT_ROW(convert_audio_avx2, SAMPLE_INT24),
+  AUDIO_CONVERT_ROW(convert_audio_avx2, SAMPLE_INT32),
+  AUDIO_CONVERT_ROW(convert_audio_avx2, SAMPLE_FLOAT),
+};
+
+#undef AUDIO_CONVERT_ROW
+
+AudioConvertFunc get_audio_converter_avx2(int src_index, int dst_index) {
+  return audio_convert_avx2[src_index][dst_index];
+}
@@ -37,14 +37,18 @@
 
 #include "convert.h"
 #include "convert_planar.h"
+#include "convert_planar_avx2.h"
 #include "../filters/resample.h"
 #include "../filters/planeswap.h"
 #include "../filters/field.h"
 #include <avs/win.h>
 #include <avs/alignment.h>
 #include <tmmintrin.h>
+#include <smmintrin.h>
 #include <algorithm>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 enum   {PLACEMENT_MPEG2, PLACEMENT_MPEG1, PLACEMENT_DV } ;
 
@@ -414,6 +418,258 @@ AVSValue __cdecl ConvertToY8::Create(AVSValue args, void*, IScriptEnvironment* e
   return new ConvertToY8(clip, getMatrix(args[1].AsString(0), env), env);
 }
 
+/*****************************************************
+ * Planar RGB <-> YUV 4:4:4 matrix, 8-16 bit and float
+ ******************************************************/
+
+// Native units: integer YUV is the 8 bit range shifted up (16<<2 is 10 bit
+// black), integer RGB is full range (0..1023 for 10 bit).
+// Float YUV and RGB both are the 8 bit values divided by 255.
+static double yuv_pixel_scale(int bits) {
+  return bits == 32 ? 1.0 / 255.0 : (double)(1 << (bits - 8));
+}
+
+static double rgb_pixel_scale(int bits) {
+  return bits == 32 ? 1.0 / 255.0 : ((1 << bits) - 1) / 255.0;
+}
+
+static void set_planar_matrix(PlanarConversionMatrix &m, const double (&coef)[3][3], const double (&offset)[3], bool integer_output) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++)
+      m.coef[i][j] = (float)coef[i][j];
+    m.offset[i] = (float)(offset[i] + (integer_output ? 0.5 : 0.0));
+  }
+}
+
+// R,G,B in -> Y,U,V out
+static void build_rgb_to_yuv_matrix(PlanarConversionMatrix &m, double Kr, double Kb, int Sy, int Suv, int Oy, int rgb_bits, int yuv_bits) {
+  const double Kg = 1. - Kr - Kb;
+  const double ys = yuv_pixel_scale(yuv_bits);
+  const double ky = ys * Sy / (255.0 * rgb_pixel_scale(rgb_bits));
+  const double kuv = ys * Suv / (255.0 * rgb_pixel_scale(rgb_bits));
+  const double coef[3][3] = {
+    { ky * Kr,            ky * Kg,            ky * Kb            },
+    { kuv * Kr / (Kb - 1), kuv * Kg / (Kb - 1), kuv               },
+    { kuv,               kuv * Kg / (Kr - 1), kuv * Kb / (Kr - 1) }
+  };
+  const double offset[3] = { ys * Oy, ys * 128, ys * 128 };
+  set_planar_matrix(m, coef, offset, yuv_bits != 32);
+}
+
+// Y,U,V in -> R,G,B out
+static void build_yuv_to_rgb_matrix(PlanarConversionMatrix &m, double Kr, double Kb, int Sy, int Suv, int Oy, int yuv_bits, int rgb_bits) {
+  const double Kg = 1. - Kr - Kb;
+  const double ys = yuv_pixel_scale(yuv_bits);
+  const double ky = 255.0 * rgb_pixel_scale(rgb_bits) / (ys * Sy);
+  const double kuv = 255.0 * rgb_pixel_scale(rgb_bits) / (ys * Suv);
+  const double coef[3][3] = {
+    { ky, 0.0,                      kuv * (1 - Kr)           },
+    { ky, kuv * (Kb - 1) * Kb / Kg, kuv * (Kr - 1) * Kr / Kg },
+    { ky, kuv * (1 - Kb),           0.0                      }
+  };
+  double offset[3];
+  for (int i = 0; i < 3; i++)
+    offset[i] = -(coef[i][0] * ys * Oy + (coef[i][1] + coef[i][2]) * ys * 128);
+  set_planar_matrix(m, coef, offset, rgb_bits != 32);
+}
+
+template<typename dst_t, typename src_t>
+static void convert_planar_matrix_row_c(BYTE* const* dstp, const BYTE* const* srcp, size_t x_start, size_t width, const PlanarConversionMatrix &m, int max_pixel_value) {
+  const src_t* src0 = reinterpret_cast<const src_t*>(srcp[0]);
+  const src_t* src1 = reinterpret_cast<const src_t*>(srcp[1]);
+  const src_t* src2 = reinterpret_cast<const src_t*>(srcp[2]);
+  const float max_value = (float)max_pixel_value;
+
+  for (size_t x = x_start; x < width; x++) {
+    const float in0 = (float)src0[x];
+    const float in1 = (float)src1[x];
+    const float in2 = (float)src2[x];
+    for (int i = 0; i < 3; i++) {
+      float result = ((m.coef[i][0] * in0 + m.coef[i][1] * in1) + m.coef[i][2] * in2) + m.offset[i];
+      if (sizeof(dst_t) != 4) {
+        // offset holds the rounder
+        result = result < 0.0f ? 0.0f : (result > max_value ? max_value : result);
+        reinterpret_cast<dst_t*>(dstp[i])[x] = (dst_t)(int)result;
+      }
+      else {
+        reinterpret_cast<dst_t*>(dstp[i])[x] = (dst_t)result;
+      }
+    }
+  }
+}
+
+template<typename pixel_t>
+AVS_TARGET("sse4.1")
+static __forceinline __m128 load_4_pixels_sse41(const BYTE* srcp) {
+  if (sizeof(pixel_t) == 1)
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(srcp))));
+  if (sizeof(pixel_t) == 2)
+    return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcp))));
+  return _mm_loadu_ps(reinterpret_cast<const float*>(srcp));
+}
+
+template<typename pixel_t>
+AVS_TARGET("sse4.1")
+static __forceinline void store_4_pixels_sse41(BYTE* dstp, const __m128 &value, const __m128 &max_pixel_value) {
+  if (sizeof(pixel_t) == 4) {
+    _mm_storeu_ps(reinterpret_cast<float*>(dstp), value);
+    return;
+  }
+  __m128i result = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), max_pixel_value));
+  result = _mm_packus_epi32(result, result);
+  if (sizeof(pixel_t) == 1)
+    *reinterpret_cast<int*>(dstp) = _mm_cvtsi128_si32(_mm_packus_epi16(result, result));
+  else
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp), result);
+}
+
+// SSE4.1 for the integer formats, float to float only needs SSE2
+template<typename dst_t, typename src_t>
+AVS_TARGET("sse4.1")
+static size_t convert_planar_matrix_row_sse41(BYTE* const* dstp, const BYTE* const* srcp, size_t width, const PlanarConversionMatrix &m, int max_pixel_value) {
+  __m128 coef[3][3], offset[3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++)
+      coef[i][j] = _mm_set1_ps(m.coef[i][j]);
+    offset[i] = _mm_set1_ps(m.offset[i]);
+  }
+  __m128 max_value = _mm_set1_ps((float)max_pixel_value);
+
+  const size_t mod4_width = width / 4 * 4;
+  for (size_t x = 0; x < mod4_width; x += 4) {
+    __m128 in0 = load_4_pixels_sse41<src_t>(srcp[0] + x * sizeof(src_t));
+    __m128 in1 = load_4_pixels_sse41<src_t>(srcp[1] + x * sizeof(src_t));
+    __m128 in2 = load_4_pixels_sse41<src_t>(srcp[2] + x * sizeof(src_t));
+    for (int i = 0; i < 3; i++) {
+      __m128 result = _mm_add_ps(_mm_mul_ps(coef[i][0], in0), _mm_mul_ps(coef[i][1], in1));
+      result = _mm_add_ps(_mm_add_ps(result, _mm_mul_ps(coef[i][2], in2)), offset[i]);
+      store_4_pixels_sse41<dst_t>(dstp[i] + x * sizeof(dst_t), result, max_value);
+    }
+  }
+  return mod4_width;
+}
+
+template<typename dst_t, typename src_t>
+static void convert_planar_matrix_row(BYTE* const* dstp, const BYTE* const* srcp, size_t width, const PlanarConversionMatrix &m, int max_pixel_value, int cpu) {
+  size_t x = 0;
+  if (cpu & CPUF_AVX2)
+    x = convert_planar_matrix_row_avx2(dstp, srcp, width, sizeof(dst_t), sizeof(src_t), m, max_pixel_value);
+  else if ((cpu & CPUF_SSE4_1) || ((cpu & CPUF_SSE2) && sizeof(dst_t) == 4 && sizeof(src_t) == 4))
+    x = convert_planar_matrix_row_sse41<dst_t, src_t>(dstp, srcp, width, m, max_pixel_value);
+  convert_planar_matrix_row_c<dst_t, src_t>(dstp, srcp, x, width, m, max_pixel_value);
+}
+
+template<typename dst_t>
+static void convert_planar_matrix_row(BYTE* const* dstp, const BYTE* const* srcp, size_t width, int src_pixelsize, const PlanarConversionMatrix &m, int max_pixel_value, int cpu) {
+  switch (src_pixelsize) {
+  case 1: convert_planar_matrix_row<dst_t, uint8_t>(dstp, srcp, width, m, max_pixel_value, cpu); break;
+  case 2: convert_planar_matrix_row<dst_t, uint16_t>(dstp, srcp, width, m, max_pixel_value, cpu); break;
+  default: convert_planar_matrix_row<dst_t, float>(dstp, srcp, width, m, max_pixel_value, cpu); break;
+  }
+}
+
+// dstp/srcp: 3 planes each, one row. Pixel sizes 1, 2 and 4 (float) in any combination,
+// max_pixel_value is the integer output clamp.
+static void convert_planar_matrix_row(BYTE* const* dstp, const BYTE* const* srcp, size_t width, int dst_pixelsize, int src_pixelsize,
+                                      const PlanarConversionMatrix &m, int max_pixel_value, int cpu) {
+  switch (dst_pixelsize) {
+  case 1: convert_planar_matrix_row<uint8_t>(dstp, srcp, width, src_pixelsize, m, max_pixel_value, cpu); break;
+  case 2: convert_planar_matrix_row<uint16_t>(dstp, srcp, width, src_pixelsize, m, max_pixel_value, cpu); break;
+  default: convert_planar_matrix_row<float>(dstp, srcp, width, src_pixelsize, m, max_pixel_value, cpu); break;
+  }
+}
+
+// dstp/srcp: 3 planes each, same geometry, same component size
+static void convert_planar_matrix(BYTE* const* dstp, const int* dst_pitch, const BYTE* const* srcp, const int* src_pitch,
+                                  int width, int height, int pixelsize, const PlanarConversionMatrix &m, int max_pixel_value, int cpu) {
+  BYTE* dst_row[3] = { dstp[0], dstp[1], dstp[2] };
+  const BYTE* src_row[3] = { srcp[0], srcp[1], srcp[2] };
+
+  for (int y = 0; y < height; y++) {
+    convert_planar_matrix_row(dst_row, src_row, width, pixelsize, pixelsize, m, max_pixel_value, cpu);
+    for (int i = 0; i < 3; i++) {
+      dst_row[i] += dst_pitch[i];
+      src_row[i] += src_pitch[i];
+    }
+  }
+}
+
+// Packed RGB24/32/48/64 line <-> three planes in R,G,B order
+template<typename pixel_t>
+static void unpack_rgb_line(BYTE* const* dstp, const BYTE* srcp, int width, int pixel_step) {
+  const pixel_t* src = reinterpret_cast<const pixel_t*>(srcp);
+  pixel_t* r = reinterpret_cast<pixel_t*>(dstp[0]);
+  pixel_t* g = reinterpret_cast<pixel_t*>(dstp[1]);
+  pixel_t* b = reinterpret_cast<pixel_t*>(dstp[2]);
+  const int step = pixel_step / sizeof(pixel_t);
+  for (int x = 0; x < width; x++) {
+    b[x] = src[0];
+    g[x] = src[1];
+    r[x] = src[2];
+    src += step;
+  }
+}
+
+// alphap may be NULL, then alpha is opaque
+template<typename pixel_t>
+static void pack_rgb_line(BYTE* dstp, const BYTE* const* srcp, const BYTE* alphap, int width, int pixel_step) {
+  pixel_t* dst = reinterpret_cast<pixel_t*>(dstp);
+  const pixel_t* r = reinterpret_cast<const pixel_t*>(srcp[0]);
+  const pixel_t* g = reinterpret_cast<const pixel_t*>(srcp[1]);
+  const pixel_t* b = reinterpret_cast<const pixel_t*>(srcp[2]);
+  const pixel_t* alpha = reinterpret_cast<const pixel_t*>(alphap);
+  const int step = pixel_step / sizeof(pixel_t);
+  for (int x = 0; x < width; x++) {
+    dst[0] = b[x];
+    dst[1] = g[x];
+    dst[2] = r[x];
+    if (step == 4)
+      dst[3] = alpha ? alpha[x] : (pixel_t)-1;
+    dst += step;
+  }
+}
+
+static void unpack_rgb_line(BYTE* const* dstp, const BYTE* srcp, int width, int pixel_step) {
+  if (pixel_step >= 6)
+    unpack_rgb_line<uint16_t>(dstp, srcp, width, pixel_step);
+  else
+    unpack_rgb_line<uint8_t>(dstp, srcp, width, pixel_step);
+}
+
+static void pack_rgb_line(BYTE* dstp, const BYTE* const* srcp, const BYTE* alphap, int width, int pixel_step) {
+  if (pixel_step >= 6)
+    pack_rgb_line<uint16_t>(dstp, srcp, alphap, width, pixel_step);
+  else
+    pack_rgb_line<uint8_t>(dstp, srcp, alphap, width, pixel_step);
+}
+
+static void fill_plane_max(BYTE* dstp, int pitch, int width, int height, int pixelsize, int bits) {
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      if (pixelsize == 1)
+        dstp[x] = 255;
+      else if (pixelsize == 2)
+        reinterpret_cast<uint16_t*>(dstp)[x] = (uint16_t)((1 << bits) - 1);
+      else
+        reinterpret_cast<float*>(dstp)[x] = 1.0f;
+    }
+    dstp += pitch;
+  }
+}
+
+// generic_type: VideoInfo::CS_GENERIC_YUV420, CS_GENERIC_RGBAP, ...
+static int planar_pixel_type(int generic_type, int bits) {
+  switch (bits) {
+  case 8:  return generic_type | VideoInfo::CS_Sample_Bits_8;
+  case 10: return generic_type | VideoInfo::CS_Sample_Bits_10;
+  case 12: return generic_type | VideoInfo::CS_Sample_Bits_12;
+  case 14: return generic_type | VideoInfo::CS_Sample_Bits_14;
+  case 16: return generic_type | VideoInfo::CS_Sample_Bits_16;
+  case 32: return generic_type | VideoInfo::CS_Sample_Bits_32;
+  }
+  return VideoInfo::CS_UNKNOWN;
+}
+
 /*****************************************************
  * ConvertRGBToYV24
  ******************************************************/
@@ -424,8 +680,11 @@ ConvertRGBToYV24::ConvertRGBToYV24(PClip src, int in_matrix, IScriptEnvironment*
   if (!vi.IsRGB())
     env->ThrowError("ConvertRGBToYV24: Only RGB data input accepted");
 
-  pixel_step = vi.BytesFromPixels(1);
-  vi.pixel_type = VideoInfo::CS_YV24;
+  bits_per_pixel = vi.BitsPerComponent();
+  planar_path = vi.IsPlanar() || vi.IsRGB48() || vi.IsRGB64();
+  has_alpha = vi.IsPlanarRGBA(); // packed RGB32/64 alpha is dropped as before
+  pixel_step = vi.IsPlanar() ? 0 : vi.BytesFromPixels(1);
+  vi.pixel_type = planar_pixel_type(has_alpha ? VideoInfo::CS_GENERIC_YUVA444 : VideoInfo::CS_GENERIC_YUV444, bits_per_pixel);
 
   const int shift = 15;
 
@@ -501,6 +760,8 @@ void ConvertRGBToYV24::BuildMatrix(double Kr, double Kb, int Sy, int Suv, int Oy
   matrix.v_g  = (int16_t)(Suv * Kg/(Kr-1) * mulfac / Srgb + 0.5);
   matrix.v_r  = (int16_t)(Suv             * mulfac / Srgb + 0.5);
   matrix.offset_y = Oy;
+
+  build_rgb_to_yuv_matrix(matrix_f, Kr, Kb, Sy, Suv, Oy, bits_per_pixel, bits_per_pixel);
 }
 
 static void convert_rgb32_to_yv24_sse2(BYTE* dstY, BYTE* dstU, BYTE* dstV, const BYTE*srcp, size_t dst_pitch_y, size_t UVpitch, size_t src_pitch, size_t width, size_t height, const ConversionMatrix &matrix) {
@@ -704,6 +965,43 @@ PVideoFrame __stdcall ConvertRGBToYV24::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame src = child->GetFrame(n, env);
   PVideoFrame dst = env->NewVideoFrame(vi);
 
+  if (planar_path) {
+    BYTE* dstp[3] = { dst->GetWritePtr(PLANAR_Y), dst->GetWritePtr(PLANAR_U), dst->GetWritePtr(PLANAR_V) };
+    int dst_pitch[3] = { dst->GetPitch(PLANAR_Y), dst->GetPitch(PLANAR_U), dst->GetPitch(PLANAR_V) };
+    const int pixelsize = vi.ComponentSize();
+    const int max_pixel_value = bits_per_pixel == 32 ? 0 : (1 << bits_per_pixel) - 1;
+
+    if (pixel_step == 0) {
+      const BYTE* srcp[3] = { src->GetReadPtr(PLANAR_R), src->GetReadPtr(PLANAR_G), src->GetReadPtr(PLANAR_B) };
+      int src_pitch[3] = { src->GetPitch(PLANAR_R), src->GetPitch(PLANAR_G), src->GetPitch(PLANAR_B) };
+      convert_planar_matrix(dstp, dst_pitch, srcp, src_pitch, vi.width, vi.height, pixelsize, matrix_f, max_pixel_value, env->GetCPUFlags());
+      if (has_alpha)
+        env->BitBlt(dst->GetWritePtr(PLANAR_A), dst->GetPitch(PLANAR_A), src->GetReadPtr(PLANAR_A), src->GetPitch(PLANAR_A),
+                    src->GetRowSize(PLANAR_A), src->GetHeight(PLANAR_A));
+      return dst;
+    }
+
+    // RGB48/64: unpack each (upside down) line to planar, then the planar kernel
+    auto env2 = static_cast<IScriptEnvironment2*>(env);
+    const int line_size = AlignNumber(vi.width * pixelsize, FRAME_ALIGN);
+    BYTE* buffer = static_cast<BYTE*>(env2->Allocate(line_size * 3, FRAME_ALIGN, AVS_POOLED_ALLOC));
+    if (!buffer)
+      env->ThrowError("ConvertRGBToYV24: Could not reserve memory.");
+    BYTE* lines[3] = { buffer, buffer + line_size, buffer + 2 * line_size };
+    const int line_pitch[3] = { 0, 0, 0 };
+
+    const BYTE* srcp = src->GetReadPtr() + src->GetPitch() * (vi.height - 1);
+    for (int y = 0; y < vi.height; y++) {
+      unpack_rgb_line(lines, srcp, vi.width, pixel_step);
+      convert_planar_matrix(dstp, dst_pitch, lines, line_pitch, vi.width, 1, pixelsize, matrix_f, max_pixel_value, env->GetCPUFlags());
+      srcp -= src->GetPitch();
+      for (int i = 0; i < 3; i++)
+        dstp[i] += dst_pitch[i];
+    }
+    env2->Free(buffer);
+    return dst;
+  }
+
   const BYTE* srcp = src->GetReadPtr();
 
   BYTE* dstY = dst->GetWritePtr(PLANAR_Y);
@@ -784,10 +1082,26 @@ ConvertYV24ToRGB::ConvertYV24ToRGB(PClip src, int in_matrix, int _pixel_step, IS
  : GenericVideoFilter(src), pixel_step(_pixel_step)
 {
 
-  if (!vi.IsYV24())
-    env->ThrowError("ConvertYV24ToRGB: Only YV24 data input accepted");
+  if (!vi.Is444())
+    env->ThrowError("ConvertYV24ToRGB: Only YUV 4:4:4 data input accepted");
+
+  yuv_bits = vi.BitsPerComponent();
+  const int src_pixelsize = vi.ComponentSize();
+  planar_path = pixel_step <= 0 || pixel_step >= 6 || yuv_bits != 8 || vi.IsYUVA();
+
+  switch (pixel_step) {
+  case 3: vi.pixel_type = VideoInfo::CS_BGR24; rgb_bits = 8; break;
+  case 4: vi.pixel_type = VideoInfo::CS_BGR32; rgb_bits = 8; break;
+  case 6: vi.pixel_type = VideoInfo::CS_BGR48; rgb_bits = 16; break;
+  case 8: vi.pixel_type = VideoInfo::CS_BGR64; rgb_bits = 16; break;
+  case 0:  vi.pixel_type = planar_pixel_type(vi.IsYUVA() ? VideoInfo::CS_GENERIC_RGBAP : VideoInfo::CS_GENERIC_RGBP, yuv_bits); rgb_bits = yuv_bits; break;
+  case -1: vi.pixel_type = planar_pixel_type(VideoInfo::CS_GENERIC_RGBAP, yuv_bits); rgb_bits = yuv_bits; break;
+  default: env->ThrowError("ConvertYV24ToRGB: Invalid pixel step. This is a bug.");
+  }
 
-  vi.pixel_type = (pixel_step == 3) ? VideoInfo::CS_BGR24 : VideoInfo::CS_BGR32;
+  if (pixel_step > 0 && src_pixelsize != (rgb_bits == 8 ? 1 : 2))
+    env->ThrowError("ConvertYV24ToRGB: %s needs a %s bit source, use ConvertToPlanarRGB for this bit depth",
+                    rgb_bits == 8 ? "RGB24/RGB32" : "RGB48/RGB64", rgb_bits == 8 ? "8" : "10-16");
   const int shift = 13;
 
   if (in_matrix == Rec601) {
@@ -863,6 +1177,8 @@ void ConvertYV24ToRGB::BuildMatrix(double Kr, double Kb, int Sy, int Suv, int Oy
   matrix.u_r = (int16_t)(Srgb * 0.000        * mulfac / Suv + 0.5);
   matrix.v_r = (int16_t)(Srgb * (1-Kr)       * mulfac / Suv + 0.5);
   matrix.offset_y = -Oy;
+
+  build_yuv_to_rgb_matrix(matrix_f, Kr, Kb, Sy, Suv, Oy, yuv_bits, rgb_bits);
 }
 
 static __forceinline __m128i convert_yuv_to_rgb_sse2_core(const __m128i &px01, const __m128i &px23, const __m128i &px45, const __m128i &px67, const __m128i& zero, const __m128i &matrix, const __m128i &round_mask) {
@@ -895,9 +1211,61 @@ static __forceinline __m128i convert_yuv_to_rgb_sse2_core(const __m128i &px01, c
   return result;
 }
 
+// Converts 8 pixels to BGRA with alpha 255, in result_lo (pixels 0-3) and result_hi (pixels 4-7)
+static __forceinline void convert_yv24_to_rgb_8_pixels_sse2(const BYTE* srcY, const BYTE* srcU, const BYTE* srcV,
+                                                            const __m128i &matrix_b, const __m128i &matrix_g, const __m128i &matrix_r,
+                                                            const __m128i &offset, const __m128i &round_mask, const __m128i &zero,
+                                                            __m128i &result_lo, __m128i &result_hi) {
+  __m128i src_y = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcY)); //0 0 0 0 0 0 0 0 Y7 Y6 Y5 Y4 Y3 Y2 Y1 Y0
+  __m128i src_u = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcU)); //0 0 0 0 0 0 0 0 U7 U6 U5 U4 U3 U2 U1 U0
+  __m128i src_v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcV)); //0 0 0 0 0 0 0 0 V7 V6 V5 V4 V3 V2 V1 V0
+
+  __m128i t1 = _mm_unpacklo_epi8(src_y, src_u); //U7 Y7 U6 Y6 U5 Y5 U4 Y4 U3 Y3 U2 Y2 U1 Y1 U0 Y0
+  __m128i t2 = _mm_unpacklo_epi8(src_v, zero);  //00 V7 00 V6 00 V5 00 V4 00 V3 00 V2 00 V1 00 V0
+
+  __m128i low  = _mm_unpacklo_epi16(t1, t2); //xx V3 U3 Y3 xx V2 U2 Y2 xx V1 U1 Y1 xx V0 U0 Y0
+  __m128i high = _mm_unpackhi_epi16(t1, t2); //xx V7 U7 Y7 xx V6 U6 Y6 xx V5 U5 Y5 xx V4 U4 Y4
+
+  __m128i px01 = _mm_unpacklo_epi8(low, zero);  //xx xx 00 V1 00 U1 00 Y1 xx xx 00 V0 00 U0 00 Y0
+  __m128i px23 = _mm_unpackhi_epi8(low, zero);  //xx xx 00 V3 00 U3 00 Y3 xx xx 00 V2 00 U2 00 Y2
+  __m128i px45 = _mm_unpacklo_epi8(high, zero); //xx xx 00 V5 00 U5 00 Y5 xx xx 00 V4 00 U4 00 Y4
+  __m128i px67 = _mm_unpackhi_epi8(high, zero); //xx xx 00 V7 00 U7 00 Y7 xx xx 00 V6 00 U6 00 Y6
+
+  px01 = _mm_add_epi16(px01, offset);
+  px23 = _mm_add_epi16(px23, offset);
+  px45 = _mm_add_epi16(px45, offset);
+  px67 = _mm_add_epi16(px67, offset);
+
+  __m128i result_b = convert_yuv_to_rgb_sse2_core(px01, px23, px45, px67, zero, matrix_b, round_mask); //00 00 00 00 00 00 00 00 b7 b6 b5 b4 b3 b2 b1 b0
+  __m128i result_g = convert_yuv_to_rgb_sse2_core(px01, px23, px45, px67, zero, matrix_g, round_mask); //00 00 00 00 00 00 00 00 g7 g6 g5 g4 g3 g2 g1 g0
+  __m128i result_r = convert_yuv_to_rgb_sse2_core(px01, px23, px45, px67, zero, matrix_r, round_mask); //00 00 00 00 00 00 00 00 r7 r6 r5 r4 r3 r2 r1 r0
+
+  __m128i result_bg = _mm_unpacklo_epi8(result_b, result_g); //g7 b7 g6 b6 g5 b5 g4 b4 g3 b3 g2 b2 g1 b1 g0 b0
+  __m128i ff = _mm_cmpeq_epi32(result_r, result_r);
+  __m128i result_ra = _mm_unpacklo_epi8(result_r, ff);       //a7 r7 a6 r6 a5 r5 a4 r4 a3 r3 a2 r2 a1 r1 a0 r0
+
+  result_lo = _mm_unpacklo_epi16(result_bg, result_ra);
+  result_hi = _mm_unpackhi_epi16(result_bg, result_ra);
+}
+
+// The pixels from x_start to width that the SIMD loops leave over
+static __forceinline void convert_yv24_to_rgb24_tail_c(BYTE* dstp, const BYTE* srcY, const BYTE* srcU, const BYTE* srcV, size_t x_start, size_t width, const ConversionMatrix &matrix) {
+  for (size_t x = x_start; x < width; ++x) {
+    int Y = srcY[x] + matrix.offset_y;
+    int U = srcU[x] - 128;
+    int V = srcV[x] - 128;
+    int b = (((int)matrix.y_b * Y + (int)matrix.u_b * U + (int)matrix.v_b * V + 4096) >> 13);
+    int g = (((int)matrix.y_g * Y + (int)matrix.u_g * U + (int)matrix.v_g * V + 4096) >> 13);
+    int r = (((int)matrix.y_r * Y + (int)matrix.u_r * U + (int)matrix.v_r * V + 4096) >> 13);
+    dstp[x*3 + 0] = PixelClip(b);
+    dstp[x*3 + 1] = PixelClip(g);
+    dstp[x*3 + 2] = PixelClip(r);
+  }
+}
+
 //todo: consider rewriting
-template<int rgb_pixel_step, int instruction_set>
-static void convert_yv24_to_rgb_ssex(BYTE* dstp, const BYTE* srcY, const BYTE* srcU, const BYTE*srcV, size_t dst_pitch, size_t src_pitch_y, size_t src_pitch_uv, size_t width, size_t height, const ConversionMatrix &matrix) {
+template<int rgb_pixel_step>
+static void convert_yv24_to_rgb_sse2(BYTE* dstp, const BYTE* srcY, const BYTE* srcU, const BYTE*srcV, size_t dst_pitch, size_t src_pitch_y, size_t src_pitch_uv, size_t width, size_t height, const ConversionMatrix &matrix) {
   dstp += dst_pitch * (height-1);  // We start at last line
 
   size_t mod8_width = rgb_pixel_step == 3 ? width / 8 * 8 : width;
@@ -909,94 +1277,34 @@ static void convert_yv24_to_rgb_ssex(BYTE* dstp, const BYTE* srcY, const BYTE* s
   __m128i zero = _mm_setzero_si128();
   __m128i round_mask = _mm_set1_epi32(4096);
   __m128i offset = _mm_set_epi16(0, -128, -128, matrix.offset_y, 0, -128, -128, matrix.offset_y);
-  __m128i pixels0123_mask = _mm_set_epi8(0, 0, 0, 0, 14, 13, 12, 10, 9, 8, 6, 5, 4, 2, 1, 0);
-  __m128i pixels4567_mask = _mm_set_epi8(4, 2, 1, 0, 0, 0, 0, 0, 14, 13, 12, 10, 9, 8, 6, 5);
-  __m128i ssse3_merge_mask = _mm_set_epi32(0xFFFFFFFF, 0, 0, 0);
   BYTE temp[32];
 
   for (size_t y = 0; y < height; ++y) {
     for (size_t x = 0; x < mod8_width; x+=8) {
-      __m128i src_y = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcY+x)); //0 0 0 0 0 0 0 0 Y7 Y6 Y5 Y4 Y3 Y2 Y1 Y0
-      __m128i src_u = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcU+x)); //0 0 0 0 0 0 0 0 U7 U6 U5 U4 U3 U2 U1 U0
-      __m128i src_v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcV+x)); //0 0 0 0 0 0 0 0 V7 V6 V5 V4 V3 V2 V1 V0
-      
-      __m128i t1 = _mm_unpacklo_epi8(src_y, src_u); //U7 Y7 U6 Y6 U5 Y5 U4 Y4 U3 Y3 U2 Y2 U1 Y1 U0 Y0
-      __m128i t2 = _mm_unpacklo_epi8(src_v, zero);  //00 V7 00 V6 00 V5 00 V4 00 V3 00 V2 00 V1 00 V0
-
-      __m128i low  = _mm_unpacklo_epi16(t1, t2); //xx V3 U3 Y3 xx V2 U2 Y2 xx V1 U1 Y1 xx V0 U0 Y0
-      __m128i high = _mm_unpackhi_epi16(t1, t2); //xx V7 U7 Y7 xx V6 U6 Y6 xx V5 U5 Y5 xx V4 U4 Y4
-
-      __m128i px01 = _mm_unpacklo_epi8(low, zero);  //xx xx 00 V1 00 U1 00 Y1 xx xx 00 V0 00 U0 00 Y0
-      __m128i px23 = _mm_unpackhi_epi8(low, zero);  //xx xx 00 V3 00 U3 00 Y3 xx xx 00 V2 00 U2 00 Y2
-      __m128i px45 = _mm_unpacklo_epi8(high, zero); //xx xx 00 V5 00 U5 00 Y5 xx xx 00 V4 00 U4 00 Y4
-      __m128i px67 = _mm_unpackhi_epi8(high, zero); //xx xx 00 V7 00 U7 00 Y7 xx xx 00 V6 00 U6 00 Y6
-      
-      px01 = _mm_add_epi16(px01, offset); 
-      px23 = _mm_add_epi16(px23, offset); 
-      px45 = _mm_add_epi16(px45, offset);
-      px67 = _mm_add_epi16(px67, offset);
-      
-      __m128i result_b = convert_yuv_to_rgb_sse2_core(px01, px23, px45, px67, zero, matrix_b, round_mask); //00 00 00 00 00 00 00 00 b7 b6 b5 b4 b3 b2 b1 b0
-      __m128i result_g = convert_yuv_to_rgb_sse2_core(px01, px23, px45, px67, zero, matrix_g, round_mask); //00 00 00 00 00 00 00 00 g7 g6 g5 g4 g3 g2 g1 g0
-      __m128i result_r = convert_yuv_to_rgb_sse2_core(px01, px23, px45, px67, zero, matrix_r, round_mask); //00 00 00 00 00 00 00 00 r7 r6 r5 r4 r3 r2 r1 r0
-
-      __m128i result_bg = _mm_unpacklo_epi8(result_b, result_g); //g7 b7 g6 b6 g5 b5 g4 b4 g3 b3 g2 b2 g1 b1 g0 b0
-      __m128i ff = _mm_cmpeq_epi32(result_r, result_r);
-      __m128i result_ra = _mm_unpacklo_epi8(result_r, ff);       //a7 r7 a6 r6 a5 r5 a4 r4 a3 r3 a2 r2 a1 r1 a0 r0
-
-      __m128i result_lo = _mm_unpacklo_epi16(result_bg, result_ra);
-      __m128i result_hi = _mm_unpackhi_epi16(result_bg, result_ra);
+      __m128i result_lo, result_hi;
+      convert_yv24_to_rgb_8_pixels_sse2(srcY+x, srcU+x, srcV+x, matrix_b, matrix_g, matrix_r, offset, round_mask, zero, result_lo, result_hi);
 
       if (rgb_pixel_step == 4) {
         //rgb32
         _mm_store_si128(reinterpret_cast<__m128i*>(dstp+x*4),    result_lo);
         _mm_store_si128(reinterpret_cast<__m128i*>(dstp+x*4+16), result_hi);
       } else {
-        //rgb24
-        if (instruction_set == CPUF_SSSE3) {
-          //"fast" SSSE3 version
-          __m128i px0123 = _mm_shuffle_epi8(result_lo, pixels0123_mask); //xxxx xxxx b3g3 r3b2 g2r2 b1g1 r1b0 g0r0
-          __m128i dst567 = _mm_shuffle_epi8(result_hi, pixels4567_mask); //r5b4 g4r4 xxxx xxxx b7g7 r7b6 g6r6 b5g5
-
-          __m128i dst012345 = _mm_or_si128(
-            _mm_andnot_si128(ssse3_merge_mask, px0123),
-            _mm_and_si128(ssse3_merge_mask, dst567)
-            ); //r5b4 g4r4 b3g3 r3b2 g2r2 b1g1 r1b0 g0r0
-
-          _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x*3), dst012345);
-          _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp+x*3+16), dst567);
-
-        } else {
-          //slow SSE2 version
-          _mm_store_si128(reinterpret_cast<__m128i*>(temp),    result_lo);
-          _mm_store_si128(reinterpret_cast<__m128i*>(temp+16), result_hi);
-
-          for (int i = 0; i < 8; ++i) {
-            *reinterpret_cast<int*>(dstp + (x+i)*3) = *reinterpret_cast<int*>(temp+i*4);
-          }
-          //last pixel
-          dstp[(x+7)*3+0] = temp[7*4+0];
-          dstp[(x+7)*3+1] = temp[7*4+1];
-          dstp[(x+7)*3+2] = temp[7*4+2];
+        //rgb24, slow SSE2 version
+        _mm_store_si128(reinterpret_cast<__m128i*>(temp),    result_lo);
+        _mm_store_si128(reinterpret_cast<__m128i*>(temp+16), result_hi);
+
+        for (int i = 0; i < 8; ++i) {
+          *reinterpret_cast<int*>(dstp + (x+i)*3) = *reinterpret_cast<int*>(temp+i*4);
         }
+        //last pixel
+        dstp[(x+7)*3+0] = temp[7*4+0];
+        dstp[(x+7)*3+1] = temp[7*4+1];
+        dstp[(x+7)*3+2] = temp[7*4+2];
       }
     }
 
     if (rgb_pixel_step == 3) {
-      for (size_t x = mod8_width; x < width; ++x) {
-        int Y = srcY[x] + matrix.offset_y;
-        int U = srcU[x] - 128;
-        int V = srcV[x] - 128;
-        int b = (((int)matrix.y_b * Y + (int)matrix.u_b * U + (int)matrix.v_b * V + 4096) >> 13);
-        int g = (((int)matrix.y_g * Y + (int)matrix.u_g * U + (int)matrix.v_g * V + 4096) >> 13);
-        int r = (((int)matrix.y_r * Y + (int)matrix.u_r * U + (int)matrix.v_r * V + 4096) >> 13);
-        dstp[x*rgb_pixel_step + 0] = PixelClip(b);
-        dstp[x*rgb_pixel_step + 1] = PixelClip(g);
-        dstp[x*rgb_pixel_step + 2] = PixelClip(r);
-        if (rgb_pixel_step == 4) {
-          dstp[x * 4 + 3] = 255;
-        }
-      }
+      convert_yv24_to_rgb24_tail_c(dstp, srcY, srcU, srcV, mod8_width, width, matrix);
     }
     dstp -= dst_pitch;
     srcY += src_pitch_y;
@@ -1005,6 +1313,48 @@ static void convert_yv24_to_rgb_ssex(BYTE* dstp, const BYTE* srcY, const BYTE* s
   }
 }
 
+AVS_TARGET("ssse3")
+static void convert_yv24_to_rgb24_ssse3(BYTE* dstp, const BYTE* srcY, const BYTE* srcU, const BYTE*srcV, size_t dst_pitch, size_t src_pitch_y, size_t src_pitch_uv, size_t width, size_t height, const ConversionMatrix &matrix) {
+  dstp += dst_pitch * (height-1);  // We start at last line
+
+  size_t mod8_width = width / 8 * 8;
+
+  __m128i matrix_b = _mm_set_epi16(0, matrix.v_b, matrix.u_b, matrix.y_b, 0, matrix.v_b, matrix.u_b, matrix.y_b);
+  __m128i matrix_g = _mm_set_epi16(0, matrix.v_g, matrix.u_g, matrix.y_g, 0, matrix.v_g, matrix.u_g, matrix.y_g);
+  __m128i matrix_r = _mm_set_epi16(0, matrix.v_r, matrix.u_r, matrix.y_r, 0, matrix.v_r, matrix.u_r, matrix.y_r);
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i round_mask = _mm_set1_epi32(4096);
+  __m128i offset = _mm_set_epi16(0, -128, -128, matrix.offset_y, 0, -128, -128, matrix.offset_y);
+  __m128i pixels0123_mask = _mm_set_epi8(0, 0, 0, 0, 14, 13, 12, 10, 9, 8, 6, 5, 4, 2, 1, 0);
+  __m128i pixels4567_mask = _mm_set_epi8(4, 2, 1, 0, 0, 0, 0, 0, 14, 13, 12, 10, 9, 8, 6, 5);
+  __m128i ssse3_merge_mask = _mm_set_epi32(0xFFFFFFFF, 0, 0, 0);
+
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < mod8_width; x+=8) {
+      __m128i result_lo, result_hi;
+      convert_yv24_to_rgb_8_pixels_sse2(srcY+x, srcU+x, srcV+x, matrix_b, matrix_g, matrix_r, offset, round_mask, zero, result_lo, result_hi);
+
+      __m128i px0123 = _mm_shuffle_epi8(result_lo, pixels0123_mask); //xxxx xxxx b3g3 r3b2 g2r2 b1g1 r1b0 g0r0
+      __m128i dst567 = _mm_shuffle_epi8(result_hi, pixels4567_mask); //r5b4 g4r4 xxxx xxxx b7g7 r7b6 g6r6 b5g5
+
+      __m128i dst012345 = _mm_or_si128(
+        _mm_andnot_si128(ssse3_merge_mask, px0123),
+        _mm_and_si128(ssse3_merge_mask, dst567)
+        ); //r5b4 g4r4 b3g3 r3b2 g2r2 b1g1 r1b0 g0r0
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x*3), dst012345);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp+x*3+16), dst567);
+    }
+
+    convert_yv24_to_rgb24_tail_c(dstp, srcY, srcU, srcV, mod8_width, width, matrix);
+    dstp -= dst_pitch;
+    srcY += src_pitch_y;
+    srcU += src_pitch_uv;
+    srcV += src_pitch_uv;
+  }
+}
+
 
 #ifdef X86_32
 
@@ -1140,6 +1490,51 @@ PVideoFrame __stdcall ConvertYV24ToRGB::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame src = child->GetFrame(n, env);
   PVideoFrame dst = env->NewVideoFrame(vi, 8);
 
+  if (planar_path) {
+    const BYTE* srcp[3] = { src->GetReadPtr(PLANAR_Y), src->GetReadPtr(PLANAR_U), src->GetReadPtr(PLANAR_V) };
+    int src_pitch[3] = { src->GetPitch(PLANAR_Y), src->GetPitch(PLANAR_U), src->GetPitch(PLANAR_V) };
+    const int pixelsize = vi.ComponentSize();
+    const int max_pixel_value = rgb_bits == 32 ? 0 : (1 << rgb_bits) - 1;
+    const bool src_alpha = src->GetPitch(PLANAR_A) != 0;
+
+    if (pixel_step <= 0) {
+      BYTE* dstp[3] = { dst->GetWritePtr(PLANAR_R), dst->GetWritePtr(PLANAR_G), dst->GetWritePtr(PLANAR_B) };
+      int dst_pitch[3] = { dst->GetPitch(PLANAR_R), dst->GetPitch(PLANAR_G), dst->GetPitch(PLANAR_B) };
+      convert_planar_matrix(dstp, dst_pitch, srcp, src_pitch, vi.width, vi.height, pixelsize, matrix_f, max_pixel_value, env->GetCPUFlags());
+      if (vi.IsPlanarRGBA()) {
+        if (src_alpha)
+          env->BitBlt(dst->GetWritePtr(PLANAR_A), dst->GetPitch(PLANAR_A), src->GetReadPtr(PLANAR_A), src->GetPitch(PLANAR_A),
+                      src->GetRowSize(PLANAR_A), src->GetHeight(PLANAR_A));
+        else
+          fill_plane_max(dst->GetWritePtr(PLANAR_A), dst->GetPitch(PLANAR_A), vi.width, vi.height, pixelsize, rgb_bits);
+      }
+      return dst;
+    }
+
+    // RGB24/32 from YUVA, RGB48/64: planar kernel to a line buffer, then pack (upside down)
+    auto env2 = static_cast<IScriptEnvironment2*>(env);
+    const int line_size = AlignNumber(vi.width * pixelsize, FRAME_ALIGN);
+    BYTE* buffer = static_cast<BYTE*>(env2->Allocate(line_size * 3, FRAME_ALIGN, AVS_POOLED_ALLOC));
+    if (!buffer)
+      env->ThrowError("ConvertYV24ToRGB: Could not reserve memory.");
+    BYTE* lines[3] = { buffer, buffer + line_size, buffer + 2 * line_size };
+    const int line_pitch[3] = { 0, 0, 0 };
+    const BYTE* srcA = src_alpha ? src->GetReadPtr(PLANAR_A) : nullptr;
+
+    BYTE* dstp = dst->GetWritePtr() + dst->GetPitch() * (vi.height - 1);
+    for (int y = 0; y < vi.height; y++) {
+      convert_planar_matrix(lines, line_pitch, srcp, src_pitch, vi.width, 1, pixelsize, matrix_f, max_pixel_value, env->GetCPUFlags());
+      pack_rgb_line(dstp, lines, srcA, vi.width, pixel_step);
+      dstp -= dst->GetPitch();
+      for (int i = 0; i < 3; i++)
+        srcp[i] += src_pitch[i];
+      if (srcA)
+        srcA += src->GetPitch(PLANAR_A);
+    }
+    env2->Free(buffer);
+    return dst;
+  }
+
 
   const BYTE* srcY = src->GetReadPtr(PLANAR_Y);
   const BYTE* srcU = src->GetReadPtr(PLANAR_U);
@@ -1161,12 +1556,12 @@ PVideoFrame __stdcall ConvertYV24ToRGB::GetFrame(int n, IScriptEnvironment* env)
   if (env->GetCPUFlags() & CPUF_SSE2) {
     //we load using movq so no need to check for alignment
     if (pixel_step == 4) {
-      convert_yv24_to_rgb_ssex<4, CPUF_SSE2>(dstp, srcY, srcU, srcV, dst_pitch, src_pitch_y, src_pitch_uv, vi.width, vi.height, matrix);
+      convert_yv24_to_rgb_sse2<4>(dstp, srcY, srcU, srcV, dst_pitch, src_pitch_y, src_pitch_uv, vi.width, vi.height, matrix);
     } else {
       if (env->GetCPUFlags() & CPUF_SSSE3) {
-        convert_yv24_to_rgb_ssex<3, CPUF_SSSE3>(dstp, srcY, srcU, srcV, dst_pitch, src_pitch_y, src_pitch_uv, vi.width, vi.height, matrix);
+        convert_yv24_to_rgb24_ssse3(dstp, srcY, srcU, srcV, dst_pitch, src_pitch_y, src_pitch_uv, vi.width, vi.height, matrix);
       } else {
-        convert_yv24_to_rgb_ssex<3, CPUF_SSE2>(dstp, srcY, srcU, srcV, dst_pitch, src_pitch_y, src_pitch_uv, vi.width, vi.height, matrix);
+        convert_yv24_to_rgb_sse2<3>(dstp, srcY, srcU, srcV, dst_pitch, src_pitch_y, src_pitch_uv, vi.width, vi.height, matrix);
       }
     }
     return dst;
@@ -1243,6 +1638,437 @@ AVSValue __cdecl ConvertYV24ToRGB::Create24(AVSValue args, void*, IScriptEnviron
   return new ConvertYV24ToRGB(clip, getMatrix(args[1].AsString(0), env), 3, env);
 }
 
+/*****************************************************
+ * Fused chroma resampling + matrix
+ *
+ * 4:2:0/4:2:2 <-> RGB in one row streamed pass, instead of the per plane
+ * FilteredResize of ConvertToPlanarGeneric plus ConvertYV24ToRGB (or the
+ * reverse). The resampling programs are the ones FilteredResize builds.
+ * Upsampled chroma is rounded like FilteredResize output, downsampled
+ * chroma stays in float between matrix and resampler.
+ ******************************************************/
+
+static void get_matrix_parameters(int in_matrix, double &Kr, double &Kb, int &Sy, int &Suv, int &Oy, const char* filter, IScriptEnvironment* env) {
+  switch (in_matrix) {
+  case Rec601:  Kr = 0.299;  Kb = 0.114;  Sy = 219; Suv = 112; Oy = 16; break;
+  case PC_601:  Kr = 0.299;  Kb = 0.114;  Sy = 255; Suv = 127; Oy = 0;  break;
+  case Rec709:  Kr = 0.2126; Kb = 0.0722; Sy = 219; Suv = 112; Oy = 16; break;
+  case PC_709:  Kr = 0.2126; Kb = 0.0722; Sy = 255; Suv = 127; Oy = 0;  break;
+  case AVERAGE: Kr = 1.0/3;  Kb = 1.0/3;  Sy = 255; Suv = 127; Oy = 0;  break;
+  default:
+    env->ThrowError("%s: Unknown matrix.", filter);
+  }
+}
+
+// Progressive 4:2:0 chroma position, as in ConvertToPlanarGeneric
+static void get_chroma_placement(int placement, int plane, float &xd, float &yd) {
+  xd = 0.0f;
+  yd = 0.0f;
+  switch (placement) {
+  case PLACEMENT_DV:
+    yd = plane == PLANAR_U ? 0.0f : 1.0f;
+    break;
+  case PLACEMENT_MPEG1:
+    xd = 0.5f;
+    // fall thru
+  case PLACEMENT_MPEG2:
+    yd = 0.5f;
+    break;
+  }
+}
+
+static float chroma_offset(bool point, int sIn, float dIn, int sOut, float dOut) {
+  //     (1 - sOut/sIn)/2 + (dOut-dIn)/sIn; // Gavino Jan 2011
+  return point ? (dOut - dIn) / sIn : 0.5f + (dOut - dIn - 0.5f*sOut) / sIn;
+}
+
+// NULL where FilteredResize would pass the plane through
+static ResamplingProgram* get_chroma_program(ResamplingFunction* filter, int source_size, float crop_start, int target_size, IScriptEnvironment* env) {
+  if (source_size == target_size && crop_start == 0.0f)
+    return NULL;
+  return filter->GetResamplingProgram(source_size, crop_start, source_size, target_size, static_cast<IScriptEnvironment2*>(env));
+}
+
+template<typename pixel_t>
+static void load_float_row(float* dstp, const BYTE* srcp, int width) {
+  const pixel_t* src = reinterpret_cast<const pixel_t*>(srcp);
+  for (int x = 0; x < width; x++)
+    dstp[x] = (float)src[x];
+}
+
+static void load_float_row(float* dstp, const BYTE* srcp, int width, int pixelsize) {
+  switch (pixelsize) {
+  case 1: load_float_row<uint8_t>(dstp, srcp, width); break;
+  case 2: load_float_row<uint16_t>(dstp, srcp, width); break;
+  default: memcpy(dstp, srcp, width * sizeof(float)); break;
+  }
+}
+
+// Chroma resampling the way FilteredResize does it, so that the fused
+// conversions give the results of the resize + ConvertYV24ToRGB and the
+// ConvertRGBToYV24 + resize chains: 14 bit coefficients for 8 and 16 bit,
+// rounded and clamped to the pixel type after each pass, float unclamped.
+template<typename pixel_t>
+static void resize_chroma_horizontal(BYTE* dstp, const BYTE* srcp, const ResamplingProgram* program) {
+  typedef typename std::conditional<sizeof(pixel_t) == 1, int, typename std::conditional<sizeof(pixel_t) == 2, __int64, float>::type>::type sum_t;
+  const pixel_t* src = reinterpret_cast<const pixel_t*>(srcp);
+  pixel_t* dst = reinterpret_cast<pixel_t*>(dstp);
+  const sum_t limit = sizeof(pixel_t) == 1 ? 255 : 65535;
+  const int filter_size = program->filter_size;
+  for (int x = 0; x < program->target_size; x++) {
+    const pixel_t* p = src + program->pixel_offset[x];
+    sum_t result = 0;
+    if (std::is_floating_point<pixel_t>::value) {
+      const float* coef = program->pixel_coefficient_float + x * filter_size;
+      for (int k = 0; k < filter_size; k++)
+        result += p[k] * coef[k];
+    }
+    else {
+      const short* coef = program->pixel_coefficient + x * filter_size;
+      for (int k = 0; k < filter_size; k++)
+        result += p[k] * coef[k];
+      result = (result + 8192) / 16384;
+      result = result < 0 ? 0 : (result > limit ? limit : result);
+    }
+    dst[x] = (pixel_t)result;
+  }
+}
+
+static void resize_chroma_horizontal(BYTE* dstp, const BYTE* srcp, const ResamplingProgram* program, int pixelsize) {
+  switch (pixelsize) {
+  case 1: resize_chroma_horizontal<uint8_t>(dstp, srcp, program); break;
+  case 2: resize_chroma_horizontal<uint16_t>(dstp, srcp, program); break;
+  default: resize_chroma_horizontal<float>(dstp, srcp, program); break;
+  }
+}
+
+// rows: the filter_size source lines of output line y
+template<typename pixel_t>
+static void resize_chroma_vertical(BYTE* dstp, const BYTE* const* rows, const ResamplingProgram* program, int y, int width) {
+  typedef typename std::conditional<sizeof(pixel_t) == 1, int, typename std::conditional<sizeof(pixel_t) == 2, __int64, float>::type>::type sum_t;
+  pixel_t* dst = reinterpret_cast<pixel_t*>(dstp);
+  const sum_t limit = sizeof(pixel_t) == 1 ? 255 : 65535;
+  const int filter_size = program->filter_size;
+  const short* coef = program->pixel_coefficient + y * filter_size;
+  const float* coef_float = program->pixel_coefficient_float + y * filter_size;
+  for (int x = 0; x < width; x++) {
+    sum_t result = 0;
+    if (std::is_floating_point<pixel_t>::value) {
+      for (int k = 0; k < filter_size; k++)
+        result += reinterpret_cast<const pixel_t*>(rows[k])[x] * coef_float[k];
+    }
+    else {
+      for (int k = 0; k < filter_size; k++)
+        result += reinterpret_cast<const pixel_t*>(rows[k])[x] * coef[k];
+      result = (result + 8192) / 16384;
+      result = result < 0 ? 0 : (result > limit ? limit : result);
+    }
+    dst[x] = (pixel_t)result;
+  }
+}
+
+static void resize_chroma_vertical(BYTE* dstp, const BYTE* const* rows, const ResamplingProgram* program, int y, int width, int pixelsize) {
+  switch (pixelsize) {
+  case 1: resize_chroma_vertical<uint8_t>(dstp, rows, program, y, width); break;
+  case 2: resize_chroma_vertical<uint16_t>(dstp, rows, program, y, width); break;
+  default: resize_chroma_vertical<float>(dstp, rows, program, y, width); break;
+  }
+}
+
+
+ConvertYUVToRGBResampled::ConvertYUVToRGBResampled(PClip src, int in_matrix, int _pixel_step, const AVSValue& InPlacement,
+                                                   const AVSValue& ChromaResampler, IScriptEnvironment* env)
+  : GenericVideoFilter(src), pixel_step(_pixel_step)
+{
+  program_h[0] = program_h[1] = program_v[0] = program_v[1] = NULL;
+
+  if ((!vi.Is420() && !vi.Is422()) || vi.IsYUVA())
+    env->ThrowError("ConvertToRGB: Only 4:2:0 and 4:2:2 input accepted");
+
+  src_pixelsize = vi.ComponentSize();
+  yuv_bits = vi.BitsPerComponent();
+  const int xs = 1 << vi.GetPlaneWidthSubsampling(PLANAR_U);
+  const int ys = 1 << vi.GetPlaneHeightSubsampling(PLANAR_U);
+  const int uv_width = vi.width / xs;
+  const int uv_height = vi.height / ys;
+
+  int placement = PLACEMENT_MPEG2;
+  if (vi.Is420())
+    placement = getPlacement(InPlacement, env);
+  else if (InPlacement.Defined())
+    env->ThrowError("Convert: Input ChromaPlacement only available with 4:2:0 source.");
+
+  switch (pixel_step) {
+  case 3: vi.pixel_type = VideoInfo::CS_BGR24; rgb_bits = 8; break;
+  case 4: vi.pixel_type = VideoInfo::CS_BGR32; rgb_bits = 8; break;
+  case 6: vi.pixel_type = VideoInfo::CS_BGR48; rgb_bits = 16; break;
+  case 8: vi.pixel_type = VideoInfo::CS_BGR64; rgb_bits = 16; break;
+  case 0:  vi.pixel_type = planar_pixel_type(VideoInfo::CS_GENERIC_RGBP, yuv_bits); rgb_bits = yuv_bits; break;
+  case -1: vi.pixel_type = planar_pixel_type(VideoInfo::CS_GENERIC_RGBAP, yuv_bits); rgb_bits = yuv_bits; break;
+  default: env->ThrowError("ConvertToRGB: Invalid pixel step. This is a bug.");
+  }
+
+  if (pixel_step > 0 && src_pixelsize != (rgb_bits == 8 ? 1 : 2))
+    env->ThrowError("ConvertToRGB: %s needs a %s bit source, use ConvertToPlanarRGB for this bit depth",
+                    rgb_bits == 8 ? "RGB24/RGB32" : "RGB48/RGB64", rgb_bits == 8 ? "8" : "10-16");
+
+  double Kr, Kb;
+  int Sy, Suv, Oy;
+  get_matrix_parameters(in_matrix, Kr, Kb, Sy, Suv, Oy, "ConvertToRGB", env);
+  build_yuv_to_rgb_matrix(matrix_f, Kr, Kb, Sy, Suv, Oy, yuv_bits, rgb_bits);
+
+  ResamplingFunction *filter = getResampler(ChromaResampler.AsString("bicubic"), env);
+  const bool P = !lstrcmpi(ChromaResampler.AsString(""), "point");
+
+  for (int i = 0; i < 2; i++) {
+    float xd = 0.0f, yd = 0.0f;
+    if (ys == 2)
+      get_chroma_placement(placement, i == 0 ? PLANAR_U : PLANAR_V, xd, yd);
+    program_h[i] = get_chroma_program(filter, uv_width, chroma_offset(P, xs, xd, 1, 0.0f), vi.width, env);
+    program_v[i] = get_chroma_program(filter, uv_height, chroma_offset(P, ys, yd, 1, 0.0f), vi.height, env);
+  }
+  delete filter;
+}
+
+ConvertYUVToRGBResampled::~ConvertYUVToRGBResampled() {
+  for (int i = 0; i < 2; i++) {
+    delete program_h[i];
+    delete program_v[i];
+  }
+}
+
+PVideoFrame __stdcall ConvertYUVToRGBResampled::GetFrame(int n, IScriptEnvironment* env)
+{
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame dst = pixel_step > 0 ? env->NewVideoFrame(vi, 8) : env->NewVideoFrame(vi);
+
+  const int cpu = env->GetCPUFlags();
+  const int width = vi.width;
+  const int dst_pixelsize = vi.ComponentSize();
+  const int max_pixel_value = rgb_bits == 32 ? 0 : (1 << rgb_bits) - 1;
+
+  // Chroma is resized horizontally first, as FilteredResize does for this
+  // scaling, into a ring of the source lines the vertical filter needs.
+  const int ring_size[2] = { program_v[0] ? program_v[0]->filter_size : 1, program_v[1] ? program_v[1]->filter_size : 1 };
+
+  // float Y, U, V lines, the resized chroma line, the packed RGB lines and the rings
+  auto env2 = static_cast<IScriptEnvironment2*>(env);
+  const int line_size = AlignNumber(width * (int)sizeof(float), FRAME_ALIGN);
+  BYTE* buffer = static_cast<BYTE*>(env2->Allocate(line_size * (7 + ring_size[0] + ring_size[1]), FRAME_ALIGN, AVS_POOLED_ALLOC));
+  if (!buffer)
+    env->ThrowError("ConvertToRGB: Could not reserve memory.");
+  float* yuv[3] = { (float*)buffer, (float*)(buffer + line_size), (float*)(buffer + 2 * line_size) };
+  BYTE* chroma = buffer + 3 * line_size;
+  BYTE* lines[3] = { buffer + 4 * line_size, buffer + 5 * line_size, buffer + 6 * line_size };
+  BYTE* ring[2] = { buffer + 7 * line_size, buffer + (7 + ring_size[0]) * line_size };
+  int produced[2] = { 0, 0 };
+  std::vector<const BYTE*> rows(max(ring_size[0], ring_size[1]));
+
+  const BYTE* srcY = src->GetReadPtr(PLANAR_Y);
+  const int src_pitch_y = src->GetPitch(PLANAR_Y);
+  const int planes[2] = { PLANAR_U, PLANAR_V };
+
+  BYTE* dstp[3];
+  int dst_pitch[3];
+  BYTE* dst_packed = NULL;
+  if (pixel_step > 0) {
+    for (int i = 0; i < 3; i++) {
+      dstp[i] = lines[i];
+      dst_pitch[i] = 0;
+    }
+    dst_packed = dst->GetWritePtr() + dst->GetPitch() * (vi.height - 1);
+  }
+  else {
+    const int rgb_planes[3] = { PLANAR_R, PLANAR_G, PLANAR_B };
+    for (int i = 0; i < 3; i++) {
+      dstp[i] = dst->GetWritePtr(rgb_planes[i]);
+      dst_pitch[i] = dst->GetPitch(rgb_planes[i]);
+    }
+  }
+
+  for (int y = 0; y < vi.height; y++) {
+    for (int i = 0; i < 2; i++) {
+      const BYTE* srcp = src->GetReadPtr(planes[i]);
+      const int src_pitch = src->GetPitch(planes[i]);
+      const ResamplingProgram* pv = program_v[i];
+      if (pv) {
+        const int needed = pv->pixel_offset[y] + pv->filter_size;
+        for (; produced[i] < needed; produced[i]++)
+          resize_chroma_horizontal(ring[i] + (produced[i] % ring_size[i]) * line_size, srcp + produced[i] * src_pitch, program_h[i], src_pixelsize);
+        for (int k = 0; k < pv->filter_size; k++)
+          rows[k] = ring[i] + ((pv->pixel_offset[y] + k) % ring_size[i]) * line_size;
+        resize_chroma_vertical(chroma, rows.data(), pv, y, width, src_pixelsize);
+      }
+      else {
+        resize_chroma_horizontal(chroma, srcp + y * src_pitch, program_h[i], src_pixelsize);
+      }
+      load_float_row(yuv[i + 1], chroma, width, src_pixelsize);
+    }
+    load_float_row(yuv[0], srcY + y * src_pitch_y, width, src_pixelsize);
+
+    const BYTE* in[3] = { (const BYTE*)yuv[0], (const BYTE*)yuv[1], (const BYTE*)yuv[2] };
+    convert_planar_matrix_row(dstp, in, width, dst_pixelsize, sizeof(float), matrix_f, max_pixel_value, cpu);
+
+    if (pixel_step > 0) {
+      pack_rgb_line(dst_packed, lines, NULL, width, pixel_step);
+      dst_packed -= dst->GetPitch();
+    }
+    else {
+      for (int i = 0; i < 3; i++)
+        dstp[i] += dst_pitch[i];
+    }
+  }
+
+  if (vi.IsPlanarRGBA())
+    fill_plane_max(dst->GetWritePtr(PLANAR_A), dst->GetPitch(PLANAR_A), vi.width, vi.height, dst_pixelsize, rgb_bits);
+
+  env2->Free(buffer);
+  return dst;
+}
+
+
+ConvertRGBToYUVResampled::ConvertRGBToYUVResampled(PClip src, int in_matrix, bool yuv420, const AVSValue& OutPlacement,
+                                                   const AVSValue& ChromaResampler, IScriptEnvironment* env)
+  : GenericVideoFilter(src)
+{
+  program_h[0] = program_h[1] = program_v[0] = program_v[1] = NULL;
+
+  if (!vi.IsRGB())
+    env->ThrowError("ConvertRGBToYUV: Only RGB data input accepted");
+
+  bits_per_pixel = vi.BitsPerComponent();
+  src_pixelsize = vi.ComponentSize();
+  pixel_step = vi.IsPlanar() ? 0 : vi.BytesFromPixels(1); // alpha is dropped like ConvertToPlanarGeneric does
+
+  double Kr, Kb;
+  int Sy, Suv, Oy;
+  get_matrix_parameters(in_matrix, Kr, Kb, Sy, Suv, Oy, "ConvertRGBToYUV", env);
+  build_rgb_to_yuv_matrix(matrix_f, Kr, Kb, Sy, Suv, Oy, bits_per_pixel, bits_per_pixel);
+
+  vi.pixel_type = planar_pixel_type(yuv420 ? VideoInfo::CS_GENERIC_YUV420 : VideoInfo::CS_GENERIC_YUV422, bits_per_pixel);
+
+  const int xs = 1 << vi.GetPlaneWidthSubsampling(PLANAR_U);
+  const int ys = 1 << vi.GetPlaneHeightSubsampling(PLANAR_U);
+  if (vi.width & (xs - 1))
+    env->ThrowError("Convert: Cannot convert if width isn't mod%d!", xs);
+  if (vi.height & (ys - 1))
+    env->ThrowError("Convert: Cannot convert if height isn't mod%d!", ys);
+  const int uv_width = vi.width / xs;
+  const int uv_height = vi.height / ys;
+
+  int placement = PLACEMENT_MPEG2;
+  if (yuv420)
+    placement = getPlacement(OutPlacement, env);
+  else if (OutPlacement.Defined())
+    env->ThrowError("Convert: Output ChromaPlacement only available with 4:2:0 output.");
+
+  ResamplingFunction *filter = getResampler(ChromaResampler.AsString("bicubic"), env);
+  const bool P = !lstrcmpi(ChromaResampler.AsString(""), "point");
+
+  for (int i = 0; i < 2; i++) {
+    float xd = 0.0f, yd = 0.0f;
+    if (yuv420)
+      get_chroma_placement(placement, i == 0 ? PLANAR_U : PLANAR_V, xd, yd);
+    program_h[i] = get_chroma_program(filter, vi.width, chroma_offset(P, 1, 0.0f, xs, xd), uv_width, env);
+    program_v[i] = get_chroma_program(filter, vi.height, chroma_offset(P, 1, 0.0f, ys, yd), uv_height, env);
+  }
+  delete filter;
+
+  // Lines of the horizontally resampled chroma the vertical filters need at once
+  ring_size = 1;
+  if (program_v[0]) {
+    for (int y = 0; y < uv_height; y++) {
+      const int first = min(program_v[0]->pixel_offset[y], program_v[1]->pixel_offset[y]);
+      const int last = max(program_v[0]->pixel_offset[y] + program_v[0]->filter_size, program_v[1]->pixel_offset[y] + program_v[1]->filter_size);
+      ring_size = max(ring_size, last - first);
+    }
+  }
+}
+
+ConvertRGBToYUVResampled::~ConvertRGBToYUVResampled() {
+  for (int i = 0; i < 2; i++) {
+    delete program_h[i];
+    delete program_v[i];
+  }
+}
+
+PVideoFrame __stdcall ConvertRGBToYUVResampled::GetFrame(int n, IScriptEnvironment* env)
+{
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame dst = env->NewVideoFrame(vi);
+
+  const int cpu = env->GetCPUFlags();
+  const int width = vi.width;
+  const int height = vi.height;
+  const int uv_width = dst->GetRowSize(PLANAR_U) / src_pixelsize;
+  const int uv_height = dst->GetHeight(PLANAR_U);
+  const int max_pixel_value = bits_per_pixel == 32 ? 0 : (1 << bits_per_pixel) - 1;
+
+  // The 4:4:4 U and V lines, the unpacked RGB lines and ring_size
+  // horizontally resized lines for U and V. Like FilteredResize, chroma is
+  // resized horizontally first and rounded to the pixel type after each pass.
+  auto env2 = static_cast<IScriptEnvironment2*>(env);
+  const int line_size = AlignNumber(width * src_pixelsize, FRAME_ALIGN);
+  const int ring_pitch = AlignNumber(uv_width * src_pixelsize, FRAME_ALIGN);
+  BYTE* buffer = static_cast<BYTE*>(env2->Allocate(line_size * 5 + ring_pitch * ring_size * 2, FRAME_ALIGN, AVS_POOLED_ALLOC));
+  if (!buffer)
+    env->ThrowError("ConvertRGBToYUV: Could not reserve memory.");
+  BYTE* lines[3] = { buffer, buffer + line_size, buffer + 2 * line_size };
+  BYTE* chroma[2] = { buffer + 3 * line_size, buffer + 4 * line_size };
+  BYTE* ring[2] = { buffer + 5 * line_size, buffer + 5 * line_size + ring_pitch * ring_size };
+  std::vector<const BYTE*> rows(ring_size);
+
+  const int rgb_planes[3] = { PLANAR_R, PLANAR_G, PLANAR_B };
+  const int planes[2] = { PLANAR_U, PLANAR_V };
+  BYTE* dstY = dst->GetWritePtr(PLANAR_Y);
+  const int dst_pitch_y = dst->GetPitch(PLANAR_Y);
+
+  // RGB line -> Y line and horizontally resized chroma in the ring, or in
+  // the frame for 4:2:2
+  auto produce_line = [&](int y) {
+    const BYTE* rgb[3];
+    if (pixel_step > 0) {
+      unpack_rgb_line(lines, src->GetReadPtr() + src->GetPitch() * (height - 1 - y), width, pixel_step);
+      for (int i = 0; i < 3; i++)
+        rgb[i] = lines[i];
+    }
+    else {
+      for (int i = 0; i < 3; i++)
+        rgb[i] = src->GetReadPtr(rgb_planes[i]) + y * src->GetPitch(rgb_planes[i]);
+    }
+    BYTE* yuv[3] = { dstY + y * dst_pitch_y, chroma[0], chroma[1] };
+    convert_planar_matrix_row(yuv, rgb, width, src_pixelsize, src_pixelsize, matrix_f, max_pixel_value, cpu);
+    for (int i = 0; i < 2; i++) {
+      BYTE* dstp = program_v[0] ? ring[i] + (y % ring_size) * ring_pitch : dst->GetWritePtr(planes[i]) + y * dst->GetPitch(planes[i]);
+      resize_chroma_horizontal(dstp, chroma[i], program_h[i], src_pixelsize);
+    }
+  };
+
+  if (!program_v[0]) {
+    for (int y = 0; y < height; y++)
+      produce_line(y);
+  }
+  else {
+    int produced = 0;
+    for (int y = 0; y < uv_height; y++) {
+      const int needed = max(program_v[0]->pixel_offset[y] + program_v[0]->filter_size, program_v[1]->pixel_offset[y] + program_v[1]->filter_size);
+      while (produced < needed)
+        produce_line(produced++);
+      for (int i = 0; i < 2; i++) {
+        const ResamplingProgram* pv = program_v[i];
+        for (int k = 0; k < pv->filter_size; k++)
+          rows[k] = ring[i] + ((pv->pixel_offset[y] + k) % ring_size) * ring_pitch;
+        resize_chroma_vertical(dst->GetWritePtr(planes[i]) + y * dst->GetPitch(planes[i]), rows.data(), pv, y, uv_width, src_pixelsize);
+      }
+    }
+    while (produced < height)
+      produce_line(produced++);
+  }
+
+  env2->Free(buffer);
+  return dst;
+}
+
 /************************************
  * YUY2 to YV16
  ************************************/
@@ -1595,8 +2421,7 @@ ConvertToPlanarGeneric::ConvertToPlanarGeneric(PClip src, int dst_space, bool in
   bool P = !lstrcmpi(chromaResampler.AsString(""), "point");
 
   auto ChrOffset = [P](int sIn, float dIn, int sOut, float dOut) {
-    //     (1 - sOut/sIn)/2 + (dOut-dIn)/sIn; // Gavino Jan 2011
-    return P ? (dOut - dIn) / sIn : 0.5f + (dOut - dIn - 0.5f*sOut) / sIn;
+    return chroma_offset(P, sIn, dIn, sOut, dOut);
   };
 
   if (interlaced) {
@@ -1677,7 +2502,14 @@ AVSValue ConvertToPlanarGeneric::Create(AVSValue& args, const char* filter, IScr
   PClip clip = args[0].AsClip();
   VideoInfo vi = clip->GetVideoInfo();
 
-  if (vi.IsRGB()) { // 8 bit only
+  if (vi.IsRGB()) {
+    const bool yuv420 = strcmp(filter, "ConvertToYUV420") == 0;
+    if (!args[1].AsBool(false) && (yuv420 || strcmp(filter, "ConvertToYUV422") == 0)) {
+      // matrix and chroma downsampling in one pass
+      if (args[3].Defined())
+        env->ThrowError("Convert: Input ChromaPlacement only available with 4:2:0 source.");
+      return new ConvertRGBToYUVResampled(clip, getMatrix(args[2].AsString(0), env), yuv420, yuv420 ? args[5] : AVSValue(), args[4], env);
+    }
     clip = new ConvertRGBToYV24(clip, getMatrix(args[2].AsString(0), env), env);
     vi = clip->GetVideoInfo();
   }
@@ -1708,11 +2540,9 @@ AVSValue ConvertToPlanarGeneric::Create(AVSValue& args, const char* filter, IScr
     else if (vi.ComponentSize() == 4) pixel_type = VideoInfo::CS_YUV422PS;
   }
   else if (strcmp(filter, "ConvertToYUV444") == 0) {
-    if (vi.IsYV24() || vi.IsColorSpace(VideoInfo::CS_YUV444P16) || vi.IsColorSpace(VideoInfo::CS_YUV444PS))
+    if (vi.Is444())
       return clip;
-    if (vi.ComponentSize() == 1) pixel_type = VideoInfo::CS_YV24;
-    else if (vi.ComponentSize() == 2) pixel_type = VideoInfo::CS_YUV444P16;
-    else if (vi.ComponentSize() == 4) pixel_type = VideoInfo::CS_YUV444PS;
+    pixel_type = planar_pixel_type(VideoInfo::CS_GENERIC_YUV444, vi.BitsPerComponent()); // keeps 10-14 bit
   }
   else if (strcmp(filter, "ConvertToYV411") == 0) {
     if (vi.IsYV411()) return clip;
@@ -80,6 +80,15 @@ struct ConversionMatrix {
   int offset_y;
 };
 
+// Float matrix for the planar RGB <-> YUV 4:4:4 paths (8-16 bit, float, RGB48/64).
+// out[i] = coef[i][0]*in[0] + coef[i][1]*in[1] + coef[i][2]*in[2] + offset[i]
+// in/out are R,G,B or Y,U,V in native pixel units. For integer output
+// offset[] already contains the +0.5 rounding term.
+struct PlanarConversionMatrix {
+  float coef[3][3];
+  float offset[3];
+};
+
 class ConvertRGBToYV24 : public GenericVideoFilter
 {
 public:
@@ -94,7 +103,11 @@ public:
 private:
   void BuildMatrix(double Kr, double Kb, int Sy, int Suv, int Oy, int shift);
   ConversionMatrix matrix;
+  PlanarConversionMatrix matrix_f;
   int pixel_step;
+  bool planar_path; // planar RGB or RGB48/64 source
+  bool has_alpha;
+  int bits_per_pixel;
 };
 
 class ConvertYUY2ToYV16 : public GenericVideoFilter
@@ -125,7 +138,59 @@ public:
 private:
   void BuildMatrix(double Kr, double Kb, int Sy, int Suv, int Oy, int shift);
   ConversionMatrix matrix;
-  int pixel_step;
+  PlanarConversionMatrix matrix_f;
+  int pixel_step; // 3, 4: RGB24/32, 6, 8: RGB48/64, 0: planar RGB, -1: planar RGBA
+  bool planar_path; // high bit depth source or planar RGB / RGB48/64 target
+  int yuv_bits;
+  int rgb_bits;
+};
+
+struct ResamplingProgram;
+
+// 4:2:0/4:2:2 -> RGB, chroma upsampling and matrix in one pass
+class ConvertYUVToRGBResampled : public GenericVideoFilter
+{
+public:
+  ConvertYUVToRGBResampled(PClip src, int matrix, int pixel_step, const AVSValue& InPlacement,
+                           const AVSValue& ChromaResampler, IScriptEnvironment* env);
+  ~ConvertYUVToRGBResampled();
+  PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+
+  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+    return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+  }
+
+private:
+  PlanarConversionMatrix matrix_f;
+  ResamplingProgram* program_h[2]; // U, V
+  ResamplingProgram* program_v[2]; // NULL for 4:2:2
+  int pixel_step; // as in ConvertYV24ToRGB
+  int src_pixelsize;
+  int yuv_bits;
+  int rgb_bits;
+};
+
+// RGB -> 4:2:0/4:2:2, matrix and chroma downsampling in one pass
+class ConvertRGBToYUVResampled : public GenericVideoFilter
+{
+public:
+  ConvertRGBToYUVResampled(PClip src, int matrix, bool yuv420, const AVSValue& OutPlacement,
+                           const AVSValue& ChromaResampler, IScriptEnvironment* env);
+  ~ConvertRGBToYUVResampled();
+  PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+
+  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+    return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+  }
+
+private:
+  PlanarConversionMatrix matrix_f;
+  ResamplingProgram* program_h[2]; // U, V
+  ResamplingProgram* program_v[2]; // NULL for 4:2:2
+  int ring_size; // chroma lines kept for the vertical filter
+  int pixel_step; // 0: planar RGB
+  int src_pixelsize;
+  int bits_per_pixel;
 };
 
 class ConvertYV16ToYUY2 : public GenericVideoFilter
@@ -0,0 +1,109 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// This file is compiled with AVX2 enabled, see CMakeLists.txt.
+
+#include "convert_planar_avx2.h"
+#include <immintrin.h>
+#include <stdint.h>
+
+
+/*****************************************
+ ***  Planar RGB <-> YUV 4:4:4 matrix  ***
+ *****************************************/
+
+template<typename pixel_t>
+static __forceinline __m256 load_8_pixels_avx2(const BYTE* srcp) {
+  if (sizeof(pixel_t) == 1)
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcp))));
+  if (sizeof(pixel_t) == 2)
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp))));
+  return _mm256_loadu_ps(reinterpret_cast<const float*>(srcp));
+}
+
+template<typename pixel_t>
+static __forceinline void store_8_pixels_avx2(BYTE* dstp, const __m256 &value, const __m256 &max_pixel_value) {
+  if (sizeof(pixel_t) == 4) {
+    _mm256_storeu_ps(reinterpret_cast<float*>(dstp), value);
+    return;
+  }
+  // offset holds the rounder, clamp and truncate like the C code
+  __m256i result = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), max_pixel_value));
+  __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+  if (sizeof(pixel_t) == 1)
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp), _mm_packus_epi16(packed, packed));
+  else
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp), packed);
+}
+
+template<typename dst_t, typename src_t>
+static size_t convert_planar_matrix_row_avx2(BYTE* const* dstp, const BYTE* const* srcp, size_t width, const PlanarConversionMatrix &m, int max_pixel_value) {
+  __m256 coef[3][3], offset[3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++)
+      coef[i][j] = _mm256_set1_ps(m.coef[i][j]);
+    offset[i] = _mm256_set1_ps(m.offset[i]);
+  }
+  __m256 max_value = _mm256_set1_ps((float)max_pixel_value);
+
+  const size_t mod8_width = width / 8 * 8;
+  for (size_t x = 0; x < mod8_width; x += 8) {
+    __m256 in0 = load_8_pixels_avx2<src_t>(srcp[0] + x * sizeof(src_t));
+    __m256 in1 = load_8_pixels_avx2<src_t>(srcp[1] + x * sizeof(src_t));
+    __m256 in2 = load_8_pixels_avx2<src_t>(srcp[2] + x * sizeof(src_t));
+    for (int i = 0; i < 3; i++) {
+      __m256 result = _mm256_add_ps(_mm256_mul_ps(coef[i][0], in0), _mm256_mul_ps(coef[i][1], in1));
+      result = _mm256_add_ps(_mm256_add_ps(result, _mm256_mul_ps(coef[i][2], in2)), offset[i]);
+      store_8_pixels_avx2<dst_t>(dstp[i] + x * sizeof(dst_t), result, max_value);
+    }
+  }
+  return mod8_width;
+}
+
+template<typename dst_t>
+static size_t convert_planar_matrix_row_avx2(BYTE* const* dstp, const BYTE* const* srcp, size_t width, int src_pixelsize, const PlanarConversionMatrix &m, int max_pixel_value) {
+  switch (src_pixelsize) {
+  case 1: return convert_planar_matrix_row_avx2<dst_t, uint8_t>(dstp, srcp, width, m, max_pixel_value);
+  case 2: return convert_planar_matrix_row_avx2<dst_t, uint16_t>(dstp, srcp, width, m, max_pixel_value);
+  default: return convert_planar_matrix_row_avx2<dst_t, float>(dstp, srcp, width, m, max_pixel_value);
+  }
+}
+
+size_t convert_planar_matrix_row_avx2(BYTE* const* dstp, const BYTE* const* srcp, size_t width, int dst_pixelsize, int src_pixelsize, const PlanarConversionMatrix &m, int max_pixel_value) {
+  switch (dst_pixelsize) {
+  case 1: return convert_planar_matrix_row_avx2<uint8_t>(dstp, srcp, width, src_pixelsize, m, max_pixel_value);
+  case 2: return convert_planar_matrix_row_avx2<uint16_t>(dstp, srcp, width, src_pixelsize, m, max_pixel_value);
+  default: return convert_planar_matrix_row_avx2<float>(dstp, srcp, width, src_pixelsize, m, max_pixel_value);
+  }
+}
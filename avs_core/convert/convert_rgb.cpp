@@ -49,6 +49,7 @@ RGB24to32::RGB24to32(PClip src)
 }
 
 //todo: think how to port to sse2 without tons of shuffles or (un)packs
+AVS_TARGET("ssse3")
 static void convert_rgb24_to_rgb32_ssse3(const BYTE *srcp, BYTE *dstp, size_t src_pitch, size_t dst_pitch, size_t width, size_t height) {
   size_t mod16_width = (width + 3) & (~size_t(15)); //when the modulo is more than 13, a problem does not happen
 #pragma warning(push)
@@ -176,6 +177,7 @@ RGB32to24::RGB32to24(PClip src)
 }
 
 //todo: think how to port to sse2 without tons of shuffles or (un)packs
+AVS_TARGET("ssse3")
 static void convert_rgb32_to_rgb24_ssse3(const BYTE *srcp, BYTE *dstp, size_t src_pitch, size_t dst_pitch, size_t width, size_t height) {
   size_t mod16_width = (width + 3) & (~size_t(15)); //when the modulo is more than 13, a problem does not happen
   __m128i mask0 = _mm_set_epi8(14, 13, 12, 10, 9, 8, 6, 5, 4, 2, 1, 0, 15, 11, 7, 3);
@@ -298,3 +300,46 @@ PVideoFrame __stdcall RGB32to24::GetFrame(int n, IScriptEnvironment* env)
   return dst;
 }
 
+
+
+PlanarRGBtoPacked::PlanarRGBtoPacked(PClip src, bool rgb32)
+  : GenericVideoFilter(src)
+{
+  vi.pixel_type = rgb32 ? VideoInfo::CS_BGR32 : VideoInfo::CS_BGR24;
+}
+
+static void convert_planarrgb_to_packed_c(const BYTE *srcp_g, const BYTE *srcp_b, const BYTE *srcp_r, const BYTE *srcp_a,
+                                          BYTE *dstp, size_t src_pitch, size_t src_pitch_a, size_t dst_pitch,
+                                          size_t width, size_t height, int pixel_step) {
+  // packed RGB is upside-down
+  dstp += dst_pitch * (height - 1);
+
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      dstp[x*pixel_step+0] = srcp_b[x];
+      dstp[x*pixel_step+1] = srcp_g[x];
+      dstp[x*pixel_step+2] = srcp_r[x];
+      if (pixel_step == 4)
+        dstp[x*4+3] = srcp_a ? srcp_a[x] : 255;
+    }
+    srcp_g += src_pitch;
+    srcp_b += src_pitch;
+    srcp_r += src_pitch;
+    if (srcp_a)
+      srcp_a += src_pitch_a;
+    dstp -= dst_pitch;
+  }
+}
+
+PVideoFrame __stdcall PlanarRGBtoPacked::GetFrame(int n, IScriptEnvironment* env)
+{
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame dst = env->NewVideoFrame(vi);
+  const bool has_alpha = child->GetVideoInfo().IsPlanarRGBA();
+
+  convert_planarrgb_to_packed_c(src->GetReadPtr(PLANAR_G), src->GetReadPtr(PLANAR_B), src->GetReadPtr(PLANAR_R),
+                                has_alpha ? src->GetReadPtr(PLANAR_A) : nullptr, dst->GetWritePtr(),
+                                src->GetPitch(PLANAR_G), has_alpha ? src->GetPitch(PLANAR_A) : 0, dst->GetPitch(),
+                                vi.width, vi.height, vi.IsRGB32() ? 4 : 3);
+  return dst;
+}
@@ -68,4 +68,20 @@ public:
 };
 
 
+class PlanarRGBtoPacked : public GenericVideoFilter
+/**
+  * 8 bit planar RGB(A) -> RGB24/RGB32, samples copied as they are.
+  * Alpha is 255 when the source has none.
+  */
+{
+public:
+  PlanarRGBtoPacked(PClip src, bool rgb32);
+  PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+
+  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+    return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+  }
+};
+
+
 #endif  // __Convert_RGB_H__
@@ -280,7 +280,7 @@ private:
     T *mutex_;
 }; 
 
-MTGuardExit::MTGuardExit(PClip &clip) :
+MTGuardExit::MTGuardExit(const PClip &clip) :
     NonCachedGenericVideoFilter(clip)
 {}
 
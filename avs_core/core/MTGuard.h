@@ -50,7 +50,7 @@ private:
     MTGuard *guard = nullptr;
 
 public:
-    MTGuardExit(PClip &clip);
+    MTGuardExit(const PClip &clip);
     void Activate(PClip &with_guard);
 
     PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
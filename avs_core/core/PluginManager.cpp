@@ -5,6 +5,17 @@
 #include "strings.h"
 #include "InternalEnvironment.h"
 #include <cassert>
+#ifdef AVS_POSIX
+#include <dlfcn.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// dlfcn equivalents of the Win32 loader calls used below
+#define FreeLibrary(lib) dlclose(lib)
+#define GetProcAddress(lib, name) dlsym((lib), (name))
+#endif
 
 typedef const char* (__stdcall *AvisynthPluginInit3Func)(IScriptEnvironment* env, const AVS_Linkage* const vectors);
 typedef const char* (__stdcall *AvisynthPluginInit2Func)(IScriptEnvironment* env);
@@ -22,6 +33,7 @@ const char RegPluginDirPlus[] = "PluginDir+";
 ---------------------------------------------------------------------------------
 */
 
+#ifdef AVS_WINDOWS
 // Translates a Windows error code to a human-readable text message.
 static std::string GetLastErrorText(DWORD nErrorCode)
 {
@@ -61,9 +73,11 @@ static bool GetRegString(HKEY rootKey, const char path[], const char entry[], st
     delete[] retStr;
     return true;
 }
+#endif // AVS_WINDOWS
 
 static std::string GetFullPathNameWrap(const std::string &f)
 {
+#ifdef AVS_WINDOWS
   // Get the lenght of the buffer we need
   DWORD len = GetFullPathName(f.c_str(), 0, NULL, NULL);
 
@@ -77,6 +91,53 @@ static std::string GetFullPathNameWrap(const std::string &f)
   // Cleanup and return
   delete [] fullPathName;
   return result;
+#else
+  // realpath only resolves existing paths, anything else is kept as it is
+  char fullPathName[AVS_MAX_PATH];
+  if (realpath(f.c_str(), fullPathName) == NULL)
+    return f;
+
+  // Keep the terminating slash of directory paths like GetFullPathName does
+  std::string result(fullPathName);
+  if (!f.empty() && f[f.size()-1] == '/' && result[result.size()-1] != '/')
+    result.append("/");
+  return result;
+#endif
+}
+
+// Names of the files (not directories) in dir matching the wildcard pattern.
+// dir must end with a slash.
+static std::vector<std::string> FindFiles(const std::string &dir, const char *pattern)
+{
+  std::vector<std::string> files;
+#ifdef AVS_WINDOWS
+  WIN32_FIND_DATA fileData;
+  HANDLE hFind = FindFirstFile(concat(dir, pattern).c_str(), &fileData);
+  for (BOOL bContinue = (hFind != INVALID_HANDLE_VALUE);
+        bContinue;
+        bContinue = FindNextFile(hFind, &fileData)
+      )
+  {
+    if ((fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)  // do not add directories
+      files.push_back(fileData.cFileName);
+  }
+  if (hFind != INVALID_HANDLE_VALUE)
+    FindClose(hFind);
+#else
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return files;
+  while (struct dirent *entry = readdir(d))
+  {
+    struct stat st;
+    if (fnmatch(pattern, entry->d_name, 0) == 0
+      && stat(concat(dir, entry->d_name).c_str(), &st) == 0
+      && !S_ISDIR(st.st_mode))  // do not add directories
+      files.push_back(entry->d_name);
+  }
+  closedir(d);
+#endif
+  return files;
 }
 
 static bool IsParameterTypeSpecifier(char c) {
@@ -426,9 +487,14 @@ void PluginManager::AddAutoloadDir(const std::string &dirPath, bool toFront)
   std::string dir(dirPath);
 
   // get folder of our executable
-  TCHAR ExeFilePath[AVS_MAX_PATH];
+  char ExeFilePath[AVS_MAX_PATH];
   memset(ExeFilePath, 0, sizeof(ExeFilePath[0])*AVS_MAX_PATH);  // WinXP does not terminate the result of GetModuleFileName with a zero, so me must zero our buffer
+#ifdef AVS_WINDOWS
   GetModuleFileName(NULL, ExeFilePath, AVS_MAX_PATH);
+#else
+  if (readlink("/proc/self/exe", ExeFilePath, AVS_MAX_PATH - 1) < 0)
+    strcpy(ExeFilePath, "./");
+#endif
   std::string ExeFileDir(ExeFilePath);
   replace(ExeFileDir, '\\', '/');
   ExeFileDir = ExeFileDir.erase(ExeFileDir.rfind('/'), std::string::npos);
@@ -438,6 +504,7 @@ void PluginManager::AddAutoloadDir(const std::string &dirPath, bool toFront)
   replace_beginning(dir, "MAINSCRIPTDIR", Env->GetVar("$MainScriptDir$", ""));
   replace_beginning(dir, "PROGRAMDIR", ExeFileDir);
 
+#ifdef AVS_WINDOWS
   std::string plugin_dir;
   if (GetRegString(HKEY_CURRENT_USER, RegAvisynthKey, RegPluginDirPlus, &plugin_dir))
     replace_beginning(dir, "USER_PLUS_PLUGINS", plugin_dir);
@@ -447,6 +514,7 @@ void PluginManager::AddAutoloadDir(const std::string &dirPath, bool toFront)
     replace_beginning(dir, "USER_CLASSIC_PLUGINS", plugin_dir);
   if (GetRegString(HKEY_LOCAL_MACHINE, RegAvisynthKey, RegPluginDirClassic, &plugin_dir))
     replace_beginning(dir, "MACHINE_CLASSIC_PLUGINS", plugin_dir);
+#endif
 
   // replace backslashes with forward slashes
   replace(dir, '\\', '/');
@@ -472,44 +540,36 @@ void PluginManager::AutoloadPlugins()
   AutoloadExecuted = true;
   Autoloading = true;
 
+#ifdef AVS_WINDOWS
   const char *binaryFilter = "*.dll";
+#else
+  const char *binaryFilter = "*.so";
+#endif
   const char *scriptFilter = "*.avsi";
 
   // Load binary plugins
   for (const std::string& dir : AutoloadDirs)
   {
-    // Append file search filter to directory path
-    std::string filePattern = concat(dir, binaryFilter);
-
     // Iterate through all files in directory
-    WIN32_FIND_DATA fileData;
-    HANDLE hFind = FindFirstFile(filePattern.c_str(), &fileData);
-    for (BOOL bContinue = (hFind != INVALID_HANDLE_VALUE);
-          bContinue;
-          bContinue = FindNextFile(hFind, &fileData)
-        )
+    for (const std::string& fileName : FindFiles(dir, binaryFilter))
     {
-      if ((fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)  // do not add directories
-      {
-        PluginFile p(concat(dir, fileData.cFileName));
+      PluginFile p(concat(dir, fileName));
 
-        // Search for loaded plugins with the same base name.
-        for (size_t i = 0; i < AutoLoadedPlugins.size(); ++i)
+      // Search for loaded plugins with the same base name.
+      for (size_t i = 0; i < AutoLoadedPlugins.size(); ++i)
+      {
+        if (streqi(AutoLoadedPlugins[i].BaseName.c_str(), p.BaseName.c_str()))
         {
-          if (streqi(AutoLoadedPlugins[i].BaseName.c_str(), p.BaseName.c_str()))
-          {
-            // Prevent loading a plugin with a basename that is 
-            // already loaded (from another autoload folder).
-            continue;
-          }
+          // Prevent loading a plugin with a basename that is 
+          // already loaded (from another autoload folder).
+          continue;
         }
-
-        // Try to load plugin
-        AVSValue dummy;
-        LoadPlugin(p, false, &dummy);
       }
-    } // for bContinue
-    FindClose(hFind);
+
+      // Try to load plugin
+      AVSValue dummy;
+      LoadPlugin(p, false, &dummy);
+    }
   }
 
   // Load script imports
@@ -517,38 +577,26 @@ void PluginManager::AutoloadPlugins()
   {
     CWDChanger cwdchange(dir.c_str());
 
-    // Append file search filter to directory path
-    std::string filePattern = concat(dir, scriptFilter);
-
     // Iterate through all files in directory
-    WIN32_FIND_DATA fileData;
-    HANDLE hFind = FindFirstFile(filePattern.c_str(), &fileData);
-    for (BOOL bContinue = (hFind != INVALID_HANDLE_VALUE);
-          bContinue;
-          bContinue = FindNextFile(hFind, &fileData)
-        )
+    for (const std::string& fileName : FindFiles(dir, scriptFilter))
     {
-      if ((fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)  // do not add directories
-      {
-        PluginFile p(concat(dir, fileData.cFileName));
+      PluginFile p(concat(dir, fileName));
 
-        // Search for loaded imports with the same base name.
-        for (size_t i = 0; i < AutoLoadedImports.size(); ++i)
+      // Search for loaded imports with the same base name.
+      for (size_t i = 0; i < AutoLoadedImports.size(); ++i)
+      {
+        if (streqi(AutoLoadedImports[i].BaseName.c_str(), p.BaseName.c_str()))
         {
-          if (streqi(AutoLoadedImports[i].BaseName.c_str(), p.BaseName.c_str()))
-          {
-            // Prevent loading a plugin with a basename that is 
-            // already loaded (from another autoload folder).
-            continue;
-          }
+          // Prevent loading a plugin with a basename that is 
+          // already loaded (from another autoload folder).
+          continue;
         }
-
-        // Try to load script
-        Env->Invoke("Import", p.FilePath.c_str());
-        AutoLoadedImports.push_back(p);
       }
-    } // for bContinue
-    FindClose(hFind);
+
+      // Try to load script
+      Env->Invoke("Import", p.FilePath.c_str());
+      AutoLoadedImports.push_back(p);
+    }
   }
 
   Autoloading = false;
@@ -618,7 +666,8 @@ void PluginManager::UpdateFunctionExports(const char* funcName, const char* func
 
 bool PluginManager::LoadPlugin(const char* path, bool throwOnError, AVSValue *result)
 {
-  return LoadPlugin(PluginFile(path), throwOnError, result);
+  PluginFile plugin(path);
+  return LoadPlugin(plugin, throwOnError, result);
 }
 
 bool PluginManager::LoadPlugin(PluginFile &plugin, bool throwOnError, AVSValue *result)
@@ -641,13 +690,21 @@ bool PluginManager::LoadPlugin(PluginFile &plugin, bool throwOnError, AVSValue *
   DllDirChanger dllchange(plugin_dir.c_str());
 
   // Load the dll into memory
+#ifdef AVS_WINDOWS
   plugin.Library = LoadLibraryEx(plugin.FilePath.c_str(), 0, LOAD_WITH_ALTERED_SEARCH_PATH);
+#else
+  plugin.Library = dlopen(plugin.FilePath.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
   if (plugin.Library == NULL)
   {
     if (throwOnError)
     {
+#ifdef AVS_WINDOWS
       DWORD errCode = GetLastError();
       Env->ThrowError("Cannot load file '%s'. Platform returned code %d:\n%s", plugin.FilePath.c_str(), errCode, GetLastErrorText(errCode).c_str());
+#else
+      Env->ThrowError("Cannot load file '%s'. Platform returned:\n%s", plugin.FilePath.c_str(), dlerror());
+#endif
     }
     else
       return false;
@@ -827,7 +884,7 @@ bool PluginManager::TryAsAvs25(PluginFile &plugin, AVSValue *result)
 
 bool PluginManager::TryAsAvsC(PluginFile &plugin, AVSValue *result)
 {
-#ifdef _WIN64
+#if defined(_WIN64) || defined(AVS_POSIX)
   AvisynthCPluginInitFunc AvisynthCPluginInit = (AvisynthCPluginInitFunc)GetProcAddress(plugin.Library, "avisynth_c_plugin_init");
   if (!AvisynthCPluginInit)
     AvisynthCPluginInit = (AvisynthCPluginInitFunc)GetProcAddress(plugin.Library, "_avisynth_c_plugin_init@4");
@@ -848,7 +905,7 @@ bool PluginManager::TryAsAvsC(PluginFile &plugin, AVSValue *result)
         AVS_ScriptEnvironment *pe;
         pe = &e;
         const char *s = NULL;
-#ifdef X86_32
+#if defined(X86_32) && defined(_MSC_VER)
         int callok = 1; // (stdcall)
         __asm // Tritical - Jan 2006
         {
@@ -2,6 +2,7 @@
 
 #include <mutex>
 #include <atomic>
+#include <thread>
 #include <avisynth.h>
 #include "ThreadPool.h"
 #include "ObjectPool.h"
@@ -14,6 +15,9 @@ struct PrefetcherJobParams
   int frame;
   Prefetcher* prefetcher;
   LruCache<size_t, PVideoFrame>::handle cache_handle;
+  bool has_cache_handle;
+  Prefetcher::FrameReadyFunc ready;   // set for FetchFrame() jobs
+  void* ready_user;
 };
 
 struct PrefetcherPimpl
@@ -27,7 +31,7 @@ struct PrefetcherPimpl
   // Maximum number of frames to prefetch
   const int nPrefetchFrames;
 
-  ThreadPool ThreadPool;
+  ::ThreadPool ThreadPool;
 
   ObjectPool<PrefetcherJobParams> JobParamsPool;
   std::mutex params_pool_mutex;
@@ -85,12 +89,51 @@ AVSValue Prefetcher::ThreadWorker(IScriptEnvironment2* env, void* data)
   Prefetcher *prefetcher = ptr->prefetcher;
   int n = ptr->frame;
   LruCache<size_t, PVideoFrame>::handle cache_handle = ptr->cache_handle;
+  const bool has_cache_handle = ptr->has_cache_handle;
+  const Prefetcher::FrameReadyFunc ready = ptr->ready;
+  void* const ready_user = ptr->ready_user;
 
   {
     std::lock_guard<std::mutex> lock(prefetcher->_pimpl->params_pool_mutex);
     prefetcher->_pimpl->JobParamsPool.Destruct(ptr);
   }
 
+  if (ready != NULL)
+  {
+    // Requested through FetchFrame(): errors go to the requester and do not
+    // poison the prefetcher.
+    PVideoFrame frame;
+    const char* error = NULL;
+    try
+    {
+      frame = prefetcher->_pimpl->child->GetFrame(n, env);
+      #ifdef X86_32
+            _mm_empty();
+      #endif
+      if (has_cache_handle)
+      {
+        cache_handle.first->value = frame;
+        prefetcher->_pimpl->VideoCache->commit_value(&cache_handle);
+      }
+    }
+    catch (const AvisynthError& err)
+    {
+      if (has_cache_handle)
+        prefetcher->_pimpl->VideoCache->rollback(&cache_handle);
+      error = err.msg;
+    }
+    catch (...)
+    {
+      if (has_cache_handle)
+        prefetcher->_pimpl->VideoCache->rollback(&cache_handle);
+      error = "Prefetcher: unknown exception while fetching a frame.";
+    }
+
+    ready(ready_user, n, frame, error);
+    --(prefetcher->_pimpl->running_workers);
+    return AVSValue();
+  }
+
   try
   {
     cache_handle.first->value = prefetcher->_pimpl->child->GetFrame(n, env);
@@ -124,7 +167,7 @@ Prefetcher::Prefetcher(const PClip& _child, int _nThreads) :
 Prefetcher::~Prefetcher()
 {
   while (_pimpl->running_workers > 0) {
-    __noop();
+    std::this_thread::yield();
   }
   delete _pimpl;
 }
@@ -134,6 +177,60 @@ size_t Prefetcher::NumPrefetchThreads() const
   return _pimpl->nThreads;
 }
 
+size_t Prefetcher::NumPrefetchFrames() const
+{
+  return _pimpl->nPrefetchFrames;
+}
+
+void Prefetcher::FetchFrame(int n, FrameReadyFunc ready, void* user, IScriptEnvironment* env)
+{
+  InternalEnvironment *envi = static_cast<InternalEnvironment*>(env);
+
+  LruCache<size_t, PVideoFrame>::handle cache_handle;
+  bool has_cache_handle = false;
+  switch(_pimpl->VideoCache->lookup(n, &cache_handle, false))
+  {
+  case LRU_LOOKUP_FOUND_AND_READY:
+    {
+      ready(user, n, cache_handle.first->value, NULL);
+      return;
+    }
+  case LRU_LOOKUP_NOT_FOUND:
+    {
+      has_cache_handle = true;
+      break;
+    }
+  case LRU_LOOKUP_FOUND_BUT_NOTAVAIL:   // Fall-through intentional
+  case LRU_LOOKUP_NO_CACHE:
+    {
+      // Someone else is already producing the frame, or it won't be cached.
+      // Waiting on the cache entry from a worker could stall the pool, so
+      // fetch it uncached; the caches further down the chain absorb the repeat.
+      cache_handle = LruCache<size_t, PVideoFrame>::handle();
+      break;
+    }
+  default:
+    {
+      assert(0);
+      break;
+    }
+  }
+
+  PrefetcherJobParams *p = NULL;
+  {
+    std::lock_guard<std::mutex> lock(_pimpl->params_pool_mutex);
+    p = _pimpl->JobParamsPool.Construct();
+  }
+  p->frame = n;
+  p->prefetcher = this;
+  p->cache_handle = cache_handle;
+  p->has_cache_handle = has_cache_handle;
+  p->ready = ready;
+  p->ready_user = user;
+  ++_pimpl->running_workers;
+  _pimpl->ThreadPool.QueueJob(ThreadWorker, p, envi, NULL);
+}
+
 int __stdcall Prefetcher::SchedulePrefetch(int current_n, int prefetch_start, InternalEnvironment* env)
 {
   int n = prefetch_start;
@@ -157,6 +254,9 @@ int __stdcall Prefetcher::SchedulePrefetch(int current_n, int prefetch_start, In
         p->frame = n;
         p->prefetcher = this;
         p->cache_handle = cache_handle;
+        p->has_cache_handle = true;
+        p->ready = NULL;
+        p->ready_user = NULL;
         ++_pimpl->running_workers;
         _pimpl->ThreadPool.QueueJob(ThreadWorker, p, env, NULL);
         break;
@@ -315,6 +415,11 @@ int __stdcall Prefetcher::SetCacheHints(int cachehints, int frame_range)
   if (CACHE_GET_MTMODE == cachehints)
     return MT_NICE_FILTER;
 
+  // We keep our own frame cache. Staying unwrapped also lets C API hosts
+  // hand batched requests straight to us.
+  if (CACHE_DONT_CACHE_ME == cachehints)
+    return 1;
+
   return 0;
 }
 
@@ -17,8 +17,17 @@ private:
   Prefetcher(const PClip& _child, int _nThreads);
 
 public:
+  // Completion callback of FetchFrame(). On failure frame is null and error is set.
+  typedef void (*FrameReadyFunc)(void* user, int n, const PVideoFrame& frame, const char* error);
+
   ~Prefetcher();
   size_t NumPrefetchThreads() const;
+  size_t NumPrefetchFrames() const;
+
+  // Fetches frame n on a prefetch worker, sharing the prefetch cache with GetFrame().
+  // Counts against the prefetch window, so pattern prefetching backs off meanwhile.
+  // A frame that is already cached is reported before this returns.
+  void FetchFrame(int n, FrameReadyFunc ready, void* user, IScriptEnvironment* env);
   virtual PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
   virtual bool __stdcall GetParity(int n);
   virtual void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
@@ -15,7 +15,7 @@ private:
   const size_t thread_id;
   VarTable* global_var_table;
   VarTable* var_table;
-  BufferPool BufferPool;
+  ::BufferPool BufferPool;
 
 public:
   ScriptEnvironmentTLS(size_t _thread_id) : 
@@ -270,7 +270,7 @@ public:
     core->ThrowError("Cannot delete environment from a TLS proxy.");
   }
 
-  void _stdcall ApplyMessage(PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, int textcolor, int halocolor, int bgcolor)
+  void __stdcall ApplyMessage(PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, int textcolor, int halocolor, int bgcolor)
   {
     core->ApplyMessage(frame, vi, message, size, textcolor, halocolor, bgcolor);
   }
@@ -146,10 +146,10 @@ public:
     if (Cache.size() > RealCapacity)
     {
       size_t nItemsToDelete = Cache.size() - RealCapacity;
-      std::list<Entry>::iterator it = --Cache.end();
+      typename std::list<Entry>::iterator it = --Cache.end();
       for (size_t i = 0; i < nItemsToDelete; ++i)
       {
-        std::list<Entry>::iterator prev_it;
+        typename std::list<Entry>::iterator prev_it;
         bool end = (it == Cache.begin());
         if (!end)
         {
@@ -38,9 +38,14 @@
 #include "internal.h"
 
 #include "audio.h"
+#include "audio_avx2.h"
 #include "../convert/convert_audio.h"
+#include <climits>
 #include <cstdio>
+#include <algorithm>
 #include <new>
+#include <vector>
+#include <smmintrin.h>
 
 #define BIGBUFFSIZE (2048*1024) // Use a 2Mb buffer for EnsureVBRMP3Sync seeking & Normalize scanning
 
@@ -85,17 +90,17 @@ extern const AVSFunction Audio_filters[] = {
                                 { "AmplifydB", BUILTIN_FUNC_PREFIX, "cf+", Amplify::Create_dB },
                                 { "Amplify", BUILTIN_FUNC_PREFIX, "cf+", Amplify::Create },
                                 { "AssumeSampleRate", BUILTIN_FUNC_PREFIX, "ci", AssumeRate::Create },
-                                { "Normalize", BUILTIN_FUNC_PREFIX, "c[volume]f[show]b", Normalize::Create },
-                                { "MixAudio", BUILTIN_FUNC_PREFIX, "cc[clip1_factor]f[clip2_factor]f", MixAudio::Create },
+                                { "Normalize", BUILTIN_FUNC_PREFIX, "c[volume]f[show]b[peakfile]s", Normalize::Create },
+                                { "MixAudio", BUILTIN_FUNC_PREFIX, "cc[clip1_factor]f[clip2_factor]f", ChannelMixer::Create_mix },
                                 { "ResampleAudio", BUILTIN_FUNC_PREFIX, "ci[]i", ResampleAudio::Create },
-                                { "ConvertToMono", BUILTIN_FUNC_PREFIX, "c", ConvertToMono::Create },
+                                { "ConvertToMono", BUILTIN_FUNC_PREFIX, "c", ChannelMixer::Create_mono },
                                 { "EnsureVBRMP3Sync", BUILTIN_FUNC_PREFIX, "c", EnsureVBRMP3Sync::Create },
-                                { "MergeChannels", BUILTIN_FUNC_PREFIX, "c+", MergeChannels::Create },
-                                { "MonoToStereo", BUILTIN_FUNC_PREFIX, "cc", MergeChannels::Create },
-                                { "GetLeftChannel", BUILTIN_FUNC_PREFIX, "c", GetChannel::Create_left },
-                                { "GetRightChannel", BUILTIN_FUNC_PREFIX, "c", GetChannel::Create_right },
-                                { "GetChannel", BUILTIN_FUNC_PREFIX, "ci+", GetChannel::Create_n },
-                                { "GetChannels", BUILTIN_FUNC_PREFIX, "ci+", GetChannel::Create_n },     // Alias to ease use!
+                                { "MergeChannels", BUILTIN_FUNC_PREFIX, "c+", ChannelMixer::Create_merge },
+                                { "MonoToStereo", BUILTIN_FUNC_PREFIX, "cc", ChannelMixer::Create_merge },
+                                { "GetLeftChannel", BUILTIN_FUNC_PREFIX, "c", ChannelMixer::Create_left },
+                                { "GetRightChannel", BUILTIN_FUNC_PREFIX, "c", ChannelMixer::Create_right },
+                                { "GetChannel", BUILTIN_FUNC_PREFIX, "ci+", ChannelMixer::Create_n },
+                                { "GetChannels", BUILTIN_FUNC_PREFIX, "ci+", ChannelMixer::Create_n },     // Alias to ease use!
                                 { "KillVideo", BUILTIN_FUNC_PREFIX, "c", KillVideo::Create },
                                 { "KillAudio", BUILTIN_FUNC_PREFIX, "c", KillAudio::Create },
                                 { "ConvertAudioTo16bit", BUILTIN_FUNC_PREFIX, "c", ConvertAudio::Create_16bit },   // in convertaudio.cpp
@@ -168,75 +173,6 @@ AVSValue __cdecl AssumeRate::Create(AVSValue args, void*, IScriptEnvironment*) {
 
 
 
-/******************************************
- *******   Convert Audio -> Mono     ******
- *******   Supports int16 & float    ******
- *****************************************/
-
-ConvertToMono::ConvertToMono(PClip _clip) :
-  GenericVideoFilter(ConvertAudio::Create(_clip, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
-  tempbuffer(NULL)
-{
-  channels = vi.AudioChannels();
-  vi.nchannels = 1;
-  tempbuffer_size = 0;
-}
-
-
-void __stdcall ConvertToMono::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (tempbuffer_size) {
-    if (tempbuffer_size < count) {
-      delete[] tempbuffer;
-      tempbuffer = new char[(unsigned)(count * channels * vi.BytesPerChannelSample())];
-      tempbuffer_size = (int)count;
-    }
-  } else {
-    tempbuffer = new char[(unsigned)(count * channels * vi.BytesPerChannelSample())];
-    tempbuffer_size = (int)count;
-  }
-
-  child->GetAudio(tempbuffer, start, count, env);
-
-  if (vi.IsSampleType(SAMPLE_INT16)) {
-    signed short* samples = (signed short*)buf;
-    signed short* tempsamples = (signed short*)tempbuffer;
-    const int rchannels = 65536 / channels;
-
-    for (int i = 0; i < (int)count; i++) { // Defeat slow default "(__int64)i < count"
-      int tsample = 0;
-      for (int j = 0 ; j < channels; j++)
-        tsample += *tempsamples++; // Accumulate samples
-      samples[i] = (signed short)((tsample * rchannels + 32768) >> 16); // tsample * (1/channels) + 0.5
-    }
-  }
-  else if (vi.IsSampleType(SAMPLE_FLOAT)) {
-    SFLOAT* samples = (SFLOAT*)buf;
-    SFLOAT* tempsamples = (SFLOAT*)tempbuffer;
-    const SFLOAT f_rchannels = SFLOAT(1.0 / channels);
-
-    for (int i = 0; i < (int)count; i++) { // Defeat slow default "(__int64)i < count"
-      SFLOAT tsample = 0.0f;
-      for (int j = 0 ; j < channels; j++)
-        tsample += *tempsamples++; // Accumulate samples
-      samples[i] = (tsample * f_rchannels);
-    }
-  }
-}
-
-
-PClip ConvertToMono::Create(PClip clip) {
-  if (!clip->GetVideoInfo().HasAudio())
-    return clip;
-  if (clip->GetVideoInfo().AudioChannels() == 1)
-    return clip;
-  else
-    return new ConvertToMono(clip);
-}
-
-AVSValue __cdecl ConvertToMono::Create(AVSValue args, void*, IScriptEnvironment*) {
-  return Create(args[0].AsClip());
-}
-
 /******************************************
  *******   Ensure VBR mp3 sync,      ******
  *******    by always reading audio  ******
@@ -308,290 +244,476 @@ AVSValue __cdecl EnsureVBRMP3Sync::Create(AVSValue args, void*, IScriptEnvironme
 
 
 /*******************************************
- *******   Mux 'N' sources, so the      ****
- *******   total channels is the sum of ****
- *******   the channels in the 'N' clip ****
+ *******   Channel routing and mixing  *****
  *******************************************/
 
-MergeChannels::MergeChannels(PClip _clip, int _num_children, PClip* _child_array, IScriptEnvironment* env) :
-  GenericVideoFilter(_clip), num_children(_num_children), child_array(_child_array), tempbuffer(NULL)
-{
-  clip_channels = new int[num_children];
-  clip_offset = new signed char * [num_children];
-  clip_channels[0] = vi.AudioChannels();
-
-  for (int i = 1;i < num_children;i++) {
-    PClip tclip = child_array[i];
-    child_array[i] = ConvertAudio::Create(tclip, vi.SampleType(), vi.SampleType());  // Clip 2 should now be same type as clip 1.
-    const VideoInfo& vi2 = child_array[i]->GetVideoInfo();
-
-    if (vi.audio_samples_per_second != vi2.audio_samples_per_second) {
-      env->ThrowError("MergeChannels: Clips must have same sample rate! Use ResampleAudio()!");  // Could be removed for fun :)
-    }
-    if (vi.SampleType() != vi2.SampleType())
-      env->ThrowError("MergeChannels: Clips must have same sample type! Use ConvertAudio()!");    // Should never happend!
-    clip_channels[i] = vi2.AudioChannels();
-    vi.nchannels += vi2.AudioChannels();
-  }
+// ConvertToMono, GetChannel, MergeChannels and MixAudio are all expressed as
+// a list of weighted input channels per output channel. The mixer is not
+// cached and MT safe, so a mixer created on top of another one sees it
+// directly and the two are folded into one mapping. Children that are not
+// used by the result are dropped, and every remaining child is read once.
+
+static ChannelMixer::Term make_term(int input, int channel, float weight, int weight_q17) {
+  ChannelMixer::Term t;
+  t.input = input;
+  t.channel = channel;
+  t.weight = weight;
+  t.weight_q17 = weight_q17;
+  return t;
+}
 
-  tempbuffer_size = 0;
+static bool is_copy_term(const ChannelMixer::Term& t) {
+  return t.weight == 1.0f && t.weight_q17 == (1 << 17);
 }
 
-MergeChannels::~MergeChannels() {
-  if (tempbuffer_size) {
-    delete[] tempbuffer;
-	tempbuffer_size=0;
-  }
-  delete[] clip_channels;
-  delete[] clip_offset;
-  delete[] child_array;
+static bool term_less(const ChannelMixer::Term& a, const ChannelMixer::Term& b) {
+  return a.input < b.input || (a.input == b.input && a.channel < b.channel);
 }
 
+static int find_or_add_input(std::vector<PClip>& inputs, const PClip& clip) {
+  for (size_t i = 0; i < inputs.size(); i++)
+    if ((void*)inputs[i] == (void*)clip)
+      return (int)i;
+  inputs.push_back(clip);
+  return (int)inputs.size() - 1;
+}
 
-void __stdcall MergeChannels::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (tempbuffer_size < count) {
-    if (tempbuffer_size) delete[] tempbuffer;
-    tempbuffer = new signed char[(unsigned)(count * vi.BytesPerAudioSample())];
-    tempbuffer_size = (int)count;
-  }
-  // Get audio:
-  const int channel_offset = (int)count * vi.BytesPerChannelSample();  // Offset per channel
-  int i, c_channel = 0;
 
-  for (i = 0;i < num_children;i++) {
-    child_array[i]->GetAudio(tempbuffer + (c_channel*channel_offset), start, count, env);
-    clip_offset[i] = tempbuffer + (c_channel * channel_offset);
-    c_channel += clip_channels[i];
+ChannelMixer::ChannelMixer(PClip _video, const VideoInfo& _audio_vi, const std::vector<PClip>& _inputs,
+                           const std::vector<std::vector<Term>>& _rows) :
+  NonCachedGenericVideoFilter(_video), inputs(_inputs), rows(_rows)
+{
+  vi.audio_samples_per_second = _audio_vi.audio_samples_per_second;
+  vi.sample_type = _audio_vi.sample_type;
+  vi.num_audio_samples = _audio_vi.num_audio_samples;
+  vi.nchannels = _audio_vi.nchannels;
+
+  for (size_t i = 0; i < inputs.size(); i++)
+    input_channels.push_back(inputs[i]->GetVideoInfo().AudioChannels());
+
+  is_route = true;
+  for (size_t o = 0; o < rows.size(); o++)
+    if (rows[o].size() > 1 || (rows[o].size() == 1 && !is_copy_term(rows[o][0])))
+      is_route = false;
+
+  // Every input has the output layout and contributes channel o to output o
+  // with one weight, e.g. MixAudio: a straight sum over the sample buffers.
+  is_elementwise = !inputs.empty() && !is_route;
+  for (size_t i = 0; i < inputs.size() && is_elementwise; i++)
+    if (input_channels[i] != vi.AudioChannels())
+      is_elementwise = false;
+  for (size_t o = 0; o < rows.size() && is_elementwise; o++) {
+    if (rows[o].size() != inputs.size()) {
+      is_elementwise = false;
+      break;
+    }
+    for (size_t k = 0; k < rows[o].size(); k++) {
+      const Term& t = rows[o][k];
+      if (t.input != (int)k || t.channel != (int)o
+          || t.weight != rows[0][k].weight || t.weight_q17 != rows[0][k].weight_q17) {
+        is_elementwise = false;
+        break;
+      }
+    }
   }
+}
 
-  // Interleave channels
-  char* samples = (char*) buf;
-  const int bpcs = vi.BytesPerChannelSample();
-  const int bps = vi.BytesPerAudioSample();
-  int dst_offset = 0;
-  for (i = 0;i < num_children;i++) {
-    signed char* src_buf = clip_offset[i];
-	const int bpcc = bpcs*clip_channels[i];
 
-	switch (bpcc) {
-	
-	case 2: { // mono 16 bit
-        for (int l = 0, k=dst_offset; l < count; l++, k+=bps) {
-          *(short*)(samples+k) = ((short*)src_buf)[l];
-        }
-        break;
-      }
-	case 4: { // mono float/32 bit, stereo 16 bit
-        for (int l = 0, k=dst_offset; l < count; l++, k+=bps) {
-          *(int*)(samples+k) = ((int*)src_buf)[l];
+PClip ChannelMixer::Create(PClip video, const VideoInfo& audio_vi, std::vector<PClip> inputs,
+                           std::vector<std::vector<Term>> rows)
+{
+  const bool int16 = audio_vi.IsSampleType(SAMPLE_INT16);
+  std::vector<PClip> used;
+
+  for (size_t o = 0; o < rows.size(); o++) {
+    std::vector<Term> row;
+    for (size_t k = 0; k < rows[o].size(); k++) {
+      const Term& t = rows[o][k];
+      const PClip& in = inputs[t.input];
+      ChannelMixer* m = dynamic_cast<ChannelMixer*>((IClip*)((void*)in));
+      if (m && m->vi.sample_type == audio_vi.sample_type) {
+        const std::vector<Term>& inner = m->rows[t.channel];
+        // 16 bit weights only compose exactly if one side is a plain copy
+        if (!int16 || is_copy_term(t) || (inner.size() == 1 && is_copy_term(inner[0]))) {
+          for (size_t j = 0; j < inner.size(); j++) {
+            const Term& it = inner[j];
+            const int q17 = (int)(((__int64)t.weight_q17 * it.weight_q17 + (1 << 16)) >> 17);
+            row.push_back(make_term(find_or_add_input(used, m->inputs[it.input]), it.channel, t.weight * it.weight, q17));
+          }
+          continue;
         }
-        break;
-      }
-	case 8: { // stereo float/32 bit
-#ifdef X86_32
-		if (env->GetCPUFlags() & CPUF_MMX) 
-    {
-      __asm 
-      {
-        mov eax,[src_buf]
-        mov edi,[samples]
-        mov ecx,dword ptr[count]
-        add edi,[dst_offset]
-        test ecx,ecx
-        mov edx,[bps]    ; bytes per strip
-        jz done
-        shr ecx,1        ; CF=count&1, count>>=1
-        jnc label        ; count was even
-
-        movq mm1,[eax]    ; do 1 odd quad
-        add eax,8
-        movq [edi],mm1
-        add edi,edx
-        test ecx,ecx
-        jz done
-        align 16
-      label:
-        movq mm0,[eax]    ; do pairs of quads
-        movq mm1,[eax+8]
-        add eax,16
-        movq [edi],mm0
-        movq [edi+edx],mm1
-        lea edi,[edi+edx*2]
-        loop label
-      done:
-        emms
       }
+      row.push_back(make_term(find_or_add_input(used, in), t.channel, t.weight, t.weight_q17));
     }
-		else 
-#endif // X86_32
-    {
-      for (int l = 0, k=dst_offset; l < count; l++, k+=bps) 
-      {
-        *(__int64*)(samples+k) = ((__int64*)src_buf)[l];
+
+    // merge repeated channels and drop silent ones
+    std::sort(row.begin(), row.end(), term_less);
+    std::vector<Term> merged;
+    for (size_t k = 0; k < row.size(); k++) {
+      if (!merged.empty() && merged.back().input == row[k].input && merged.back().channel == row[k].channel) {
+        merged.back().weight += row[k].weight;
+        merged.back().weight_q17 += row[k].weight_q17;
       }
+      else
+        merged.push_back(row[k]);
     }
-        break;
-      }
-	default: { // everything else, 1 byte at a time
-        for (int l = 0; l < count; l++) {
-          for (int k = 0; k < bpcc; k++) {
-            samples[dst_offset + (l*bps) + k] = src_buf[(l*bpcc) + k];
-          }
-        }
+    rows[o].clear();
+    for (size_t k = 0; k < merged.size(); k++)
+      if (merged[k].weight != 0.0f || merged[k].weight_q17 != 0)
+        rows[o].push_back(merged[k]);
+  }
+
+  // only keep the inputs that are still referenced
+  std::vector<int> remap(used.size(), -1);
+  inputs.clear();
+  for (size_t o = 0; o < rows.size(); o++) {
+    for (size_t k = 0; k < rows[o].size(); k++) {
+      Term& t = rows[o][k];
+      if (remap[t.input] < 0) {
+        remap[t.input] = (int)inputs.size();
+        inputs.push_back(used[t.input]);
       }
+      t.input = remap[t.input];
     }
-    dst_offset += bpcc;
+    std::sort(rows[o].begin(), rows[o].end(), term_less);
   }
-}
-
-
-AVSValue __cdecl MergeChannels::Create(AVSValue args, void*, IScriptEnvironment* env) {
-  int num_args;
-  PClip* child_array;
-
-  if (args[0].IsArray()) {
-    num_args = args[0].ArraySize();
-    if (num_args == 1)
-      return args[0][0];
-
-    child_array = new PClip[num_args];
-    for (int i = 0; i < num_args; ++i)
-      child_array[i] = args[0][i].AsClip();
 
-    return new MergeChannels(args[0][0].AsClip(), num_args, child_array, env);
+  // A mixer on top of a mixer only passes the frames through
+  ChannelMixer* video_mixer = dynamic_cast<ChannelMixer*>((IClip*)((void*)video));
+  if (video_mixer)
+    video = video_mixer->child;
+
+  // Nothing left to do?
+  if (inputs.size() == 1 && (void*)inputs[0] == (void*)video) {
+    const VideoInfo& vi0 = video->GetVideoInfo();
+    bool identity = vi0.AudioChannels() == audio_vi.AudioChannels()
+                 && vi0.num_audio_samples == audio_vi.num_audio_samples
+                 && vi0.sample_type == audio_vi.sample_type;
+    for (size_t o = 0; o < rows.size() && identity; o++)
+      identity = rows[o].size() == 1 && rows[o][0].channel == (int)o && is_copy_term(rows[o][0]);
+    if (identity)
+      return video;
   }
-  // MonoToStereo Case
-  num_args = 2;
-  child_array = new PClip[num_args];
-  child_array[0] = GetChannel::Create_left(args[0].AsClip());
-  child_array[1] = GetChannel::Create_right(args[1].AsClip());
 
-  return new MergeChannels(child_array[0], num_args, child_array, env);
+  return new ChannelMixer(video, audio_vi, inputs, rows);
 }
 
 
-/***************************************************
- *******   Get left or right                 *******
- *******    channel from a stereo source     *******
- ***************************************************/
-
+template<int bytes>
+static void copy_channel(BYTE* dst, size_t dst_step, const BYTE* src, size_t src_step, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    memcpy(dst, src, bytes);
+    dst += dst_step;
+    src += src_step;
+  }
+}
 
+template<int bytes>
+static void clear_channel(BYTE* dst, size_t dst_step, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    memset(dst, 0, bytes);
+    dst += dst_step;
+  }
+}
 
-GetChannel::GetChannel(PClip _clip, int* _channel, int _numchannels) :
-  GenericVideoFilter(_clip), channel(_channel), numchannels(_numchannels), tempbuffer(NULL)
-{
-  cbps = vi.BytesPerChannelSample();
-  src_bps = vi.BytesPerAudioSample();
-  vi.nchannels = numchannels;
-  tempbuffer_size = 0;
-  dst_bps = vi.BytesPerAudioSample();
+void ChannelMixer::Route(BYTE* dst, const BYTE* const* src, size_t count) {
+  const int bpcs = vi.BytesPerChannelSample();
+  const size_t dst_step = vi.BytesPerAudioSample();
+
+  for (size_t o = 0; o < rows.size(); o++) {
+    BYTE* dstp = dst + o * bpcs;
+    if (rows[o].empty()) {
+      switch (bpcs) {
+      case 1: clear_channel<1>(dstp, dst_step, count); break;
+      case 2: clear_channel<2>(dstp, dst_step, count); break;
+      case 3: clear_channel<3>(dstp, dst_step, count); break;
+      default: clear_channel<4>(dstp, dst_step, count); break;
+      }
+      continue;
+    }
+    const Term& t = rows[o][0];
+    const BYTE* srcp = src[t.input] + t.channel * bpcs;
+    const size_t src_step = (size_t)input_channels[t.input] * bpcs;
+    switch (bpcs) {
+    case 1: copy_channel<1>(dstp, dst_step, srcp, src_step, count); break;
+    case 2: copy_channel<2>(dstp, dst_step, srcp, src_step, count); break;
+    case 3: copy_channel<3>(dstp, dst_step, srcp, src_step, count); break;
+    default: copy_channel<4>(dstp, dst_step, srcp, src_step, count); break;
+    }
+  }
 }
 
+// Any matrix, one sample at a time. Only int16 and float get here.
+void ChannelMixer::Mix(BYTE* dst, const BYTE* const* src, size_t count, IScriptEnvironment* env) {
+  const size_t out_channels = rows.size();
 
-void __stdcall GetChannel::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (tempbuffer_size < count) {
-    if (tempbuffer_size) delete[] tempbuffer;
-    tempbuffer = new char[(unsigned)(count * src_bps)];
-    tempbuffer_size = (int)count;
-  }
-  child->GetAudio(tempbuffer, start, count, env);
-  
-  switch (cbps) {
-  case 1: {    // 8 bit
-      char* samples = (char*)buf;
-      char* tbuff = tempbuffer;
-      for (int i = 0; i < count; i++) {
-        for (int k = 0; k < numchannels; k++) {
-          *(samples++) = tbuff[channel[k]];
+  if (vi.IsSampleType(SAMPLE_INT16)) {
+    short* samples = (short*)dst;
+    for (size_t i = 0; i < count; i++) {
+      for (size_t o = 0; o < out_channels; o++) {
+        __int64 sum = 1 << 16;
+        for (size_t k = 0; k < rows[o].size(); k++) {
+          const Term& t = rows[o][k];
+          sum += Int32x32To64(((const short*)src[t.input])[i * input_channels[t.input] + t.channel], t.weight_q17);
         }
-        tbuff += src_bps;
+        *samples++ = (short)clamp(sum >> 17, (__int64)INT16_MIN, (__int64)INT16_MAX);
       }
-	  break;
     }
-  case 2: {    // 16 bit
-      short* samples = (short*)buf;
-      short* tbuff = (short*)tempbuffer;
-      for (int i = 0; i < count; i++) {
-        for (int k = 0; k < numchannels; k++) {
-          *(samples++) = tbuff[channel[k]];
+  }
+  else if (vi.IsSampleType(SAMPLE_FLOAT)) {
+    SFLOAT* samples = (SFLOAT*)dst;
+    for (size_t i = 0; i < count; i++) {
+      for (size_t o = 0; o < out_channels; o++) {
+        SFLOAT sum = 0.0f;
+        for (size_t k = 0; k < rows[o].size(); k++) {
+          const Term& t = rows[o][k];
+          sum += ((const SFLOAT*)src[t.input])[i * input_channels[t.input] + t.channel] * t.weight;
         }
-        tbuff += src_bps>>1;
+        *samples++ = sum;
       }
-	  break;
     }
-  case 4: {    // float/32 bit
-      int* samples = (int*)buf;
-      int* tbuff = (int*)tempbuffer;
-      for (int i = 0; i < count; i++) {
-        for (int k = 0; k < numchannels; k++) {
-          *(samples++) = tbuff[channel[k]];
-        }
-        tbuff += src_bps>>2;
-      }
-	  break;
+  }
+}
+
+// dst = w[0] * dst + w[1] * src[1] + ..., dst already holds input 0
+static void mix_elementwise_float_sse2(float* dst, const BYTE* const* src, const float* w, size_t n_src, size_t count) {
+  const size_t mod4 = count & ~(size_t)3;
+  const __m128 w0 = _mm_set1_ps(w[0]);
+  for (size_t j = 0; j < mod4; j += 4) {
+    __m128 acc = _mm_mul_ps(_mm_loadu_ps(dst + j), w0);
+    for (size_t i = 1; i < n_src; i++)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps((const float*)src[i] + j), _mm_set1_ps(w[i])));
+    _mm_storeu_ps(dst + j, acc);
+  }
+  for (size_t j = mod4; j < count; j++) {
+    float acc = dst[j] * w[0];
+    for (size_t i = 1; i < n_src; i++)
+      acc += ((const float*)src[i])[j] * w[i];
+    dst[j] = acc;
+  }
+}
+
+void ChannelMixer::MixElementwise(BYTE* dst, const BYTE* const* src, size_t count, IScriptEnvironment* env) {
+  const size_t n_src = inputs.size();
+  const size_t samples = count * vi.AudioChannels();
+  const std::vector<Term>& w = rows[0];
+
+  if (n_src == 1 && is_copy_term(w[0]))
+    return;
+
+  if (vi.IsSampleType(SAMPLE_INT16)) {
+    short* out = (short*)dst;
+    for (size_t j = 0; j < samples; j++) {
+      __int64 sum = Int32x32To64(out[j], w[0].weight_q17) + (1 << 16);
+      for (size_t i = 1; i < n_src; i++)
+        sum += Int32x32To64(((const short*)src[i])[j], w[i].weight_q17);
+      out[j] = (short)clamp(sum >> 17, (__int64)INT16_MIN, (__int64)INT16_MAX);
     }
-  default: {  // 24 bit, etc
-      char* samples = (char*)buf;
-      char* tbuff = tempbuffer;
-      for (int i = 0; i < count; i++) {
-        for (int k = 0; k < numchannels; k++) {
-          int src_o = channel[k] * cbps;
-          for (int j = src_o; j < src_o+cbps; j++)
-            *(samples++) = tbuff[j];
-        }
-        tbuff += src_bps;
+  }
+  else if (vi.IsSampleType(SAMPLE_FLOAT)) {
+    std::vector<float> weights(n_src);
+    for (size_t i = 0; i < n_src; i++)
+      weights[i] = w[i].weight;
+    if (env->GetCPUFlags() & CPUF_SSE2)
+      mix_elementwise_float_sse2((float*)dst, src, weights.data(), n_src, samples);
+    else {
+      float* out = (float*)dst;
+      for (size_t j = 0; j < samples; j++) {
+        float acc = out[j] * weights[0];
+        for (size_t i = 1; i < n_src; i++)
+          acc += ((const float*)src[i])[j] * weights[i];
+        out[j] = acc;
       }
-	  break;
     }
   }
 }
 
 
-PClip GetChannel::Create_left(PClip clip) {
+void __stdcall ChannelMixer::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+  const size_t n_inputs = inputs.size();
+  const size_t bpcs = vi.BytesPerChannelSample();
 
-  if (clip->GetVideoInfo().AudioChannels() == 1)
-    return clip;
+  // Each input is read once, for an elementwise mix the first one goes
+  // straight into the output buffer.
+  const size_t first = is_elementwise ? 1 : 0;
+  size_t total = 0;
+  for (size_t i = first; i < n_inputs; i++)
+    total += (size_t)count * input_channels[i] * bpcs;
 
-  int* ch = new int[1];
-  ch[0] = 0;
-  return new GetChannel(clip, ch, 1);
+  BYTE* tempbuffer = NULL;
+  if (total) {
+    tempbuffer = static_cast<BYTE*>(env2->Allocate(total, 64, AVS_POOLED_ALLOC));
+    if (!tempbuffer)
+      env->ThrowError("ChannelMixer: Could not reserve memory.");
+  }
+
+  try
+  {
+    std::vector<const BYTE*> src(n_inputs);
+    BYTE* p = tempbuffer;
+    if (is_elementwise) {
+      inputs[0]->GetAudio(buf, start, count, env);
+      src[0] = (const BYTE*)buf;
+    }
+    for (size_t i = first; i < n_inputs; i++) {
+      inputs[i]->GetAudio(p, start, count, env);
+      src[i] = p;
+      p += (size_t)count * input_channels[i] * bpcs;
+    }
+
+    if (is_route)
+      Route((BYTE*)buf, src.data(), (size_t)count);
+    else if (is_elementwise)
+      MixElementwise((BYTE*)buf, src.data(), (size_t)count, env);
+    else
+      Mix((BYTE*)buf, src.data(), (size_t)count, env);
+  }
+  catch (...)
+  {
+    env2->Free(tempbuffer);
+    throw;
+  }
+  env2->Free(tempbuffer);
 }
 
-PClip GetChannel::Create_right(PClip clip) {
-  if (clip->GetVideoInfo().AudioChannels() == 1)
+
+/*** Entry points ***/
+
+PClip ChannelMixer::Create_mono(PClip clip) {
+  if (!clip->GetVideoInfo().HasAudio() || clip->GetVideoInfo().AudioChannels() == 1)
     return clip;
 
-  int* ch = new int[1];
-  ch[0] = 1;
-  return new GetChannel(clip, ch, 1);
+  PClip src = ConvertAudio::Create(clip, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT);
+  VideoInfo audio_vi = src->GetVideoInfo();
+  const int channels = audio_vi.AudioChannels();
+  audio_vi.nchannels = 1;
+
+  // 16 bit keeps the old rounding: (sum * (65536/channels) + 32768) >> 16
+  std::vector<std::vector<Term>> rows(1);
+  for (int c = 0; c < channels; c++)
+    rows[0].push_back(make_term(0, c, float(1.0 / channels), 2 * (65536 / channels)));
+  return Create(src, audio_vi, std::vector<PClip>(1, src), rows);
+}
+
+AVSValue __cdecl ChannelMixer::Create_mono(AVSValue args, void*, IScriptEnvironment*) {
+  return Create_mono(args[0].AsClip());
+}
+
+
+static PClip get_channels(PClip clip, const std::vector<int>& channels) {
+  VideoInfo audio_vi = clip->GetVideoInfo();
+  audio_vi.nchannels = (int)channels.size();
+  std::vector<std::vector<ChannelMixer::Term>> rows(channels.size());
+  for (size_t o = 0; o < channels.size(); o++)
+    rows[o].push_back(make_term(0, channels[o], 1.0f, 1 << 17));
+  return ChannelMixer::Create(clip, audio_vi, std::vector<PClip>(1, clip), rows);
 }
 
-PClip GetChannel::Create_n(PClip clip, int* n, int numchannels) {
-  return new GetChannel(clip, n, numchannels);
+PClip ChannelMixer::Create_left(PClip clip) {
+  if (!clip->GetVideoInfo().HasAudio() || clip->GetVideoInfo().AudioChannels() == 1)
+    return clip;
+  return get_channels(clip, std::vector<int>(1, 0));
+}
+
+PClip ChannelMixer::Create_right(PClip clip) {
+  if (!clip->GetVideoInfo().HasAudio() || clip->GetVideoInfo().AudioChannels() == 1)
+    return clip;
+  return get_channels(clip, std::vector<int>(1, 1));
 }
 
-AVSValue __cdecl GetChannel::Create_left(AVSValue args, void*, IScriptEnvironment*) {
+AVSValue __cdecl ChannelMixer::Create_left(AVSValue args, void*, IScriptEnvironment*) {
   return Create_left(args[0].AsClip());
 }
 
-AVSValue __cdecl GetChannel::Create_right(AVSValue args, void*, IScriptEnvironment*) {
+AVSValue __cdecl ChannelMixer::Create_right(AVSValue args, void*, IScriptEnvironment*) {
   return Create_right(args[0].AsClip());
 }
 
-AVSValue __cdecl GetChannel::Create_n(AVSValue args, void*, IScriptEnvironment* env) {
+AVSValue __cdecl ChannelMixer::Create_n(AVSValue args, void*, IScriptEnvironment* env) {
+  PClip clip = args[0].AsClip();
   AVSValue args_c = args[1];
   const int num_args = args_c.ArraySize();
-  int* child_array = new int[num_args];
+  std::vector<int> channels(num_args);
   for (int i = 0; i < num_args; ++i) {
-    child_array[i] = args_c[i].AsInt() - 1;  // Beware: Channel is 0-based in code and 1 based in scripts
-    if (child_array[i] >= args[0].AsClip()->GetVideoInfo().AudioChannels())
+    channels[i] = args_c[i].AsInt() - 1;  // Beware: Channel is 0-based in code and 1 based in scripts
+    if (channels[i] >= clip->GetVideoInfo().AudioChannels())
       env->ThrowError("GetChannel: Attempted to request a channel that didn't exist!");
-    if (child_array[i] < 0)
+    if (channels[i] < 0)
       env->ThrowError("GetChannel: There are no channels below 1! (first channel is 1)");
   }
-  return Create_n(args[0].AsClip(), child_array, num_args);
+  return get_channels(clip, channels);
 }
 
+
+AVSValue __cdecl ChannelMixer::Create_merge(AVSValue args, void*, IScriptEnvironment* env) {
+  std::vector<PClip> clips;
+
+  if (args[0].IsArray()) {
+    const int num_args = args[0].ArraySize();
+    if (num_args == 1)
+      return args[0][0];
+    for (int i = 0; i < num_args; ++i)
+      clips.push_back(args[0][i].AsClip());
+  }
+  else {
+    // MonoToStereo Case
+    clips.push_back(Create_left(args[0].AsClip()));
+    clips.push_back(Create_right(args[1].AsClip()));
+  }
+
+  VideoInfo audio_vi = clips[0]->GetVideoInfo();
+  for (size_t i = 1; i < clips.size(); i++) {
+    clips[i] = ConvertAudio::Create(clips[i], audio_vi.SampleType(), audio_vi.SampleType());  // Clip 2 should now be same type as clip 1.
+    const VideoInfo& vi2 = clips[i]->GetVideoInfo();
+
+    if (audio_vi.audio_samples_per_second != vi2.audio_samples_per_second)
+      env->ThrowError("MergeChannels: Clips must have same sample rate! Use ResampleAudio()!");  // Could be removed for fun :)
+    if (audio_vi.SampleType() != vi2.SampleType())
+      env->ThrowError("MergeChannels: Clips must have same sample type! Use ConvertAudio()!");    // Should never happend!
+    audio_vi.nchannels += vi2.AudioChannels();
+  }
+
+  std::vector<std::vector<Term>> rows;
+  for (size_t i = 0; i < clips.size(); i++) {
+    const int channels = clips[i]->GetVideoInfo().AudioChannels();
+    for (int c = 0; c < channels; c++)
+      rows.push_back(std::vector<Term>(1, make_term((int)i, c, 1.0f, 1 << 17)));
+  }
+  return Create(clips[0], audio_vi, clips, rows);
+}
+
+
+AVSValue __cdecl ChannelMixer::Create_mix(AVSValue args, void*, IScriptEnvironment* env) {
+  const double track1_factor = args[2].AsDblDef(0.5);
+  const double track2_factor = args[3].AsDblDef(1.0 - track1_factor);
+
+  PClip child = ConvertAudio::Create(args[0].AsClip(), SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT);
+  const VideoInfo& audio_vi = child->GetVideoInfo();
+  PClip clip = ConvertAudio::Create(args[1].AsClip(), audio_vi.SampleType(), audio_vi.SampleType());  // Clip 2 should now be same type as clip 1.
+  const VideoInfo& vi2 = clip->GetVideoInfo();
+
+  if (audio_vi.audio_samples_per_second != vi2.audio_samples_per_second)
+    env->ThrowError("MixAudio: Clips must have same sample rate! Use ResampleAudio()!");  // Could be removed for fun :)
+
+  if (audio_vi.AudioChannels() != vi2.AudioChannels())
+    env->ThrowError("MixAudio: Clips must have same number of channels! Use ConvertToMono() or MergeChannels()!");
+
+  const int q1 = int(track1_factor*131072.0 + 0.5);
+  const int q2 = int(track2_factor*131072.0 + 0.5);
+  std::vector<std::vector<Term>> rows(audio_vi.AudioChannels());
+  for (int o = 0; o < audio_vi.AudioChannels(); o++) {
+    rows[o].push_back(make_term(0, o, float(track1_factor), q1));
+    rows[o].push_back(make_term(1, o, float(track2_factor), q2));
+  }
+
+  std::vector<PClip> inputs;
+  inputs.push_back(child);
+  inputs.push_back(clip);
+  return Create(child, audio_vi, inputs, rows);
+}
+
+
 /******************************
  *******   Kill Video  ********
  ******************************/
@@ -634,7 +756,7 @@ AVSValue __cdecl KillAudio::Create(AVSValue args, void*, IScriptEnvironment*) {
  *****************************/
 
 DelayAudio::DelayAudio(double delay, PClip _child)
-    : GenericVideoFilter(_child), delay_samples(__int64(delay * vi.audio_samples_per_second + 0.5)) {
+    : GenericVideoFilter(_child), delay_samples((__int64)(delay * vi.audio_samples_per_second + 0.5)) {
   vi.num_audio_samples += delay_samples;
 }
 
@@ -827,144 +949,380 @@ AVSValue __cdecl Amplify::Create_dB(AVSValue args, void*, IScriptEnvironment* en
 
 /*****************************
  ***** Normalize audio  ******
- ***** Supports int16,float******
+ ** Supports int16,int32,float **
  ******************************/
 
-Normalize::Normalize(PClip _child, float _max_factor, bool _showvalues) :
-  GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
+Normalize::Normalize(PClip _child, float _max_factor, bool _showvalues, const char* _peakfile) :
+  GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_INT32 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
   max_factor(_max_factor),
   showvalues(_showvalues),
+  peakfile(_peakfile),
   frameno(0),
   max_volume(-1.0f)
 {
 }
 
 
+static size_t audio_peak_int16_sse2(const short* samples, size_t count, int &min_value, int &max_value)
+{
+  const size_t done = count & ~(size_t)7;
+  if (!done)
+    return 0;
+
+  __m128i vmin = _mm_set1_epi16((short)min_value);
+  __m128i vmax = _mm_set1_epi16((short)max_value);
+  for (size_t i = 0; i < done; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    vmin = _mm_min_epi16(vmin, v);
+    vmax = _mm_max_epi16(vmax, v);
+  }
+  vmin = _mm_min_epi16(vmin, _mm_srli_si128(vmin, 8));
+  vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 8));
+  vmin = _mm_min_epi16(vmin, _mm_srli_si128(vmin, 4));
+  vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 4));
+  vmin = _mm_min_epi16(vmin, _mm_srli_si128(vmin, 2));
+  vmax = _mm_max_epi16(vmax, _mm_srli_si128(vmax, 2));
+  min_value = (short)_mm_cvtsi128_si32(vmin);
+  max_value = (short)_mm_cvtsi128_si32(vmax);
+  return done;
+}
 
-void __stdcall Normalize::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (max_volume < 0.0f) {
-    // Read samples into buffer and test them
-    if (vi.SampleType() == SAMPLE_INT16) {
-      __int64 bcount = count;
-      short* samples = (short*)buf;
-      bool bigbuff=false;
-
-	  if (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) {
-	    samples = new(std::nothrow) short[BIGBUFFSIZE/sizeof(short)];
-	    if (samples) {
-	      bigbuff=true;
-	      bcount = vi.AudioSamplesFromBytes(BIGBUFFSIZE);
-	    }
-	    else {
-	      samples = (short*)buf; // malloc failed just reuse clients buffer
-	    }
-	  }
+AVS_TARGET("sse4.1")
+static size_t audio_peak_int32_sse41(const int* samples, size_t count, int &min_value, int &max_value)
+{
+  const size_t done = count & ~(size_t)3;
+  if (!done)
+    return 0;
+
+  __m128i vmin = _mm_set1_epi32(min_value);
+  __m128i vmax = _mm_set1_epi32(max_value);
+  for (size_t i = 0; i < done; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    vmin = _mm_min_epi32(vmin, v);
+    vmax = _mm_max_epi32(vmax, v);
+  }
+  vmin = _mm_min_epi32(vmin, _mm_srli_si128(vmin, 8));
+  vmax = _mm_max_epi32(vmax, _mm_srli_si128(vmax, 8));
+  vmin = _mm_min_epi32(vmin, _mm_srli_si128(vmin, 4));
+  vmax = _mm_max_epi32(vmax, _mm_srli_si128(vmax, 4));
+  min_value = _mm_cvtsi128_si32(vmin);
+  max_value = _mm_cvtsi128_si32(vmax);
+  return done;
+}
 
-      const __int64 passes = vi.num_audio_samples / bcount;
-	  __int64 negpeaksampleno=-1, pospeaksampleno=-1;
-      int i_pos_volume = 0;
-      int i_neg_volume = 0;
-      const int chanXbcount = (int)bcount * vi.AudioChannels();
-
-      for (__int64 i = 0; i < passes; i++) {
-        child->GetAudio(samples, bcount*i, bcount, env);
-        for (int j = 0; j < chanXbcount; j++) {
-		  const int sample=samples[j];
-          if (sample < i_neg_volume) {	// Cope with MIN_SHORT
-		    i_neg_volume = sample;
-		    negpeaksampleno = chanXbcount*i+j;
-			if (sample <= -32767) {
-			  i = passes;
-			  break;
-			}
-		  }
-		  else if (sample > i_pos_volume) {
-			i_pos_volume = sample;
-			pospeaksampleno = chanXbcount*i+j;
-			if (sample == 32767) {
-			  i = passes;
-			  break;
-			}
-		  }
+static size_t audio_peak_float_sse(const float* samples, size_t count, float &max_abs)
+{
+  const size_t done = count & ~(size_t)3;
+  if (!done)
+    return 0;
+
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 vmax = _mm_set1_ps(max_abs);
+  for (size_t i = 0; i < done; i += 4) {
+    __m128 v = _mm_and_ps(_mm_loadu_ps(samples + i), abs_mask);
+    vmax = _mm_max_ps(v, vmax);  // NaN samples are skipped, as by the scalar compare
+  }
+  vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+  vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+  max_abs = _mm_cvtss_f32(vmax);
+  return done;
+}
+
+
+// One chunk of the Normalize peak scan. Positions are the first value
+// reaching the extreme, relative to the chunk, -1 if it stayed at zero.
+struct NormalizeScanJob
+{
+  const void* samples;
+  size_t count;  // values, samples * channels
+  int sample_type;
+  int cpu;
+
+  int min_value, max_value;
+  float max_abs;
+  __int64 min_pos, max_pos;
+};
+
+template<typename sample_t>
+static __int64 find_value(const sample_t* samples, size_t count, sample_t value)
+{
+  for (size_t i = 0; i < count; i++)
+    if (samples[i] == value)
+      return i;
+  return -1;
+}
+
+static AVSValue NormalizeScanWorker(IScriptEnvironment2*, void* data)
+{
+  NormalizeScanJob* job = reinterpret_cast<NormalizeScanJob*>(data);
+  const size_t count = job->count;
+  const int cpu = job->cpu;
+  size_t done = 0;
+
+  job->min_value = job->max_value = 0;
+  job->max_abs = 0.0f;
+  job->min_pos = job->max_pos = -1;
+
+  switch (job->sample_type) {
+  case SAMPLE_INT16:
+  {
+    const short* samples = reinterpret_cast<const short*>(job->samples);
+    int min_value = 0, max_value = 0;
+    if (cpu & CPUF_AVX2)
+      done = audio_peak_int16_avx2(samples, count, min_value, max_value);
+    else if (cpu & CPUF_SSE2)
+      done = audio_peak_int16_sse2(samples, count, min_value, max_value);
+    for (; done < count; done++) {
+      min_value = min(min_value, (int)samples[done]);
+      max_value = max(max_value, (int)samples[done]);
+    }
+    job->min_value = min_value;
+    job->max_value = max_value;
+    if (min_value < 0)
+      job->min_pos = find_value(samples, count, (short)min_value);
+    if (max_value > 0)
+      job->max_pos = find_value(samples, count, (short)max_value);
+    break;
+  }
+  case SAMPLE_INT32:
+  {
+    const int* samples = reinterpret_cast<const int*>(job->samples);
+    int min_value = 0, max_value = 0;
+    if (cpu & CPUF_AVX2)
+      done = audio_peak_int32_avx2(samples, count, min_value, max_value);
+    else if (cpu & CPUF_SSE4_1)
+      done = audio_peak_int32_sse41(samples, count, min_value, max_value);
+    for (; done < count; done++) {
+      min_value = min(min_value, samples[done]);
+      max_value = max(max_value, samples[done]);
+    }
+    job->min_value = min_value;
+    job->max_value = max_value;
+    if (min_value < 0)
+      job->min_pos = find_value(samples, count, min_value);
+    if (max_value > 0)
+      job->max_pos = find_value(samples, count, max_value);
+    break;
+  }
+  default: // SAMPLE_FLOAT
+  {
+    const SFLOAT* samples = reinterpret_cast<const SFLOAT*>(job->samples);
+    float max_abs = 0.0f;
+    if (cpu & CPUF_AVX2)
+      done = audio_peak_float_avx2(samples, count, max_abs);
+    else if (cpu & CPUF_SSE)
+      done = audio_peak_float_sse(samples, count, max_abs);
+    for (; done < count; done++) {
+      const SFLOAT sample = fabsf(samples[done]);
+      if (sample > max_abs)
+        max_abs = sample;
+    }
+    job->max_abs = max_abs;
+    if (max_abs > 0.0f) {
+      for (size_t i = 0; i < count; i++) {
+        if (fabsf(samples[i]) == max_abs) {
+          job->max_pos = i;
+          break;
         }
       }
-	  // Remaining samples
-	  if ((i_pos_volume != 32767) && (i_neg_volume > -32767)) {
-		const __int64 rem_samples = vi.num_audio_samples % bcount;
-		const int chanXremcount = (int)rem_samples * vi.AudioChannels();
-
-		child->GetAudio(samples, bcount*passes, rem_samples, env);
-		for (int j = 0; j < chanXremcount; j++) {
-		  const int sample=samples[j];
-		  if (sample < i_neg_volume) {	// Cope with MIN_SHORT
-			i_neg_volume = sample;
-			negpeaksampleno = chanXbcount*passes+j;
-		  }
-		  else if (sample > i_pos_volume) {
-			i_pos_volume = sample;
-			pospeaksampleno = chanXbcount*passes+j;
-		  }
-		}
-	  }
-	  if (bigbuff) delete[] samples;
+    }
+    break;
+  }
+  }
+  return AVSValue();
+}
 
-	  i_pos_volume = -i_pos_volume; // Remember -ve has 1 more range than +ve, i.e. -32768
-	  if (i_neg_volume < i_pos_volume) {
-	    i_pos_volume = i_neg_volume;
-	    frameno = vi.FramesFromAudioSamples(negpeaksampleno / vi.AudioChannels());
-	  }
-	  else {
-	    frameno = vi.FramesFromAudioSamples(pospeaksampleno / vi.AudioChannels());
-	  }
-      max_volume = float(i_pos_volume * (-1.0/32768.0));
-      max_factor = max_factor / max_volume;
-
-    } else if (vi.SampleType() == SAMPLE_FLOAT) {  // Float
-      __int64 bcount = count;
-      SFLOAT* samples = (SFLOAT*)buf;
-      bool bigbuff=false;
-
-	  if (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) {
-	    samples = new(std::nothrow) SFLOAT[BIGBUFFSIZE/sizeof(SFLOAT)];
-	    if (samples) {
-	      bigbuff=true;
-	      bcount = vi.AudioSamplesFromBytes(BIGBUFFSIZE);
-	    }
-	    else {
-	      samples = (SFLOAT*)buf; // malloc failed just reuse clients buffer
-	    }
-	  }
 
-      const int chanXbcount = (int)bcount * vi.AudioChannels();
-      const __int64 passes = vi.num_audio_samples / bcount;
-	  __int64 peaksampleno=-1;
-	  
-      for (__int64 i = 0;i < passes;i++) {
-        child->GetAudio(samples, bcount*i, bcount, env);
-        for (int j = 0;j < chanXbcount;j++) {
-		  const SFLOAT sample = fabsf(samples[j]);
-          if (sample > max_volume) {
-		    max_volume = sample;
-			peaksampleno = chanXbcount*i+j;
-		  }
-        }
+// Reads the track in order in BIGBUFFSIZE chunks on this thread, upstream filters
+// need not be thread safe and sources see a linear read. The chunks are scanned
+// on the ThreadPool while the following ones are being read.
+void Normalize::ScanPeak(IScriptEnvironment* env)
+{
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+  const int sample_type = vi.SampleType();
+  const int channels = vi.AudioChannels();
+  const __int64 chunk_samples = max<__int64>(vi.AudioSamplesFromBytes(BIGBUFFSIZE), 1);
+  const int threads = (int)env2->GetProperty(AEP_THREADPOOL_THREADS);
+  const int slots = clamp(threads, 1, 8);
+
+  std::vector<NormalizeScanJob> jobs(slots);
+  std::vector<BYTE*> buffers(slots, (BYTE*)NULL);
+  IJobCompletion* completion = threads > 0 ? env2->NewCompletion(slots) : NULL;
+
+  int min_value = 0, max_value = 0;
+  float max_abs = 0.0f;
+  __int64 min_pos = -1, max_pos = -1;
+
+  try
+  {
+    for (int i = 0; i < slots; i++) {
+      buffers[i] = static_cast<BYTE*>(env2->Allocate((size_t)vi.BytesFromAudioSamples(chunk_samples), 64, AVS_POOLED_ALLOC));
+      if (!buffers[i])
+        env->ThrowError("Normalize: Could not reserve memory.");
+    }
+
+    __int64 start = 0;
+    bool full_scale = false;
+    while (start < vi.num_audio_samples && !full_scale) {
+      const __int64 batch_start = start;
+      int n = 0;
+      for (; n < slots && start < vi.num_audio_samples; n++) {
+        const __int64 samples = min(chunk_samples, vi.num_audio_samples - start);
+        child->GetAudio(buffers[n], start, samples, env);
+        NormalizeScanJob &job = jobs[n];
+        job.samples = buffers[n];
+        job.count = (size_t)samples * channels;
+        job.sample_type = sample_type;
+        job.cpu = env->GetCPUFlags();
+        if (completion)
+          env2->ParallelJob(NormalizeScanWorker, &job, completion);
+        else
+          NormalizeScanWorker(env2, &job);
+        start += samples;
       }
-      // Remaining samples
-      const __int64 rem_samples = vi.num_audio_samples % bcount;
-      const int chanXremcount = (int)rem_samples * vi.AudioChannels();
-
-      child->GetAudio(samples, bcount*passes, rem_samples, env);
-      for (int j = 0;j < chanXremcount;j++) {
-		const SFLOAT sample = fabsf(samples[j]);
-        if (sample > max_volume) {
-		  max_volume = sample;
-		  peaksampleno = chanXbcount*passes+j;
-		}
+      if (completion) {
+        completion->Wait();
+        completion->Reset();
+      }
+
+      // Combine in track order so the first occurrence of the peak wins
+      for (int i = 0; i < n; i++) {
+        const NormalizeScanJob &job = jobs[i];
+        const __int64 base = (batch_start + i * chunk_samples) * channels;
+        if (job.min_value < min_value) {
+          min_value = job.min_value;
+          min_pos = base + job.min_pos;
+        }
+        if (job.max_value > max_value) {
+          max_value = job.max_value;
+          max_pos = base + job.max_pos;
+        }
+        if (job.max_abs > max_abs) {
+          max_abs = job.max_abs;
+          max_pos = base + job.max_pos;
+        }
       }
-	  if (bigbuff) delete[] samples;
 
-	  frameno = vi.FramesFromAudioSamples(peaksampleno / vi.AudioChannels());
-      max_factor = max_factor / max_volume;
+      // The lowest integer is the largest peak there is, and its first
+      // occurrence is already found. Any other value, even the highest
+      // positive one, can still be topped by it later in the track.
+      if (sample_type == SAMPLE_INT16)
+        full_scale = min_value == -32768;
+      else if (sample_type == SAMPLE_INT32)
+        full_scale = min_value == INT_MIN;
+    }
+  }
+  catch (...)
+  {
+    if (completion)
+      completion->Destroy();
+    for (int i = 0; i < slots; i++)
+      env2->Free(buffers[i]);
+    throw;
+  }
+  if (completion)
+    completion->Destroy();
+  for (int i = 0; i < slots; i++)
+    env2->Free(buffers[i]);
+
+  __int64 peaksampleno = max_pos;
+  if (sample_type == SAMPLE_FLOAT) {
+    max_volume = max_abs;
+  }
+  else {
+    // Remember -ve has 1 more range than +ve
+    const double range = sample_type == SAMPLE_INT16 ? 32768.0 : 2147483648.0;
+    if (-(double)min_value > (double)max_value) {
+      max_volume = float(-(double)min_value / range);
+      peaksampleno = min_pos;
+    }
+    else
+      max_volume = float((double)max_value / range);
+  }
+  frameno = vi.FramesFromAudioSamples(peaksampleno / channels);
+}
+
+
+// FNV-1a over the audio format and three short stretches of the track, so a
+// peak file is not reused after the source or the filters before Normalize change.
+unsigned __int64 Normalize::Fingerprint(IScriptEnvironment* env)
+{
+  unsigned __int64 hash = 14695981039346656037ull;
+  auto add = [&hash](const void* data, size_t size) {
+    const BYTE* p = reinterpret_cast<const BYTE*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash ^= p[i];
+      hash *= 1099511628211ull;
+    }
+  };
+
+  const int format[3] = { vi.SampleType(), vi.AudioChannels(), vi.SamplesPerSecond() };
+  add(format, sizeof(format));
+  add(&vi.num_audio_samples, sizeof(vi.num_audio_samples));
+
+  const __int64 stretch = min<__int64>(4096, vi.num_audio_samples);
+  if (stretch > 0) {
+    std::vector<BYTE> buffer((size_t)vi.BytesFromAudioSamples(stretch));
+    const __int64 starts[3] = { 0, (vi.num_audio_samples - stretch) / 2, vi.num_audio_samples - stretch };
+    for (int i = 0; i < 3; i++) {
+      child->GetAudio(buffer.data(), starts[i], stretch, env);
+      add(buffer.data(), buffer.size());
+    }
+  }
+  return hash;
+}
+
+static const char peakfile_header[] = "# AviSynth Normalize peak file, version 1\n";
+
+bool Normalize::LoadPeakFile(unsigned __int64 fingerprint)
+{
+  FILE* f = fopen(peakfile, "r");
+  if (!f)
+    return false;
+
+  char header[sizeof(peakfile_header)] = { 0 };
+  unsigned long long file_fingerprint = 0;
+  float peak = 0.0f;
+  int frame = 0;
+  const bool ok = fgets(header, sizeof(header), f) && !strcmp(header, peakfile_header)
+    && fscanf(f, "fingerprint=%llx\npeak=%g\nframe=%d", &file_fingerprint, &peak, &frame) == 3
+    && file_fingerprint == fingerprint && peak >= 0.0f;
+  fclose(f);
+
+  if (ok) {
+    max_volume = peak;
+    frameno = frame;
+  }
+  return ok;
+}
+
+void Normalize::SavePeakFile(unsigned __int64 fingerprint)
+{
+  FILE* f = fopen(peakfile, "w");
+  if (!f)
+    return; // only a cache, Normalize works without it
+  fprintf(f, "%sfingerprint=%016llx\npeak=%.9g\nframe=%d\n", peakfile_header, (unsigned long long)fingerprint, max_volume, frameno);
+  fclose(f);
+}
+
+
+void __stdcall Normalize::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
+  {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    if (max_volume < 0.0f) {
+      const float volume = max_factor;
+      unsigned __int64 fingerprint = 0;
+      bool loaded = false;
+      if (peakfile) {
+        fingerprint = Fingerprint(env);
+        loaded = LoadPeakFile(fingerprint);
+      }
+      if (!loaded) {
+        ScanPeak(env);
+        if (peakfile)
+          SavePeakFile(fingerprint);
+      }
+      max_factor = volume / max_volume;
     }
   }
 
@@ -1015,6 +1373,14 @@ saturate2:
         (__int64)INT16_MAX);
     }
 #endif // X86_32
+  } else if (vi.SampleType() == SAMPLE_INT32) {
+    int* samples = (int*)buf;
+    child->GetAudio(buf, start, count, env);
+    const double factor = max_factor;
+    for (int i = 0; i < chanXcount; ++i) {
+      const double sample = floor(samples[i] * factor + 0.5);
+      samples[i] = (int)clamp(sample, (double)INT_MIN, (double)INT_MAX);
+    }
   } else if (vi.SampleType() == SAMPLE_FLOAT) {
     SFLOAT* samples = (SFLOAT*)buf;
     child->GetAudio(buf, start, count, env);
@@ -1047,119 +1413,7 @@ PVideoFrame __stdcall Normalize::GetFrame(int n, IScriptEnvironment* env) {
 
 AVSValue __cdecl Normalize::Create(AVSValue args, void*, IScriptEnvironment* env) {
 
-  return new Normalize(args[0].AsClip(), args[1].AsFloatf(1.0f), args[2].AsBool(false));}
-
-
-/*****************************
- ***** Mix audio  tracks ******
- ******************************/
-
-MixAudio::MixAudio(PClip _child, PClip _clip, double _track1_factor, double _track2_factor, IScriptEnvironment* env) :
-  GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
-  track1_factor(int(_track1_factor*131072.0 + 0.5)),
-  track2_factor(int(_track2_factor*131072.0 + 0.5)),
-  t1factor(float(_track1_factor)),
-  t2factor(float(_track2_factor)),
-  tempbuffer(NULL)
-{
-  clip = ConvertAudio::Create(_clip, vi.SampleType(), vi.SampleType());  // Clip 2 should now be same type as clip 1.
-  const VideoInfo vi2 = clip->GetVideoInfo();
-
-  if (vi.audio_samples_per_second != vi2.audio_samples_per_second)
-    env->ThrowError("MixAudio: Clips must have same sample rate! Use ResampleAudio()!");  // Could be removed for fun :)
-
-  if (vi.AudioChannels() != vi2.AudioChannels())
-    env->ThrowError("MixAudio: Clips must have same number of channels! Use ConvertToMono() or MergeChannels()!");
-
-  tempbuffer_size = 0;
-}
-
-
-void __stdcall MixAudio::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (tempbuffer_size < count)
-  {
-    if (tempbuffer_size)
-      delete[] tempbuffer;
-
-    tempbuffer = new signed char[(size_t)(count * vi.BytesPerAudioSample())];
-    tempbuffer_size = (int)count;
-  }
-
-  child->GetAudio(buf, start, count, env);
-  clip->GetAudio(tempbuffer, start, count, env);
-  unsigned channels = vi.AudioChannels();
-
-  if (vi.SampleType()&SAMPLE_INT16) {
-#ifdef X86_32
-    const short* tbuffer = (short*)tempbuffer;
-    const short* endsample = (short*)buf + unsigned(count)*channels;
-	  const int t1_factor = track1_factor;
-	  const int t2_factor = track2_factor;
-
-    __asm {
-		  push   ebx
-          mov	 edi, [buf]
-          mov	 esi, [tbuffer]
-          align  16
-iloop3:
-          movsx	 eax, WORD PTR [edi]		; *samples
-          add	 edi, 2						; samples++
-          imul	 [t1_factor]
-          mov	 ebx, 65536
-          xor	 ecx, ecx
-		  add    ebx, eax
-          movsx	 eax, WORD PTR [esi]		; *clip_samples
-		  adc    ecx, edx
-          imul	 [t2_factor]
-          add	 esi, 2						; clip_samples++
-          add	 eax, ebx
-          adc	 edx, ecx
-
-          cmp	 edx, -1					; if (nh < -1) return MIN_SHORT;
-          jge	 notnegsat3
-          mov	 eax, -32768
-          jmp	 saturate3
-notnegsat3:
-          test	 edx, edx					; if (nh >  0) return MAX_SHORT;
-          jle	 notpossat3
-          mov	 eax, 32767
-          jmp	 saturate3
-notpossat3:
-          shrd	 eax, edx, 17				; n>>17
-saturate3:
-          mov	 WORD PTR [edi-2], ax		; *samples
-
-          cmp	 edi, [endsample]
-          jl	 iloop3
-		  pop    ebx
-    }
-#else
-    short* samples = (short*)buf;
-    short* clip_samples = (short*)tempbuffer;
-    for (unsigned i = 0; i < unsigned(count)*channels; ++i) {
-      samples[i] = (short)clamp(
-        signed_saturated_add64(signed_saturated_add64(Int32x32To64(samples[i], track1_factor), Int32x32To64(clip_samples[i], track2_factor)), 65536) >> 17,
-        (__int64)INT16_MIN,
-        (__int64)INT16_MAX);
-    }
-#endif
-  } else if (vi.SampleType()&SAMPLE_FLOAT) {
-    SFLOAT* samples = (SFLOAT*)buf;
-    const SFLOAT* clip_samples = (SFLOAT*)tempbuffer;
-    for (unsigned i = 0; i < unsigned(count)*channels; ++i) {
-        samples[i] = (samples[i] * t1factor) + (clip_samples[i] * t2factor);
-    }
-  }
-}
-
-
-
-AVSValue __cdecl MixAudio::Create(AVSValue args, void*, IScriptEnvironment* env) {
-  double track1_factor = args[2].AsDblDef(0.5);
-  double track2_factor = args[3].AsDblDef(1.0 - track1_factor);
-  return new MixAudio(args[0].AsClip(), args[1].AsClip(), track1_factor, track2_factor, env);
-}
-
+  return new Normalize(args[0].AsClip(), args[1].AsFloatf(1.0f), args[2].AsBool(false), args[3].AsString(0));}
 
 
 /********************************
@@ -1167,7 +1421,6 @@ AVSValue __cdecl MixAudio::Create(AVSValue args, void*, IScriptEnvironment* env)
  *******************************/
 
 static int Amasktab[Amask+1];
-static SFLOAT fAmasktab[Amask+1];
 
 ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_d, IScriptEnvironment* env)
     : GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
@@ -1175,6 +1428,11 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
 {
   srcbuffer  = 0;
   fsrcbuffer = 0;
+  phase_table = 0;
+  coef_buffer = 0;
+  history = 0;
+  history_size = history_count = 0;
+  history_start = 0;
 
   if (vi.audio_samples_per_second == 0) {
     skip_conversion = true;
@@ -1221,10 +1479,6 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
   }
   else { // SAMPLE_FLOAT
 
-	// Load interpolate ratio table
-	for (int i=0; i<=Amask; i++)
-	  fAmasktab[i] = float(i) / (Amask+1);   /* a is between 0 and 1 */
-
 	/* Account for increased filter gain when using factors less than 1 */
 	if (factor < 1)
 	  makeFilter(fImp, factor, Nwing, 0.90, 9);  // generate filter coefficients
@@ -1249,6 +1503,132 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
 
   double dh = min(double(Npc), factor * Npc);  /* Filter sampling period */
   dhb = int(dh * (1 << Na) + 0.5);
+
+  if (vi.IsSampleType(SAMPLE_FLOAT))
+    MakePhaseTable();
+}
+
+
+// Interpolated impulse response at table position idx, zero from limit on
+static double ImpulseAt(const SFLOAT* fImp, double idx, int limit) {
+  if (idx >= limit)
+    return 0.0;
+  const int i = int(idx);
+  return fImp[i] + (fImp[i + 1] - fImp[i]) * (idx - i);
+}
+
+// Samples fImp the way FilterUD did: the left wing (including the centre sample)
+// for distances up to Nwing, the right wing up to Nwing-1, dhb/2^Na table
+// points per input sample.
+void ResampleAudio::MakePhaseTable() {
+  const double dh = double(dhb) / (1 << Na);
+  taps_left = int(ceil(Nwing / dh));
+  taps = (2 * taps_left + 2 + 7) & ~7;  // whole AVX2 vectors
+
+  const int phases = 1 << Nphase_bits;
+  std::vector<double> rows((phases + 1) * taps);
+  for (int p = 0; p <= phases; p++) {
+    const double frac = double(p) / phases;
+    for (int k = 0; k < taps; k++) {
+      const double d = k - taps_left - frac;  // input sample position relative to output
+      rows[p * taps + k] = d <= 0 ? ImpulseAt(fImp, -d * dh, Nwing) : ImpulseAt(fImp, d * dh, Nwing - 1);
+    }
+  }
+
+  phase_table = new float[phases * taps * 2];
+  for (int p = 0; p < phases; p++) {
+    float* row = phase_table + p * taps * 2;
+    for (int k = 0; k < taps; k++) {
+      row[k] = float(rows[p * taps + k]);
+      row[taps + k] = float(rows[(p + 1) * taps + k] - rows[p * taps + k]);
+    }
+  }
+  coef_buffer = new float[taps];
+}
+
+
+// Makes the source samples [first, first+samples) available in history,
+// reusing what the previous request already fetched.
+void ResampleAudio::FillHistory(__int64 first, int samples, IScriptEnvironment* env) {
+  const int ch = vi.AudioChannels();
+
+  if (samples > history_size) {
+    delete[] history;
+    history = new float[samples * ch];
+    history_size = samples;
+    history_count = 0;
+  }
+
+  int keep = 0;
+  if (first >= history_start && first < history_start + history_count) {
+    const int shift = int(first - history_start);
+    keep = min(history_count - shift, samples);
+    if (shift > 0) {
+      for (int c = 0; c < ch; c++)
+        memmove(history + c * history_size, history + c * history_size + shift, keep * sizeof(float));
+    }
+  }
+  history_start = first;
+  history_count = samples;
+
+  const int fetch = samples - keep;
+  if (fetch <= 0)
+    return;
+
+  if (!fsrcbuffer || fetch * ch > srcbuffer_size) {
+    delete[] fsrcbuffer;
+    fsrcbuffer = new SFLOAT[fetch * ch];
+    srcbuffer_size = fetch * ch;
+  }
+  child->GetAudio(fsrcbuffer, first + keep, fetch, env);
+
+  for (int c = 0; c < ch; c++) {
+    float* dst = history + c * history_size + keep;
+    const SFLOAT* src = fsrcbuffer + c;
+    for (int i = 0; i < fetch; i++)
+      dst[i] = src[i * ch];
+  }
+}
+
+
+// One output sample of the SAMPLE_FLOAT path for all channels: the coefficients
+// are interpolated between two phase rows once, then applied to every channel.
+// src points to tap 0 of channel 0, taps is a multiple of 8.
+static void resample_float_sample_sse(SFLOAT* dst, const float* src, int src_pitch, int channels, const float* row, float a, float* coef, int taps)
+{
+  const float* delta = row + taps;
+  const __m128 va = _mm_set1_ps(a);
+  for (int k = 0; k < taps; k += 4)
+    _mm_storeu_ps(coef + k, _mm_add_ps(_mm_loadu_ps(row + k), _mm_mul_ps(_mm_loadu_ps(delta + k), va)));
+
+  for (int ch = 0; ch < channels; ch++) {
+    const float* x = src + ch * src_pitch;
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int k = 0; k < taps; k += 8) {
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(coef + k), _mm_loadu_ps(x + k)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(coef + k + 4), _mm_loadu_ps(x + k + 4)));
+    }
+    __m128 sum = _mm_add_ps(acc0, acc1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    _mm_store_ss(dst + ch, sum);
+  }
+}
+
+static void resample_float_sample_c(SFLOAT* dst, const float* src, int src_pitch, int channels, const float* row, float a, float* coef, int taps)
+{
+  const float* delta = row + taps;
+  for (int k = 0; k < taps; k++)
+    coef[k] = row[k] + delta[k] * a;
+
+  for (int ch = 0; ch < channels; ch++) {
+    const float* x = src + ch * src_pitch;
+    float v = 0.0f;
+    for (int k = 0; k < taps; k++)
+      v += coef[k] * x[k];
+    dst[ch] = v;
+  }
 }
 
 
@@ -1257,8 +1637,8 @@ void __stdcall ResampleAudio::GetAudio(void* buf, __int64 start, __int64 count,
     child->GetAudio(buf, start, count, env);
     return ;
   }
-  __int64 src_start = __int64(((long double)start           / factor) * (1 << Np) + 0.5);
-  __int64 src_end   = __int64(((long double)(start + count) / factor) * (1 << Np) + 0.5);
+  __int64 src_start = (__int64)(((long double)start           / factor) * (1 << Np) + 0.5);
+  __int64 src_end   = (__int64)(((long double)(start + count) / factor) * (1 << Np) + 0.5);
   const __int64 source_samples = ((src_end - src_start) >> Np) + 2 * Xoff + 1;
   const int source_bytes = (int)vi.BytesFromAudioSamples(source_samples);
 
@@ -1414,48 +1794,37 @@ nofix:
 	}
   }
   else { // SAMPLE_FLOAT
-
-	if (!fsrcbuffer || source_bytes > srcbuffer_size) {
-		delete[] fsrcbuffer;
-	  fsrcbuffer = new SFLOAT[source_bytes >> 2];
-	  srcbuffer_size = source_bytes;
-	  last_samples= 0;
-	  last_start = 0;
-	}
-
-	const int offset = int((src_start >> Np) - Xoff - last_start);
-	last_start = (src_start >> Np) - Xoff;
-	
-	int overlap = int(last_samples - offset);
-	if ((offset < 0) || (overlap <= 0))
-	  overlap = 0;
-	else if (offset > 0)
-	  memcpy(fsrcbuffer, fsrcbuffer+offset*ch, overlap*ch<<2);
-	last_samples= max<__int64>(overlap, source_samples);
-
-    if (source_samples-overlap > 0)
-	  child->GetAudio(&fsrcbuffer[overlap*ch], last_start+overlap, source_samples-overlap, env);
-
-	SFLOAT* dst = (SFLOAT*)buf;
-
-	SFLOAT* dst_end = &dst[count * ch];
-
-	while (dst < dst_end) {
-	  for (int q = 0; q < ch; q++) {
-		SFLOAT* Xp = &fsrcbuffer[(pos >> Np) * ch];
-		SFLOAT v = FilterUD(Xp +      q, (short)(   pos  & Pmask), - ch);  /* Perform left-wing inner product */
-		v       += FilterUD(Xp + ch + q, (short)(( -pos) & Pmask),   ch);  /* Perform right-wing inner product */
-		*dst++ = v;     /* deposit output */
-	  }
-	  if ((dtberror += dtbe) >= (1 << 31)) { // Don't be a creep ;-)
-		dtberror -= (1u << 31);
-		pos += dtb + 1;   /* Move to next sample by time increment + error adjustment */
-	  }
-	  else {
-		pos += dtb;       /* Move to next sample by time increment */
-	  }
-	}
-
+    // Window as for SAMPLE_INT16, plus room for the padding taps of the last outputs
+    FillHistory((src_start >> Np) - Xoff, int(source_samples) + taps, env);
+
+    void (*resample_sample)(SFLOAT*, const float*, int, int, const float*, float, float*, int) = resample_float_sample_c;
+    if (env->GetCPUFlags() & CPUF_AVX2)
+      resample_sample = resample_float_sample_avx2;
+    else if (env->GetCPUFlags() & CPUF_SSE)
+      resample_sample = resample_float_sample_sse;
+
+    static const int phase_shift = Np - Nphase_bits;
+    static const float phase_scale = 1.0f / (1 << phase_shift);
+    const float* src = history - taps_left;
+
+    SFLOAT* dst = (SFLOAT*)buf;
+    SFLOAT* dst_end = &dst[count * ch];
+
+    while (dst < dst_end) {
+      const unsigned phase = unsigned(pos & Pmask);
+      const float* row = phase_table + (phase >> phase_shift) * taps * 2;
+      const float a = (phase & ((1 << phase_shift) - 1)) * phase_scale;
+      resample_sample(dst, src + (pos >> Np), history_size, ch, row, a, coef_buffer, taps);
+      dst += ch;
+
+      if ((dtberror += dtbe) >= (1u << 31)) { // Don't be a creep ;-)
+        dtberror -= (1u << 31);
+        pos += dtb + 1;   /* Move to next sample by time increment + error adjustment */
+      }
+      else {
+        pos += dtb;       /* Move to next sample by time increment */
+      }
+    }
   }
 }
 
@@ -1567,32 +1936,6 @@ __int64 ResampleAudio::FilterUD(short *Xp, short Ph, short Inc) {
   return (v);
 }
 
-// FilterUD SAMPLE_FLOAT Version  -- Approx same speed as new int16 and SSRC on P4 (40% on P2)
-SFLOAT ResampleAudio::FilterUD(SFLOAT *Xp, short Ph, short Inc) {
-  SFLOAT v = 0;
-  unsigned Ho = (Ph * (unsigned)dhb) >> Np;
-  unsigned End = Nwing;
-  if (Inc > 0)        /* If doing right wing...              */
-  {                   /* ...drop extra coeff, so when Ph is  */
-    End--;            /*    0.5, we don't do too many mult's */
-    if (Ph == 0)      /* If the phase is zero...             */
-      Ho += dhb;      /* ...then we've already skipped the   */
-  }                   /*    first sample, so we must also    */
-                      /*    skip ahead in fImp[]             */
-  while ((Ho >> Na) < End) {
-    SFLOAT t = fImp[Ho >> Na];      /* Get IR sample */
-    t += (fImp[(Ho >> Na) + 1] - t) * fAmasktab[Ho & Amask]; /* t is now interpolated filter coeff */
-    t *= *Xp;         /* Mult coeff by input sample */
-    v += t;           /* The filter output */
-    Ho += dhb;        /* IR step */
-    Xp += Inc;        /* Input signal step. NO CHECK ON BOUNDS */
-  }
-  return (v);
-}
-
-
-
-
 /********************************
  *******   Helper methods *******
  ********************************/
@@ -36,6 +36,8 @@
 
 #include <avisynth.h>
 #include <cmath>
+#include <mutex>
+#include <vector>
 
 
 
@@ -96,26 +98,6 @@ public:
 
 
 
-class ConvertToMono : public GenericVideoFilter
-/**
-  * Class to convert audio to mono
- **/
-{
-public:
-  ConvertToMono(PClip _clip);
-  virtual ~ConvertToMono()
-  {if (tempbuffer_size) {delete[] tempbuffer;tempbuffer_size=0;}}
-
-  void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
-  static PClip Create(PClip clip);
-  static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment*);
-
-private:
-  char *tempbuffer;
-  int tempbuffer_size;
-  int channels;
-};
-
 class EnsureVBRMP3Sync : public GenericVideoFilter
 /**
   * Ensure VBR mp3 sync, by always reading audio sequencially.
@@ -132,57 +114,51 @@ private:
   __int64 last_end;
 };
 
-class MergeChannels : public GenericVideoFilter
+class ChannelMixer : public NonCachedGenericVideoFilter
 /**
-  * Class to convert two mono sources to stereo
+  * Routes and mixes the channels of one or more clips. ConvertToMono,
+  * GetChannel, MergeChannels and MixAudio all create one of these, and
+  * a mixer reading from another mixer is folded into a single mapping.
  **/
 {
 public:
-  MergeChannels(PClip _clip, int _num_children, PClip* _child_array, IScriptEnvironment* env);
-  ~MergeChannels();
+  // Output channel gets weight * channel of input. The fixed point weight
+  // (1.0 == 1<<17) is the one used for 16 bit samples.
+  struct Term {
+    int input;
+    int channel;
+    float weight;
+    int weight_q17;
+  };
 
-  void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
-  static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment*);
+  ChannelMixer(PClip _video, const VideoInfo& _audio_vi, const std::vector<PClip>& _inputs,
+               const std::vector<std::vector<Term>>& _rows);
 
-private:
-  int* clip_channels;
-  signed char** clip_offset;
-  signed char *tempbuffer;
-  PClip* child_array;
-  const int num_children;
-  int tempbuffer_size;
-};
+  void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
 
+  static PClip Create(PClip video, const VideoInfo& audio_vi, std::vector<PClip> inputs,
+                      std::vector<std::vector<Term>> rows);
 
-class GetChannel : public GenericVideoFilter
-/**
-  * Class to get left or right channel from stereo source
- **/
-{
-public:
-  GetChannel(PClip _clip, int* _channel, int numchannels);
-  virtual ~GetChannel()
-  {
-    if (tempbuffer_size) {delete[] tempbuffer;tempbuffer_size=0;}
-    if (channel)         {delete[] channel;   channel=0;        }
-  }
-
-  void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
+  static PClip Create_mono(PClip clip);
   static PClip Create_left(PClip clip);
   static PClip Create_right(PClip clip);
-  static PClip Create_n(PClip clip, int* n, int numchannels);
+  static AVSValue __cdecl Create_mono(AVSValue args, void*, IScriptEnvironment*);
+  static AVSValue __cdecl Create_merge(AVSValue args, void*, IScriptEnvironment* env);
   static AVSValue __cdecl Create_left(AVSValue args, void*, IScriptEnvironment*);
   static AVSValue __cdecl Create_right(AVSValue args, void*, IScriptEnvironment*);
   static AVSValue __cdecl Create_n(AVSValue args, void*, IScriptEnvironment* env);
+  static AVSValue __cdecl Create_mix(AVSValue args, void*, IScriptEnvironment* env);
 
 private:
-  char *tempbuffer;
-  int* channel;
-  int tempbuffer_size;
-  int numchannels;
-  int cbps;
-  int src_bps;
-  int dst_bps;
+  void Route(BYTE* dst, const BYTE* const* src, size_t count);
+  void Mix(BYTE* dst, const BYTE* const* src, size_t count, IScriptEnvironment* env);
+  void MixElementwise(BYTE* dst, const BYTE* const* src, size_t count, IScriptEnvironment* env);
+
+  std::vector<PClip> inputs;
+  std::vector<int> input_channels;
+  std::vector<std::vector<Term>> rows;
+  bool is_route;        // every output is a plain copy of one input channel (or silent)
+  bool is_elementwise;  // every input has the output layout, each with a single weight
 };
 
 class KillVideo : public GenericVideoFilter
@@ -258,7 +234,7 @@ class Normalize : public GenericVideoFilter
  **/
 {
 public:
-  Normalize(PClip _child, float _max_factor, bool _showvalues);
+  Normalize(PClip _child, float _max_factor, bool _showvalues, const char* _peakfile);
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
 
@@ -266,34 +242,19 @@ public:
 
 
 private:
+  void ScanPeak(IScriptEnvironment* env);
+  unsigned __int64 Fingerprint(IScriptEnvironment* env);
+  bool LoadPeakFile(unsigned __int64 fingerprint);
+  void SavePeakFile(unsigned __int64 fingerprint);
+
   float max_factor;
   float max_volume;
   int   frameno;
   bool showvalues;
+  const char* peakfile;
+  std::mutex scan_mutex;
 };
 
-class MixAudio : public GenericVideoFilter
-/**
-  * Mix audio from one clip into another.
- **/
-{
-public:
-  MixAudio(PClip _child, PClip _clip, double _track1_factor, double _track2_factor, IScriptEnvironment* env);
-  void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
-
-  static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
-  virtual ~MixAudio() {if (tempbuffer_size) delete[] tempbuffer;tempbuffer_size=0;}
-
-
-private:
-  PClip clip;
-  signed char *tempbuffer;
-  const int track1_factor, track2_factor;
-  const float t1factor, t2factor;
-  int tempbuffer_size;
-};
-
-
 class ResampleAudio : public GenericVideoFilter
 /**
   * Class to resample the audio stream
@@ -303,16 +264,22 @@ public:
   ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_d, IScriptEnvironment* env);
   virtual ~ResampleAudio()
     { delete[]  srcbuffer;
-      delete[] fsrcbuffer; }
+      delete[] fsrcbuffer;
+      delete[] phase_table;
+      delete[] history;
+      delete[] coef_buffer; }
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
 
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
   enum { Nwing = 8192, Nmult = 65 };   // Number of filter points, (Nwing>>Nhc)*2+1
+  enum { Nphase_bits = 8 };            // SAMPLE_FLOAT: 2^Nphase_bits coefficient rows per input sample period
 
 private:
   __int64 FilterUD(short  *Xp, short Ph, short Inc);
-  SFLOAT  FilterUD(SFLOAT *Xp, short Ph, short Inc);
+
+  void MakePhaseTable();
+  void FillHistory(__int64 first, int samples, IScriptEnvironment* env);
 
   const double factor;
   int Xoff, dtb, dhb;
@@ -328,6 +295,19 @@ private:
 
   __int64 last_start, last_samples;
 
+  // SAMPLE_FLOAT polyphase filter. Each row holds the taps coefficients for one
+  // phase, followed by the difference to the next row for interpolating between them.
+  // Tap 0 is taps_left input samples before the one at or before the output position.
+  float* phase_table;
+  int taps, taps_left;
+  float* coef_buffer;
+
+  // SAMPLE_FLOAT source samples [history_start, history_start+history_count), one
+  // history_size long row per channel, so sequential requests only fetch the new part.
+  float* history;
+  int history_size, history_count;
+  __int64 history_start;
+
   union { // Share storage
 	SFLOAT fImp[Nwing+1];
 	short Imp[Nwing+1];
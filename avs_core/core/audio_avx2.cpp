@@ -0,0 +1,145 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// This file is compiled with AVX2 enabled, see CMakeLists.txt.
+
+#include "audio_avx2.h"
+#include <immintrin.h>
+
+void resample_float_sample_avx2(SFLOAT* dst, const float* src, int src_pitch, int channels, const float* row, float a, float* coef, int taps)
+{
+  // Interpolate the coefficients once for all channels
+  const float* delta = row + taps;
+  const __m256 va = _mm256_set1_ps(a);
+  for (int k = 0; k < taps; k += 8) {
+    __m256 c = _mm256_add_ps(_mm256_loadu_ps(row + k), _mm256_mul_ps(_mm256_loadu_ps(delta + k), va));
+    _mm256_storeu_ps(coef + k, c);
+  }
+
+  for (int ch = 0; ch < channels; ch++) {
+    const float* x = src + ch * src_pitch;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int k = 0;
+    for (; k + 16 <= taps; k += 16) {
+      acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(coef + k), _mm256_loadu_ps(x + k)));
+      acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(coef + k + 8), _mm256_loadu_ps(x + k + 8)));
+    }
+    if (k < taps)
+      acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(coef + k), _mm256_loadu_ps(x + k)));
+    acc0 = _mm256_add_ps(acc0, acc1);
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    dst[ch] = _mm_cvtss_f32(sum);
+  }
+
+  _mm256_zeroupper();
+}
+
+
+size_t audio_peak_int16_avx2(const short* samples, size_t count, int &min_value, int &max_value)
+{
+  const size_t done = count & ~(size_t)15;
+  if (!done)
+    return 0;
+
+  __m256i vmin = _mm256_set1_epi16((short)min_value);
+  __m256i vmax = _mm256_set1_epi16((short)max_value);
+  for (size_t i = 0; i < done; i += 16) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+    vmin = _mm256_min_epi16(vmin, v);
+    vmax = _mm256_max_epi16(vmax, v);
+  }
+
+  __m128i mn = _mm_min_epi16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+  __m128i mx = _mm_max_epi16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+  // minpos works on unsigned words, flip the sign bit to use it for signed ones
+  const __m128i sign = _mm_set1_epi16((short)0x8000);
+  min_value = (short)(_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(mn, sign))) ^ 0x8000);
+  max_value = (short)(~_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(mx, _mm_set1_epi16(0x7fff)))) ^ 0x8000);
+
+  _mm256_zeroupper();
+  return done;
+}
+
+size_t audio_peak_int32_avx2(const int* samples, size_t count, int &min_value, int &max_value)
+{
+  const size_t done = count & ~(size_t)7;
+  if (!done)
+    return 0;
+
+  __m256i vmin = _mm256_set1_epi32(min_value);
+  __m256i vmax = _mm256_set1_epi32(max_value);
+  for (size_t i = 0; i < done; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+    vmin = _mm256_min_epi32(vmin, v);
+    vmax = _mm256_max_epi32(vmax, v);
+  }
+
+  __m128i mn = _mm_min_epi32(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+  __m128i mx = _mm_max_epi32(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+  mn = _mm_min_epi32(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+  mx = _mm_max_epi32(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+  mn = _mm_min_epi32(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+  mx = _mm_max_epi32(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+  min_value = _mm_cvtsi128_si32(mn);
+  max_value = _mm_cvtsi128_si32(mx);
+
+  _mm256_zeroupper();
+  return done;
+}
+
+size_t audio_peak_float_avx2(const float* samples, size_t count, float &max_abs)
+{
+  const size_t done = count & ~(size_t)7;
+  if (!done)
+    return 0;
+
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 vmax = _mm256_set1_ps(max_abs);
+  for (size_t i = 0; i < done; i += 8) {
+    __m256 v = _mm256_and_ps(_mm256_loadu_ps(samples + i), abs_mask);
+    vmax = _mm256_max_ps(v, vmax);  // NaN samples are skipped, as by the scalar compare
+  }
+
+  __m128 mx = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+  mx = _mm_max_ps(mx, _mm_movehl_ps(mx, mx));
+  mx = _mm_max_ss(mx, _mm_shuffle_ps(mx, mx, 1));
+  max_abs = _mm_cvtss_f32(mx);
+
+  _mm256_zeroupper();
+  return done;
+}
@@ -0,0 +1,51 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef __Audio_AVX2_H__
+#define __Audio_AVX2_H__
+
+#include <avisynth.h>
+
+// AVX2 kernels, only to be called when CPUF_AVX2 is set.
+
+// One output sample of the SAMPLE_FLOAT ResampleAudio, see resample_float_sample_sse.
+void resample_float_sample_avx2(SFLOAT* dst, const float* src, int src_pitch, int channels, const float* row, float a, float* coef, int taps);
+
+// Normalize peak scan. They process whole vectors, update the running
+// extremes and return the number of values done, the caller finishes the rest.
+size_t audio_peak_int16_avx2(const short* samples, size_t count, int &min_value, int &max_value);
+size_t audio_peak_int32_avx2(const int* samples, size_t count, int &min_value, int &max_value);
+size_t audio_peak_float_avx2(const float* samples, size_t count, float &max_abs);
+
+#endif  // __Audio_AVX2_H__
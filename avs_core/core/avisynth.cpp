@@ -50,7 +50,12 @@
 #include <fstream>
 
 #include <avs/win.h>
+#ifdef AVS_WINDOWS
 #include <objbase.h>
+#else
+#include <unistd.h>
+#include <set>
+#endif
 
 #include <string>
 #include <cstdio>
@@ -59,12 +64,9 @@
 #include "MTGuard.h"
 #include "cache.h"
 #include <clocale>
+#include <type_traits>
 
-#ifdef _MSC_VER
-  #define strnicmp(a,b,c) _strnicmp(a,b,c)
-#else
-  #define _RPT1(x,y,z) ((void)0)
-#endif
+#define strnicmp(a,b,c) _strnicmp(a,b,c)
 
 #ifndef YieldProcessor // low power spin idle
   #define YieldProcessor() __nop(void)
@@ -111,6 +113,7 @@ struct {
 const _PixelClip PixelClip;
 
 
+#ifdef AVS_WINDOWS
 // Helper function to count set bits in the processor mask.
 static DWORD CountSetBits(ULONG_PTR bitMask)
 {
@@ -255,11 +258,35 @@ static size_t GetNumPhysicalCPUs()
 
   return processorCoreCount;
 }
+#else
+static size_t GetNumPhysicalCPUs()
+{
+  // Count the distinct (physical id, core id) pairs, hyperthreads share them
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (f == NULL)
+    return 0;
+
+  std::set<std::pair<int, int> > cores;
+  int physical_id = 0, core_id = -1;
+  char line[256];
+  while (fgets(line, sizeof(line), f))
+  {
+    if (sscanf(line, "physical id : %d", &physical_id) == 1)
+      continue;
+    if (sscanf(line, "core id : %d", &core_id) == 1)
+      cores.insert(std::make_pair(physical_id, core_id));
+  }
+  fclose(f);
+
+  return cores.size();
+}
+#endif
 
 static std::string FormatString(const char *fmt, va_list args)
 {
   va_list args2;
   va_copy(args2, args);
+#ifdef AVS_WINDOWS
   _locale_t locale = _create_locale(LC_NUMERIC, "C"); // decimal point: dot
 
   int count = _vsnprintf_l(NULL, 0, fmt, locale, args);
@@ -267,6 +294,17 @@ static std::string FormatString(const char *fmt, va_list args)
   _vsnprintf_l(buf.data(), buf.size(), fmt, locale, args2);
 
   _free_locale(locale);
+#else
+  locale_t locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0); // decimal point: dot
+  locale_t old_locale = uselocale(locale);
+
+  int count = vsnprintf(NULL, 0, fmt, args);
+  std::vector<char> buf(count + 1);
+  vsnprintf(buf.data(), buf.size(), fmt, args2);
+
+  uselocale(old_locale);
+  freelocale(locale);
+#endif
   va_end(args2);
 
   return std::string(buf.data());
@@ -372,8 +410,8 @@ VideoFrameBuffer::~VideoFrameBuffer() {
 //  _ASSERTE(refcount == 0);
   InterlockedIncrement(&sequence_number); // HACK : Notify any children with a pointer, this buffer has changed!!!
   if (data) delete[] data;
-  (BYTE*)data = 0; // and mark it invalid!!
-  (int)data_size = 0;   // and don't forget to set the size to 0 as well!
+  const_cast<BYTE*&>(data) = 0; // and mark it invalid!!
+  const_cast<int&>(data_size) = 0;   // and don't forget to set the size to 0 as well!
 }
 
 
@@ -672,7 +710,7 @@ public:
   bool __stdcall PlanarChromaAlignment(IScriptEnvironment::PlanarChromaAlignmentMode key);
   PVideoFrame __stdcall SubframePlanar(PVideoFrame src, int rel_offset, int new_pitch, int new_row_size, int new_height, int rel_offsetU, int rel_offsetV, int new_pitchUV);
   void __stdcall DeleteScriptEnvironment();
-  void _stdcall ApplyMessage(PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, int textcolor, int halocolor, int bgcolor);
+  void __stdcall ApplyMessage(PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, int textcolor, int halocolor, int bgcolor);
   const AVS_Linkage* const __stdcall GetAVSLinkage();
   AVSValue __stdcall GetVarDef(const char* name, const AVSValue& def = AVSValue());
 
@@ -747,8 +785,10 @@ private:
   IScriptEnvironment2* This() { return this; }
   bool PlanarChromaAlignmentState;
 
+#ifdef AVS_WINDOWS
   HRESULT hrfromcoinit;
   DWORD coinitThreadId;
+#endif
 
   bool closing;                 // Used to avoid deadlock, if vartable is being accessed while shutting down (Popcontext)
 
@@ -783,7 +823,7 @@ private:
   VideoFrame* AllocateFrame(size_t vfb_size);
   std::mutex memory_mutex;
 
-  BufferPool BufferPool;
+  ::BufferPool BufferPool;
 
   typedef std::vector<MTGuard*> MTGuardRegistryType;
   MTGuardRegistryType MTGuardRegistry;
@@ -808,20 +848,38 @@ private:
 const std::string ScriptEnvironment::DEFAULT_MODE_SPECIFIER = "DEFAULT_MT_MODE";
 
 
+static unsigned __int64 GetTotalPhysicalMemory()
+{
+#ifdef AVS_WINDOWS
+  MEMORYSTATUSEX memstatus;
+  memstatus.dwLength = sizeof(memstatus);
+  GlobalMemoryStatusEx(&memstatus);
+  return memstatus.ullTotalPhys;
+#else
+  return (unsigned __int64)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+#endif
+}
+
 static unsigned __int64 ConstrainMemoryRequest(unsigned __int64 requested)
 {
   // Get system memory information
+  unsigned __int64 total_phys = GetTotalPhysicalMemory();
+#ifdef AVS_WINDOWS
   MEMORYSTATUSEX memstatus;
   memstatus.dwLength = sizeof(memstatus);
   GlobalMemoryStatusEx(&memstatus);
+  unsigned __int64 total_virtual = memstatus.ullTotalVirtual;
+#else
+  unsigned __int64 total_virtual = sizeof(void*) == 4 ? 3*1024*1024*1024ull : ~0ull;
+#endif
 
   // mem_limit is the largest amount of memory that makes sense to use.
   // We don't want to use more than the virtual address space,
   // and we also don't want to start paging to disk.
-  unsigned __int64 mem_limit = min(memstatus.ullTotalVirtual, memstatus.ullTotalPhys);
+  unsigned __int64 mem_limit = min(total_virtual, total_phys);
 
   unsigned __int64 mem_sysreserve = 0;
-  if (memstatus.ullTotalPhys > memstatus.ullTotalVirtual)
+  if (total_phys > total_virtual)
   {
     // We are probably running on a 32bit OS system where the virtual space is capped to 
     // much less than what the system can use, so it is enough to reserve only a small amount.
@@ -848,7 +906,9 @@ ScriptEnvironment::ScriptEnvironment()
     plugin_manager(NULL),
     vsprintf_buf(NULL),
     vsprintf_len(0),
+#ifdef AVS_WINDOWS
     hrfromcoinit(E_FAIL), coinitThreadId(0),
+#endif
     closing(false),
     PlanarChromaAlignmentState(true),   // Change to "true" for 2.5.7
     ImportDepth(0),
@@ -858,6 +918,7 @@ ScriptEnvironment::ScriptEnvironment()
     BufferPool(this)
 {
   try {
+#ifdef AVS_WINDOWS
     // Make sure COM is initialised
     hrfromcoinit = CoInitialize(NULL);
 
@@ -869,11 +930,9 @@ ScriptEnvironment::ScriptEnvironment()
     }
     // Remember our threadId.
     coinitThreadId=GetCurrentThreadId();
+#endif
 
-    MEMORYSTATUSEX memstatus;
-    memstatus.dwLength = sizeof(memstatus);
-    GlobalMemoryStatusEx(&memstatus);
-    memory_max = ConstrainMemoryRequest(memstatus.ullTotalPhys / 4);
+    memory_max = ConstrainMemoryRequest(GetTotalPhysicalMemory() / 4);
     memory_max = min(memory_max, 1024*1024*1024ull);  // at start, cap memory usage to 1GB
     memory_used = 0ull;
 
@@ -909,10 +968,12 @@ ScriptEnvironment::ScriptEnvironment()
     LogTickets.max_load_factor(0.8f);
   }
   catch (const AvisynthError &err) {
+#ifdef AVS_WINDOWS
     if(SUCCEEDED(hrfromcoinit)) {
       hrfromcoinit=E_FAIL;
       CoUninitialize();
     }
+#endif
     // Needs must, to not loose the text we
     // must leak a little memory.
     throw AvisynthError(_strdup(err.msg));
@@ -988,12 +1049,14 @@ ScriptEnvironment::~ScriptEnvironment() {
   delete plugin_manager;
   delete [] vsprintf_buf;
 
+#ifdef AVS_WINDOWS
   // If we init'd COM and this is the right thread then release it
   // If it's the wrong threadId then tuff, nothing we can do.
   if(SUCCEEDED(hrfromcoinit) && (coinitThreadId == GetCurrentThreadId())) {
     hrfromcoinit=E_FAIL;
     CoUninitialize();
   }
+#endif
 }
 
 void __stdcall ScriptEnvironment::SetLogParams(const char *target, int level)
@@ -1041,7 +1104,13 @@ void __stdcall ScriptEnvironment::LogMsg_valist(int level, const char *fmt, va_l
 
     // Setup string prefixes for output messages
     const char *levelStr = nullptr;
+#ifdef AVS_WINDOWS
     WORD levelAttr;
+#else
+    // No console text attributes, the levels are told apart by their prefix
+    enum { FOREGROUND_BLUE = 0, FOREGROUND_GREEN = 0, FOREGROUND_RED = 0, FOREGROUND_INTENSITY = 0 };
+    int levelAttr;
+#endif
     switch (level)
     {
     case LOGLEVEL_ERROR:
@@ -1067,16 +1136,22 @@ void __stdcall ScriptEnvironment::LogMsg_valist(int level, const char *fmt, va_l
 
     // Prepare message output target
     std::ostream *targetStream = nullptr;
+#ifdef AVS_WINDOWS
     HANDLE hConsole = GetStdHandle(STD_ERROR_HANDLE);
+#endif
 
     if (streqi("stderr", LogTarget.c_str()))
     {
+#ifdef AVS_WINDOWS
         hConsole = GetStdHandle(STD_ERROR_HANDLE);
+#endif
         targetStream = &std::cerr;
     }
     else if (streqi("stdout", LogTarget.c_str()))
     {
+#ifdef AVS_WINDOWS
         hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+#endif
         targetStream = &std::cout;
     }
     else if (LogFileStream.is_open())
@@ -1093,15 +1168,22 @@ void __stdcall ScriptEnvironment::LogMsg_valist(int level, const char *fmt, va_l
     // Format our message string
     std::string msg = FormatString(fmt, va);
 
+#ifdef AVS_WINDOWS
     // Save current console attributes so that we can restore them later
     CONSOLE_SCREEN_BUFFER_INFO Info;
     GetConsoleScreenBufferInfo(hConsole, &Info);
+#endif
 
     // Do the output
     *targetStream << "---------------------------------------------------------------------" << std::endl;
+#ifdef AVS_WINDOWS
     SetConsoleTextAttribute(hConsole, levelAttr);
     *targetStream << levelStr;
     SetConsoleTextAttribute(hConsole, Info.wAttributes);
+#else
+    (void)levelAttr;
+    *targetStream << levelStr;
+#endif
     *targetStream << msg << std::endl;
     targetStream->flush();
 }
@@ -1353,7 +1435,11 @@ int ScriptEnvironment::SetMemoryMax(int mem) {
 }
 
 int ScriptEnvironment::SetWorkingDir(const char * newdir) {
+#ifdef AVS_WINDOWS
   return SetCurrentDirectory(newdir) ? 0 : 1;
+#else
+  return chdir(newdir) == 0 ? 0 : 1;
+#endif
 }
 
 void ScriptEnvironment::CheckVersion(int version) {
@@ -1751,6 +1837,7 @@ VideoFrame* ScriptEnvironment::GetNewFrame(size_t vfb_size)
    * -----------------------------------------------------------
    */
 
+#ifdef AVS_WINDOWS
   // See if we could benefit from 64-bit Avisynth
   if (sizeof(void*) == 4)
   {
@@ -1767,6 +1854,7 @@ VideoFrame* ScriptEnvironment::GetNewFrame(size_t vfb_size)
           LogMsgOnce(ticket, LOGLEVEL_INFO, "We have run out of memory, but your system still has some free RAM left. You might benefit from a 64-bit build of Avisynth+.");
       }
   }
+#endif
 
   ThrowError("Could not allocate video frame. Out of memory. memory_max = %I64d, memory_used = %I64d Request=%Iu", memory_max, memory_used.load(), vfb_size);
   return NULL;
@@ -2308,6 +2396,15 @@ void* ScriptEnvironment::ManageCache(int key, void* data) {
     }
     break;
   }
+  // Called by Cache instances before growing their audio buffer,
+  // data points to an unsigned __int64 that receives the bytes left below SetMemoryMax
+  case MC_QueryAvailableMemory:
+  {
+    unsigned __int64* available = reinterpret_cast<unsigned __int64*>(data);
+    const unsigned __int64 used = memory_used;
+    *available = used < memory_max ? memory_max - used : 0;
+    break;
+  }
   } // switch
   return 0;
 }
@@ -2730,7 +2827,8 @@ char* ScriptEnvironment::SaveString(const char* s, int len) {
 
 char* ScriptEnvironment::VSprintf(const char* fmt, void* val) {
   try {
-    std::string str = FormatString(fmt, (va_list)val);
+    // va_list may be an array type, which is passed as a pointer
+    std::string str = FormatString(fmt, (std::decay<va_list>::type)val);
     std::lock_guard<std::mutex> lock(string_mutex);
     return string_dump.SaveString(str.c_str(), int(str.size())); // SaveString will add the NULL in len mode.
   } catch (...) {
@@ -2778,7 +2876,7 @@ const AVS_Linkage* const __stdcall ScriptEnvironment::GetAVSLinkage() {
 }
 
 
-void _stdcall ScriptEnvironment::ApplyMessage(PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, int textcolor, int halocolor, int bgcolor) {
+void __stdcall ScriptEnvironment::ApplyMessage(PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, int textcolor, int halocolor, int bgcolor) {
   ::ApplyMessage(frame, vi, message, size, textcolor, halocolor, bgcolor, this);
 }
 
@@ -2808,7 +2906,11 @@ IScriptEnvironment2* __stdcall CreateScriptEnvironment2(int version)
   * to shut down immediately instead of continuing to spin.
   * This solves our problem at the cost of some performance.
   */
+#ifdef AVS_WINDOWS
   _putenv("OMP_WAIT_POLICY=passive");
+#else
+  setenv("OMP_WAIT_POLICY", "passive", 1);
+#endif
 
   if (version <= AVISYNTH_INTERFACE_VERSION)
     return new ScriptEnvironment();
@@ -10,8 +10,14 @@
 #include <avisynth.h>
 #include <avisynth_c.h>
 #include <avs/win.h>
+#include "Prefetcher.h"
 #include <algorithm>
+#include <condition_variable>
 #include <cstdarg>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
 
 
 struct AVS_Clip 
@@ -466,6 +472,201 @@ int AVSC_CC avs_set_cache_hints(AVS_Clip * p, int cachehints, int frame_range)
 	}
 }
 
+/////////////////////////////////////////////////////////////////////
+//
+// AVS_FrameBatch
+//
+
+struct AVS_FrameBatch
+{
+	struct Result {
+		int n;
+		PVideoFrame frame;
+		std::string error;
+	};
+
+	PClip clip;
+	IScriptEnvironment * env;
+	Prefetcher * prefetcher;   // 0 if the clip isn't prefetched
+	std::vector<int> frames;
+	size_t submitted;          // frames[0..submitted) have been handed out for fetching
+	size_t delivered;
+	size_t in_flight;
+	size_t max_in_flight;
+	std::deque<Result> ready;
+	std::mutex mutex;
+	std::condition_variable ready_cond;
+	std::string error;         // of the frame last returned
+
+	AVS_FrameBatch(const AVS_Clip * p) :
+		clip(p->clip), env(p->env), prefetcher(0),
+		submitted(0), delivered(0), in_flight(0), max_in_flight(1) {}
+};
+
+static void avs_frame_batch_ready(void * user, int n, const PVideoFrame & frame, const char * error)
+{
+	AVS_FrameBatch * b = (AVS_FrameBatch *)user;
+	AVS_FrameBatch::Result r;
+	r.n = n;
+	r.frame = frame;
+	if (error)
+		r.error = error;
+
+	std::lock_guard<std::mutex> lock(b->mutex);
+	b->ready.push_back(r);
+	--b->in_flight;
+	b->ready_cond.notify_all();
+}
+
+// Keeps up to max_in_flight frames queued on the prefetcher. Without a
+// prefetcher, computes the next frame on the calling thread if none is ready.
+static void avs_frame_batch_submit(AVS_FrameBatch * b)
+{
+	for (;;) {
+		int n;
+		{
+			std::lock_guard<std::mutex> lock(b->mutex);
+			if (b->submitted == b->frames.size())
+				return;
+			if (b->prefetcher ? b->in_flight >= b->max_in_flight : !b->ready.empty())
+				return;
+			n = b->frames[b->submitted++];
+			++b->in_flight;
+		}
+
+		// Every frame counted in in_flight has to be reported, whatever the
+		// filters throw, or avs_release_frame_batch waits for it forever.
+		if (b->prefetcher) {
+			try {
+				b->prefetcher->FetchFrame(n, avs_frame_batch_ready, b, b->env);
+			} catch (const AvisynthError &err) {
+				avs_frame_batch_ready(b, n, PVideoFrame(), err.msg);
+			} catch (...) {
+				avs_frame_batch_ready(b, n, PVideoFrame(), "Avisynth: unknown exception while fetching a frame.");
+			}
+		} else {
+			try {
+				PVideoFrame f = b->clip->GetFrame(n, b->env);
+				avs_frame_batch_ready(b, n, f, 0);
+			} catch (const AvisynthError &err) {
+				avs_frame_batch_ready(b, n, PVideoFrame(), err.msg);
+			} catch (...) {
+				avs_frame_batch_ready(b, n, PVideoFrame(), "Avisynth: unknown exception while fetching a frame.");
+			}
+			return;
+		}
+	}
+}
+
+static int avs_frame_batch_next(AVS_FrameBatch * b, int * n, AVS_VideoFrame * * frame, bool block)
+{
+	avs_frame_batch_submit(b);
+
+	AVS_FrameBatch::Result r;
+	{
+		std::unique_lock<std::mutex> lock(b->mutex);
+		if (b->delivered == b->frames.size())
+			return -1;
+		if (block)
+			b->ready_cond.wait(lock, [b] { return !b->ready.empty(); });
+		else if (b->ready.empty())
+			return 0;
+		r = b->ready.front();
+		b->ready.pop_front();
+		++b->delivered;
+	}
+
+	// refill the window right away so the workers don't idle while the host is busy
+	if (b->prefetcher)
+		avs_frame_batch_submit(b);
+
+	b->error = r.error;
+	if (n)
+		*n = r.n;
+	if (frame) {
+		AVS_VideoFrame * f;
+		new((PVideoFrame *)&f) PVideoFrame(r.frame);
+		*frame = f;
+	}
+	return 1;
+}
+
+extern "C"
+AVS_FrameBatch * AVSC_CC avs_request_frames(AVS_Clip * p, const int * frames, int count)
+{
+	p->error = 0;
+	try {
+		if (count < 0 || (count > 0 && !frames))
+			throw AvisynthError("avs_request_frames: invalid frame list");
+
+		AVS_FrameBatch * b = new AVS_FrameBatch(p);
+		b->frames.assign(frames, frames + count);
+
+		// Prefetch() returns itself uncached, so a script ending in it hands us the prefetcher.
+		b->prefetcher = dynamic_cast<Prefetcher*>((IClip*)(void*)p->clip);
+		if (b->prefetcher) {
+			b->max_in_flight = b->prefetcher->NumPrefetchFrames();
+			avs_frame_batch_submit(b);
+		}
+		return b;
+	} catch (const AvisynthError &err) {
+		p->error = err.msg;
+		return 0;
+	} catch (const std::bad_alloc &) {
+		p->error = "avs_request_frames: out of memory";
+		return 0;
+	}
+}
+
+extern "C"
+AVS_FrameBatch * AVSC_CC avs_request_frame_range(AVS_Clip * p, int first, int count)
+{
+	p->error = 0;
+	if (count < 0) {
+		p->error = "avs_request_frame_range: invalid frame range";
+		return 0;
+	}
+	try {
+		std::vector<int> frames(count);
+		for (int i = 0; i < count; ++i)
+			frames[i] = first + i;
+		return avs_request_frames(p, frames.empty() ? 0 : &frames[0], count);
+	} catch (const std::bad_alloc &) {
+		p->error = "avs_request_frame_range: out of memory";
+		return 0;
+	}
+}
+
+extern "C"
+int AVSC_CC avs_poll_frame(AVS_FrameBatch * b, int * n, AVS_VideoFrame * * frame)
+{
+	return avs_frame_batch_next(b, n, frame, false);
+}
+
+extern "C"
+int AVSC_CC avs_wait_frame(AVS_FrameBatch * b, int * n, AVS_VideoFrame * * frame)
+{
+	return avs_frame_batch_next(b, n, frame, true);
+}
+
+extern "C"
+const char * AVSC_CC avs_frame_batch_get_error(AVS_FrameBatch * b) // return 0 if no error
+{
+	return b->error.empty() ? 0 : b->error.c_str();
+}
+
+extern "C"
+void AVSC_CC avs_release_frame_batch(AVS_FrameBatch * b)
+{
+	{
+		// frames still being computed report back into the batch
+		std::unique_lock<std::mutex> lock(b->mutex);
+		b->submitted = b->frames.size();
+		b->ready_cond.wait(lock, [b] { return b->in_flight == 0; });
+	}
+	delete b;
+}
+
 //////////////////////////////////////////////////////////////////
 //
 //
@@ -35,14 +35,24 @@
 #include "cache.h"
 #include "internal.h"
 #include "LruCache.h"
+#include "InternalEnvironment.h"
 #include <cassert>
+#include <climits>
 #include <cstdio>
+#include <mutex>
 
 #ifdef X86_32
 #include <mmintrin.h>
 #endif
 
 
+// Audio cache limits: the default buffer, the most CACHE_AUDIO_AUTO grows to on its own,
+// and how many requests the auto modes look at before switching on or off.
+static const size_t AUDIO_CACHE_DEFAULT_SIZE = 256*1024;
+static const size_t AUDIO_CACHE_AUTO_MAX_SIZE = 8*1024*1024;
+static const int AUDIO_AUTO_ENABLE_SCORE = 3;
+static const int AUDIO_AUTO_DISABLE_SCORE = -64;
+
 extern const AVSFunction Cache_filters[] = {
   { "Cache", BUILTIN_FUNC_PREFIX, "c", Cache::Create },
   { "InternalCache", BUILTIN_FUNC_PREFIX, "c", Cache::Create },
@@ -59,19 +69,45 @@ struct CachePimpl
   std::shared_ptr<LruCache<size_t, PVideoFrame> > VideoCache;
 
   // Audio cache
+  // AudioCache holds the samples [AudioCacheStart, AudioCacheStart+AudioCacheCount)
+  // of the child, a sliding window of at most MaxSampleCount samples.
+  std::mutex AudioMutex;
   CachePolicyHint AudioPolicy;
   char* AudioCache;
   size_t SampleSize;
   size_t MaxSampleCount;
+  size_t AudioInitialSize;    // bytes, used when auto mode switches the cache on
+  __int64 AudioCacheStart;
+  size_t AudioCacheCount;
+
+  // Auto mode bookkeeping: the previous request and how much the cache
+  // would have (CACHE_AUDIO_NONE) or has (CACHE_AUDIO_AUTO) been used lately.
+  __int64 AudioLastStart;
+  __int64 AudioLastEnd;
+  int AudioScore;
+  int AudioTooSmallCount;
+
+  // Statistics, in requests
+  __int64 AudioHits;
+  __int64 AudioMisses;
 
   CachePimpl(const PClip& _child) :
     child(_child),
     vi(_child->GetVideoInfo()),
     VideoCache(std::make_shared<LruCache<size_t, PVideoFrame> >(0)),
-    AudioPolicy(CACHE_AUDIO),
+    AudioPolicy(CACHE_AUDIO_NONE),
     AudioCache(NULL),
     SampleSize(0),
-    MaxSampleCount(0)
+    MaxSampleCount(0),
+    AudioInitialSize(AUDIO_CACHE_DEFAULT_SIZE),
+    AudioCacheStart(0),
+    AudioCacheCount(0),
+    AudioLastStart(0),
+    AudioLastEnd(0),
+    AudioScore(0),
+    AudioTooSmallCount(0),
+    AudioHits(0),
+    AudioMisses(0)
   {
     SampleSize = vi.BytesPerAudioSample();
   }
@@ -90,13 +126,22 @@ Cache::Cache(const PClip& _child, IScriptEnvironment* env) :
 {
   _pimpl = new CachePimpl(_child);
   env->ManageCache(MC_RegisterCache, reinterpret_cast<void*>(this));
+
+  // Let the child pick its audio cache mode, e.g. EnsureVBRMP3Sync wants CACHE_AUDIO
+  if (_child->GetVersion() >= 5) {
+    const int audio_mode = _child->SetCacheHints(CACHE_GETCHILD_AUDIO_MODE, 0);
+    if (audio_mode >= CACHE_AUDIO && audio_mode <= CACHE_AUDIO_AUTO)
+      SetCacheHints(audio_mode, _child->SetCacheHints(CACHE_GETCHILD_AUDIO_SIZE, 0));
+  }
   _RPT5(0, "Cache::Cache registered. cache_id=%p child=%p w=%d h=%d VideoCacheSize=%Iu\n", (void *)this, (void *)_child, _pimpl->vi.width, _pimpl->vi.height, _pimpl->VideoCache->size()); // P.F.
 }
 
 Cache::~Cache()
 {
   _RPT5(0, "Cache::Cache unregister. cache_id=%p child=%p w=%d h=%d VideoCacheSize=%Iu\n", (void *)this, (void *)_pimpl->child, _pimpl->vi.width, _pimpl->vi.height, _pimpl->VideoCache->size()); // P.F.
+  _RPT3(0, "Cache::Cache audio hits=%I64d misses=%I64d size=%Iu\n", _pimpl->AudioHits, _pimpl->AudioMisses, _pimpl->MaxSampleCount * _pimpl->SampleSize);
   Env->ManageCache(MC_UnRegisterCache, reinterpret_cast<void*>(this));
+  ResizeAudioCache(0, false);
   delete _pimpl;
 }
 
@@ -253,11 +298,162 @@ void __stdcall Cache::GetAudio(void* buf, __int64 start, __int64 count, IScriptE
     // -----------------------------------------------------------
     //          Caching
     // -----------------------------------------------------------
-    
-    // TODO: implement audio cache
 
+    CachePimpl* p = _pimpl;
+    std::lock_guard<std::mutex> lock(p->AudioMutex);
+
+    const __int64 end = start + count;
+    const bool overlaps_last = (start < p->AudioLastEnd) && (end > p->AudioLastStart);
+    p->AudioLastStart = start;
+    p->AudioLastEnd = end;
+
+    switch (p->AudioPolicy)
+    {
+    case CACHE_AUDIO_NONE:
+      // Auto mode, off: switch on once requests keep re-reading samples
+    {
+      if (overlaps_last)
+        p->AudioScore++;
+      else if (p->AudioScore > 0)
+        p->AudioScore--;
+
+      const size_t request_size = (size_t)count * p->SampleSize;
+      const size_t wanted = max(p->AudioInitialSize, min(request_size * 2, AUDIO_CACHE_AUTO_MAX_SIZE));
+      if (p->AudioScore < AUDIO_AUTO_ENABLE_SCORE || request_size > wanted || !ResizeAudioCache(wanted, true)) {
+        p->AudioMisses++;
+        p->child->GetAudio(buf, start, count, env);
+        return;
+      }
+      _RPT2(0, "Cache::GetAudio auto mode on. cache=%p size=%Iu\n", (void *)this, p->MaxSampleCount * p->SampleSize);
+      p->AudioPolicy = CACHE_AUDIO_AUTO;
+      p->AudioScore = 0;
+      p->AudioTooSmallCount = 0;
+      break;
+    }
+
+    case CACHE_AUDIO_AUTO:
+      // Auto mode, on: grow when requests keep being too big for the cache,
+      // switch off when nothing has been served from it for a while.
+      if ((size_t)count > p->MaxSampleCount) {
+        const size_t new_size = (size_t)((count * p->SampleSize + 8191) & ~(__int64)8191);
+        if (++p->AudioTooSmallCount <= 2 || new_size > AUDIO_CACHE_AUTO_MAX_SIZE || !ResizeAudioCache(new_size, true)) {
+          p->AudioMisses++;
+          p->child->GetAudio(buf, start, count, env);
+          return;
+        }
+        p->AudioTooSmallCount = 0;
+      }
+
+      if (start < p->AudioCacheStart + (__int64)p->AudioCacheCount && end > p->AudioCacheStart)
+        p->AudioScore = 0;
+      else if (--p->AudioScore < AUDIO_AUTO_DISABLE_SCORE) {
+        _RPT1(0, "Cache::GetAudio auto mode off. cache=%p\n", (void *)this);
+        ResizeAudioCache(0, false);
+        p->AudioPolicy = CACHE_AUDIO_NONE;
+        p->AudioScore = 0;
+        p->AudioMisses++;
+        p->child->GetAudio(buf, start, count, env);
+        return;
+      }
+      break;
+
+    case CACHE_AUDIO:
+      if ((size_t)count > p->MaxSampleCount) {
+        p->AudioMisses++;
+        p->child->GetAudio(buf, start, count, env);
+        return;
+      }
+      break;
+
+    default: // CACHE_AUDIO_NOTHING
+      p->child->GetAudio(buf, start, count, env);
+      return;
+    }
+
+    // count <= MaxSampleCount from here on
+    const size_t sample_size = p->SampleSize;
+    __int64 cache_end = p->AudioCacheStart + (__int64)p->AudioCacheCount;
+
+    if (start >= p->AudioCacheStart && end <= cache_end) {
+      p->AudioHits++;
+    }
+    else {
+      p->AudioMisses++;
+      try
+      {
+        if (start < p->AudioCacheStart || start > cache_end) {
+          // Not reachable by appending, restart the window at the request
+          p->AudioCacheCount = 0;
+          p->AudioCacheStart = start;
+        }
+        else if (end > p->AudioCacheStart + (__int64)p->MaxSampleCount) {
+          // Slide the window so the request fits, by at least half of what
+          // lies before the request to keep appending cheap on linear reads.
+          size_t shift = (size_t)(end - (p->AudioCacheStart + (__int64)p->MaxSampleCount));
+          shift = max(shift, (size_t)((start - p->AudioCacheStart) / 2));
+          if (shift >= p->AudioCacheCount) {
+            p->AudioCacheStart = start;
+            p->AudioCacheCount = 0;
+          }
+          else {
+            memmove(p->AudioCache, p->AudioCache + shift * sample_size, (p->AudioCacheCount - shift) * sample_size);
+            p->AudioCacheStart += shift;
+            p->AudioCacheCount -= shift;
+          }
+        }
 
-    _pimpl->child->GetAudio(buf, start, count, env);
+        // Read just what completes the request and append it
+        cache_end = p->AudioCacheStart + (__int64)p->AudioCacheCount;
+        p->child->GetAudio(p->AudioCache + p->AudioCacheCount * sample_size, cache_end, end - cache_end, env);
+        p->AudioCacheCount += (size_t)(end - cache_end);
+      }
+      catch (...)
+      {
+        p->AudioCacheCount = 0;
+        throw;
+      }
+    }
+
+    memcpy(buf, p->AudioCache + (size_t)(start - p->AudioCacheStart) * sample_size, (size_t)count * sample_size);
+}
+
+// Reallocates the audio cache to nBytes (0 frees it), dropping its content.
+// Memory is accounted against SetMemoryMax; with check_memory the call fails
+// instead of growing the cache into the last quarter of what is left.
+bool Cache::ResizeAudioCache(size_t nBytes, bool check_memory)
+{
+  CachePimpl* p = _pimpl;
+  const size_t old_size = p->MaxSampleCount * p->SampleSize;
+  const size_t new_count = p->SampleSize ? nBytes / p->SampleSize : 0;
+  const size_t new_size = new_count * p->SampleSize;
+
+  if (check_memory && new_size > old_size) {
+    unsigned __int64 available = 0;
+    Env->ManageCache(MC_QueryAvailableMemory, reinterpret_cast<void*>(&available));
+    if (new_size - old_size > available / 4)
+      return false;
+  }
+
+  char* NewAudioCache = NULL;
+  if (new_size) {
+    NewAudioCache = (char*)realloc(p->AudioCache, new_size);
+    if (NewAudioCache == NULL)
+      return false;
+  }
+  else
+    free(p->AudioCache);
+
+  InternalEnvironment* envi = static_cast<InternalEnvironment*>(Env);
+  if (old_size)
+    envi->AdjustMemoryConsumption(old_size, true);
+  if (new_size)
+    envi->AdjustMemoryConsumption(new_size, false);
+
+  p->AudioCache = NewAudioCache;
+  p->MaxSampleCount = new_count;
+  p->AudioCacheStart = 0;
+  p->AudioCacheCount = 0;
+  return true;
 }
 
 const VideoInfo& __stdcall Cache::GetVideoInfo()
@@ -387,45 +583,52 @@ int __stdcall Cache::SetCacheHints(int cachehints, int frame_range)
       break;
 
     /*********************************************
-        TODO AUDIO
+        AUDIO
     *********************************************/
 
     case CACHE_AUDIO:
     case CACHE_AUDIO_AUTO:
+    {
       if (!_pimpl->vi.HasAudio())
         break;
 
+      std::lock_guard<std::mutex> lock(_pimpl->AudioMutex);
+
       // Range means for audio.
       // 0 == Create a default buffer (256kb).
       // Positive. Allocate X bytes for cache.
       if (frame_range == 0) {
-        if (_pimpl->AudioPolicy != CACHE_AUDIO_NONE)   // We already have a policy - no need for a default one.
+        if (_pimpl->AudioPolicy != CACHE_AUDIO_NONE && _pimpl->AudioPolicy != CACHE_AUDIO_NOTHING)   // We already have a policy - no need for a default one.
           break;
 
-        frame_range=256*1024;
+        frame_range = (int)_pimpl->AudioInitialSize;
       }
 
       if (frame_range/_pimpl->SampleSize > _pimpl->MaxSampleCount) { // Only make bigger
-        char * NewAudioCache = (char*)realloc(_pimpl->AudioCache, frame_range);
-        if (NewAudioCache == NULL)
+        if (!ResizeAudioCache(frame_range, false))
         {
           throw std::bad_alloc();
         }
-        _pimpl->AudioCache = NewAudioCache;
-
-        _pimpl->MaxSampleCount = frame_range/_pimpl->SampleSize;
       }
 
       _pimpl->AudioPolicy = (CachePolicyHint)cachehints;
+      _pimpl->AudioScore = 0;
+      _pimpl->AudioTooSmallCount = 0;
       break;
+    }
 
     case CACHE_AUDIO_NONE:
     case CACHE_AUDIO_NOTHING:
-      free(_pimpl->AudioCache);
-      _pimpl->AudioCache = NULL;
-      _pimpl->MaxSampleCount = 0;
+    {
+      std::lock_guard<std::mutex> lock(_pimpl->AudioMutex);
+      // For CACHE_AUDIO_NONE the range is the initial size once auto mode switches the cache on
+      if (cachehints == CACHE_AUDIO_NONE && frame_range > 0)
+        _pimpl->AudioInitialSize = frame_range;
+      ResizeAudioCache(0, false);
       _pimpl->AudioPolicy = (CachePolicyHint)cachehints;
+      _pimpl->AudioScore = 0;
       break;
+    }
 
     case CACHE_GET_AUDIO_POLICY: // Get the current audio policy.
       return _pimpl->AudioPolicy;
@@ -433,6 +636,12 @@ int __stdcall Cache::SetCacheHints(int cachehints, int frame_range)
     case CACHE_GET_AUDIO_SIZE: // Get the current audio cache size.
       return (int)(_pimpl->SampleSize * _pimpl->MaxSampleCount);
 
+    case CACHE_GET_AUDIO_HITS: // Get the number of audio requests served from the cache.
+      return (int)min(_pimpl->AudioHits, (__int64)INT_MAX);
+
+    case CACHE_GET_AUDIO_MISSES: // Get the number of audio requests that had to read from the child.
+      return (int)min(_pimpl->AudioMisses, (__int64)INT_MAX);
+
     case CACHE_PREFETCH_AUDIO_BEGIN:    // Begin queue request to prefetch audio (take critical section).
     case CACHE_PREFETCH_AUDIO_STARTLO:  // Set low 32 bits of start.
     case CACHE_PREFETCH_AUDIO_STARTHI:  // Set high 32 bits of start.
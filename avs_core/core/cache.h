@@ -49,6 +49,7 @@ private:
   IScriptEnvironment* Env;
   CachePimpl* _pimpl;
   void FillAudioZeros(void* buf, int start_offset, int count);
+  bool ResizeAudioCache(size_t nBytes, bool check_memory);
 
 public:
 #ifdef _DEBUG  
@@ -19,7 +19,32 @@
 //	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 
 #include <avs/cpuid.h>
+#include <atomic>
+#ifdef _MSC_VER
 #include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(int cpuinfo[4], int leaf, int subleaf = 0)
+{
+#ifdef _MSC_VER
+  __cpuidex(cpuinfo, leaf, subleaf);
+#else
+  __cpuid_count(leaf, subleaf, cpuinfo[0], cpuinfo[1], cpuinfo[2], cpuinfo[3]);
+#endif
+}
+
+static unsigned long long xgetbv(unsigned int xcr)
+{
+#ifdef _MSC_VER
+  return _xgetbv(xcr);
+#else
+  unsigned int eax, edx;
+  __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (xcr));
+  return ((unsigned long long)edx << 32) | eax;
+#endif
+}
 
 #define IS_BIT_SET(bitfield, bit) ((bitfield) & (1<<(bit)) ? true : false)
 
@@ -28,7 +53,7 @@ static int CPUCheckForExtensions()
   int result = 0;
   int cpuinfo[4];
 
-  __cpuid(cpuinfo, 1);
+  cpuid(cpuinfo, 1);
   if (IS_BIT_SET(cpuinfo[3], 0))
     result |= CPUF_FPU;
   if (IS_BIT_SET(cpuinfo[3], 23))
@@ -47,21 +72,35 @@ static int CPUCheckForExtensions()
     result |= CPUF_SSE4_2;
 
   // AVX
-#if (_MSC_FULL_VER >= 160040219)    // We require VC++2010 SP1 at least
+#if !defined(_MSC_VER) || (_MSC_FULL_VER >= 160040219)    // We require VC++2010 SP1 at least
   bool xgetbv_supported = IS_BIT_SET(cpuinfo[2], 27);
   bool avx_supported = IS_BIT_SET(cpuinfo[2], 28);
   if (xgetbv_supported && avx_supported)
   {
-    if ((_xgetbv(_XCR_XFEATURE_ENABLED_MASK) & 0x6ull) == 0x6ull)
-      result |= CPUF_AVX;   
+    if ((xgetbv(0) & 0x6ull) == 0x6ull)
+    {
+      result |= CPUF_AVX;
+      if (IS_BIT_SET(cpuinfo[2], 12))
+        result |= CPUF_FMA3;
+
+      // AVX2 is reported in the extended features leaf
+      int cpuinfo_ext[4];
+      cpuid(cpuinfo, 0);
+      if (cpuinfo[0] >= 7)
+      {
+        cpuid(cpuinfo_ext, 7, 0);
+        if (IS_BIT_SET(cpuinfo_ext[1], 5))
+          result |= CPUF_AVX2;
+      }
+    }
   }
 #endif
 
   // 3DNow!, 3DNow!, and ISSE
-  __cpuid(cpuinfo, 0x80000000);   
+  cpuid(cpuinfo, 0x80000000);   
   if (cpuinfo[0] >= 0x80000001) 
   {
-    __cpuid(cpuinfo, 0x80000001);   
+    cpuid(cpuinfo, 0x80000001);   
    
     if (IS_BIT_SET(cpuinfo[3], 31))
       result |= CPUF_3DNOW;   
@@ -76,7 +115,14 @@ static int CPUCheckForExtensions()
   return result;
 }
 
+// Mask applied to the detected extensions, see SetMaxCPU
+static std::atomic<int> lCPUExtensionsMask(~0);
+
 int GetCPUFlags() {
   static int lCPUExtensionsAvailable = CPUCheckForExtensions();
-  return lCPUExtensionsAvailable;
+  return lCPUExtensionsAvailable & lCPUExtensionsMask;
+}
+
+void SetMaxCPU(int new_flags) {
+  lCPUExtensionsMask = new_flags;
 }
@@ -32,6 +32,10 @@
 #ifndef AVSCORE_EXCEPTION_H
 #define AVSCORE_EXCEPTION_H
 
+#include <avs/config.h>
+
+#ifdef AVS_WINDOWS
+
 // IMPORTANT: Project must be compiled with /EHa
 #include <eh.h>
 
@@ -54,6 +58,15 @@ private:
     _se_translator_function m_prev;
 };
 
+#else
+
+// There are no structured exceptions to translate, faults stay fatal
+class SehGuard
+{
+};
+
+#endif
+
 class SehException
 {
 public:
@@ -491,7 +491,7 @@ const unsigned short font[][20] = {
 		0x3000,0x3000,0x3f00,0x0000,
 		0x0000,0x0000,0x0000,0x0000,
 	},
-	//STARTCHAR \ 
+	//STARTCHAR backslash
 	{
 		0x0000,0x0000,0x0000,0x3000,
 		0x3000,0x1800,0x1800,0x0c00,
@@ -902,7 +902,14 @@ static const AVS_Linkage avs_linkage = {    // struct AVS_Linkage {
 /**********************************************************************/
 };                                          // }
 
+#ifdef AVS_WINDOWS
 extern __declspec(dllexport) const AVS_Linkage* const AVS_linkage = &avs_linkage;
+#else
+// Plugins define a writable AVS_linkage of their own. An exported one would
+// be found before it by the dynamic linker and fault on the plugin's store,
+// so the core's stays hidden and plugins get it via AvisynthPluginInit3.
+extern __attribute__((__visibility__("hidden"))) const AVS_Linkage* const AVS_linkage = &avs_linkage;
+#endif
 
 
 /**********************************************************************/
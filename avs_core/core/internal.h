@@ -52,7 +52,8 @@ enum MANAGE_CACHE_KEYS
   MC_NodCache          = 0xFFFF0007,
   MC_NodAndExpandCache = 0xFFFF0008,
   MC_RegisterMTGuard,
-  MC_UnRegisterMTGuard
+  MC_UnRegisterMTGuard,
+  MC_QueryAvailableMemory
 };
 
 #include <avisynth.h>
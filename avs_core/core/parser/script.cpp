@@ -39,8 +39,14 @@
 #include <cstdlib>
 #include <cmath>
 #include <vector>
-#include <io.h>
 #include <avs/win.h>
+#ifdef AVS_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
 #include <avs/minmax.h>
 #include <new>
 #include <clocale>
@@ -193,6 +199,7 @@ extern const AVSFunction Script_functions[] = {
   { "Assert", BUILTIN_FUNC_PREFIX, "s", AssertEval },
 
   { "SetMemoryMax", BUILTIN_FUNC_PREFIX, "[]i", SetMemoryMax },
+  { "SetMaxCPU",    BUILTIN_FUNC_PREFIX, "s", SetMaxCPU },
 
   { "SetWorkingDir", BUILTIN_FUNC_PREFIX, "s", SetWorkingDir },
   { "Exist",         BUILTIN_FUNC_PREFIX, "s", Exist },
@@ -300,6 +307,8 @@ void ScriptFunction::Delete(void* self, IScriptEnvironment*)
  *******   Helper Functions   ******
  **********************************/
 
+#ifdef AVS_WINDOWS
+
 CWDChanger::CWDChanger(const char* new_cwd) :
   old_working_directory(NULL)
 {
@@ -336,6 +345,36 @@ DllDirChanger::~DllDirChanger(void)
   delete [] old_directory;
 }
 
+#else
+
+CWDChanger::CWDChanger(const char* new_cwd) :
+  old_working_directory(NULL)
+{
+  old_working_directory = getcwd(NULL, 0);
+  restore = old_working_directory && chdir(new_cwd) == 0;
+}
+
+CWDChanger::~CWDChanger(void)
+{
+  if (restore && chdir(old_working_directory) != 0)
+    restore = false;
+
+  free(old_working_directory);
+}
+
+// The dynamic loader has no search directory to change, dependencies of a
+// plugin are found through its rpath or LD_LIBRARY_PATH
+DllDirChanger::DllDirChanger(const char* new_dir) :
+  old_directory(NULL), restore(false)
+{
+}
+
+DllDirChanger::~DllDirChanger(void)
+{
+}
+
+#endif
+
 AVSValue Assert(AVSValue args, void*, IScriptEnvironment* env) 
 {
   if (!args[0].AsBool())
@@ -400,6 +439,7 @@ AVSValue Import(AVSValue args, void*, IScriptEnvironment* env)
   for (int i=0; i<args.ArraySize(); ++i) {
     const char* script_name = args[i].AsString();
 
+#ifdef AVS_WINDOWS
     TCHAR full_path[AVS_MAX_PATH];
     TCHAR* file_part;
     if (strchr(script_name, '\\') || strchr(script_name, '/')) {
@@ -415,6 +455,16 @@ AVSValue Import(AVSValue args, void*, IScriptEnvironment* env)
     HANDLE h = ::CreateFile(full_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
     if (h == INVALID_HANDLE_VALUE)
       env->ThrowError("Import: couldn't open \"%s\"", full_path);
+#else
+    char full_path[AVS_MAX_PATH];
+    if (!realpath(script_name, full_path))
+      env->ThrowError("Import: unable to locate \"%s\" (try specifying a path), error=0x%x", script_name, errno);
+    char* file_part = strrchr(full_path, '/') + 1;
+
+    FILE* h = fopen(full_path, "rb");
+    if (!h)
+      env->ThrowError("Import: couldn't open \"%s\"", full_path);
+#endif
 
     size_t dir_part_len = file_part - full_path;
 
@@ -431,10 +481,19 @@ AVSValue Import(AVSValue args, void*, IScriptEnvironment* env)
     *file_part = 0;
     CWDChanger change_cwd(full_path);
 
+#ifdef AVS_WINDOWS
     DWORD size = GetFileSize(h, NULL);
     std::vector<char> buf(size+1, 0);
     BOOL status = ReadFile(h, buf.data(), size, &size, NULL);
     CloseHandle(h);
+#else
+    fseek(h, 0, SEEK_END);
+    size_t size = ftell(h);
+    fseek(h, 0, SEEK_SET);
+    std::vector<char> buf(size+1, 0);
+    bool status = fread(buf.data(), 1, size, h) == size;
+    fclose(h);
+#endif
     if (!status)
       env->ThrowError("Import: unable to read \"%s\"", script_name);
 
@@ -472,6 +531,32 @@ AVSValue ScriptDir (AVSValue args, void*, IScriptEnvironment* env) { return env-
 AVSValue SetMemoryMax(AVSValue args, void*, IScriptEnvironment* env) { return env->SetMemoryMax(args[0].AsInt(0)); }
 AVSValue SetWorkingDir(AVSValue args, void*, IScriptEnvironment* env) { return env->SetWorkingDir(args[0].AsString()); }
 
+AVSValue SetMaxCPU(AVSValue args, void*, IScriptEnvironment* env)
+{
+  // each level also allows the ones before it
+  static const struct { const char* name; int flags; } levels[] = {
+    { "none",   0 },
+    { "sse2",   CPUF_FPU | CPUF_MMX | CPUF_INTEGER_SSE | CPUF_SSE | CPUF_SSE2 | CPUF_3DNOW | CPUF_3DNOW_EXT },
+    { "sse3",   CPUF_SSE3 },
+    { "ssse3",  CPUF_SSSE3 },
+    { "sse4.1", CPUF_SSE4_1 },
+    { "sse4.2", CPUF_SSE4_2 },
+    { "avx",    CPUF_AVX },
+    { "avx2",   ~0 },
+  };
+  const char* name = args[0].AsString();
+  int flags = 0;
+  for (const auto& level : levels) {
+    flags |= level.flags;
+    if (!lstrcmpi(name, level.name)) {
+      ::SetMaxCPU(flags);
+      return AVSValue();
+    }
+  }
+  env->ThrowError("SetMaxCPU: unknown level \"%s\", use none, sse2, sse3, ssse3, sse4.1, sse4.2, avx or avx2", name);
+  return AVSValue();
+}
+
 AVSValue Muldiv(AVSValue args, void*, IScriptEnvironment* env) { return int(MulDiv(args[0].AsInt(), args[1].AsInt(), args[2].AsInt())); }
 
 AVSValue Floor(AVSValue args, void*, IScriptEnvironment* env) { return int(floor(args[0].AsFloat())); }
@@ -648,7 +733,7 @@ AVSValue Select(AVSValue args, void*, IScriptEnvironment* env)
   return args[1][i];
 }
 
-AVSValue NOP(AVSValue args, void*, IScriptEnvironment* env) { return NULL;}
+AVSValue NOP(AVSValue args, void*, IScriptEnvironment* env) { return 0;}
 
 AVSValue Undefined(AVSValue args, void*, IScriptEnvironment* env) { return AVSValue();}
 
@@ -658,6 +743,7 @@ AVSValue Exist(AVSValue args, void*, IScriptEnvironment* env) {
   if (strchr(filename, '*') || strchr(filename, '?')) // wildcard
       return false;
 
+#ifdef AVS_WINDOWS
   struct _finddata_t c_file;
 
   intptr_t f = _findfirst(filename, &c_file);
@@ -668,6 +754,10 @@ AVSValue Exist(AVSValue args, void*, IScriptEnvironment* env) {
   _findclose(f);
 
   return true;
+#else
+  struct stat st;
+  return stat(filename, &st) == 0;
+#endif
 }
 
 
@@ -886,7 +976,7 @@ AVSValue AudioRate(AVSValue args, void*, IScriptEnvironment* env) { return VI(ar
 AVSValue AudioLength(AVSValue args, void*, IScriptEnvironment* env) { return (int)VI(args[0]).num_audio_samples; }  // Truncated to int
 AVSValue AudioLengthLo(AVSValue args, void*, IScriptEnvironment* env) { return (int)(VI(args[0]).num_audio_samples % (unsigned)args[1].AsInt(1000000000)); }
 AVSValue AudioLengthHi(AVSValue args, void*, IScriptEnvironment* env) { return (int)(VI(args[0]).num_audio_samples / (unsigned)args[1].AsInt(1000000000)); }
-AVSValue AudioLengthS(AVSValue args, void*, IScriptEnvironment* env) { char s[32]; return env->SaveString(_i64toa(VI(args[0]).num_audio_samples, s, 10)); } 
+AVSValue AudioLengthS(AVSValue args, void*, IScriptEnvironment* env) { return env->Sprintf("%lld", VI(args[0]).num_audio_samples); } 
 AVSValue AudioLengthF(AVSValue args, void*, IScriptEnvironment* env) { return (float)VI(args[0]).num_audio_samples; } // at least this will give an order of the size
 AVSValue AudioDuration(AVSValue args, void*, IScriptEnvironment* env) {
   const VideoInfo& vi = VI(args[0]);
@@ -928,21 +1018,28 @@ AVSValue String(AVSValue args, void*, IScriptEnvironment* env)
 		return "";	// <--WE
   } else {	// standard behaviour
 	  if (args[0].IsInt()) {
-		char s[12];
-		return env->SaveString(_itoa(args[0].AsInt(), s, 10));
+		return env->Sprintf("%d", args[0].AsInt());
 	  }
 	  if (args[0].IsFloat()) {
 		char s[30];
+#ifdef AVS_WINDOWS
     _locale_t locale = _create_locale(LC_NUMERIC, "C"); // decimal point: dot
     _sprintf_l(s,"%lf", locale, args[0].AsFloat());
     _free_locale(locale);
+#else
+    locale_t locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0); // decimal point: dot
+    locale_t old_locale = uselocale(locale);
+    snprintf(s, sizeof(s), "%lf", args[0].AsFloat());
+    uselocale(old_locale);
+    freelocale(locale);
+#endif
 		return env->SaveString(s);
 	  }
   }
   return "";
 } 
 
-AVSValue Hex(AVSValue args, void*, IScriptEnvironment* env) { char s[9]; return env->SaveString(_itoa(args[0].AsInt(), s, 16)); } 
+AVSValue Hex(AVSValue args, void*, IScriptEnvironment* env) { return env->Sprintf("%x", args[0].AsInt()); } 
 
 AVSValue IsBool(AVSValue args, void*, IScriptEnvironment* env) { return args[0].IsBool(); }
 AVSValue IsInt(AVSValue args, void*, IScriptEnvironment* env) { return args[0].IsInt(); }
@@ -956,7 +1053,7 @@ AVSValue VersionNumber(AVSValue args, void*, IScriptEnvironment* env) { return A
 AVSValue VersionString(AVSValue args, void*, IScriptEnvironment* env) { return AVS_FULLVERSION; }
 
 AVSValue Int(AVSValue args, void*, IScriptEnvironment* env) { return int(args[0].AsFloat()); }
-AVSValue Frac(AVSValue args, void*, IScriptEnvironment* env) { return args[0].AsFloat() - __int64(args[0].AsFloat()); }
+AVSValue Frac(AVSValue args, void*, IScriptEnvironment* env) { return args[0].AsFloat() - (__int64)(args[0].AsFloat()); }
 AVSValue Float(AVSValue args, void*, IScriptEnvironment* env) { return args[0].AsFloat(); }
 
 AVSValue Value(AVSValue args, void*, IScriptEnvironment* env) { char *stopstring; return strtod(args[0].AsString(),&stopstring); }
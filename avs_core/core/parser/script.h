@@ -39,7 +39,9 @@
 #include <avs/win.h>
 #include "expression.h"
 #include "scriptparser.h"
+#ifdef AVS_WINDOWS
 #include <tchar.h>
+#endif
 
 
 /********************************************************************
@@ -83,6 +85,7 @@ AVSValue Import(AVSValue args, void*, IScriptEnvironment* env);
 AVSValue SetMemoryMax(AVSValue args, void*, IScriptEnvironment* env);
 
 AVSValue SetWorkingDir(AVSValue args, void*, IScriptEnvironment* env);
+AVSValue SetMaxCPU(AVSValue args, void*, IScriptEnvironment* env);
 
 /*****   Entry/Factory Methods   ******/
 
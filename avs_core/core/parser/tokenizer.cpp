@@ -38,6 +38,7 @@
 
 #include <cfloat>
 #include <climits>
+#include <cctype>
 
 
 
@@ -0,0 +1,387 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#include "AVIIndexCache.h"
+#include <avs/win.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+namespace {
+
+const char kMagic[8] = { 'A','V','S','I','D','X','0','1' };
+
+enum {
+	kFlagFakeIndex		= 1,
+	kFlagAggressive		= 2,
+	kFlagHyperIndexed	= 4,
+};
+
+unsigned __int64 HashFNV1a(const void *data, size_t len, unsigned __int64 h = 0xcbf29ce484222325ui64) {
+	const unsigned char *p = (const unsigned char *)data;
+
+	while(len--)
+		h = (h ^ *p++) * 0x100000001b3ui64;
+
+	return h;
+}
+
+bool GetFileStamp(const char *pszFile, __int64& size, __int64& mtime) {
+#ifdef _WIN32
+	struct _stat64 st;
+
+	if (_stat64(pszFile, &st))
+		return false;
+#else
+	struct stat st;
+
+	if (stat(pszFile, &st))
+		return false;
+#endif
+
+	size	= (__int64)st.st_size;
+	mtime	= (__int64)st.st_mtime;
+	return true;
+}
+
+std::string GetTempCachePath(const char *pszFile) {
+	std::string dir;
+
+#ifdef _WIN32
+	char buf[MAX_PATH + 1];
+	DWORD len = GetTempPathA(sizeof buf, buf);
+
+	if (!len || len > MAX_PATH)
+		return std::string();
+
+	dir.assign(buf, len);
+#else
+	const char *tmp = getenv("TMPDIR");
+
+	dir = tmp && *tmp ? tmp : "/tmp";
+	if (dir[dir.size()-1] != '/')
+		dir += '/';
+#endif
+
+	char name[40];
+	sprintf(name, "avsidx_%016llx.avsidx", (unsigned long long)HashFNV1a(pszFile, strlen(pszFile)));
+
+	return dir + name;
+}
+
+class Writer {
+public:
+	std::vector<unsigned char> buf;
+
+	void Put(const void *p, size_t len) {
+		buf.insert(buf.end(), (const unsigned char *)p, (const unsigned char *)p + len);
+	}
+
+	void Put32(unsigned long v) {
+		for(int i=0; i<4; ++i)
+			buf.push_back((unsigned char)(v >> (8*i)));
+	}
+
+	void Put64(unsigned __int64 v) {
+		for(int i=0; i<8; ++i)
+			buf.push_back((unsigned char)(v >> (8*i)));
+	}
+
+	void PutVarint(unsigned __int64 v) {
+		while(v >= 0x80) {
+			buf.push_back((unsigned char)(v | 0x80));
+			v >>= 7;
+		}
+		buf.push_back((unsigned char)v);
+	}
+};
+
+class Reader {
+public:
+	Reader(const unsigned char *p, size_t len) : ptr(p), limit(p + len), ok(true) {}
+
+	bool Get(void *dst, size_t len) {
+		if ((size_t)(limit - ptr) < len)
+			return ok = false;
+
+		memcpy(dst, ptr, len);
+		ptr += len;
+		return true;
+	}
+
+	unsigned long Get32() {
+		unsigned char b[4] = {0};
+		Get(b, 4);
+		return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned long)b[3] << 24);
+	}
+
+	unsigned __int64 Get64() {
+		unsigned __int64 lo = Get32();
+		return lo | ((unsigned __int64)Get32() << 32);
+	}
+
+	unsigned __int64 GetVarint() {
+		unsigned __int64 v = 0;
+
+		for(int shift=0; shift<64; shift+=7) {
+			if (ptr >= limit)
+				break;
+
+			unsigned char b = *ptr++;
+
+			v |= (unsigned __int64)(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+
+		ok = false;
+		return 0;
+	}
+
+	bool Ok() const { return ok; }
+	bool AtEnd() const { return ptr == limit; }
+
+private:
+	const unsigned char *ptr, *limit;
+	bool ok;
+};
+
+bool ReadWholeFile(const std::string& path, std::vector<unsigned char>& data) {
+	FILE *f = fopen(path.c_str(), "rb");
+
+	if (!f)
+		return false;
+
+	unsigned char buf[65536];
+	size_t n;
+
+	while((n = fread(buf, 1, sizeof buf, f)) > 0)
+		data.insert(data.end(), buf, buf + n);
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+bool WriteWholeFile(const std::string& path, const std::vector<unsigned char>& data) {
+	FILE *f = fopen(path.c_str(), "wb");
+
+	if (!f)
+		return false;
+
+	bool ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+
+	if (fclose(f))
+		ok = false;
+
+	if (!ok)
+		remove(path.c_str());
+
+	return ok;
+}
+
+// Chunks mostly follow each other directly, so positions are stored as the
+// distance from where the previous chunk of the same stream ended.
+
+inline __int64 NextExpectedPos(const AVIIndexEntry2& e) {
+	const __int64 len = e.size & 0x7FFFFFFF;
+
+	return e.pos + len + (len & 1);
+}
+
+}	// namespace
+
+
+void AVIIndexCache::AddStream(FOURCC fccType, __int64 bytes, const AVIIndexEntry2 *pIndex, int count) {
+	streams.push_back(Stream());
+
+	Stream& s = streams.back();
+
+	s.fccType	= fccType;
+	s.bytes		= bytes;
+	s.entries.assign(pIndex, pIndex + count);
+}
+
+bool AVIIndexCache::Save(const char *pszFile) const {
+	__int64 size, mtime;
+
+	if (!GetFileStamp(pszFile, size, mtime))
+		return false;
+
+	Writer w;
+	const size_t pathlen = strlen(pszFile);
+
+	w.Put(kMagic, sizeof kMagic);
+	w.Put64(size);
+	w.Put64(mtime);
+	w.Put32((unsigned long)pathlen);
+	w.Put(pszFile, pathlen);
+	w.Put32((fFakeIndex ? kFlagFakeIndex : 0) | (fAggressive ? kFlagAggressive : 0) | (fHyperIndexed ? kFlagHyperIndexed : 0));
+	w.Put32((unsigned long)streams.size());
+
+	for(size_t i=0; i<streams.size(); ++i) {
+		const Stream& s = streams[i];
+
+		w.Put32(s.fccType);
+		w.Put64(s.bytes);
+		w.PutVarint(s.entries.size());
+
+		__int64 expected = 0;
+		FOURCC ckid = 0;
+
+		for(size_t j=0; j<s.entries.size(); ++j) {
+			const AVIIndexEntry2& e = s.entries[j];
+			const __int64 delta = e.pos - expected;
+			const bool bNewId = !j || e.ckid != ckid;
+
+			w.PutVarint(((unsigned __int64)(e.size & 0x7FFFFFFF) << 2) | (e.size < 0 ? 2 : 0) | (bNewId ? 1 : 0));
+			if (bNewId)
+				w.Put32(ckid = e.ckid);
+
+			w.PutVarint(((unsigned __int64)delta << 1) ^ (unsigned __int64)(delta >> 63));
+
+			expected = NextExpectedPos(e);
+		}
+	}
+
+	w.Put64(HashFNV1a(&w.buf[0], w.buf.size()));
+
+	const std::string local = std::string(pszFile) + ".avsidx";
+
+	if (WriteWholeFile(local, w.buf))
+		return true;
+
+	const std::string temp = GetTempCachePath(pszFile);
+
+	return !temp.empty() && WriteWholeFile(temp, w.buf);
+}
+
+bool AVIIndexCache::Load(const char *pszFile) {
+	__int64 size, mtime;
+
+	if (!GetFileStamp(pszFile, size, mtime))
+		return false;
+
+	std::vector<unsigned char> data;
+
+	if (!ReadWholeFile(std::string(pszFile) + ".avsidx", data)) {
+		const std::string temp = GetTempCachePath(pszFile);
+
+		if (temp.empty() || !ReadWholeFile(temp, data))
+			return false;
+	}
+
+	if (data.size() < sizeof kMagic + 8 || memcmp(&data[0], kMagic, sizeof kMagic))
+		return false;
+
+	Reader r(&data[0], data.size() - 8);
+
+	if (HashFNV1a(&data[0], data.size() - 8) != Reader(&data[data.size() - 8], 8).Get64())
+		return false;
+
+	char magic[sizeof kMagic];
+	r.Get(magic, sizeof magic);
+
+	if ((__int64)r.Get64() != size || (__int64)r.Get64() != mtime)
+		return false;
+
+	const unsigned long pathlen = r.Get32();
+
+	if (!r.Ok() || pathlen != strlen(pszFile))
+		return false;
+
+	std::string path(pathlen, '\0');
+
+	if (!r.Get(&path[0], pathlen) || path != pszFile)
+		return false;
+
+	const unsigned long flags = r.Get32();
+	const unsigned long count = r.Get32();
+
+	if (!r.Ok() || count > 100)
+		return false;
+
+	std::vector<Stream> loaded(count);
+
+	for(unsigned long i=0; i<count; ++i) {
+		Stream& s = loaded[i];
+
+		s.fccType	= r.Get32();
+		s.bytes		= r.Get64();
+
+		const unsigned __int64 entries = r.GetVarint();
+
+		// every entry takes at least two bytes
+		if (!r.Ok() || entries > data.size() / 2)
+			return false;
+
+		s.entries.resize((size_t)entries);
+
+		__int64 expected = 0;
+		FOURCC ckid = 0;
+
+		for(size_t j=0; j<s.entries.size(); ++j) {
+			AVIIndexEntry2& e = s.entries[j];
+			const unsigned __int64 v = r.GetVarint();
+
+			if (v & 1)
+				ckid = r.Get32();
+
+			const unsigned __int64 z = r.GetVarint();
+
+			if (!r.Ok())
+				return false;
+
+			e.ckid	= ckid;
+			e.size	= (long)((v >> 2) & 0x7FFFFFFF) | (v & 2 ? 0x80000000 : 0);
+			e.pos	= expected + (__int64)((z >> 1) ^ (0 - (z & 1)));
+
+			expected = NextExpectedPos(e);
+		}
+	}
+
+	if (!r.AtEnd())
+		return false;
+
+	streams.swap(loaded);
+	fFakeIndex		= !!(flags & kFlagFakeIndex);
+	fAggressive		= !!(flags & kFlagAggressive);
+	fHyperIndexed	= !!(flags & kFlagHyperIndexed);
+	return true;
+}
@@ -0,0 +1,72 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef f_AVIINDEXCACHE_H
+#define f_AVIINDEXCACHE_H
+
+#include "AVIIndex.h"
+#include <vector>
+
+
+// Sidecar cache of the per-stream index AVIReadHandler builds while parsing
+// a file.  Rebuilding that index means reading every OpenDML standard index
+// block or, without an index, walking every chunk of the movi data; on
+// files of tens of gigabytes that dominates the time to open them.
+//
+// The cache is stored next to the file as "<file>.avsidx", or in the temp
+// directory if that location is not writable, and is only used while the
+// path, size and modification time of the file match the ones recorded in
+// it.  Entries are delta coded, which typically takes 2-4 bytes per chunk.
+class AVIIndexCache {
+public:
+	struct Stream {
+		FOURCC		fccType;
+		__int64		bytes;
+		std::vector<AVIIndexEntry2> entries;
+	};
+
+	std::vector<Stream>	streams;
+	bool	fFakeIndex;			// index was rebuilt by scanning the file
+	bool	fAggressive;		// ... in aggressive recovery mode
+	bool	fHyperIndexed;		// index came from OpenDML index blocks
+
+	AVIIndexCache() : fFakeIndex(false), fAggressive(false), fHyperIndexed(false) {}
+
+	void AddStream(FOURCC fccType, __int64 bytes, const AVIIndexEntry2 *pIndex, int count);
+
+	bool Load(const char *pszFile);
+	bool Save(const char *pszFile) const;
+};
+
+#endif
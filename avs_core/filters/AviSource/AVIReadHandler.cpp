@@ -26,10 +26,17 @@
 #include "List.h"
 #include "Fixes.h"
 #include "File64.h"
+#include "ReadAhead.h"
+#include "FileMap.h"
+#include "AVIScan.h"
+#include "AVIIndexCache.h"
 
 #include "clip_info.h"
 
 #include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 #pragma warning(disable: 4706)    // assignment within conditional expression
@@ -70,14 +77,6 @@ AvisynthError MyWin32Error(const char *format, DWORD err, ...) {
   return AvisynthError(exception_conversion_buffer);
 }
 
-// Copied over from VD_misc.cpp, as the only function being used from there
-static bool isValidFOURCC(FOURCC fcc) {
-	return isprint((unsigned char)(fcc>>24))
-		&& isprint((unsigned char)(fcc>>16))
-		&& isprint((unsigned char)(fcc>> 8))
-		&& isprint((unsigned char)(fcc    ));
-}
-
 //#define STREAMING_DEBUG
 
 // HACK!!!!
@@ -349,6 +348,8 @@ public:
 	__int64 getStreamPtr();
 	void FixCacheProblems(class AVIReadStream *);
 	long ReadData(int stream, void *buffer, __int64 position, long len);
+	const void *MapData(__int64 position, long len);
+	const std::vector<std::string>& getFilePaths() const { return vFilePaths; }
 
 private:
 //	enum { STREAM_SIZE = 65536 };
@@ -378,9 +379,25 @@ private:
 
 	List2<AVIStreamNode>		listStreams;
 	List2<AVIFileDesc>			listFiles;
+	std::vector<std::string>	vFilePaths;		// by segment number; empty for tunneled files
+	std::vector<ReadOnlyFileMap *>	vFileMaps;	// created on first MapData() per segment
+
+	// Index scans of files at least this large are split across threads.
+
+	enum { PARALLEL_SCAN_MIN_BYTES = 256*1048576 };
+
+	// Only set while a file is being parsed.
+
+	const char *	pszParsePath;
+	AVIIndexCache *	pIndexCache;		// index to take instead of reading it from the file
+	AVIIndexCache *	pIndexCacheSave;	// receives the index built from the file
 
 	void		_construct(const char *pszFile);
+	void		_parseFileCached(List2<AVIStreamNode>& streams, const char *pszFile);
 	void		_parseFile(List2<AVIStreamNode>& streams);
+	bool		_applyIndexCache(List2<AVIStreamNode>& streams);
+	bool		_scanParallel(List2<AVIStreamNode>& streams, __int64 i64Start, __int64 i64FileSize, DWORD dwLengthLeft, bool bStopWhenLengthExhausted);
+	void		_addScannedChunk(List2<AVIStreamNode>& streams, FOURCC fccType, __int64 pos, DWORD dwLength);
 	bool		_parseStreamHeader(List2<AVIStreamNode>& streams, DWORD dwLengthLeft, bool& bIndexDamaged);
 	bool		_parseIndexBlock(List2<AVIStreamNode>& streams, int count, __int64);
 	void		_parseExtendedIndexBlock(List2<AVIStreamNode>& streams, AVIStreamNode *pasn, __int64 fpos, DWORD dwLength);
@@ -597,6 +614,7 @@ public:
 	bool isStreaming();
 	bool isKeyframeOnly();
 	bool getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev) { return false; }
+	const void *MapSample(long lStart, long *plBytes) { return NULL; }
 
 private:
 	IAvisynthClipInfo *const pAvisynthClipInfo;
@@ -711,6 +729,7 @@ public:
 	bool isKeyframeOnly();
 	void Reinit();
 	bool getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev);
+	const void *MapSample(long lStart, long *plBytes);
 
 private:
 	AVIReadHandler *parent;
@@ -731,6 +750,20 @@ private:
 	__int64		i64CachedPosition;
 	AVIIndexEntry2	*pCachedEntry;
 
+	// video read-ahead
+
+	enum { READAHEAD_POOL_SIZE = 64*1048576 };
+	enum { READAHEAD_MAX_CHUNKS = 16 };
+
+	AVIReadAhead	*pReadAhead;
+	bool		fReadAheadTried;
+	long		lReadAheadLast;
+	long		lReadAheadStep;
+
+	void		_BeginReadAhead();
+	void		_ScheduleReadAhead(long lStart);
+	void		_EndReadAhead();
+
 };
 
 ///////////////////////////////////////////////////////////////////////////
@@ -747,6 +780,11 @@ AVIReadStream::AVIReadStream(AVIReadHandler *parent, AVIStreamNode *psnData, int
 	fStreamingActive = false;
 	fRealTime = false;
 
+	pReadAhead = NULL;
+	fReadAheadTried = false;
+	lReadAheadLast = -1;
+	lReadAheadStep = 1;
+
 	parent->AddRef();
 
 	pIndex = psnData->index.index2Ptr();
@@ -767,6 +805,7 @@ AVIReadStream::AVIReadStream(AVIReadHandler *parent, AVIStreamNode *psnData, int
 }
 
 AVIReadStream::~AVIReadStream() {
+	_EndReadAhead();
 	EndStreaming();
 	parent->Release();
 	Remove();
@@ -776,6 +815,92 @@ void AVIReadStream::Reinit() {
 	pIndex = psnData->index.index2Ptr();
 	i64CachedPosition = 0;
 	pCachedEntry = pIndex;
+
+	// The index and segment list changed; restart read-ahead on next read.
+
+	_EndReadAhead();
+}
+
+// Video chunks are prefetched by a reader thread on its own file handles
+// so that disk (or network) latency overlaps with decompression.  Only
+// handlers opened from files can do this; tunneled AVIFile streams cannot.
+
+void AVIReadStream::_BeginReadAhead() {
+	fReadAheadTried = true;
+
+	if (parent->fDisableFastIO || parent->getFilePaths().empty() || frames < 2)
+		return;
+
+	long lMaxSize = 0;
+
+	for(long i=0; i<frames; ++i) {
+		long size = pIndex[i].size & 0x7FFFFFFF;
+
+		if (size > lMaxSize)
+			lMaxSize = size;
+	}
+
+	if (!lMaxSize)
+		return;
+
+	long slots = READAHEAD_POOL_SIZE / lMaxSize;
+
+	if (slots > READAHEAD_MAX_CHUNKS)
+		slots = READAHEAD_MAX_CHUNKS;
+	else if (slots < 2)
+		slots = 2;
+
+	pReadAhead = new(std::nothrow) AVIReadAhead(parent->getFilePaths(), (int)slots, lMaxSize);
+
+	if (pReadAhead && !pReadAhead->IsOpen())
+		_EndReadAhead();
+}
+
+// Follows the access direction: a small constant stride (forward, backward,
+// or every n-th frame) is extrapolated, anything else is treated as a seek
+// after which playback goes forward.
+
+void AVIReadStream::_ScheduleReadAhead(long lStart) {
+	AVIReadAhead::Request req[READAHEAD_MAX_CHUNKS];
+	int count = 0;
+
+	if (lReadAheadLast >= 0) {
+		long step = lStart - lReadAheadLast;
+
+		lReadAheadStep = (step && step >= -8 && step <= 8) ? step : 1;
+	}
+
+	lReadAheadLast = lStart;
+
+	long pos = lStart;
+
+	while(count < READAHEAD_MAX_CHUNKS) {
+		pos += lReadAheadStep;
+
+		if (pos < 0 || pos >= frames)
+			break;
+
+		const AVIIndexEntry2 *avie2 = &pIndex[pos];
+		long size = avie2->size & 0x7FFFFFFF;
+
+		if (!size)
+			continue;
+
+		req[count].key = pos;
+		req[count].pos = avie2->pos + 8;
+		req[count].len = size;
+		++count;
+	}
+
+	pReadAhead->Schedule(req, count);
+}
+
+void AVIReadStream::_EndReadAhead() {
+	delete pReadAhead;
+	pReadAhead = NULL;
+	fReadAheadTried = false;
+	lReadAheadLast = -1;
+	lReadAheadStep = 1;
 }
 
 HRESULT AVIReadStream::BeginStreaming(long lStart, long lEnd, long lRate) {
@@ -1109,7 +1234,19 @@ HRESULT AVIReadStream::Read(long lStart, long lSamples, void *lpBuffer, long cbB
 			
 			long size = avie2->size & 0x7FFFFFFF;
 
-			if (psnData->cache && fStreamingActive && size < psnData->cache->getMaxRead()) {
+			if (!fReadAheadTried)
+				_BeginReadAhead();
+
+			lActual = -1;
+
+			if (pReadAhead) {
+				lActual = pReadAhead->Fetch(lStart, lpBuffer, size);
+				_ScheduleReadAhead(lStart);
+			}
+
+			if (lActual == size) {
+				// served by read-ahead
+			} else if (psnData->cache && fStreamingActive && size < psnData->cache->getMaxRead()) {
 //OutputDebugString("[v] attempting cached read\n");
 				lActual = psnData->cache->Read(lpBuffer, avie2->pos, avie2->pos + 8, size);
 				psnData->stream_bytes += lActual;
@@ -1249,6 +1386,27 @@ bool AVIReadStream::getVBRInfo(double& bitrate_mean, double& bitrate_stddev, dou
 	return false;
 }
 
+// Returns the chunk in place from a read-only mapping of its segment, or
+// NULL if the stream cannot be mapped (tunneled file, audio, 32-bit build).
+
+const void *AVIReadStream::MapSample(long lStart, long *plBytes) {
+	if (sampsize || lStart < 0 || lStart >= frames || parent->fDisableFastIO)
+		return NULL;
+
+	AVIIndexEntry2 *avie2 = &pIndex[lStart];
+	long size = avie2->size & 0x7FFFFFFF;
+
+	if (!size)
+		return NULL;
+
+	const void *p = parent->MapData(avie2->pos+8, size);
+
+	if (p && plBytes)
+		*plBytes = size;
+
+	return p;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 AVIReadHandler::AVIReadHandler(const char *s)
@@ -1269,6 +1427,9 @@ AVIReadHandler::AVIReadHandler(const char *s)
 	nFiles = 1;
 	nCurrentFile = 0;
 	pSegmentHint = NULL;
+	pszParsePath = NULL;
+	pIndexCache = NULL;
+	pIndexCacheSave = NULL;
 
 	if (!g_disklockinited) {
 		g_disklockinited=true;
@@ -1287,6 +1448,9 @@ AVIReadHandler::AVIReadHandler(PAVIFILE paf) {
 	streamBuffer = NULL;
 	pSegmentHint = NULL;
 	fFakeIndex = false;
+	pszParsePath = NULL;
+	pIndexCache = NULL;
+	pIndexCacheSave = NULL;
 
 	if (FAILED(paf->QueryInterface(IID_IAvisynthClipInfo, (void **)&pAvisynthClipInfo)))
 		pAvisynthClipInfo = NULL;
@@ -1337,7 +1501,7 @@ void AVIReadHandler::_construct(const char *pszFile) {
 
 		// recursively parse file
 
-		_parseFile(listStreams);
+		_parseFileCached(listStreams, pszFile);
 
 		// Create first link
 
@@ -1349,6 +1513,7 @@ void AVIReadHandler::_construct(const char *pszFile) {
 		pDesc->i64Size			= i64Size = _sizeFile();
 
 		listFiles.AddHead(pDesc);
+		vFilePaths.push_back(pszFile);
 
 	} catch(...) {
 		_destruct();
@@ -1381,7 +1546,7 @@ bool AVIReadHandler::AppendFile(const char *pszFile) {
 		);
 
 	try {
-		_parseFile(newstreams);
+		_parseFileCached(newstreams, pszFile);
 
 		pasn_old = listStreams.AtHead();
 		pasn_new = newstreams.AtHead();
@@ -1520,6 +1685,171 @@ bool AVIReadHandler::AppendFile(const char *pszFile) {
 
 	++nFiles;
 	listFiles.AddTail(pDesc);
+	vFilePaths.push_back(pszFile);
+
+	return true;
+}
+
+// Parses a file, taking the stream indices from the index cache when it is
+// current, and refreshes the cache when building them was expensive: from
+// OpenDML index blocks or by scanning the file.
+
+void AVIReadHandler::_parseFileCached(List2<AVIStreamNode>& streamlist, const char *pszFile) {
+	const int streams_start = streams;
+	const bool fFakeIndexStart = fFakeIndex;
+
+	pszParsePath = pszFile;
+
+	try {
+		AVIIndexCache cache;
+
+		if (cache.Load(pszFile)) {
+			pIndexCache = &cache;
+
+			try {
+				_parseFile(streamlist);
+
+				pIndexCache = NULL;
+				pszParsePath = NULL;
+				return;
+			} catch(const AvisynthError&) {
+				AVIStreamNode *pasn;
+
+				// The cache does not describe this file; parse it for real.
+
+				while(pasn = streamlist.RemoveHead())
+					delete pasn;
+
+				streams = streams_start;
+				fFakeIndex = fFakeIndexStart;
+				pIndexCache = NULL;
+			}
+
+			_seekFile(0);
+		}
+
+		AVIIndexCache fresh;
+
+		pIndexCacheSave = &fresh;
+		_parseFile(streamlist);
+		pIndexCacheSave = NULL;
+		pszParsePath = NULL;
+
+		if (fresh.fFakeIndex || fresh.fHyperIndexed)
+			fresh.Save(pszFile);
+	} catch(...) {
+		pszParsePath = NULL;
+		pIndexCache = NULL;
+		pIndexCacheSave = NULL;
+		throw;
+	}
+}
+
+bool AVIReadHandler::_applyIndexCache(List2<AVIStreamNode>& streamlist) {
+	AVIStreamNode *pasn = streamlist.AtHead(), *pasn_next;
+	size_t i = 0;
+
+	while(pasn_next = pasn->NextFromHead()) {
+		if (i >= pIndexCache->streams.size())
+			return false;
+
+		const AVIIndexCache::Stream& s = pIndexCache->streams[i++];
+
+		if (s.fccType != pasn->hdr.fccType)
+			return false;
+
+		pasn->index.clear();
+
+		for(size_t j=0; j<s.entries.size(); ++j) {
+			const AVIIndexEntry2& e = s.entries[j];
+
+			if (!pasn->index.add(e.ckid, e.pos, e.size & 0x7FFFFFFF, !(e.size & 0x80000000)))
+				throw MyMemoryError();
+		}
+
+		pasn->bytes = s.bytes;
+		pasn = pasn_next;
+	}
+
+	return i == pIndexCache->streams.size();
+}
+
+void AVIReadHandler::_addScannedChunk(List2<AVIStreamNode>& streamlist, FOURCC fccType, __int64 pos, DWORD dwLength) {
+	AVIStreamNode *pasn, *pasn_next;
+	int stream = StreamFromFOURCC(fccType);
+
+	if (stream >=0 && stream < streams) {
+
+		pasn = streamlist.AtHead();
+
+		while(stream-- && (pasn_next = pasn->NextFromHead()))
+			pasn = pasn_next;
+
+		if (pasn && pasn_next) {
+
+			// Set the keyframe flag for the first sample in the stream, or
+			// if this is known to be a keyframe-only stream.  Do not set the
+			// keyframe flag if the frame has zero bytes (drop frame).
+
+			pasn->index.add(fccType, pos, dwLength, (!pasn->bytes || pasn->keyframe_only) && dwLength>0);
+			pasn->bytes += dwLength;
+		}
+	}
+}
+
+// Replays the sequential index scan below from a chunk list collected by
+// several threads.  Returns false if the sequential scan has to run
+// instead: the chunk walk failed, or the scan would have switched to
+// aggressive recovery, which needs the file position by position.
+
+bool AVIReadHandler::_scanParallel(List2<AVIStreamNode>& streamlist, __int64 i64Start, __int64 i64FileSize, DWORD dwLengthLeft, bool bStopWhenLengthExhausted) {
+	std::vector<AVIScanChunk> chunks;
+	bool bDamaged = false;
+	int threads = (int)std::thread::hardware_concurrency();
+
+	if (threads > 8)
+		threads = 8;
+
+	if (threads < 2 || !AVIScanChunks(pszParsePath, i64Start, i64FileSize, threads, chunks, bDamaged))
+		return false;
+
+	AVIStreamNode *pasn, *pasn_next;
+	std::vector<__int64> bytes_start;
+
+	pasn = streamlist.AtHead();
+
+	while(pasn_next = pasn->NextFromHead()) {
+		bytes_start.push_back(pasn->bytes);
+		pasn = pasn_next;
+	}
+
+	size_t i;
+
+	for(i=0; i<chunks.size(); ++i) {
+		const AVIScanChunk& c = chunks[i];
+
+		if (!bStopWhenLengthExhausted && dwLengthLeft < 8)
+			break;
+
+		dwLengthLeft -= 8+(c.len + (c.len&1));
+
+		if (isxdigit(c.fcc&0xff) && isxdigit((c.fcc>>8)&0xff))
+			_addScannedChunk(streamlist, c.fcc, c.pos, c.len);
+	}
+
+	if (bDamaged && i == chunks.size() && (bStopWhenLengthExhausted || dwLengthLeft >= 8)) {
+		size_t j = 0;
+
+		pasn = streamlist.AtHead();
+
+		while(pasn_next = pasn->NextFromHead()) {
+			pasn->index.clear();
+			pasn->bytes = bytes_start[j++];
+			pasn = pasn_next;
+		}
+
+		return false;
+	}
 
 	return true;
 }
@@ -1620,7 +1950,9 @@ void AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist) {
 			break;
 
 		case ckidAVINEWINDEX:	// idx1
-			if (!hyperindexed) {
+			if (pIndexCache)
+				index_found = true;
+			else if (!hyperindexed) {
 				index_found = _parseIndexBlock(streamlist, dwLength/16, i64ChunkMoviPos);
 				dwLength &= 15;
 			}
@@ -1660,7 +1992,14 @@ void AVIReadHandler::_parseFile(List2<AVIStreamNode>& streamlist) {
 
 terminate_scan:
 
-	if (!hyperindexed && !index_found)
+	if (pIndexCache) {
+		if (!_applyIndexCache(streamlist))
+			throw MyError("AVI index cache does not match the file");
+
+		fFakeIndex |= pIndexCache->fFakeIndex;
+		bAggressive = pIndexCache->fAggressive;
+		bScanRequired = false;
+	} else if (!hyperindexed && !index_found)
 		bScanRequired = true;
 
 	if (bScanRequired) {
@@ -1697,8 +2036,14 @@ terminate_scan:
 		// valid chunks are found.
 
 		bool bStopWhenLengthExhausted = !hyperindexed && !bAggressive;
+		bool bScanned = false;
+
+		// Large files are walked by several threads at once.
+
+		if (!bAggressive && pszParsePath && i64FileSize - i64ChunkMoviPos >= PARALLEL_SCAN_MIN_BYTES)
+			bScanned = _scanParallel(streamlist, i64ChunkMoviPos, i64FileSize, dwLengthLeft, bStopWhenLengthExhausted);
 
-		for(;;) {
+		while(!bScanned) {
 //			pd.advance((long)((_posFile() - i64ChunkMoviPos)/1024));
 //			pd.check();
 
@@ -1753,8 +2098,6 @@ terminate_scan:
 				continue;
 			}
 
-			int stream;
-			
 //			_RPT2(0,"(stream header) Chunk '%-4s', length %08lx\n", &fccType, dwLength);
 
 			dwLengthLeft -= 8+(dwLength + (dwLength&1));
@@ -1782,33 +2125,19 @@ terminate_scan:
 			if (_posFile() > i64FileSize)
 				break;
 
-			if (isxdigit(fccType&0xff) && isxdigit((fccType>>8)&0xff)) {
-				stream = StreamFromFOURCC(fccType);
-
-				if (stream >=0 && stream < streams) {
-
-					pasn = streamlist.AtHead();
-
-					while(stream-- && (pasn_next = pasn->NextFromHead()))
-						pasn = pasn_next;
-
-					if (pasn && pasn_next) {
-
-						// Set the keyframe flag for the first sample in the stream, or
-						// if this is known to be a keyframe-only stream.  Do not set the
-						// keyframe flag if the frame has zero bytes (drop frame).
-
-						pasn->index.add(fccType, _posFile()-(dwLength + (dwLength&1))-8, dwLength, (!pasn->bytes || pasn->keyframe_only) && dwLength>0);
-						pasn->bytes += dwLength;
-					}
-				}
-
-			}
+			if (isxdigit(fccType&0xff) && isxdigit((fccType>>8)&0xff))
+				_addScannedChunk(streamlist, fccType, _posFile()-(dwLength + (dwLength&1))-8, dwLength);
 		}
 	}
 
 	bAggressivelyRecovered |= bAggressive;
 
+	if (pIndexCacheSave) {
+		pIndexCacheSave->fFakeIndex		= bScanRequired;
+		pIndexCacheSave->fAggressive	= bAggressive;
+		pIndexCacheSave->fHyperIndexed	= hyperindexed && !bScanRequired;
+	}
+
 	// glue together indices
 
 	pasn = streamlist.AtHead();
@@ -1819,6 +2148,9 @@ terminate_scan:
 
 		pasn->frames = pasn->index.indexLen();
 
+		if (pIndexCacheSave)
+			pIndexCacheSave->AddStream(pasn->hdr.fccType, pasn->bytes, pasn->index.index2Ptr(), pasn->frames);
+
 		// Clear sample size for video streams!
 
 		if (pasn->hdr.fccType == streamtypeVIDEO)
@@ -1932,7 +2264,7 @@ bool AVIReadHandler::_parseStreamHeader(List2<AVIStreamNode>& streamlist, DWORD
 				break;
 
 			case 'xdni':			// OpenDML extended index
-				{
+				if (!pIndexCache) {
 					__int64 posFileSave = _posFile();
 
 					try {
@@ -2158,6 +2490,9 @@ void AVIReadHandler::_destruct() {
 			delete pDesc;
 		}
 
+	for(size_t i=0; i<vFileMaps.size(); ++i)
+		delete vFileMaps[i];
+
 	delete [] pSegmentHint;
 }
 
@@ -2532,6 +2867,27 @@ long AVIReadHandler::ReadData(int stream, void *buffer, __int64 position, long l
 	return _readFile(buffer, len);
 }
 
+const void *AVIReadHandler::MapData(__int64 position, long len) {
+	size_t file = (size_t)(position>>48);
+
+	if (file >= vFilePaths.size())
+		return NULL;
+
+	if (vFileMaps.size() < vFilePaths.size())
+		vFileMaps.resize(vFilePaths.size(), NULL);
+
+	if (!vFileMaps[file]) {
+		if (!(vFileMaps[file] = new(std::nothrow) ReadOnlyFileMap))
+			return NULL;
+
+		// A failed Open() leaves an empty map behind so we don't retry.
+
+		vFileMaps[file]->Open(vFilePaths[file].c_str());
+	}
+
+	return vFileMaps[file]->Map(position & 0x0000FFFFFFFFFFFFi64, len);
+}
+
 void AVIReadHandler::_SelectFile(int file) {
 	AVIFileDesc *pDesc, *pDesc_next;
 
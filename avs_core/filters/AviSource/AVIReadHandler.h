@@ -44,6 +44,10 @@ public:
 	virtual bool isKeyframeOnly()=0;
 
 	virtual bool getVBRInfo(double& bitrate_mean, double& bitrate_stddev, double& maxdev)=0;
+
+	// Direct pointer to a video chunk if the file can be memory-mapped,
+	// otherwise NULL.  Valid for the lifetime of the handler.
+	virtual const void *MapSample(long lStart, long *plBytes)=0;
 };
 
 class IAVIReadHandler {
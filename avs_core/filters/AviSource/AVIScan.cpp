@@ -0,0 +1,290 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#include "AVIScan.h"
+#include "ReadAhead.h"
+
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+
+namespace {
+
+// Window over the file.  Chunk headers are tiny and, for compressed
+// streams, close together, so one read usually serves many of them.
+
+class ScanReader {
+public:
+	explicit ScanReader(ReadAheadFile& f) : file(f), buf(65536), base(0), valid(0) {}
+
+	bool Read(__int64 pos, void *dst, long len) {
+		if (pos < base || pos + len > base + valid) {
+			long r = file.ReadAt(pos, &buf[0], (long)buf.size());
+
+			base = pos;
+			valid = r < 0 ? 0 : r;
+
+			if (len > valid)
+				return false;
+		}
+
+		memcpy(dst, &buf[(size_t)(pos - base)], len);
+		return true;
+	}
+
+private:
+	ReadAheadFile& file;
+	std::vector<char> buf;
+	__int64 base;
+	long valid;
+};
+
+enum {
+	kHandoff,		// reached a chunk starting at or beyond the end of the range
+	kEnd,			// end of file
+	kDamaged,		// invalid chunk header
+	kNoSync,		// no chunk boundary found inside the range
+	kFailed			// I/O or memory failure
+};
+
+struct ScanRange {
+	__int64	start, end;
+	std::vector<AVIScanChunk> chunks;
+	__int64	handoff;
+	int		status;
+};
+
+// Position of the chunk following the one at pos, as AVIReadHandler's scan
+// would seek to it: RIFF/AVIX and LIST/movi are entered, everything else is
+// skipped.  Returns false at end of file.
+
+bool NextChunk(ScanReader& r, __int64 pos, FOURCC fcc, DWORD len, __int64 i64FileSize, __int64& next) {
+	next = pos + 8;
+
+	if (len) {
+		if (fcc == 'FFIR' || fcc == 'TSIL') {
+			FOURCC fcc2;
+
+			if (!r.Read(pos + 8, &fcc2, 4))
+				return false;
+
+			if (fcc2 != 'XIVA' && fcc2 != 'ivom')
+				next += len + (len&1);
+			else
+				next += 4;
+		} else
+			next += len + (len&1);
+	}
+
+	return next <= i64FileSize;
+}
+
+int WalkChunks(ScanReader& r, __int64 pos, __int64 end, __int64 i64FileSize, std::vector<AVIScanChunk>& chunks, __int64& handoff) {
+	for(;;) {
+		if (pos >= end) {
+			handoff = pos;
+			return kHandoff;
+		}
+
+		DWORD hdr[2];
+
+		if (!r.Read(pos, hdr, 8))
+			return kEnd;
+
+		if (!isValidFOURCC(hdr[0]) || pos + 8 + hdr[1] > i64FileSize)
+			return kDamaged;
+
+		__int64 next;
+
+		if (!NextChunk(r, pos, hdr[0], hdr[1], i64FileSize, next))
+			return kEnd;
+
+		AVIScanChunk c = { pos, hdr[0], hdr[1] };
+		chunks.push_back(c);
+
+		pos = next;
+	}
+}
+
+// Only chunk types that actually occur in movi data are accepted as a
+// resync point, which keeps false hits inside compressed data rare.
+
+bool IsSyncCandidate(FOURCC fcc, DWORD len, __int64 pos, __int64 i64FileSize) {
+	if (!isValidFOURCC(fcc) || pos + 8 + len > i64FileSize)
+		return false;
+
+	if (fcc == 'FFIR' || fcc == 'TSIL' || fcc == 'KNUJ')
+		return true;
+
+	const int c0 = fcc & 0xff, c1 = (fcc >> 8) & 0xff;
+	const int type = fcc >> 16;
+
+	if (c0 == 'i' && c1 == 'x')
+		return true;
+
+	return isxdigit(c0) && isxdigit(c1)
+		&& (type == 'cd' || type == 'bd' || type == 'bw' || type == 'xt' || type == 'cp');
+}
+
+bool ConfirmChain(ScanReader& r, __int64 pos, __int64 i64FileSize) {
+	for(int i=0; i<4; ++i) {
+		DWORD hdr[2];
+		__int64 next;
+
+		if (!r.Read(pos, hdr, 8) || !IsSyncCandidate(hdr[0], hdr[1], pos, i64FileSize))
+			return false;
+
+		if (!NextChunk(r, pos, hdr[0], hdr[1], i64FileSize, next))
+			return false;
+
+		if (next == i64FileSize)
+			return true;
+
+		pos = next;
+	}
+
+	return true;
+}
+
+void ScanRangeProc(const char *pszFile, __int64 i64FileSize, ScanRange *range, bool bSync) {
+	try {
+		ReadAheadFile f;
+
+		if (!f.Open(pszFile)) {
+			range->status = kFailed;
+			return;
+		}
+
+		ScanReader r(f), probe(f);
+		__int64 pos = range->start;
+
+		if (bSync) {
+			// chunks always start on an even offset
+			for(pos = (pos + 1) & ~1i64; pos < range->end; pos += 2) {
+				DWORD hdr[2];
+
+				if (!r.Read(pos, hdr, 8))
+					break;
+
+				if (IsSyncCandidate(hdr[0], hdr[1], pos, i64FileSize) && ConfirmChain(probe, pos, i64FileSize))
+					break;
+			}
+
+			if (pos >= range->end || pos + 8 > i64FileSize) {
+				range->status = kNoSync;
+				return;
+			}
+		}
+
+		range->status = WalkChunks(r, pos, range->end, i64FileSize, range->chunks, range->handoff);
+	} catch(...) {
+		range->chunks.clear();
+		range->status = kFailed;
+	}
+}
+
+bool ChunkPosLess(const AVIScanChunk& c, __int64 pos) {
+	return c.pos < pos;
+}
+
+}	// namespace
+
+
+bool AVIScanChunks(const char *pszFile, __int64 i64Start, __int64 i64FileSize, int threads,
+				   std::vector<AVIScanChunk>& chunks, bool& bDamaged) {
+	if (threads < 1)
+		threads = 1;
+
+	std::vector<ScanRange> ranges(threads);
+	const __int64 span = ((i64FileSize - i64Start) / threads) & ~1i64;
+
+	for(int k=0; k<threads; ++k) {
+		ranges[k].start		= i64Start + span * k;
+		ranges[k].end		= k+1 < threads ? ranges[k].start + span : 0x7FFFFFFFFFFFFFFFi64;
+		ranges[k].handoff	= -1;
+		ranges[k].status	= kFailed;
+	}
+
+	std::vector<std::thread> workers;
+
+	try {
+		for(int k=1; k<threads; ++k)
+			workers.push_back(std::thread(ScanRangeProc, pszFile, i64FileSize, &ranges[k], true));
+	} catch(...) {
+		// fewer workers; their ranges are walked below instead
+	}
+
+	ScanRangeProc(pszFile, i64FileSize, &ranges[0], false);
+
+	for(size_t i=0; i<workers.size(); ++i)
+		workers[i].join();
+
+	if (ranges[0].status == kFailed)
+		return false;
+
+	// Stitch the ranges together.  The walk of range k-1 ends on the first
+	// chunk at or past its end; range k is taken over from that chunk on if
+	// its own walk passed through it, otherwise that part is walked again.
+
+	ReadAheadFile f;
+	ScanReader r(f);
+	bool bOpen = false;
+
+	chunks.swap(ranges[0].chunks);
+
+	int status = ranges[0].status;
+	__int64 handoff = ranges[0].handoff;
+
+	for(int k=1; k<threads && status == kHandoff; ++k) {
+		ScanRange& next = ranges[k];
+		std::vector<AVIScanChunk>::iterator it = std::lower_bound(next.chunks.begin(), next.chunks.end(), handoff, ChunkPosLess);
+
+		if (next.status != kFailed && next.status != kNoSync && it != next.chunks.end() && it->pos == handoff) {
+			chunks.insert(chunks.end(), it, next.chunks.end());
+			status = next.status;
+			handoff = next.handoff;
+		} else {
+			if (!bOpen && !(bOpen = f.Open(pszFile)))
+				return false;
+
+			status = WalkChunks(r, handoff, next.end, i64FileSize, chunks, handoff);
+		}
+
+		std::vector<AVIScanChunk>().swap(next.chunks);
+	}
+
+	bDamaged = status == kDamaged;
+	return true;
+}
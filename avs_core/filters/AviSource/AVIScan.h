@@ -0,0 +1,73 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef f_AVISCAN_H
+#define f_AVISCAN_H
+
+#include <avs/win.h>
+#include <mmsystem.h>
+#include <ctype.h>
+#include <vector>
+
+
+// Copied over from VD_misc.cpp, as the only function being used from there
+inline bool isValidFOURCC(FOURCC fcc) {
+	return isprint((unsigned char)(fcc>>24))
+		&& isprint((unsigned char)(fcc>>16))
+		&& isprint((unsigned char)(fcc>> 8))
+		&& isprint((unsigned char)(fcc    ));
+}
+
+// One chunk header met while walking the movi data.
+struct AVIScanChunk {
+	__int64	pos;
+	FOURCC	fcc;
+	DWORD	len;
+};
+
+// Walks the chunk chain of a file that has no usable index, starting at
+// i64Start, and returns every chunk header exactly as the sequential
+// (non-aggressive) walk in AVIReadHandler::_parseFile would visit them.
+//
+// The file is split into ranges that are walked by several threads; each
+// thread resynchronizes on the chunk chain inside its range, and ranges
+// are stitched together only where the walk of the previous range lands
+// exactly on a chunk of the next one, so the result never depends on the
+// resync.  The walk stops at the end of the file or at the first chunk
+// that fails validation; bDamaged tells which.  Returns false if the file
+// cannot be opened.
+bool AVIScanChunks(const char *pszFile, __int64 i64Start, __int64 i64FileSize, int threads,
+				   std::vector<AVIScanChunk>& chunks, bool& bDamaged);
+
+#endif
@@ -0,0 +1,151 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#include "FileMap.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+ReadOnlyFileMap::ReadOnlyFileMap() : pData(NULL), i64Size(0), hMapping(NULL) {
+}
+
+ReadOnlyFileMap::~ReadOnlyFileMap() {
+	Close();
+}
+
+bool ReadOnlyFileMap::Open(const char *pszFile) {
+	Close();
+
+	if (sizeof(void *) < 8)
+		return false;
+
+	HANDLE hFile = CreateFileA(pszFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER li;
+
+	if (!GetFileSizeEx(hFile, &li) || !li.QuadPart) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	// The mapping keeps its own reference to the file.
+
+	hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+
+	if (!hMapping)
+		return false;
+
+	pData = (const unsigned char *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (!pData) {
+		Close();
+		return false;
+	}
+
+	i64Size = li.QuadPart;
+	return true;
+}
+
+void ReadOnlyFileMap::Close() {
+	if (pData)
+		UnmapViewOfFile(pData);
+
+	if (hMapping)
+		CloseHandle(hMapping);
+
+	pData = NULL;
+	hMapping = NULL;
+	i64Size = 0;
+}
+
+#else
+
+ReadOnlyFileMap::ReadOnlyFileMap() : pData(NULL), i64Size(0) {
+}
+
+ReadOnlyFileMap::~ReadOnlyFileMap() {
+	Close();
+}
+
+bool ReadOnlyFileMap::Open(const char *pszFile) {
+	Close();
+
+	if (sizeof(void *) < 8)
+		return false;
+
+	int fd = open(pszFile, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+
+	if (fstat(fd, &st) || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (p == MAP_FAILED)
+		return false;
+
+	posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	pData = (const unsigned char *)p;
+	i64Size = st.st_size;
+	return true;
+}
+
+void ReadOnlyFileMap::Close() {
+	if (pData)
+		munmap((void *)pData, (size_t)i64Size);
+
+	pData = NULL;
+	i64Size = 0;
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef f_FILEMAP_H
+#define f_FILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <avs/win.h>
+#endif
+
+
+// Read-only view of a whole file.  Only 64-bit builds map anything; a
+// 32-bit process would run out of address space on large captures, so
+// Open() simply fails there and callers keep using ordinary reads.
+
+class ReadOnlyFileMap {
+public:
+	ReadOnlyFileMap();
+	~ReadOnlyFileMap();
+
+	bool Open(const char *pszFile);
+	void Close();
+
+	const unsigned char *GetPtr() const { return pData; }
+	int64_t GetSize() const { return i64Size; }
+
+	// Returns NULL unless [pos, pos+len) lies entirely inside the file.
+	const unsigned char *Map(int64_t pos, long len) const {
+		if (!pData || pos < 0 || len < 0 || pos + len > i64Size)
+			return NULL;
+		return pData + pos;
+	}
+
+private:
+	const unsigned char *pData;
+	int64_t i64Size;
+
+#ifdef _WIN32
+	HANDLE	hMapping;
+#endif
+
+	ReadOnlyFileMap(const ReadOnlyFileMap&);
+	ReadOnlyFileMap& operator=(const ReadOnlyFileMap&);
+};
+
+#endif
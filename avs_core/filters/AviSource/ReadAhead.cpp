@@ -0,0 +1,376 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#include "ReadAhead.h"
+
+#include <new>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+//	ReadAheadFile
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+ReadAheadFile::ReadAheadFile() : hFile(INVALID_HANDLE_VALUE) {
+}
+
+ReadAheadFile::~ReadAheadFile() {
+	Close();
+}
+
+bool ReadAheadFile::Open(const char *pszFile) {
+	Close();
+
+	hFile = CreateFileA(pszFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	return hFile != INVALID_HANDLE_VALUE;
+}
+
+void ReadAheadFile::Close() {
+	if (hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+long ReadAheadFile::ReadAt(int64_t pos, void *buffer, long len) {
+	OVERLAPPED ov;
+	DWORD dwActual;
+
+	// On a synchronous handle the OVERLAPPED offset turns ReadFile into a
+	// positional read, so no separate seek is needed.
+
+	memset(&ov, 0, sizeof ov);
+	ov.Offset		= (DWORD)pos;
+	ov.OffsetHigh	= (DWORD)(pos >> 32);
+
+	if (!ReadFile(hFile, buffer, (DWORD)len, &dwActual, &ov))
+		return -1;
+
+	return (long)dwActual;
+}
+
+#else
+
+ReadAheadFile::ReadAheadFile() : fd(-1) {
+}
+
+ReadAheadFile::~ReadAheadFile() {
+	Close();
+}
+
+bool ReadAheadFile::Open(const char *pszFile) {
+	Close();
+
+	fd = open(pszFile, O_RDONLY);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (fd >= 0)
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	return fd >= 0;
+}
+
+void ReadAheadFile::Close() {
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+long ReadAheadFile::ReadAt(int64_t pos, void *buffer, long len) {
+	char *dst = (char *)buffer;
+	long actual = 0;
+
+	while(actual < len) {
+		ssize_t r = pread(fd, dst + actual, len - actual, (off_t)(pos + actual));
+
+		if (r < 0)
+			return -1;
+
+		if (!r)
+			break;
+
+		actual += (long)r;
+	}
+
+	return actual;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+//
+//	AVIReadAhead
+//
+///////////////////////////////////////////////////////////////////////////
+
+AVIReadAhead::AVIReadAhead(const std::vector<std::string>& paths, int nslots, long _slot_size)
+: slot_size(_slot_size)
+, quit(false)
+{
+	for(size_t i=0; i<paths.size(); ++i) {
+		ReadAheadFile *f = new(std::nothrow) ReadAheadFile;
+
+		if (!f || !f->Open(paths[i].c_str())) {
+			delete f;
+			break;
+		}
+
+		files.push_back(f);
+	}
+
+	// A segment we cannot open ourselves simply never gets prefetched.
+
+	if (files.size() < paths.size()) {
+		for(size_t i=0; i<files.size(); ++i)
+			delete files[i];
+		files.clear();
+		return;
+	}
+
+	slots.resize(nslots);
+
+	for(int i=0; i<nslots; ++i) {
+		Slot& s = slots[i];
+
+		s.data		= new(std::nothrow) char[slot_size];
+		s.key		= -1;
+		s.pos		= 0;
+		s.len		= 0;
+		s.actual	= 0;
+		s.state		= kFree;
+		s.priority	= 0;
+		s.stale		= false;
+
+		if (!s.data) {
+			slots.resize(i);
+			break;
+		}
+	}
+
+	if (slots.empty()) {
+		for(size_t i=0; i<files.size(); ++i)
+			delete files[i];
+		files.clear();
+		return;
+	}
+
+	worker = std::thread(&AVIReadAhead::ThreadProc, this);
+}
+
+AVIReadAhead::~AVIReadAhead() {
+	if (worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			quit = true;
+		}
+		work_cond.notify_all();
+		worker.join();
+	}
+
+	for(size_t i=0; i<slots.size(); ++i)
+		delete[] slots[i].data;
+
+	for(size_t i=0; i<files.size(); ++i)
+		delete files[i];
+}
+
+AVIReadAhead::Slot *AVIReadAhead::FindSlot(long key) {
+	for(size_t i=0; i<slots.size(); ++i) {
+		Slot& s = slots[i];
+
+		if (s.state != kFree && s.key == key)
+			return &s;
+	}
+
+	return NULL;
+}
+
+// Returns the number of bytes copied, or -1 if the chunk has to be read
+// by the caller.
+
+long AVIReadAhead::Fetch(long key, void *buffer, long len) {
+	std::unique_lock<std::mutex> guard(lock);
+
+	Slot *s = FindSlot(key);
+
+	if (!s || s->stale || s->len != len)
+		return -1;
+
+	// Not started yet: the caller is about to read it anyway, so take it
+	// off the queue instead of waiting for the worker to get there.
+
+	if (s->state == kQueued) {
+		s->state = kFree;
+		return -1;
+	}
+
+	while(s->state == kReading)
+		done_cond.wait(guard);
+
+	if (s->state != kReady || s->key != key || s->actual != len) {
+		if (s->state == kReady && s->key == key)
+			s->state = kFree;
+		return -1;
+	}
+
+	s->state = kCopying;
+	guard.unlock();
+
+	memcpy(buffer, s->data, len);
+
+	guard.lock();
+	s->state = kFree;
+	guard.unlock();
+
+	work_cond.notify_one();
+
+	return len;
+}
+
+// Replaces the read-ahead window.  Requests are given in the order they
+// are expected to be consumed; anything no longer wanted is dropped.
+
+void AVIReadAhead::Schedule(const Request *req, int count) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		for(size_t i=0; i<slots.size(); ++i) {
+			Slot& s = slots[i];
+			int j;
+
+			if (s.state == kFree || s.state == kCopying)
+				continue;
+
+			for(j=0; j<count; ++j)
+				if (req[j].key == s.key && req[j].pos == s.pos && req[j].len == s.len)
+					break;
+
+			if (j < count) {
+				s.priority = j;
+				s.stale = false;
+			} else if (s.state == kReading)
+				s.stale = true;
+			else
+				s.state = kFree;
+		}
+
+		for(int j=0; j<count; ++j) {
+			if (req[j].len <= 0 || req[j].len > slot_size)
+				continue;
+
+			if ((size_t)(req[j].pos >> 48) >= files.size())
+				continue;
+
+			Slot *s = FindSlot(req[j].key);
+
+			if (s && !s->stale)
+				continue;
+
+			size_t i;
+
+			for(i=0; i<slots.size(); ++i)
+				if (slots[i].state == kFree)
+					break;
+
+			if (i >= slots.size())
+				break;
+
+			Slot& fs = slots[i];
+
+			fs.key		= req[j].key;
+			fs.pos		= req[j].pos;
+			fs.len		= req[j].len;
+			fs.actual	= 0;
+			fs.priority	= j;
+			fs.stale	= false;
+			fs.state	= kQueued;
+		}
+	}
+
+	work_cond.notify_one();
+}
+
+void AVIReadAhead::ThreadProc() {
+	std::unique_lock<std::mutex> guard(lock);
+
+	while(!quit) {
+		Slot *next = NULL;
+
+		for(size_t i=0; i<slots.size(); ++i) {
+			Slot& s = slots[i];
+
+			if (s.state == kQueued && (!next || s.priority < next->priority))
+				next = &s;
+		}
+
+		if (!next) {
+			work_cond.wait(guard);
+			continue;
+		}
+
+		next->state = kReading;
+
+		const int64_t pos = next->pos;
+		const long len = next->len;
+		char *data = next->data;
+
+		guard.unlock();
+
+		long actual = files[(size_t)(pos >> 48)]->ReadAt(pos & 0x0000FFFFFFFFFFFFLL, data, len);
+
+		guard.lock();
+
+		next->actual = actual;
+
+		if (next->stale) {
+			next->stale = false;
+			next->state = kFree;
+		} else
+			next->state = kReady;
+
+		done_cond.notify_all();
+	}
+}
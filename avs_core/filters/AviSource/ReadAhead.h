@@ -0,0 +1,133 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef f_READAHEAD_H
+#define f_READAHEAD_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <avs/win.h>
+#endif
+
+
+// Positional reads on a private file handle.  The reader thread owns its
+// own handles so it never disturbs the File64 position of the handler.
+
+class ReadAheadFile {
+public:
+	ReadAheadFile();
+	~ReadAheadFile();
+
+	bool Open(const char *pszFile);
+	void Close();
+	long ReadAt(int64_t pos, void *buffer, long len);
+
+private:
+#ifdef _WIN32
+	HANDLE	hFile;
+#else
+	int		fd;
+#endif
+
+	ReadAheadFile(const ReadAheadFile&);
+	ReadAheadFile& operator=(const ReadAheadFile&);
+};
+
+
+// Bounded pool of chunk buffers filled by a single reader thread.
+//
+// Keys are sample numbers of the stream, positions are AVI index positions
+// (segment number in bits 48 and up).  The consumer announces the chunks it
+// expects next with Schedule() and picks them up with Fetch(); a chunk that
+// is not in the pool yet is left for the caller to read synchronously.
+
+class AVIReadAhead {
+public:
+	struct Request {
+		long	key;
+		int64_t	pos;
+		long	len;
+	};
+
+	AVIReadAhead(const std::vector<std::string>& paths, int slots, long slot_size);
+	~AVIReadAhead();
+
+	bool IsOpen() const { return !files.empty(); }
+	long Fetch(long key, void *buffer, long len);
+	void Schedule(const Request *req, int count);
+
+private:
+	enum {
+		kFree,
+		kQueued,
+		kReading,
+		kReady,
+		kCopying
+	};
+
+	struct Slot {
+		char	*data;
+		long	key;
+		int64_t	pos;
+		long	len;
+		long	actual;
+		int		state;
+		int		priority;
+		bool	stale;
+	};
+
+	std::vector<ReadAheadFile *> files;
+	std::vector<Slot> slots;
+	const long slot_size;
+
+	std::mutex lock;
+	std::condition_variable work_cond;
+	std::condition_variable done_cond;
+	std::thread worker;
+	bool quit;
+
+	Slot *FindSlot(long key);
+	void ThreadProc();
+
+	AVIReadAhead(const AVIReadAhead&);
+	AVIReadAhead& operator=(const AVIReadAhead&);
+};
+
+#endif
@@ -41,6 +41,8 @@
 #include "AVIReadHandler.h"
 #include "avi_source.h"
 #include <avs/minmax.h>
+#include <algorithm>
+#include <cstring>
 
 static void __cdecl free_buffer(void* buff, IScriptEnvironment* env)
 {
@@ -82,7 +84,8 @@ TemporalBuffer::TemporalBuffer(const VideoInfo& vi, bool bMediaPad, IScriptEnvir
   }
 }
 
-static PVideoFrame AdjustFrameAlignment(TemporalBuffer* frame, const VideoInfo& vi, bool bInvertFrames, IScriptEnvironment* env)
+// src has the plane layout of frame; it is either frame's own buffer or a mapped chunk.
+static PVideoFrame AdjustFrameAlignment(TemporalBuffer* frame, const BYTE* src, const VideoInfo& vi, bool bInvertFrames, IScriptEnvironment* env)
 {
     auto result = env->NewVideoFrame(vi);
     BYTE* dstp = result->GetWritePtr();
@@ -93,69 +96,230 @@ static PVideoFrame AdjustFrameAlignment(TemporalBuffer* frame, const VideoInfo&
       pitch = -pitch;
     }
 
-    env->BitBlt(dstp,                          pitch,                      frame->GetPtr(),         frame->GetPitch(),         result->GetRowSize(),         result->GetHeight());
-    env->BitBlt(result->GetWritePtr(PLANAR_V), result->GetPitch(PLANAR_V), frame->GetPtr(PLANAR_V), frame->GetPitch(PLANAR_V), result->GetRowSize(PLANAR_V), result->GetHeight(PLANAR_V));
-    env->BitBlt(result->GetWritePtr(PLANAR_U), result->GetPitch(PLANAR_U), frame->GetPtr(PLANAR_U), frame->GetPitch(PLANAR_U), result->GetRowSize(PLANAR_U), result->GetHeight(PLANAR_U));
+    env->BitBlt(dstp,                          pitch,                      src + frame->GetOffset(),         frame->GetPitch(),         result->GetRowSize(),         result->GetHeight());
+    env->BitBlt(result->GetWritePtr(PLANAR_V), result->GetPitch(PLANAR_V), src + frame->GetOffset(PLANAR_V), frame->GetPitch(PLANAR_V), result->GetRowSize(PLANAR_V), result->GetHeight(PLANAR_V));
+    env->BitBlt(result->GetWritePtr(PLANAR_U), result->GetPitch(PLANAR_U), src + frame->GetOffset(PLANAR_U), frame->GetPitch(PLANAR_U), result->GetRowSize(PLANAR_U), result->GetHeight(PLANAR_U));
     return result;
 }
 
-LRESULT AVISource::DecompressBegin(LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst) {
-  if (!ex) {
-    LRESULT result = ICDecompressBegin(hic, lpbiSrc, lpbiDst);
+LRESULT AVISource::DecompressBegin(AVIDecoder* d, LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst) {
+  if (!d->ex) {
+    LRESULT result = ICDecompressBegin(d->hic, lpbiSrc, lpbiDst);
     if (result != ICERR_UNSUPPORTED)
       return result;
     else
-      ex = true;
+      d->ex = true;
       // and fall thru
   }
-  return ICDecompressExBegin(hic, 0,
+  return ICDecompressExBegin(d->hic, 0,
     lpbiSrc, 0, 0, 0, lpbiSrc->biWidth, lpbiSrc->biHeight,
     lpbiDst, 0, 0, 0, lpbiDst->biWidth, lpbiDst->biHeight);
 }
 
-LRESULT AVISource::DecompressFrame(int n, bool preroll, IScriptEnvironment* env) {
+LRESULT AVISource::DecompressFrame(AVIDecoder* d, int n, bool preroll, IScriptEnvironment* env) {
   _RPT2(0,"AVISource: Decompressing frame %d%s\n", n, preroll ? " (preroll)" : "");
-  BYTE* buf = frame->GetPtr();
+  BYTE* buf = d->frame->GetPtr();
   long bytes_read;
+  std::unique_lock<std::mutex> io(io_mutex);
+
+  // Only the chunk read now may be used from the mapping
+  const BYTE* previous_mapped = d->mapped_frame;
+  d->mapped_frame = 0;
+
+  if (!d->hic) {
+    // Uncompressed chunks that exactly match the frame layout are used in
+    // place from the file mapping; GetFrame copies them straight into the
+    // new frame, skipping the read and the temporal buffer.
+    long mapped_bytes = 0;
+    const BYTE* mapped = (const BYTE*)d->pvideo->MapSample(n, &mapped_bytes);
+    if (mapped && mapped_bytes == long(d->frame->GetSize())) {
+      d->mapped_frame = mapped;
+      d->dropped_frame = false;
+      return ICERR_OK;
+    }
 
-  if (!hic) {
-    bytes_read = long(frame->GetSize());
-    pvideo->Read(n, 1, buf, bytes_read, &bytes_read, NULL);
-    dropped_frame = !bytes_read;
-    if (dropped_frame) return ICERR_OK;  // If frame is 0 bytes (dropped), return instead of attempt decompressing as Vdub.
+    bytes_read = long(d->frame->GetSize());
+    d->pvideo->Read(n, 1, buf, bytes_read, &bytes_read, NULL);
+    d->dropped_frame = !bytes_read;
+    if (d->dropped_frame) {
+      // A dropped frame repeats the previous one, which may have been mapped
+      if (previous_mapped)
+        memcpy(buf, previous_mapped, d->frame->GetSize());
+      return ICERR_OK;  // If frame is 0 bytes (dropped), return instead of attempt decompressing as Vdub.
+    }
   }
   else {
-    bytes_read = srcbuffer_size;
-    LRESULT err = pvideo->Read(n, 1, srcbuffer, srcbuffer_size, &bytes_read, NULL);
-    while (err == AVIERR_BUFFERTOOSMALL || (err == 0 && !srcbuffer)) {
-      delete[] srcbuffer;
-      pvideo->Read(n, 1, 0, srcbuffer_size, &bytes_read, NULL);
-      srcbuffer_size = bytes_read;
-      srcbuffer = new BYTE[bytes_read + 16]; // Provide 16 hidden guard bytes for HuffYUV, Xvid, etc bug
-      err = pvideo->Read(n, 1, srcbuffer, srcbuffer_size, &bytes_read, NULL);
+    bytes_read = d->srcbuffer_size;
+    LRESULT err = d->pvideo->Read(n, 1, d->srcbuffer, d->srcbuffer_size, &bytes_read, NULL);
+    while (err == AVIERR_BUFFERTOOSMALL || (err == 0 && !d->srcbuffer)) {
+      delete[] d->srcbuffer;
+      d->pvideo->Read(n, 1, 0, d->srcbuffer_size, &bytes_read, NULL);
+      d->srcbuffer_size = bytes_read;
+      d->srcbuffer = new BYTE[bytes_read + 16]; // Provide 16 hidden guard bytes for HuffYUV, Xvid, etc bug
+      err = d->pvideo->Read(n, 1, d->srcbuffer, d->srcbuffer_size, &bytes_read, NULL);
     }
-    dropped_frame = !bytes_read;
-    if (dropped_frame) return ICERR_OK;  // If frame is 0 bytes (dropped), return instead of attempt decompressing as Vdub.
+    io.unlock();
+    d->dropped_frame = !bytes_read;
+    if (d->dropped_frame) return ICERR_OK;  // If frame is 0 bytes (dropped), return instead of attempt decompressing as Vdub.
 
     // Fill guard bytes with 0xA5's for Xvid bug
-    memset(srcbuffer + bytes_read, 0xA5, 16);
+    memset(d->srcbuffer + bytes_read, 0xA5, 16);
     // and a Null terminator for good measure
-    srcbuffer[bytes_read + 15] = 0;
+    d->srcbuffer[bytes_read + 15] = 0;
 
     int flags = preroll ? ICDECOMPRESS_PREROLL : 0;
-    flags |= dropped_frame ? ICDECOMPRESS_NULLFRAME : 0;
-    flags |= !pvideo->IsKeyFrame(n) ? ICDECOMPRESS_NOTKEYFRAME : 0;
-    pbiSrc->biSizeImage = bytes_read;
-    LRESULT result = !ex ? ICDecompress(hic, flags, pbiSrc, srcbuffer, &biDst, buf)
-                         : ICDecompressEx(hic, flags, pbiSrc, srcbuffer,
-                                          0, 0, vi.width, vi.height, &biDst, buf,
-                                          0, 0, vi.width, vi.height);
+    flags |= d->dropped_frame ? ICDECOMPRESS_NULLFRAME : 0;
+    flags |= !d->pvideo->IsKeyFrame(n) ? ICDECOMPRESS_NOTKEYFRAME : 0;
+    d->pbiSrc->biSizeImage = bytes_read;
+    LRESULT result = !d->ex ? ICDecompress(d->hic, flags, d->pbiSrc, d->srcbuffer, &biDst, buf)
+                            : ICDecompressEx(d->hic, flags, d->pbiSrc, d->srcbuffer,
+                                             0, 0, vi.width, vi.height, &biDst, buf,
+                                             0, 0, vi.width, vi.height);
     if (result != ICERR_OK) return result;
   }
   return ICERR_OK;
 }
 
 
+// Takes ownership of _hic.  The stream is owned too, unless it is pvideo.
+AVIDecoder* AVISource::CreateDecoder(IAVIReadStream* stream, HIC _hic, IScriptEnvironment* env) {
+  AVIDecoder* d = new AVIDecoder;
+  d->pvideo = stream;
+  d->hic = _hic;
+  d->ex = false;
+  d->pbiSrc = 0;
+  d->srcbuffer = 0;
+  d->srcbuffer_size = 0;
+  d->frame = 0;
+  d->mapped_frame = 0;
+  d->dropped_frame = false;
+  d->last_frame_no = -1;
+  d->target = -1;
+  d->last_used = 0;
+  decoders.push_back(d);
+
+  // each instance patches biSizeImage per frame, so it gets its own header
+  d->pbiSrc = (BITMAPINFOHEADER*)malloc(pbiSrc->biSize);
+  if (!d->pbiSrc) env->ThrowError("AviSource: Could not allocate BITMAPINFOHEADER.");
+  memcpy(d->pbiSrc, pbiSrc, pbiSrc->biSize);
+
+  if (d->hic)
+    DecompressBegin(d, d->pbiSrc, &biDst);
+
+  d->frame = new TemporalBuffer(vi, bMediaPad, env);
+  return d;
+}
+
+void AVISource::DestroyDecoder(AVIDecoder* d) {
+  if (d->hic) {
+    !d->ex ? ICDecompressEnd(d->hic) : ICDecompressExEnd(d->hic);
+    ICClose(d->hic);
+  }
+  if (d->pvideo != pvideo)
+    delete d->pvideo;
+  if (d->pbiSrc)
+    free(d->pbiSrc);
+  if (d->srcbuffer)
+    delete[] d->srcbuffer;
+  if (d->frame)
+    delete d->frame;
+  delete d;
+}
+
+// Opens one more instance of the codec on a stream of its own.  Returns
+// NULL if the codec or the file refuses a second instance.
+AVIDecoder* AVISource::AddDecoder(IScriptEnvironment* env) {
+  HIC h = 0;
+  if (decoders[0]->hic) {
+    h = ICOpen(ICTYPE_VIDEO, fccCodec, ICMODE_DECOMPRESS);
+    if (!h)
+      return 0;
+  }
+
+  IAVIReadStream* stream;
+  {
+    std::lock_guard<std::mutex> io(io_mutex);
+    stream = pfile->GetStream(bIsType1 ? 'svai' : streamtypeVIDEO, video_track);
+  }
+  if (!stream) {
+    if (h) ICClose(h);
+    return 0;
+  }
+
+  const size_t count = decoders.size();
+  try {
+    return CreateDecoder(stream, h, env);
+  }
+  catch (...) {
+    if (decoders.size() > count) {
+      DestroyDecoder(decoders.back());
+      decoders.pop_back();
+    } else {
+      delete stream;
+      if (h) ICClose(h);
+    }
+    return 0;
+  }
+}
+
+// Called with decoder_mutex held.  Prefers the decoder that is positioned
+// inside the GOP of n (or is busy getting there), then a fresh instance
+// while Prefetch has threads to spare, then the least recently used idle
+// one.  A busy or NULL result means the caller has to wait.
+AVIDecoder* AVISource::SelectDecoder(int n, int keyframe, IScriptEnvironment* env) {
+  AVIDecoder* best = 0;
+  int best_pos = -1;
+  for (size_t i = 0; i < decoders.size(); ++i) {
+    AVIDecoder* d = decoders[i];
+    int pos = d->target >= 0 ? d->target : d->last_frame_no;
+    if (pos >= keyframe && pos <= n && pos > best_pos) {
+      best = d;
+      best_pos = pos;
+    }
+  }
+  if (best)
+    return best;
+
+  size_t threads = static_cast<IScriptEnvironment2*>(env)->GetProperty(AEP_FILTERCHAIN_THREADS);
+  if (decoders.size() < min(threads, (size_t)MAX_DECODERS)) {
+    AVIDecoder* d = AddDecoder(env);
+    if (d)
+      return d;
+  }
+
+  AVIDecoder* idle = 0;
+  for (size_t i = 0; i < decoders.size(); ++i) {
+    AVIDecoder* d = decoders[i];
+    if (d->target < 0 && (!idle || d->last_used < idle->last_used))
+      idle = d;
+  }
+  return idle;
+}
+
+// Small LRU of decoded frames, so that stepping back inside a long GOP
+// does not decode it again from the keyframe.  Called with decoder_mutex held.
+bool AVISource::FindRecentFrame(int n, PVideoFrame& result) {
+  for (size_t i = 0; i < recent.size(); ++i) {
+    if (recent[i].n == n) {
+      std::rotate(recent.begin(), recent.begin() + i, recent.begin() + i + 1);
+      result = recent[0].frame;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AVISource::AddRecentFrame(int n, const PVideoFrame& frame) {
+  PVideoFrame existing;
+  if (FindRecentFrame(n, existing))
+    return;
+  RecentFrame rf = { n, frame };
+  recent.insert(recent.begin(), rf);
+  if ((int)recent.size() > max_recent)
+    recent.pop_back();
+}
+
+
 void AVISource::CheckHresult(HRESULT hr, const char* msg, IScriptEnvironment* env) {
   if (SUCCEEDED(hr)) return;
   char buf[1024] = {0};
@@ -291,10 +455,7 @@ void AVISource::LocateVideoCodec(const char fourCC[], IScriptEnvironment* env) {
 
 
 AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[], const char fourCC[], int vtrack, int atrack, avi_mode_e mode, IScriptEnvironment* env) {
-  srcbuffer = 0; srcbuffer_size = 0;
   memset(&vi, 0, sizeof(vi));
-  ex = false;
-  last_frame_no = -1;
   pbiSrc = 0;
   aSrc = 0;
   audioStreamSource = 0;
@@ -304,7 +465,10 @@ AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[]
   hic = 0;
   bInvertFrames = false;
   bMediaPad = false;
-  frame = 0;
+  video_track = vtrack;
+  fccCodec = 0;
+  max_recent = 0;
+  use_count = 0;
 
   AVIFileInit();
   try {
@@ -517,7 +681,11 @@ AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[]
           if (bOpen)
             env->ThrowError("AviSource: Could not open video stream in any supported format.");
 
-          DecompressBegin(pbiSrc, &biDst);
+          // remember the codec, Prefetch may want more instances of it
+          ICINFO icinfo;
+          memset(&icinfo, 0, sizeof(icinfo));
+          icinfo.dwSize = sizeof(icinfo);
+          fccCodec = (ICGetInfo(hic, &icinfo, sizeof(icinfo)) && icinfo.fccHandler) ? icinfo.fccHandler : pbiSrc->biCompression;
         }
         // Flip DIB formats if negative height
         if ((pbiSrc->biHeight < 0) && (vi.IsRGB() || vi.IsY8()))
@@ -559,27 +727,29 @@ AVISource::AVISource(const char filename[], bool fAudio, const char pixel_type[]
 
     // try to decompress frame 0 if not audio only.
 
-    dropped_frame=false;
-
     if (mode != MODE_WAV) {
       bMediaPad = !(!bMediaPad && !vi.IsY8() && vi.IsPlanar());
+      max_recent = clamp(int(RECENT_FRAMES_BYTES / max(vi.BMPSize(), 1)), 2, int(MAX_RECENT_FRAMES));
       int keyframe = pvideo->NearestKeyFrame(0);
-      frame = new TemporalBuffer(vi, bMediaPad, env);
+      HIC h = hic;
+      hic = 0;
+      AVIDecoder* d = CreateDecoder(pvideo, h, env);
 
-      LRESULT error = DecompressFrame(keyframe, false, env);
+      LRESULT error = DecompressFrame(d, keyframe, false, env);
       if (error != ICERR_OK)   // shutdown, if init not succesful.
         env->ThrowError("AviSource: Could not decompress frame 0");
 
       // Cope with dud AVI files that start with drop
       // frames, just return the first key frame
-      if (dropped_frame) {
+      if (d->dropped_frame) {
         keyframe = pvideo->NextKeyFrame(0);
-        error = DecompressFrame(keyframe, false, env);
+        error = DecompressFrame(d, keyframe, false, env);
         if (error != ICERR_OK)   // shutdown, if init not succesful.
           env->ThrowError("AviSource: Could not decompress first keyframe %d", keyframe);
       }
-      last_frame_no=0;
-      last_frame = AdjustFrameAlignment(frame, vi, bInvertFrames, env);
+      d->last_frame_no=0;
+      d->last_frame = AdjustFrameAlignment(d->frame, d->mapped_frame ? d->mapped_frame : d->frame->GetPtr(), vi, bInvertFrames, env);
+      AddRecentFrame(0, d->last_frame);
     }
   }
   catch (...) {
@@ -593,10 +763,12 @@ AVISource::~AVISource() {
 }
 
 void AVISource::CleanUp() { // Tritical - Jan 2006
-  if (hic) {
-    !ex ? ICDecompressEnd(hic) : ICDecompressExEnd(hic);
+  recent.clear();
+  for (size_t i = 0; i < decoders.size(); ++i)
+    DestroyDecoder(decoders[i]);
+  decoders.clear();
+  if (hic)  // still here only if setup failed before the first decoder took it
     ICClose(hic);
-  }
   if (pvideo) delete pvideo;
   if (aSrc) delete aSrc;
   if (audioStreamSource) delete audioStreamSource;
@@ -605,57 +777,106 @@ void AVISource::CleanUp() { // Tritical - Jan 2006
   AVIFileExit();
   if (pbiSrc)
     free(pbiSrc);
-  if (srcbuffer)  // Tritical May 2005
-    delete[] srcbuffer;
-  if (frame)
-    delete frame;
 }
 
 const VideoInfo& AVISource::GetVideoInfo() { return vi; }
 
+// The read handler is shared by all decoders, see io_mutex
+int AVISource::NearestKeyFrame(int n) {
+  std::lock_guard<std::mutex> io(io_mutex);
+  return pvideo->NearestKeyFrame(n);
+}
+
 PVideoFrame AVISource::GetFrame(int n, IScriptEnvironment* env) {
 
   n = clamp(n, 0, vi.num_frames-1);
-  dropped_frame=false;
-  if (n != last_frame_no) {
-    // find the last keyframe
-    int keyframe = pvideo->NearestKeyFrame(n);
-    // maybe we don't need to go back that far
-    if (last_frame_no < n && last_frame_no >= keyframe)
-      keyframe = last_frame_no+1;
-    if (keyframe < 0) keyframe = 0;
-
-    bool frameok = false;
-    //PVideoFrame frame = env->NewVideoFrame(vi, -4);
-
-    bool not_found_yet;
-    do {
-      not_found_yet=false;
-      for (int i = keyframe; i <= n; ++i) {
-        LRESULT error = DecompressFrame(i, i != n, env);
-        if ((!dropped_frame) && (error == ICERR_OK)) frameok = true;   // Better safe than sorry
-      }
-      last_frame_no = n;
 
-      if (!last_frame && !frameok) {  // Last keyframe was not valid.
-        const int key_pre=keyframe;
-        keyframe = pvideo->NearestKeyFrame(keyframe-1);
-        if (keyframe < 0) keyframe = 0;
-        if (keyframe == key_pre)
-          env->ThrowError("AVISource: could not find valid keyframe for frame %d.", n);
+  // find the last keyframe
+  int keyframe = NearestKeyFrame(n);
+  if (keyframe < 0) keyframe = 0;
 
-        not_found_yet=true;
-      }
-    } while(not_found_yet);
+  std::unique_lock<std::mutex> lock(decoder_mutex);
+  PVideoFrame result;
+  AVIDecoder* d;
+  for (;;) {
+    if (FindRecentFrame(n, result))
+      return result;
+    d = SelectDecoder(n, keyframe, env);
+    if (d && d->target < 0)
+      break;
+    decoder_cond.wait(lock);
+  }
+  d->target = n;
+  d->last_used = ++use_count;
+  // last_frame_no is written under decoder_mutex, SelectDecoder reads it
+  const int last_frame_no = d->last_frame_no;
+  lock.unlock();
+
+  // maybe we don't need to go back that far
+  if (last_frame_no < n && last_frame_no >= keyframe)
+    keyframe = last_frame_no+1;
 
-    if (frameok) {
-      last_frame = AdjustFrameAlignment(frame, vi, bInvertFrames, env);
+  // frames just before n are kept too, in case the caller steps backwards
+  const int keep_from = n - max_recent / 2;
+
+  try {
+    if (n != last_frame_no) {
+      bool frameok = false;
+
+      bool not_found_yet;
+      do {
+        not_found_yet=false;
+        for (int i = keyframe; i <= n; ++i) {
+          const bool keep = i != n && i > keep_from;
+          LRESULT error = DecompressFrame(d, i, i != n && !keep, env);
+          if ((!d->dropped_frame) && (error == ICERR_OK)) {
+            frameok = true;   // Better safe than sorry
+            if (keep) {
+              PVideoFrame kept = AdjustFrameAlignment(d->frame, d->mapped_frame ? d->mapped_frame : d->frame->GetPtr(), vi, bInvertFrames, env);
+              std::lock_guard<std::mutex> guard(decoder_mutex);
+              AddRecentFrame(i, kept);
+            }
+          }
+        }
+        {
+          std::lock_guard<std::mutex> guard(decoder_mutex);
+          d->last_frame_no = n;
+        }
+
+        if (!d->last_frame && !frameok) {  // Last keyframe was not valid.
+          const int key_pre=keyframe;
+          keyframe = NearestKeyFrame(keyframe-1);
+          if (keyframe < 0) keyframe = 0;
+          if (keyframe == key_pre)
+            env->ThrowError("AVISource: could not find valid keyframe for frame %d.", n);
+
+          not_found_yet=true;
+        }
+      } while(not_found_yet);
+
+      if (frameok) {
+        d->last_frame = AdjustFrameAlignment(d->frame, d->mapped_frame ? d->mapped_frame : d->frame->GetPtr(), vi, bInvertFrames, env);
+      }
     }
+    result = d->last_frame;
   }
-  return last_frame;
+  catch (...) {
+    lock.lock();
+    d->last_frame_no = -1;  // codec state is unknown now
+    d->target = -1;
+    decoder_cond.notify_all();
+    throw;
+  }
+
+  lock.lock();
+  d->target = -1;
+  AddRecentFrame(n, result);
+  decoder_cond.notify_all();
+  return result;
 }
 
 void AVISource::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
+  std::lock_guard<std::mutex> io(io_mutex);
   long bytes_read=0;
   __int64 samples_read=0;
 
@@ -685,7 +906,8 @@ int __stdcall AVISource::SetCacheHints(int cachehints,int frame_range)
   switch(cachehints)
   {
   case CACHE_GET_MTMODE:
-    return MT_SERIALIZED;
+    // decoders and file access are guarded internally, see GetFrame
+    return MT_NICE_FILTER;
   default:
     return 0;
   }
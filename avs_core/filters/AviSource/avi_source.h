@@ -35,6 +35,9 @@
 #include "../../core/alignplanar.h"
 #include "VD_Audio.h"
 #include "AVIReadHandler.h"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 
 
 // AVI Decompressors require 4bytes aligned buffer with minimum padding or no padding buffer.
@@ -57,33 +60,75 @@ public:
   {
     switch (plane) { case PLANAR_U: return pU; case PLANAR_V: return pV; default: return pY; }
   }
+  size_t GetOffset(int plane=PLANAR_Y) { return GetPtr(plane) - pY; }
 };
 
 
-class AVISource : public IClip {
-  IAVIReadHandler *pfile;
-  IAVIReadStream *pvideo;
+// One decompressor with its own read stream and output buffer.  AVISource
+// keeps one per GOP being decoded so that independent GOPs can be decoded
+// concurrently under Prefetch.
+struct AVIDecoder {
+  IAVIReadStream* pvideo;
   HIC hic;
-  VideoInfo vi;
+  bool ex;
+  BITMAPINFOHEADER* pbiSrc;
   BYTE* srcbuffer;
   int srcbuffer_size;
+  TemporalBuffer* frame;
+  const BYTE* mapped_frame; // uncompressed chunk inside the file mapping, laid out like frame
+  bool dropped_frame;
+
+  PVideoFrame last_frame;
+  int last_frame_no;
+  int target;               // frame being decoded, -1 while idle
+  unsigned last_used;
+};
+
+
+class AVISource : public IClip {
+  enum { MAX_DECODERS = 8 };
+  enum { RECENT_FRAMES_BYTES = 64*1048576 };
+  enum { MAX_RECENT_FRAMES = 16 };
+
+  struct RecentFrame {
+    int n;
+    PVideoFrame frame;
+  };
+
+  IAVIReadHandler *pfile;
+  IAVIReadStream *pvideo;   // stream of the first decoder; also used for index lookups
+  HIC hic;                  // codec found during negotiation, owned by the first decoder afterwards
+  VideoInfo vi;
   BITMAPINFOHEADER* pbiSrc;
   BITMAPINFOHEADER biDst;
-  bool ex;
-  bool dropped_frame;
   bool bIsType1;
   bool bInvertFrames;
   bool bMediaPad;
+  int video_track;
+  DWORD fccCodec;
 
-  PVideoFrame last_frame;
-  int last_frame_no;
   AudioSource* aSrc;
   AudioStreamSource* audioStreamSource;
   __int64 audio_stream_pos;
-  TemporalBuffer* frame;
 
-  LRESULT DecompressBegin(LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst);
-  LRESULT DecompressFrame(int n, bool preroll, IScriptEnvironment* env);
+  std::vector<AVIDecoder*> decoders;
+  std::vector<RecentFrame> recent;  // most recently used first
+  int max_recent;
+  unsigned use_count;
+  std::mutex decoder_mutex;
+  std::condition_variable decoder_cond;
+  std::mutex io_mutex;              // the read handler and audio source are not reentrant
+
+  AVIDecoder* CreateDecoder(IAVIReadStream* stream, HIC _hic, IScriptEnvironment* env);
+  AVIDecoder* AddDecoder(IScriptEnvironment* env);
+  AVIDecoder* SelectDecoder(int n, int keyframe, IScriptEnvironment* env);
+  void DestroyDecoder(AVIDecoder* d);
+  bool FindRecentFrame(int n, PVideoFrame& result);
+  void AddRecentFrame(int n, const PVideoFrame& frame);
+  int NearestKeyFrame(int n);
+
+  LRESULT DecompressBegin(AVIDecoder* d, LPBITMAPINFOHEADER lpbiSrc, LPBITMAPINFOHEADER lpbiDst);
+  LRESULT DecompressFrame(AVIDecoder* d, int n, bool preroll, IScriptEnvironment* env);
 
   void CheckHresult(HRESULT hr, const char* msg, IScriptEnvironment* env);
   bool AttemptCodecNegotiation(DWORD fccHandler, BITMAPINFOHEADER* bmih);
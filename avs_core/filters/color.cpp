@@ -328,8 +328,8 @@ static void coloryuv_apply_lut_yuy2(BYTE* pDst, const BYTE* pSrc, int dst_pitch,
     {                                                     \
         const double t = env2->GetVar("coloryuv_" #var_name "_" #plane, DBL_MIN); \
         if (t != DBL_MIN) {                               \
-            c_##plane##->internal_name = t;               \
-            c_##plane##->changed = true;                  \
+            c_##plane->internal_name = t;               \
+            c_##plane->changed = true;                  \
         }                                                 \
     }
 
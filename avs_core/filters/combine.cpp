@@ -38,6 +38,7 @@
 #include <avs/minmax.h>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 
 
 
@@ -85,8 +86,8 @@ StackVertical::StackVertical(const std::vector<PClip>& child_array, IScriptEnvir
     vi.height += vin.height;
   }
 
-  // reverse the order of the clips in RGB mode because it's upside-down
-  if (vi.IsRGB())
+  // reverse the order of the clips in packed RGB mode because it's upside-down
+  if (vi.IsRGB() && !vi.IsPlanar())
     std::reverse(children.begin(), children.end());
 }
 
@@ -114,18 +115,21 @@ PVideoFrame __stdcall StackVertical::GetFrame(int n, IScriptEnvironment* env)
 
   if (vi.IsPlanar() && (vi.NumComponents() > 1))
   {
-    // Copy Planar
-    const int dst_pitchUV = dst->GetPitch(PLANAR_U);
-    const int row_sizeUV = dst->GetRowSize(PLANAR_U);
+    // Copy Planar, alpha included
+    const bool alpha = vi.IsYUVA() || vi.IsPlanarRGBA();
 
-    for (const int& plane: { PLANAR_U, PLANAR_V })
+    for (const int& plane: { PLANAR_U, PLANAR_V, PLANAR_A })
     {
+      if (plane == PLANAR_A && !alpha)
+        break;
+      const int dst_pitchP = dst->GetPitch(plane);
+      const int row_sizeP = dst->GetRowSize(plane);
       dstp = dst->GetWritePtr(plane);
       for (const auto& src: frames)
       {
         const int src_height = src->GetHeight(plane);
-        env->BitBlt(dstp, dst_pitchUV, src->GetReadPtr(plane), src->GetPitch(plane), row_sizeUV, src_height);
-        dstp += dst_pitchUV * src_height;
+        env->BitBlt(dstp, dst_pitchP, src->GetReadPtr(plane), src->GetPitch(plane), row_sizeP, src_height);
+        dstp += dst_pitchP * src_height;
       }
     }
   }
@@ -154,7 +158,7 @@ AVSValue __cdecl StackVertical::Create(AVSValue args, void*, IScriptEnvironment*
   }
   else {
     env->ThrowError("StackVertical: clip array not recognized!");
-    return NULL;
+    return 0;
   }
 }
 
@@ -206,16 +210,19 @@ PVideoFrame __stdcall StackHorizontal::GetFrame(int n, IScriptEnvironment* env)
   }
 
   if (vi.IsPlanar() && (vi.NumComponents() > 1)) {
-    // Copy Planar
-    const int dst_pitchUV = dst->GetPitch(PLANAR_U);
-    const int heightUV = dst->GetHeight(PLANAR_U);
-
-    for (const int plane: { PLANAR_U, PLANAR_V }) {
+    // Copy Planar, alpha included
+    const bool alpha = vi.IsYUVA() || vi.IsPlanarRGBA();
+
+    for (const int plane: { PLANAR_U, PLANAR_V, PLANAR_A }) {
+      if (plane == PLANAR_A && !alpha)
+        break;
+      const int dst_pitchP = dst->GetPitch(plane);
+      const int heightP = dst->GetHeight(plane);
       dstp = dst->GetWritePtr(plane);
       for (const auto& src: frames)
       {
         const int src_rowsize = src->GetRowSize(plane);
-        env->BitBlt(dstp, dst_pitchUV, src->GetReadPtr(plane), src->GetPitch(plane), src_rowsize, heightUV);
+        env->BitBlt(dstp, dst_pitchP, src->GetReadPtr(plane), src->GetPitch(plane), src_rowsize, heightP);
         dstp += src_rowsize;
       }
     }
@@ -245,7 +252,7 @@ AVSValue __cdecl StackHorizontal::Create(AVSValue args, void*, IScriptEnvironmen
   }
   else {
     env->ThrowError("StackHorizontal: clip array not recognized!");
-    return NULL;
+    return 0;
   }
 }
 
@@ -20,6 +20,7 @@
 
 #include "conditional_reader.h"
 #include <cstdlib>
+#include <cctype>
 #include <avs/win.h>
 #include <avs/minmax.h>
 
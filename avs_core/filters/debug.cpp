@@ -140,7 +140,7 @@ public:
   Preroll( PClip _child, const int _videopr, const double _audiopr, IScriptEnvironment* env )
     : GenericVideoFilter(_child),
       videopr(_videopr),
-      audiopr(__int64(_audiopr*vi.audio_samples_per_second+0.5)),
+      audiopr((__int64)(_audiopr*vi.audio_samples_per_second+0.5)),
       videonext(0),
       audionext(0) {
 
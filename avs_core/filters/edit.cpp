@@ -118,30 +118,30 @@ Trim::Trim(double starttime, double endtime, PClip _child, trim_mode_e mode, ISc
   if (!vi.HasAudio())
     env->ThrowError("AudioTrim: Cannot trim if there is no audio.");
 
-  audio_offset = clamp(__int64(starttime*vi.audio_samples_per_second + 0.5), 0ll, vi.num_audio_samples);
+  audio_offset = clamp((__int64)(starttime*vi.audio_samples_per_second + 0.5), 0ll, vi.num_audio_samples);
 
   switch (mode) {
     case Default:
 	  if (endtime == 0.0)
 		esampleno = vi.num_audio_samples;
 	  else if (endtime < 0.0)
-		esampleno = __int64((starttime-endtime)*vi.audio_samples_per_second + 0.5);
+		esampleno = (__int64)((starttime-endtime)*vi.audio_samples_per_second + 0.5);
 	  else
-		esampleno = __int64(endtime*vi.audio_samples_per_second + 0.5);
+		esampleno = (__int64)(endtime*vi.audio_samples_per_second + 0.5);
 
 	  break;
 	case Length:
 	  if (endtime < 0.0)
 		env->ThrowError("AudioTrim: Length must be >= 0");
 
-	  esampleno = __int64((starttime+endtime)*vi.audio_samples_per_second + 0.5);
+	  esampleno = (__int64)((starttime+endtime)*vi.audio_samples_per_second + 0.5);
 
 	  break;
 	case End:
 	  if (endtime < starttime)
 		env->ThrowError("AudioTrim: End must be >= Start");
 
-	  esampleno = __int64(endtime*vi.audio_samples_per_second + 0.5);
+	  esampleno = (__int64)(endtime*vi.audio_samples_per_second + 0.5);
 
 	  break;
 	default:
@@ -639,7 +639,7 @@ Dissolve::Dissolve(PClip _child1, PClip _child2, int _overlap, double fps, IScri
 	video_fade_start = 0;
 	video_fade_end = 0;
 
-	audio_fade_start = vi.num_audio_samples - __int64(Int32x32To64(vi.SamplesPerSecond(), overlap)/fps+0.5);
+	audio_fade_start = vi.num_audio_samples - (__int64)(Int32x32To64(vi.SamplesPerSecond(), overlap)/fps+0.5);
 	audio_fade_end = vi.num_audio_samples-1;
   }
   audio_overlap = int(audio_fade_end - audio_fade_start);
@@ -915,11 +915,11 @@ bool Reverse::GetParity(int n)
 void Reverse::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) 
 {
   child->GetAudio(buf, vi.num_audio_samples - start - count, count, env);
-  int xor = vi.BytesPerAudioSample() - 1;
+  int mask = vi.BytesPerAudioSample() - 1;
   char* buf2 = (char*)buf;
   const int count_bytes = (int)vi.BytesFromAudioSamples(count);
   for (int i=0; i<(count_bytes>>1); ++i) {
-    char temp = buf2[i]; buf2[i] = buf2[count_bytes-1-(i^xor)]; buf2[count_bytes-1-(i^xor)] = temp;
+    char temp = buf2[i]; buf2[i] = buf2[count_bytes-1-(i^mask)]; buf2[count_bytes-1-(i^mask)] = temp;
   }
 }
 
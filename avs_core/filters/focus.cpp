@@ -33,12 +33,16 @@
 // import and export plugins, or graphical user interfaces.
 
 #include "focus.h"
+#include "focus_avx2.h"
 #include <cmath>
 #include <vector>
+#include <algorithm>
+#include <malloc.h>
 #include <avs/alignment.h>
 #include <avs/minmax.h>
 #include "../core/internal.h"
 #include <emmintrin.h>
+#include <smmintrin.h>
 #include <stdint.h>
 
  
@@ -76,7 +80,7 @@ AdjustFocusV::AdjustFocusV(double _amount, PClip _child)
 
 template<typename pixel_t>
 static void af_vertical_c(BYTE* line_buf8, BYTE* dstp8, const int height, const int pitch8, const int width, const int half_amount) {
-  typedef std::conditional < sizeof(pixel_t) == 1, int, __int64>::type weight_t;
+  typedef typename std::conditional < sizeof(pixel_t) == 1, int, __int64>::type weight_t;
   // kernel:[(1-1/2^_amount)/2, 1/2^_amount, (1-1/2^_amount)/2]
   weight_t center_weight = half_amount*2;    // *2: 16 bit scaled arithmetic, but the converted amount parameter scaled is only 15 bits
   weight_t outer_weight = 32768-half_amount; // (1-1/2^_amount)/2  32768 = 0.5
@@ -100,27 +104,6 @@ static void af_vertical_c(BYTE* line_buf8, BYTE* dstp8, const int height, const
   }
 }
 
-static void af_vertical_c_float(BYTE* line_buf8, BYTE* dstp8, const int height, const int pitch8, const int width, const float amount) {
-    float *dstp = reinterpret_cast<float *>(dstp8);
-    float *line_buf = reinterpret_cast<float *>(line_buf8);
-    int pitch = pitch8 / sizeof(float);
-    
-    const float center_weight = amount;
-    const float outer_weight = (1.0f - amount) / 2.0f;
-
-    for (int y = height-1; y>0; --y) {
-        for (int x = 0; x < width; ++x) {
-            float a = dstp[x] * center_weight + (line_buf[x] + dstp[x+pitch]) * outer_weight;
-            line_buf[x] = dstp[x];
-            dstp[x] = a;
-        }
-        dstp += pitch;
-    }
-    for (int x = 0; x < width; ++x) { // Last row - map centre as lower
-        dstp[x] = dstp[x] * center_weight + (line_buf[x] + dstp[x]) * outer_weight;
-    }
-}
-
 static __forceinline __m128i af_blend_sse2(__m128i &upper, __m128i &center, __m128i &lower, __m128i &center_weight, __m128i &outer_weight, __m128i &round_mask) {
   __m128i outer_tmp = _mm_add_epi16(upper, lower);
   __m128i center_tmp = _mm_mullo_epi16(center, center_weight);
@@ -271,8 +254,7 @@ static void af_vertical_mmx(BYTE* line_buf, BYTE* dstp, int height, int pitch, i
 template<typename pixel_t>
 static void af_vertical_process(BYTE* line_buf, BYTE* dstp, size_t height, size_t pitch, size_t row_size, int half_amount, IScriptEnvironment* env) {
   size_t width = row_size / sizeof(pixel_t);
-  // only for 8/16 bit, float separated
-  // todo: sse2 for 16
+  // only for 8 bit, 10-16 bit and float use af_vertical_hbd_process
   if (sizeof(pixel_t) == 1 && (env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(dstp, 16) && width >= 16) {
     //pitch of aligned frames is always >= 16 so we'll just process some garbage if width is not mod16
     af_vertical_sse2(line_buf, dstp, (int)height, (int)pitch, (int)width, half_amount);
@@ -293,15 +275,261 @@ static void af_vertical_process(BYTE* line_buf, BYTE* dstp, size_t height, size_
   }
 }
 
-static void af_vertical_process_float(BYTE* line_buf, BYTE* dstp, size_t height, size_t pitch, size_t row_size, double amountd, IScriptEnvironment* env) {
-    size_t width = row_size / sizeof(float);
-    // todo sse2 float
-    if (false && (env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(dstp, 16) && width >= 16) {
-        //pitch of aligned frames is always >= 16 so we'll just process some garbage if width is not mod16
-        //af_vertical_sse2_float(line_buf, dstp, (int)height, (int)pitch, (int)width, (float amountd));
-    } else {
-        af_vertical_c_float(line_buf, dstp, (int)height, (int)pitch, (int)width, (float)amountd);
-    }
+// --------------------------------------------------------
+// Blur/Sharpen row kernels for planar clips
+// 10-16 bit and float use float weights, integer results are
+// rounded and clamped to the bit depth.
+// 8 bit rows are only used by the fused H+V filter and follow
+// the arithmetic of the frame based 8 bit code.
+// --------------------------------------------------------
+
+struct AFWeights {
+  int center_weight_i;  // 8 bit C, 16 bit scaled
+  int outer_weight_i;
+  short t;              // 8 bit SIMD, 6 bit scaled
+  float center_weight;  // 10-16 bit and float
+  float outer_weight;
+  int max_pixel_value;
+};
+
+static AFWeights af_make_weights(double amountd, int half_amount, int bits_per_pixel) {
+  AFWeights w;
+  w.center_weight_i = half_amount*2;
+  w.outer_weight_i = 32768-half_amount;
+  w.t = short((half_amount + 256) >> 9);
+  w.center_weight = (float)amountd;
+  w.outer_weight = (float)((1.0 - amountd) / 2.0);
+  w.max_pixel_value = bits_per_pixel == 32 ? 0 : (1 << bits_per_pixel) - 1;
+  return w;
+}
+
+// the scalar equivalent of af_blend_sse2 followed by packus
+static __forceinline BYTE af_blend_6bit(int upper, int center, int lower, int t) {
+  int center_tmp = center * t;
+  int result = clamp(center_tmp + (upper + lower) * (64 - t), -32768, 32767);
+  result = clamp(result + center_tmp, -32768, 32767);
+  result = clamp(result + 0x40, -32768, 32767);
+  return (BYTE)clamp(result >> 7, 0, 255);
+}
+
+template<typename pixel_t>
+static __forceinline pixel_t af_blend_c(pixel_t upper, pixel_t center, pixel_t lower, const AFWeights &w) {
+  if (sizeof(pixel_t) == 1)
+    return (pixel_t)ScaledPixelClip((int)(center * w.center_weight_i + (upper + lower) * w.outer_weight_i));
+  float result = center * w.center_weight + ((float)upper + (float)lower) * w.outer_weight;
+  if (sizeof(pixel_t) == 4)
+    return (pixel_t)result;
+  return (pixel_t)clamp((int)(result + 0.5f), 0, w.max_pixel_value);
+}
+
+template<typename pixel_t>
+static void af_vertical_row_c(BYTE* dstp8, const BYTE* upper8, const BYTE* center8, const BYTE* lower8, size_t x_start, size_t width, const AFWeights &w) {
+  pixel_t* dstp = reinterpret_cast<pixel_t*>(dstp8);
+  const pixel_t* upper = reinterpret_cast<const pixel_t*>(upper8);
+  const pixel_t* center = reinterpret_cast<const pixel_t*>(center8);
+  const pixel_t* lower = reinterpret_cast<const pixel_t*>(lower8);
+  for (size_t x = x_start; x < width; ++x)
+    dstp[x] = af_blend_c<pixel_t>(upper[x], center[x], lower[x], w);
+}
+
+// x_end may stop short of the line, the last pixel is its own right neighbour
+template<typename pixel_t>
+static void af_horizontal_row_c(BYTE* dstp8, const BYTE* srcp8, size_t x_start, size_t x_end, size_t width, const AFWeights &w) {
+  pixel_t* dstp = reinterpret_cast<pixel_t*>(dstp8);
+  const pixel_t* srcp = reinterpret_cast<const pixel_t*>(srcp8);
+  for (size_t x = x_start; x < x_end; ++x) {
+    pixel_t left = srcp[x > 0 ? x-1 : 0];
+    pixel_t right = srcp[x < width-1 ? x+1 : x];
+    dstp[x] = af_blend_c<pixel_t>(left, srcp[x], right, w);
+  }
+}
+
+static void af_vertical_row_uint8_sse2(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, const AFWeights &w) {
+  size_t mod16_width = width / 16 * 16;
+  __m128i center_weight = _mm_set1_epi16(w.t);
+  __m128i outer_weight = _mm_set1_epi16(64 - w.t);
+  __m128i round_mask = _mm_set1_epi16(0x40);
+  __m128i zero = _mm_setzero_si128();
+
+  for (size_t x = 0; x < mod16_width; x+=16) {
+    __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(upper+x));
+    __m128i cen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center+x));
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lower+x));
+    __m128i result = af_unpack_blend_sse2(up, cen, low, center_weight, outer_weight, round_mask, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x), result);
+  }
+  for (size_t x = mod16_width; x < width; ++x)
+    dstp[x] = af_blend_6bit(upper[x], center[x], lower[x], w.t);
+}
+
+static void af_horizontal_row_uint8_sse2(BYTE* dstp, const BYTE* srcp, size_t width, const AFWeights &w) {
+  __m128i center_weight = _mm_set1_epi16(w.t);
+  __m128i outer_weight = _mm_set1_epi16(64 - w.t);
+  __m128i round_mask = _mm_set1_epi16(0x40);
+  __m128i zero = _mm_setzero_si128();
+
+  // like af_horizontal_yv12_sse2: SIMD arithmetic up to mod16 width, C for the rest
+  size_t mod16_width = width / 16 * 16;
+
+  dstp[0] = af_blend_6bit(srcp[0], srcp[0], srcp[1], w.t);
+  size_t x = 1;
+  for (; x + 16 < width && x + 16 <= mod16_width; x+=16) {
+    __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp+x-1));
+    __m128i cen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp+x));
+    __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp+x+1));
+    __m128i result = af_unpack_blend_sse2(left, cen, right, center_weight, outer_weight, round_mask, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x), result);
+  }
+  for (; x < mod16_width; ++x)
+    dstp[x] = af_blend_6bit(srcp[x-1], srcp[x], srcp[x < width-1 ? x+1 : x], w.t);
+  af_horizontal_row_c<uint8_t>(dstp, srcp, mod16_width, width, width, w);
+}
+
+static __forceinline __m128 af_blend_ps_sse2(const __m128 &upper, const __m128 &center, const __m128 &lower, const __m128 &center_weight, const __m128 &outer_weight) {
+  return _mm_add_ps(_mm_mul_ps(center, center_weight), _mm_mul_ps(_mm_add_ps(upper, lower), outer_weight));
+}
+
+AVS_TARGET("sse4.1")
+static __forceinline __m128i af_blend_uint16_sse41(const __m128i &upper, const __m128i &center, const __m128i &lower,
+                                                   const __m128 &center_weight, const __m128 &outer_weight, const __m128 &rounder, const __m128i &max_pixel_value) {
+  __m128i zero = _mm_setzero_si128();
+  __m128 result_lo = af_blend_ps_sse2(_mm_cvtepi32_ps(_mm_unpacklo_epi16(upper, zero)), _mm_cvtepi32_ps(_mm_unpacklo_epi16(center, zero)),
+                                      _mm_cvtepi32_ps(_mm_unpacklo_epi16(lower, zero)), center_weight, outer_weight);
+  __m128 result_hi = af_blend_ps_sse2(_mm_cvtepi32_ps(_mm_unpackhi_epi16(upper, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(center, zero)),
+                                      _mm_cvtepi32_ps(_mm_unpackhi_epi16(lower, zero)), center_weight, outer_weight);
+  //negative results are clamped to zero by the unsigned saturation
+  __m128i result = _mm_packus_epi32(_mm_cvttps_epi32(_mm_add_ps(result_lo, rounder)), _mm_cvttps_epi32(_mm_add_ps(result_hi, rounder)));
+  return _mm_min_epu16(result, max_pixel_value);
+}
+
+AVS_TARGET("sse4.1")
+static size_t af_vertical_row_uint16_sse41(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, const AFWeights &w) {
+  size_t mod8_width = width / 8 * 8;
+  __m128 center_weight = _mm_set1_ps(w.center_weight);
+  __m128 outer_weight = _mm_set1_ps(w.outer_weight);
+  __m128 rounder = _mm_set1_ps(0.5f);
+  __m128i max_pixel_value = _mm_set1_epi16((short)w.max_pixel_value);
+
+  for (size_t x = 0; x < mod8_width; x+=8) {
+    __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(upper+x*2));
+    __m128i cen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center+x*2));
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lower+x*2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x*2), af_blend_uint16_sse41(up, cen, low, center_weight, outer_weight, rounder, max_pixel_value));
+  }
+  return mod8_width;
+}
+
+AVS_TARGET("sse4.1")
+static size_t af_horizontal_row_uint16_sse41(BYTE* dstp, const BYTE* srcp, size_t width, const AFWeights &w) {
+  __m128 center_weight = _mm_set1_ps(w.center_weight);
+  __m128 outer_weight = _mm_set1_ps(w.outer_weight);
+  __m128 rounder = _mm_set1_ps(0.5f);
+  __m128i max_pixel_value = _mm_set1_epi16((short)w.max_pixel_value);
+
+  size_t x = 1;
+  for (; x + 8 < width; x+=8) {
+    __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp+x*2-2));
+    __m128i cen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp+x*2));
+    __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp+x*2+2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x*2), af_blend_uint16_sse41(left, cen, right, center_weight, outer_weight, rounder, max_pixel_value));
+  }
+  return x;
+}
+
+static size_t af_vertical_row_float_sse2(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, const AFWeights &w) {
+  size_t mod4_width = width / 4 * 4;
+  __m128 center_weight = _mm_set1_ps(w.center_weight);
+  __m128 outer_weight = _mm_set1_ps(w.outer_weight);
+
+  for (size_t x = 0; x < mod4_width; x+=4) {
+    __m128 up = _mm_loadu_ps(reinterpret_cast<const float*>(upper)+x);
+    __m128 cen = _mm_loadu_ps(reinterpret_cast<const float*>(center)+x);
+    __m128 low = _mm_loadu_ps(reinterpret_cast<const float*>(lower)+x);
+    _mm_storeu_ps(reinterpret_cast<float*>(dstp)+x, af_blend_ps_sse2(up, cen, low, center_weight, outer_weight));
+  }
+  return mod4_width;
+}
+
+static size_t af_horizontal_row_float_sse2(BYTE* dstp, const BYTE* srcp, size_t width, const AFWeights &w) {
+  __m128 center_weight = _mm_set1_ps(w.center_weight);
+  __m128 outer_weight = _mm_set1_ps(w.outer_weight);
+  const float* src = reinterpret_cast<const float*>(srcp);
+
+  size_t x = 1;
+  for (; x + 4 < width; x+=4) {
+    __m128 result = af_blend_ps_sse2(_mm_loadu_ps(src+x-1), _mm_loadu_ps(src+x), _mm_loadu_ps(src+x+1), center_weight, outer_weight);
+    _mm_storeu_ps(reinterpret_cast<float*>(dstp)+x, result);
+  }
+  return x;
+}
+
+// one output line from three source lines
+static void af_vertical_row(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, int pixelsize, const AFWeights &w, int cpu) {
+  size_t done = 0;
+  switch (pixelsize) {
+  case 1:
+    if ((cpu & CPUF_SSE2) && width >= 16)
+      af_vertical_row_uint8_sse2(dstp, upper, center, lower, width, w);
+    else
+      af_vertical_row_c<uint8_t>(dstp, upper, center, lower, 0, width, w);
+    return;
+  case 2:
+    if (cpu & CPUF_AVX2)
+      done = af_vertical_row_uint16_avx2(dstp, upper, center, lower, width, w.center_weight, w.outer_weight, w.max_pixel_value);
+    else if (cpu & CPUF_SSE4_1)
+      done = af_vertical_row_uint16_sse41(dstp, upper, center, lower, width, w);
+    af_vertical_row_c<uint16_t>(dstp, upper, center, lower, done, width, w);
+    return;
+  default:
+    if (cpu & CPUF_AVX2)
+      done = af_vertical_row_float_avx2(dstp, upper, center, lower, width, w.center_weight, w.outer_weight);
+    else if (cpu & CPUF_SSE2)
+      done = af_vertical_row_float_sse2(dstp, upper, center, lower, width, w);
+    af_vertical_row_c<float>(dstp, upper, center, lower, done, width, w);
+    return;
+  }
+}
+
+// one output line from one source line, dstp and srcp must not overlap
+static void af_horizontal_row(BYTE* dstp, const BYTE* srcp, size_t width, int pixelsize, const AFWeights &w, int cpu) {
+  size_t done = 1;
+  switch (pixelsize) {
+  case 1:
+    if ((cpu & CPUF_SSE2) && width >= 16)
+      af_horizontal_row_uint8_sse2(dstp, srcp, width, w);
+    else
+      af_horizontal_row_c<uint8_t>(dstp, srcp, 0, width, width, w);
+    return;
+  case 2:
+    if (cpu & CPUF_AVX2)
+      done = af_horizontal_row_uint16_avx2(dstp, srcp, width, w.center_weight, w.outer_weight, w.max_pixel_value);
+    else if (cpu & CPUF_SSE4_1)
+      done = af_horizontal_row_uint16_sse41(dstp, srcp, width, w);
+    af_horizontal_row_c<uint16_t>(dstp, srcp, 0, 1, width, w);
+    af_horizontal_row_c<uint16_t>(dstp, srcp, done, width, width, w);
+    return;
+  default:
+    if (cpu & CPUF_AVX2)
+      done = af_horizontal_row_float_avx2(dstp, srcp, width, w.center_weight, w.outer_weight);
+    else if (cpu & CPUF_SSE2)
+      done = af_horizontal_row_float_sse2(dstp, srcp, width, w);
+    af_horizontal_row_c<float>(dstp, srcp, 0, 1, width, w);
+    af_horizontal_row_c<float>(dstp, srcp, done, width, width, w);
+    return;
+  }
+}
+
+// 10-16 bit and float, in place with two line buffers holding the unfiltered upper line
+static void af_vertical_hbd_process(BYTE* line_buf, BYTE* line_buf2, BYTE* dstp, size_t height, size_t pitch, size_t row_size, int pixelsize, const AFWeights &w, int cpu) {
+  size_t width = row_size / pixelsize;
+  memcpy(line_buf, dstp, row_size); // First row - map centre as upper
+  for (size_t y = 0; y < height; ++y) {
+    const BYTE* lower = y < height-1 ? dstp + pitch : dstp; // Last row - map centre as lower
+    memcpy(line_buf2, dstp, row_size);
+    af_vertical_row(dstp, line_buf, line_buf2, lower, width, pixelsize, w, cpu);
+    std::swap(line_buf, line_buf2);
+    dstp += pitch;
+  }
 }
 
 // --------------------------------
@@ -315,13 +543,15 @@ PVideoFrame __stdcall AdjustFocusV::GetFrame(int n, IScriptEnvironment* env)
     env->MakeWritable(&src);
 
     auto env2 = static_cast<IScriptEnvironment2*>(env);
-    BYTE* line_buf = reinterpret_cast<BYTE*>(env2->Allocate(src->GetRowSize(), 16, AVS_POOLED_ALLOC));
+    const int line_size = AlignNumber(src->GetRowSize(), 64);
+    BYTE* line_buf = reinterpret_cast<BYTE*>(env2->Allocate(line_size * 2, 64, AVS_POOLED_ALLOC));
     if (!line_buf) {
         env2->ThrowError("AdjustFocusV: Could not reserve memory.");
     }
 
     if (vi.IsPlanar()) {
         int pixelsize = vi.ComponentSize();
+        const AFWeights weights = af_make_weights(amountd, half_amount, vi.BitsPerComponent());
         const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
         for (int cplane = 0; cplane < 3; cplane++) {
             int plane = planes[cplane];
@@ -329,13 +559,14 @@ PVideoFrame __stdcall AdjustFocusV::GetFrame(int n, IScriptEnvironment* env)
             int pitch = src->GetPitch(plane);
             int row_size = src->GetRowSize(plane);
             int height = src->GetHeight(plane);
-            memcpy(line_buf, dstp, row_size); // First row - map centre as upper
-
-            switch (pixelsize) {
-            case 1: af_vertical_process<uint8_t>(line_buf, dstp, height, pitch, row_size, half_amount, env); break;
-            case 2: af_vertical_process<uint16_t>(line_buf, dstp, height, pitch, row_size, half_amount, env); break;
-            default: // 4: float 
-                af_vertical_process_float(line_buf, dstp, height, pitch, row_size, amountd, env); break;
+            if (row_size == 0)
+                continue;
+
+            if (pixelsize == 1) {
+                memcpy(line_buf, dstp, row_size); // First row - map centre as upper
+                af_vertical_process<uint8_t>(line_buf, dstp, height, pitch, row_size, half_amount, env);
+            } else {
+                af_vertical_hbd_process(line_buf, line_buf + line_size, dstp, height, pitch, row_size, pixelsize, weights, env->GetCPUFlags());
             }
         }
     }
@@ -790,7 +1021,7 @@ template<typename pixel_t>
 static __forceinline void af_horizontal_yv12_process_line_c(pixel_t left, BYTE *dstp8, size_t row_size, int center_weight, int outer_weight) {
   size_t x;
   pixel_t* dstp = reinterpret_cast<pixel_t *>(dstp8);
-  typedef std::conditional < sizeof(pixel_t) == 1, int, __int64>::type weight_t; // for calling the right ScaledPixelClip()
+  typedef typename std::conditional < sizeof(pixel_t) == 1, int, __int64>::type weight_t; // for calling the right ScaledPixelClip()
   size_t width = row_size / sizeof(pixel_t);
   for (x = 0; x < width-1; ++x) {
     pixel_t temp = ScaledPixelClip((weight_t)(dstp[x] * (weight_t)center_weight + (left + dstp[x+1]) * (weight_t)outer_weight));
@@ -816,31 +1047,6 @@ static void af_horizontal_yv12_c(BYTE* dstp8, size_t height, size_t pitch8, size
     }
 }
 
-static __forceinline void af_horizontal_yv12_process_line_float_c(float left, float *dstp, size_t row_size, float center_weight, float outer_weight) {
-    size_t x;
-    size_t width = row_size / sizeof(float);
-    for (x = 0; x < width-1; ++x) {
-        float temp = dstp[x] * center_weight + (left + dstp[x+1]) * outer_weight;
-        left = dstp[x]; 
-        dstp[x] = temp;
-    }
-    dstp[x] = dstp[x] * center_weight + (left + dstp[x]) * outer_weight;
-}
-
-static void af_horizontal_yv12_float_c(BYTE* dstp8, size_t height, size_t pitch8, size_t row_size, float amount) 
-{
-    float* dstp = reinterpret_cast<float *>(dstp8);
-    size_t pitch = pitch8 / sizeof(float);
-    float center_weight = amount;
-    float outer_weight = (1.0f - amount) / 2.0f;
-    float left;
-    for (size_t y = height; y>0; --y) {
-        left = dstp[0];
-        af_horizontal_yv12_process_line_float_c(left, dstp, row_size, center_weight, outer_weight);
-        dstp += pitch;
-    }
-}
-
 static void af_horizontal_yv12_sse2(BYTE* dstp, size_t height, size_t pitch, size_t width, size_t amount) {
   size_t mod16_width = (width / 16) * 16;
   size_t sse_loop_limit = width == mod16_width ? mod16_width - 16 : mod16_width; 
@@ -974,6 +1180,14 @@ static void copy_frame(const PVideoFrame &src, PVideoFrame &dst, IScriptEnvironm
     src->GetPitch(PLANAR_U), src->GetRowSize(PLANAR_U), src->GetHeight(PLANAR_U));
 }
 
+static void copy_alpha(const PVideoFrame &src, PVideoFrame &dst, IScriptEnvironment *env) {
+  // alpha is not filtered
+  if (src->GetPitch(PLANAR_A)) {
+    env->BitBlt(dst->GetWritePtr(PLANAR_A), dst->GetPitch(PLANAR_A), src->GetReadPtr(PLANAR_A),
+      src->GetPitch(PLANAR_A), src->GetRowSize(PLANAR_A), src->GetHeight(PLANAR_A));
+  }
+}
+
 
 // ----------------------------------
 // Blur/Sharpen Horizontal GetFrame()
@@ -984,9 +1198,30 @@ PVideoFrame __stdcall AdjustFocusH::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame src = child->GetFrame(n, env);
   PVideoFrame dst = env->NewVideoFrame(vi);
 
-  if (vi.IsPlanar()) {
+  if (vi.IsPlanar() && vi.ComponentSize() != 1) {
+    // 10-16 bit and float go from src to dst line by line
+    const AFWeights weights = af_make_weights(amountd, half_amount, vi.BitsPerComponent());
+    const int pixelsize = vi.ComponentSize();
+    const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    for (int cplane = 0; cplane < 3; cplane++) {
+      int plane = planes[cplane];
+      const BYTE* srcp = src->GetReadPtr(plane);
+      BYTE* dstp = dst->GetWritePtr(plane);
+      int src_pitch = src->GetPitch(plane);
+      int dst_pitch = dst->GetPitch(plane);
+      int row_size = src->GetRowSize(plane);
+      int height = src->GetHeight(plane);
+      for (int y = 0; y < height; ++y) {
+        af_horizontal_row(dstp, srcp, row_size / pixelsize, pixelsize, weights, env->GetCPUFlags());
+        srcp += src_pitch;
+        dstp += dst_pitch;
+      }
+    }
+    copy_alpha(src, dst, env);
+  } else if (vi.IsPlanar()) {
     const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
     copy_frame(src, dst, env); //planar processing is always in-place
+    copy_alpha(src, dst, env);
     int pixelsize = vi.ComponentSize();
     for(int cplane=0;cplane<3;cplane++) {
       int plane = planes[cplane];
@@ -1003,12 +1238,7 @@ PVideoFrame __stdcall AdjustFocusH::GetFrame(int n, IScriptEnvironment* env)
         } else
 #endif
         {
-            switch (pixelsize) {
-            case 1: af_horizontal_yv12_c<uint8_t>(q, height, pitch, row_size, half_amount); break;
-            case 2: af_horizontal_yv12_c<uint16_t>(q, height, pitch, row_size, half_amount); break;
-            default: // 4: float
-                    af_horizontal_yv12_float_c(q, height, pitch, row_size, (float)amountd); break;
-            }
+            af_horizontal_yv12_c<uint8_t>(q, height, pitch, row_size, half_amount);
           
         } 
     }
@@ -1054,6 +1284,61 @@ PVideoFrame __stdcall AdjustFocusH::GetFrame(int n, IScriptEnvironment* env)
 }
 
 
+// ----------------------------------
+// Blur/Sharpen both directions
+// ----------------------------------
+
+AdjustFocusHV::AdjustFocusHV(double _amountH, double _amountV, PClip _child)
+: GenericVideoFilter(_child), amountdH(pow(2.0, _amountH)), amountdV(pow(2.0, _amountV)) {
+    half_amountH = int(32768 * amountdH + 0.5);
+    half_amountV = int(32768 * amountdV + 0.5);
+}
+
+// Same result as AdjustFocusH(AdjustFocusV(clip)): each line is filtered vertically
+// into a line buffer and from there horizontally into dst, so there is no intermediate frame.
+PVideoFrame __stdcall AdjustFocusHV::GetFrame(int n, IScriptEnvironment* env)
+{
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame dst = env->NewVideoFrame(vi);
+
+  const int pixelsize = vi.ComponentSize();
+  const int cpu = env->GetCPUFlags();
+  const AFWeights weightsH = af_make_weights(amountdH, half_amountH, vi.BitsPerComponent());
+  const AFWeights weightsV = af_make_weights(amountdV, half_amountV, vi.BitsPerComponent());
+
+  auto env2 = static_cast<IScriptEnvironment2*>(env);
+  BYTE* line_buf = reinterpret_cast<BYTE*>(env2->Allocate(src->GetRowSize(), 64, AVS_POOLED_ALLOC));
+  if (!line_buf) {
+    env2->ThrowError("AdjustFocusHV: Could not reserve memory.");
+  }
+
+  const int planes[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+  for (int cplane = 0; cplane < 3; cplane++) {
+    const int plane = planes[cplane];
+    const BYTE* srcp = src->GetReadPtr(plane);
+    BYTE* dstp = dst->GetWritePtr(plane);
+    const int src_pitch = src->GetPitch(plane);
+    const int dst_pitch = dst->GetPitch(plane);
+    const int row_size = src->GetRowSize(plane);
+    const int height = src->GetHeight(plane);
+    if (row_size == 0)
+      continue;
+
+    for (int y = 0; y < height; ++y) {
+      const BYTE* center = srcp + (size_t)y * src_pitch;
+      const BYTE* upper = y > 0 ? center - src_pitch : center;
+      const BYTE* lower = y < height-1 ? center + src_pitch : center;
+      af_vertical_row(line_buf, upper, center, lower, row_size / pixelsize, pixelsize, weightsV, cpu);
+      af_horizontal_row(dstp + (size_t)y * dst_pitch, line_buf, row_size / pixelsize, pixelsize, weightsH, cpu);
+    }
+  }
+  copy_alpha(src, dst, env);
+
+  env2->Free(line_buf);
+  return dst;
+}
+
+
 /************************************************
  *******   Sharpen/Blur Factory Methods   *******
  ***********************************************/
@@ -1077,6 +1362,9 @@ AVSValue __cdecl Create_Sharpen(AVSValue args, void*, IScriptEnvironment* env)
     if (fabs(amountV) < 0.00002201361136) {
       return new AdjustFocusH(amountH, args[0].AsClip());
     }
+    else if (args[0].AsClip()->GetVideoInfo().IsPlanar()) {
+      return new AdjustFocusHV(amountH, amountV, args[0].AsClip());
+    }
     else {
       return new AdjustFocusH(amountH, new AdjustFocusV(amountV, args[0].AsClip()));
     }
@@ -1103,6 +1391,9 @@ AVSValue __cdecl Create_Blur(AVSValue args, void*, IScriptEnvironment* env)
     if (fabs(amountV) < 0.00002201361136) {
       return new AdjustFocusH(-amountH, args[0].AsClip());
     }
+    else if (args[0].AsClip()->GetVideoInfo().IsPlanar()) {
+      return new AdjustFocusHV(-amountH, -amountV, args[0].AsClip());
+    }
     else {
       return new AdjustFocusH(-amountH, new AdjustFocusV(-amountV, args[0].AsClip()));
     }
@@ -1116,6 +1407,15 @@ AVSValue __cdecl Create_Blur(AVSValue args, void*, IScriptEnvironment* env)
  ****  TemporalSoften  *****
  **************************/
 
+// A threshold this large turns the plane into a plain temporal average
+static bool ts_threshold_passes_all(int threshold, int pixelsize, int bits_per_pixel) {
+  switch (pixelsize) {
+  case 1: return threshold >= 255;
+  case 2: return threshold * 256 >= (1 << bits_per_pixel) - 1; // same scaling as accumulate_line_c
+  default: return false; // float threshold tops out at 255/256
+  }
+}
+
 TemporalSoften::TemporalSoften( PClip _child, unsigned radius, unsigned luma_thresh, 
                                 unsigned chroma_thresh, int _scenechange, IScriptEnvironment* env )
   : GenericVideoFilter  (_child),
@@ -1168,6 +1468,53 @@ TemporalSoften::TemporalSoften( PClip _child, unsigned radius, unsigned luma_thr
     planes[c++]=luma_thresh;
   }
   planes[c]=0;
+
+  window_n = -1;
+  for (int i = 0; i < 3; ++i) {
+    window_sum[i] = nullptr;
+    window_pitch[i] = 0;
+  }
+
+  // Planes that are plain averages get a running sum, see GetFrame
+  if (scenechange == 0 && kernel > 1 && !vi.IsPlanarRGB() && !vi.IsPlanarRGBA() && pixelsize <= 2) {
+    bool windowed = false;
+    for (int i = 0; i < c / 2; ++i) {
+      const int plane = planes[i*2];
+      bool passes_all;
+      if (vi.IsYUY2())
+        passes_all = luma_threshold >= 255 && chroma_threshold >= 255;
+      else
+        passes_all = ts_threshold_passes_all((BYTE)planes[i*2+1], pixelsize, vi.BitsPerComponent());
+      if (!passes_all)
+        continue;
+      if (vi.IsPlanar() && plane != PLANAR_Y && (vi.IsY() || vi.NumComponents() < 3))
+        continue;
+
+      const bool is_chroma = vi.IsPlanar() && plane != PLANAR_Y;
+      const int width = vi.RowSize(plane) / pixelsize;
+      const int height = is_chroma ? vi.height >> vi.GetPlaneHeightSubsampling(plane) : vi.height;
+      const int sum_size = pixelsize == 1 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+      window_pitch[i] = AlignNumber(width * sum_size, 64);
+      window_sum[i] = static_cast<BYTE*>(_aligned_malloc((size_t)window_pitch[i] * height, 64));
+      if (!window_sum[i]) {
+        for (int j = 0; j < i; ++j)
+          _aligned_free(window_sum[j]);
+        env->ThrowError("TemporalSoften: Could not reserve memory.");
+      }
+      windowed = true;
+    }
+
+    // the frame leaving the window is fetched as well
+    if (windowed)
+      child->SetCacheHints(CACHE_WINDOW, kernel+1);
+  }
+}
+
+TemporalSoften::~TemporalSoften()
+{
+  for (int i = 0; i < 3; ++i)
+    _aligned_free(window_sum[i]);
 }
 
 //offset is the initial value of x. Used when C routine processes only parts of frames after SSE/MMX paths do their job.
@@ -1175,8 +1522,8 @@ template<typename pixel_t>
 static void accumulate_line_c(BYTE* _c_plane, const BYTE** planeP, int planes, int offset, size_t rowsize, BYTE _threshold, int div) {
   pixel_t *c_plane = reinterpret_cast<pixel_t *>(_c_plane);
 
-  typedef std::conditional < sizeof(pixel_t) == 1, unsigned int, std::conditional < sizeof(pixel_t) == 2, unsigned __int64, float>::type >::type sum_t;
-  typedef std::conditional < std::is_floating_point<pixel_t>::value, float, size_t>::type threshold_t;
+  typedef typename std::conditional < sizeof(pixel_t) == 1, unsigned int, typename std::conditional < sizeof(pixel_t) == 2, unsigned __int64, float>::type >::type sum_t;
+  typedef typename std::conditional < std::is_floating_point<pixel_t>::value, float, size_t>::type threshold_t;
 
   size_t width = rowsize / sizeof(pixel_t);
 
@@ -1240,7 +1587,7 @@ static void accumulate_line_yuy2_c(BYTE* c_plane, const BYTE** planeP, int plane
 }
 
 
-static __forceinline __m128i ts_multiply_repack_sse2(__m128i &src, __m128i &div, __m128i &halfdiv, __m128i &zero) {
+static __forceinline __m128i ts_multiply_repack_sse2(const __m128i &src, const __m128i &div, const __m128i &halfdiv, const __m128i &zero) {
   __m128i acc = _mm_madd_epi16(src, div);
   acc = _mm_add_epi32(acc, halfdiv);
   acc = _mm_srli_epi32(acc, 15);
@@ -1294,6 +1641,73 @@ static void accumulate_line_sse2(BYTE* c_plane, const BYTE** planeP, int planes,
   }
 }
 
+// 10-16 bit: threshold is scaled by 256 and the sum kept in 32 bits, like the C version
+AVS_TARGET("sse4.1")
+static void accumulate_line_16_sse41(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold, int div) {
+  size_t width = rowsize / sizeof(uint16_t);
+  size_t mod8_width = width / 8 * 8;
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i thresh = _mm_set1_epi16((short)(threshold * 256));
+  __m128i div_vector = _mm_set1_epi32(div);
+  __m128i halfdiv_vector = _mm_set1_epi32(16384);
+
+  for (size_t x = 0; x < mod8_width; x+=8) {
+    __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c_plane+x*2));
+    __m128i low = _mm_unpacklo_epi16(current, zero);
+    __m128i high = _mm_unpackhi_epi16(current, zero);
+
+    for(int plane = planes-1; plane >= 0; --plane) {
+      __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planeP[plane]+x*2));
+
+      __m128i absdiff = _mm_or_si128(_mm_subs_epu16(p, current), _mm_subs_epu16(current, p));
+      __m128i leq_thresh = _mm_cmpeq_epi16(_mm_subs_epu16(absdiff, thresh), zero);
+      __m128i blended = _mm_blendv_epi8(current, p, leq_thresh); //abs(p-c) <= thresh ? p : c
+
+      low = _mm_add_epi32(low, _mm_unpacklo_epi16(blended, zero));
+      high = _mm_add_epi32(high, _mm_unpackhi_epi16(blended, zero));
+    }
+
+    //sum * div fits in 32 bits: div is 32768/(planes+1)
+    low = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(low, div_vector), halfdiv_vector), 15);
+    high = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(high, div_vector), halfdiv_vector), 15);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(c_plane+x*2), _mm_packus_epi32(low, high));
+  }
+
+  if (mod8_width != width)
+    accumulate_line_c<uint16_t>(c_plane, planeP, planes, (int)mod8_width, rowsize, threshold, div);
+}
+
+static void accumulate_line_float_sse2(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold, int div) {
+  size_t width = rowsize / sizeof(float);
+  size_t mod4_width = width / 4 * 4;
+
+  __m128 thresh = _mm_set1_ps(threshold / 256.0f);
+  __m128 divisor = _mm_set1_ps((float)(planes + 1));
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+  for (size_t x = 0; x < mod4_width; x+=4) {
+    __m128 current = _mm_loadu_ps(reinterpret_cast<const float*>(c_plane)+x);
+    __m128 sum = current;
+
+    for(int plane = planes-1; plane >= 0; --plane) {
+      __m128 p = _mm_loadu_ps(reinterpret_cast<const float*>(planeP[plane])+x);
+
+      __m128 absdiff = _mm_and_ps(_mm_sub_ps(current, p), abs_mask);
+      __m128 leq_thresh = _mm_cmple_ps(absdiff, thresh);
+      __m128 blended = _mm_or_ps(_mm_and_ps(leq_thresh, p), _mm_andnot_ps(leq_thresh, current));
+
+      sum = _mm_add_ps(sum, blended);
+    }
+
+    _mm_storeu_ps(reinterpret_cast<float*>(c_plane)+x, _mm_div_ps(sum, divisor));
+  }
+
+  if (mod4_width != width)
+    accumulate_line_c<float>(c_plane, planeP, planes, (int)mod4_width, rowsize, threshold, div);
+}
+
 #ifdef X86_32
 
 static __forceinline __m64 ts_multiply_repack_mmx(__m64 &src, __m64 &div, __m64 &halfdiv, __m64 &zero) {
@@ -1366,7 +1780,22 @@ static void accumulate_line_yuy2(BYTE* c_plane, const BYTE** planeP, int planes,
 }
 
 static void accumulate_line(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold, int div, bool aligned16, int pixelsize, IScriptEnvironment* env) {
-  // todo: sse for 16bit/float
+  if ((pixelsize == 2) && (env->GetCPUFlags() & CPUF_AVX2) && rowsize >= 32) {
+    size_t done = accumulate_line_16_avx2(c_plane, planeP, planes, rowsize, threshold, div);
+    if (done * 2 != rowsize)
+      accumulate_line_c<uint16_t>(c_plane, planeP, planes, (int)done, rowsize, threshold, div);
+  } else
+  if ((pixelsize == 2) && (env->GetCPUFlags() & CPUF_SSE4_1) && rowsize >= 16) {
+    accumulate_line_16_sse41(c_plane, planeP, planes, rowsize, threshold, div);
+  } else
+  if ((pixelsize == 4) && (env->GetCPUFlags() & CPUF_AVX2) && rowsize >= 32) {
+    size_t done = accumulate_line_float_avx2(c_plane, planeP, planes, rowsize, threshold);
+    if (done * 4 != rowsize)
+      accumulate_line_c<float>(c_plane, planeP, planes, (int)done, rowsize, threshold, div);
+  } else
+  if ((pixelsize == 4) && (env->GetCPUFlags() & CPUF_SSE2) && rowsize >= 16) {
+    accumulate_line_float_sse2(c_plane, planeP, planes, rowsize, threshold, div);
+  } else
   if ((pixelsize == 1) && (env->GetCPUFlags() & CPUF_SSE2) && aligned16 && rowsize >= 16) {
     accumulate_line_sse2(c_plane, planeP, planes, rowsize, threshold | (threshold << 8), div);
   } else
@@ -1388,6 +1817,167 @@ static void accumulate_line(BYTE* c_plane, const BYTE** planeP, int planes, size
 }
 
 
+/* Sliding window
+ *
+ * When a plane's threshold cannot reject any neighbour and scenechange is off,
+ * the result is a plain average of the window. For linear access the per pixel
+ * sum of the window is then kept between frames: the frame leaving the window
+ * is subtracted and the frame entering it is added, instead of summing
+ * 2*radius+1 frames again.
+ */
+
+template<typename pixel_t, typename sum_t>
+static void ts_window_rebuild_c(BYTE* dstp, int dst_pitch, BYTE* sump8, int sum_pitch, const BYTE** frameP, const int* framePitch, int frames,
+                                size_t width, int height, int div) {
+  for (int y = 0; y < height; ++y) {
+    sum_t* sump = reinterpret_cast<sum_t*>(sump8 + (size_t)y * sum_pitch);
+    pixel_t* dst = reinterpret_cast<pixel_t*>(dstp + (size_t)y * dst_pitch);
+
+    for (size_t x = 0; x < width; ++x)
+      sump[x] = 0;
+    for (int i = 0; i < frames; ++i) {
+      const pixel_t* srcp = reinterpret_cast<const pixel_t*>(frameP[i] + (size_t)y * framePitch[i]);
+      for (size_t x = 0; x < width; ++x)
+        sump[x] += srcp[x];
+    }
+    for (size_t x = 0; x < width; ++x)
+      dst[x] = (pixel_t)(((unsigned __int64)sump[x] * div + 16384) >> 15);
+  }
+}
+
+template<typename pixel_t, typename sum_t>
+static void ts_window_slide_c(BYTE* dstp8, int dst_pitch, BYTE* sump8, int sum_pitch, const BYTE* addp8, int add_pitch, const BYTE* subp8, int sub_pitch,
+                              size_t offset, size_t width, int height, int div) {
+  for (int y = 0; y < height; ++y) {
+    pixel_t* dstp = reinterpret_cast<pixel_t*>(dstp8);
+    sum_t* sump = reinterpret_cast<sum_t*>(sump8);
+    const pixel_t* addp = reinterpret_cast<const pixel_t*>(addp8);
+    const pixel_t* subp = reinterpret_cast<const pixel_t*>(subp8);
+
+    for (size_t x = offset; x < width; ++x) {
+      sum_t sum = sump[x] + addp[x] - subp[x];
+      sump[x] = sum;
+      dstp[x] = (pixel_t)(((unsigned __int64)sum * div + 16384) >> 15);
+    }
+
+    dstp8 += dst_pitch;
+    sump8 += sum_pitch;
+    addp8 += add_pitch;
+    subp8 += sub_pitch;
+  }
+}
+
+// 8 bit, sums in 16 bits
+static void ts_window_slide_sse2(BYTE* dstp, int dst_pitch, BYTE* sump, int sum_pitch, const BYTE* addp, int add_pitch, const BYTE* subp, int sub_pitch,
+                                 size_t width, int height, int div) {
+  size_t mod16_width = width / 16 * 16;
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i div_vector = _mm_set1_epi16(div);
+  __m128i halfdiv_vector = _mm_set1_epi32(16384);
+
+  for (int y = 0; y < height; ++y) {
+    for (size_t x = 0; x < mod16_width; x+=16) {
+      __m128i add = _mm_loadu_si128(reinterpret_cast<const __m128i*>(addp+x));
+      __m128i sub = _mm_loadu_si128(reinterpret_cast<const __m128i*>(subp+x));
+      __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(sump+x*2));
+      __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(sump+x*2+16));
+
+      low = _mm_sub_epi16(_mm_add_epi16(low, _mm_unpacklo_epi8(add, zero)), _mm_unpacklo_epi8(sub, zero));
+      high = _mm_sub_epi16(_mm_add_epi16(high, _mm_unpackhi_epi8(add, zero)), _mm_unpackhi_epi8(sub, zero));
+
+      _mm_store_si128(reinterpret_cast<__m128i*>(sump+x*2), low);
+      _mm_store_si128(reinterpret_cast<__m128i*>(sump+x*2+16), high);
+
+      __m128i sum_ll = _mm_unpacklo_epi16(low, zero);
+      __m128i sum_lh = _mm_unpackhi_epi16(low, zero);
+      __m128i sum_hl = _mm_unpacklo_epi16(high, zero);
+      __m128i sum_hh = _mm_unpackhi_epi16(high, zero);
+
+      __m128i low_low   = ts_multiply_repack_sse2(sum_ll, div_vector, halfdiv_vector, zero);
+      __m128i low_high  = ts_multiply_repack_sse2(sum_lh, div_vector, halfdiv_vector, zero);
+      __m128i high_low  = ts_multiply_repack_sse2(sum_hl, div_vector, halfdiv_vector, zero);
+      __m128i high_high = ts_multiply_repack_sse2(sum_hh, div_vector, halfdiv_vector, zero);
+
+      low = _mm_unpacklo_epi32(low_low, low_high);
+      high = _mm_unpacklo_epi32(high_low, high_high);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x), _mm_unpacklo_epi64(low, high));
+    }
+
+    if (mod16_width != width)
+      ts_window_slide_c<uint8_t, uint16_t>(dstp, dst_pitch, sump, sum_pitch, addp, add_pitch, subp, sub_pitch, mod16_width, width, 1, div);
+
+    dstp += dst_pitch;
+    sump += sum_pitch;
+    addp += add_pitch;
+    subp += sub_pitch;
+  }
+}
+
+// 10-16 bit, sums in 32 bits
+AVS_TARGET("sse4.1")
+static void ts_window_slide16_sse41(BYTE* dstp, int dst_pitch, BYTE* sump, int sum_pitch, const BYTE* addp, int add_pitch, const BYTE* subp, int sub_pitch,
+                                    size_t width, int height, int div) {
+  size_t mod8_width = width / 8 * 8;
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i div_vector = _mm_set1_epi32(div);
+  __m128i halfdiv_vector = _mm_set1_epi32(16384);
+
+  for (int y = 0; y < height; ++y) {
+    for (size_t x = 0; x < mod8_width; x+=8) {
+      __m128i add = _mm_loadu_si128(reinterpret_cast<const __m128i*>(addp+x*2));
+      __m128i sub = _mm_loadu_si128(reinterpret_cast<const __m128i*>(subp+x*2));
+      __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(sump+x*4));
+      __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(sump+x*4+16));
+
+      low = _mm_sub_epi32(_mm_add_epi32(low, _mm_unpacklo_epi16(add, zero)), _mm_unpacklo_epi16(sub, zero));
+      high = _mm_sub_epi32(_mm_add_epi32(high, _mm_unpackhi_epi16(add, zero)), _mm_unpackhi_epi16(sub, zero));
+
+      _mm_store_si128(reinterpret_cast<__m128i*>(sump+x*4), low);
+      _mm_store_si128(reinterpret_cast<__m128i*>(sump+x*4+16), high);
+
+      low = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(low, div_vector), halfdiv_vector), 15);
+      high = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(high, div_vector), halfdiv_vector), 15);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x*2), _mm_packus_epi32(low, high));
+    }
+
+    if (mod8_width != width)
+      ts_window_slide_c<uint16_t, uint32_t>(dstp, dst_pitch, sump, sum_pitch, addp, add_pitch, subp, sub_pitch, mod8_width, width, 1, div);
+
+    dstp += dst_pitch;
+    sump += sum_pitch;
+    addp += add_pitch;
+    subp += sub_pitch;
+  }
+}
+
+static void ts_window_slide(BYTE* dstp, int dst_pitch, BYTE* sump, int sum_pitch, const BYTE* addp, int add_pitch, const BYTE* subp, int sub_pitch,
+                            size_t width, int height, int div, int pixelsize, IScriptEnvironment* env) {
+  if (pixelsize == 1) {
+    if (env->GetCPUFlags() & CPUF_SSE2)
+      ts_window_slide_sse2(dstp, dst_pitch, sump, sum_pitch, addp, add_pitch, subp, sub_pitch, width, height, div);
+    else
+      ts_window_slide_c<uint8_t, uint16_t>(dstp, dst_pitch, sump, sum_pitch, addp, add_pitch, subp, sub_pitch, 0, width, height, div);
+  } else {
+    if (env->GetCPUFlags() & CPUF_SSE4_1)
+      ts_window_slide16_sse41(dstp, dst_pitch, sump, sum_pitch, addp, add_pitch, subp, sub_pitch, width, height, div);
+    else
+      ts_window_slide_c<uint16_t, uint32_t>(dstp, dst_pitch, sump, sum_pitch, addp, add_pitch, subp, sub_pitch, 0, width, height, div);
+  }
+}
+
+static void ts_window_rebuild(BYTE* dstp, int dst_pitch, BYTE* sump, int sum_pitch, const BYTE** frameP, const int* framePitch, int frames,
+                              size_t width, int height, int div, int pixelsize) {
+  if (pixelsize == 1)
+    ts_window_rebuild_c<uint8_t, uint16_t>(dstp, dst_pitch, sump, sum_pitch, frameP, framePitch, frames, width, height, div);
+  else
+    ts_window_rebuild_c<uint16_t, uint32_t>(dstp, dst_pitch, sump, sum_pitch, frameP, framePitch, frames, width, height, div);
+}
+
+
 static int calculate_sad_sse2(const BYTE* cur_ptr, const BYTE* other_ptr, int cur_pitch, int other_pitch, size_t width, size_t height)
 {
   size_t mod16_width = width / 16 * 16;
@@ -1449,7 +2039,7 @@ static size_t calculate_sad_c(const BYTE* cur_ptr, const BYTE* other_ptr, int cu
   const pixel_t *ptr2 = reinterpret_cast<const pixel_t *>(other_ptr);
   size_t width = rowsize / sizeof(pixel_t);
 
-  typedef std::conditional < std::is_floating_point<pixel_t>::value, float, size_t>::type sum_t;
+  typedef typename std::conditional < std::is_floating_point<pixel_t>::value, float, size_t>::type sum_t;
   sum_t sum = 0; 
 
   for (size_t y = 0; y < height; ++y) {
@@ -1520,6 +2110,16 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame CenterFrame = frames[radius];
   env->MakeWritable(&CenterFrame);
 
+  // Only one thread at a time owns the running sums, the others take the regular path.
+  // When n follows the frame the sums belong to, they are slid by one frame.
+  std::unique_lock<std::mutex> window_lock(window_mutex, std::defer_lock);
+  PVideoFrame leaving;
+  if ((window_sum[0] || window_sum[1] || window_sum[2]) && window_lock.try_lock()) {
+    if (window_n >= 0 && n == window_n + 1)
+      leaving = child->GetFrame(clamp(n - radius - 1, 0, vi.num_frames - 1), env);
+    window_n = -1; // invalid until all planes are done
+  }
+
   do {
     const BYTE* planeP[16];
     const BYTE* planeP2[16];
@@ -1545,6 +2145,30 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
     int h = frames[radius]->GetHeight(planes[c]);
     int pitch = frames[radius]->GetPitch(planes[c]);
 
+    if (window_lock.owns_lock() && window_sum[c/2]) {
+      const size_t width = frames[radius]->GetRowSize(planes[c]) / pixelsize;
+      const int w_div = 32768 / kernel;
+      const int w_pitch = CenterFrame->GetPitch(planes[c]);
+
+      if (leaving) {
+        ts_window_slide(c_plane, w_pitch, window_sum[c/2], window_pitch[c/2],
+                        frames[kernel-1]->GetReadPtr(planes[c]), frames[kernel-1]->GetPitch(planes[c]),
+                        leaving->GetReadPtr(planes[c]), leaving->GetPitch(planes[c]),
+                        width, h, w_div, pixelsize, env);
+      } else {
+        const BYTE* windowP[2*MAX_RADIUS+1];
+        int windowPitch[2*MAX_RADIUS+1];
+        for (int i = 0; i < kernel; ++i) {
+          windowP[i] = frames[i]->GetReadPtr(planes[c]);
+          windowPitch[i] = frames[i]->GetPitch(planes[c]);
+        }
+        ts_window_rebuild(c_plane, w_pitch, window_sum[c/2], window_pitch[c/2], windowP, windowPitch, kernel,
+                          width, h, w_div, pixelsize);
+      }
+      c += 2;
+      continue;
+    }
+
     if (scenechange>0) {
       int d2 = 0;
       bool skiprest = false;
@@ -1619,6 +2243,9 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
     c += 2;
   } while (planes[c]);
 
+  if (window_lock.owns_lock())
+    window_n = n;
+
   //  PVideoFrame result = frames[radius]; // we are using CenterFrame instead
   //  return result;
   return CenterFrame;
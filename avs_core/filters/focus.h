@@ -36,6 +36,7 @@
 #define __Focus_H__
 
 #include <avisynth.h>
+#include <mutex>
 
 
 class AdjustFocusV : public GenericVideoFilter 
@@ -75,6 +76,24 @@ private:
   int half_amount;
 };
 
+class AdjustFocusHV : public GenericVideoFilter
+/**
+  * Class to adjust focus in both directions in a single pass, helper for sharpen/blur on planar clips
+ **/
+{
+public:
+  AdjustFocusHV(double _amountH, double _amountV, PClip _child);
+  PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+
+  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+    return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+  }
+
+private:
+  const double amountdH, amountdV;
+  int half_amountH, half_amountV;
+};
+
 AVSValue __cdecl Create_Sharpen(AVSValue args, void*, IScriptEnvironment* env);
 AVSValue __cdecl Create_Blur(AVSValue args, void*, IScriptEnvironment* env);
 
@@ -88,6 +107,7 @@ class TemporalSoften : public GenericVideoFilter
 {
 public:
   TemporalSoften( PClip _child, unsigned radius, unsigned luma_thresh, unsigned chroma_thresh,int _scenechange, IScriptEnvironment* env );
+  ~TemporalSoften();
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
@@ -105,6 +125,12 @@ private:
   const unsigned luma_threshold, chroma_threshold;
   const int kernel;
 
+// Sliding window, used for planes whose threshold accepts every pixel:
+  std::mutex window_mutex;
+  int window_n;         // frame the sums belong to, -1 if none
+  BYTE* window_sum[3];  // per entry of planes[], nullptr if not windowed
+  int window_pitch[3];
+
   enum { MAX_RADIUS=7 };
 };
 
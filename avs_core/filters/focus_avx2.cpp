@@ -0,0 +1,195 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// This file is compiled with AVX2 enabled, see CMakeLists.txt.
+
+#include "focus_avx2.h"
+#include <immintrin.h>
+#include <stdint.h>
+
+
+/****************************************
+ ***  AdjustFocus rows, 10-16 bit/float ***
+ ****************************************/
+
+static __forceinline __m256 af_blend_ps_avx2(const __m256 &upper, const __m256 &center, const __m256 &lower, const __m256 &center_weight, const __m256 &outer_weight) {
+  return _mm256_add_ps(_mm256_mul_ps(center, center_weight), _mm256_mul_ps(_mm256_add_ps(upper, lower), outer_weight));
+}
+
+static __forceinline __m256i af_blend_uint16_avx2(const __m256i &upper, const __m256i &center, const __m256i &lower,
+                                                  const __m256 &center_weight, const __m256 &outer_weight, const __m256 &rounder, const __m256i &max_pixel_value) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256 result_lo = af_blend_ps_avx2(_mm256_cvtepi32_ps(_mm256_unpacklo_epi16(upper, zero)), _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(center, zero)),
+                                      _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(lower, zero)), center_weight, outer_weight);
+  __m256 result_hi = af_blend_ps_avx2(_mm256_cvtepi32_ps(_mm256_unpackhi_epi16(upper, zero)), _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(center, zero)),
+                                      _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(lower, zero)), center_weight, outer_weight);
+  __m256i result = _mm256_packus_epi32(_mm256_cvttps_epi32(_mm256_add_ps(result_lo, rounder)), _mm256_cvttps_epi32(_mm256_add_ps(result_hi, rounder)));
+  return _mm256_min_epu16(result, max_pixel_value);
+}
+
+size_t af_vertical_row_uint16_avx2(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, float center_weight, float outer_weight, int max_pixel_value) {
+  size_t mod16_width = width / 16 * 16;
+  __m256 cw = _mm256_set1_ps(center_weight);
+  __m256 ow = _mm256_set1_ps(outer_weight);
+  __m256 rounder = _mm256_set1_ps(0.5f);
+  __m256i max_vector = _mm256_set1_epi16((short)max_pixel_value);
+
+  for (size_t x = 0; x < mod16_width; x+=16) {
+    __m256i up = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(upper+x*2));
+    __m256i cen = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center+x*2));
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lower+x*2));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dstp+x*2), af_blend_uint16_avx2(up, cen, low, cw, ow, rounder, max_vector));
+  }
+
+  _mm256_zeroupper();
+  return mod16_width;
+}
+
+size_t af_vertical_row_float_avx2(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, float center_weight, float outer_weight) {
+  size_t mod8_width = width / 8 * 8;
+  __m256 cw = _mm256_set1_ps(center_weight);
+  __m256 ow = _mm256_set1_ps(outer_weight);
+
+  for (size_t x = 0; x < mod8_width; x+=8) {
+    __m256 up = _mm256_loadu_ps(reinterpret_cast<const float*>(upper)+x);
+    __m256 cen = _mm256_loadu_ps(reinterpret_cast<const float*>(center)+x);
+    __m256 low = _mm256_loadu_ps(reinterpret_cast<const float*>(lower)+x);
+    _mm256_storeu_ps(reinterpret_cast<float*>(dstp)+x, af_blend_ps_avx2(up, cen, low, cw, ow));
+  }
+
+  _mm256_zeroupper();
+  return mod8_width;
+}
+
+size_t af_horizontal_row_uint16_avx2(BYTE* dstp, const BYTE* srcp, size_t width, float center_weight, float outer_weight, int max_pixel_value) {
+  __m256 cw = _mm256_set1_ps(center_weight);
+  __m256 ow = _mm256_set1_ps(outer_weight);
+  __m256 rounder = _mm256_set1_ps(0.5f);
+  __m256i max_vector = _mm256_set1_epi16((short)max_pixel_value);
+
+  size_t x = 1;
+  for (; x + 16 < width; x+=16) {
+    __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcp+x*2-2));
+    __m256i cen = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcp+x*2));
+    __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcp+x*2+2));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dstp+x*2), af_blend_uint16_avx2(left, cen, right, cw, ow, rounder, max_vector));
+  }
+
+  _mm256_zeroupper();
+  return x;
+}
+
+size_t af_horizontal_row_float_avx2(BYTE* dstp, const BYTE* srcp, size_t width, float center_weight, float outer_weight) {
+  __m256 cw = _mm256_set1_ps(center_weight);
+  __m256 ow = _mm256_set1_ps(outer_weight);
+  const float* src = reinterpret_cast<const float*>(srcp);
+
+  size_t x = 1;
+  for (; x + 8 < width; x+=8) {
+    __m256 result = af_blend_ps_avx2(_mm256_loadu_ps(src+x-1), _mm256_loadu_ps(src+x), _mm256_loadu_ps(src+x+1), cw, ow);
+    _mm256_storeu_ps(reinterpret_cast<float*>(dstp)+x, result);
+  }
+
+  _mm256_zeroupper();
+  return x;
+}
+
+
+/***************************
+ ****  TemporalSoften  *****
+ **************************/
+
+size_t accumulate_line_16_avx2(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold, int div) {
+  size_t width = rowsize / sizeof(uint16_t);
+  size_t mod16_width = width / 16 * 16;
+
+  __m256i zero = _mm256_setzero_si256();
+  __m256i thresh = _mm256_set1_epi16((short)(threshold * 256));
+  __m256i div_vector = _mm256_set1_epi32(div);
+  __m256i halfdiv_vector = _mm256_set1_epi32(16384);
+
+  for (size_t x = 0; x < mod16_width; x+=16) {
+    __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c_plane+x*2));
+    // unpack and pack work within 128 bit lanes, so the pixel order is restored by the final pack
+    __m256i low = _mm256_unpacklo_epi16(current, zero);
+    __m256i high = _mm256_unpackhi_epi16(current, zero);
+
+    for(int plane = planes-1; plane >= 0; --plane) {
+      __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(planeP[plane]+x*2));
+
+      __m256i absdiff = _mm256_or_si256(_mm256_subs_epu16(p, current), _mm256_subs_epu16(current, p));
+      __m256i leq_thresh = _mm256_cmpeq_epi16(_mm256_subs_epu16(absdiff, thresh), zero);
+      __m256i blended = _mm256_blendv_epi8(current, p, leq_thresh); //abs(p-c) <= thresh ? p : c
+
+      low = _mm256_add_epi32(low, _mm256_unpacklo_epi16(blended, zero));
+      high = _mm256_add_epi32(high, _mm256_unpackhi_epi16(blended, zero));
+    }
+
+    low = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(low, div_vector), halfdiv_vector), 15);
+    high = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(high, div_vector), halfdiv_vector), 15);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(c_plane+x*2), _mm256_packus_epi32(low, high));
+  }
+
+  _mm256_zeroupper();
+  return mod16_width;
+}
+
+size_t accumulate_line_float_avx2(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold) {
+  size_t width = rowsize / sizeof(float);
+  size_t mod8_width = width / 8 * 8;
+
+  __m256 thresh = _mm256_set1_ps(threshold / 256.0f);
+  __m256 divisor = _mm256_set1_ps((float)(planes + 1));
+  __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+  for (size_t x = 0; x < mod8_width; x+=8) {
+    __m256 current = _mm256_loadu_ps(reinterpret_cast<const float*>(c_plane)+x);
+    __m256 sum = current;
+
+    for(int plane = planes-1; plane >= 0; --plane) {
+      __m256 p = _mm256_loadu_ps(reinterpret_cast<const float*>(planeP[plane])+x);
+
+      __m256 absdiff = _mm256_and_ps(_mm256_sub_ps(current, p), abs_mask);
+      __m256 leq_thresh = _mm256_cmp_ps(absdiff, thresh, _CMP_LE_OQ);
+
+      sum = _mm256_add_ps(sum, _mm256_blendv_ps(current, p, leq_thresh));
+    }
+
+    _mm256_storeu_ps(reinterpret_cast<float*>(c_plane)+x, _mm256_div_ps(sum, divisor));
+  }
+
+  _mm256_zeroupper();
+  return mod8_width;
+}
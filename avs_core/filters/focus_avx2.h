@@ -0,0 +1,55 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef __Focus_AVX2_H__
+#define __Focus_AVX2_H__
+
+#include <avisynth.h>
+
+// AVX2 kernels, only to be called when CPUF_AVX2 is set.
+// They process whole vectors and return the number of pixels done,
+// the caller finishes the rest of the line.
+
+// Blur/Sharpen rows, see af_vertical_row and af_horizontal_row.
+// The horizontal ones start at pixel 1 and return where they stopped.
+size_t af_vertical_row_uint16_avx2(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, float center_weight, float outer_weight, int max_pixel_value);
+size_t af_vertical_row_float_avx2(BYTE* dstp, const BYTE* upper, const BYTE* center, const BYTE* lower, size_t width, float center_weight, float outer_weight);
+size_t af_horizontal_row_uint16_avx2(BYTE* dstp, const BYTE* srcp, size_t width, float center_weight, float outer_weight, int max_pixel_value);
+size_t af_horizontal_row_float_avx2(BYTE* dstp, const BYTE* srcp, size_t width, float center_weight, float outer_weight);
+
+// TemporalSoften
+size_t accumulate_line_16_avx2(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold, int div);
+size_t accumulate_line_float_avx2(BYTE* c_plane, const BYTE** planeP, int planes, size_t rowsize, BYTE threshold);
+
+#endif  // __Focus_AVX2_H__
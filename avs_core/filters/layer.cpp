@@ -43,6 +43,10 @@
 #include <avs/alignment.h>
 #include "../core/internal.h"
 #include <emmintrin.h>
+#include <smmintrin.h>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
 
 
 
@@ -81,8 +85,12 @@ Mask::Mask(PClip _child1, PClip _child2, IScriptEnvironment* env)
   const VideoInfo& vi2 = child2->GetVideoInfo();
   if (vi1.width != vi2.width || vi1.height != vi2.height)
     env->ThrowError("Mask error: image dimensions don't match");
-  if (!vi1.IsRGB32() | !vi2.IsRGB32())
-    env->ThrowError("Mask error: sources must be RGB32");
+  if (vi1.IsPlanarRGBA() || vi1.IsYUVA()) {
+    if (!vi2.IsPlanar() || vi2.BitsPerComponent() != vi1.BitsPerComponent())
+      env->ThrowError("Mask error: mask clip must be planar with the same bit depth as the source");
+  }
+  else if (!vi1.IsRGB32() | !vi2.IsRGB32())
+    env->ThrowError("Mask error: sources must be RGB32, planar RGBA or YUVA");
 
   vi = vi1;
   mask_frames = vi2.num_frames;
@@ -206,6 +214,171 @@ static void mask_c(BYTE *srcp, const BYTE *alphap, int src_pitch, int alpha_pitc
   }
 }
 
+// Planar RGBA and YUVA: alpha plane is replaced with the luma of the planar RGB mask clip
+static void mask_planar8_sse2(BYTE *dstp, const BYTE *srcp_g, const BYTE *srcp_b, const BYTE *srcp_r, int dst_pitch, int src_pitch, int width, int height, int cyb, int cyg, int cyr) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i one = _mm_set1_epi16(1);
+  __m128i coeff_bg = _mm_set_epi16(cyg, cyb, cyg, cyb, cyg, cyb, cyg, cyb);
+  __m128i coeff_r = _mm_set_epi16(16384, cyr, 16384, cyr, 16384, cyr, 16384, cyr);
+
+  int mod8_width = width / 8 * 8;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < mod8_width; x += 8) {
+      __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcp_b+x)), zero);
+      __m128i g = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcp_g+x)), zero);
+      __m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcp_r+x)), zero);
+
+      //b*cyb + g*cyg + r*cyr + 16384
+      __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b, g), coeff_bg), _mm_madd_epi16(_mm_unpacklo_epi16(r, one), coeff_r));
+      __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b, g), coeff_bg), _mm_madd_epi16(_mm_unpackhi_epi16(r, one), coeff_r));
+      lo = _mm_srai_epi32(lo, 15);
+      hi = _mm_srai_epi32(hi, 15);
+
+      __m128i luma = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp+x), _mm_packus_epi16(luma, zero));
+    }
+
+    for (int x = mod8_width; x < width; ++x) {
+      dstp[x] = (cyb*srcp_b[x] + cyg*srcp_g[x] + cyr*srcp_r[x] + 16384) >> 15;
+    }
+
+    dstp += dst_pitch;
+    srcp_g += src_pitch;
+    srcp_b += src_pitch;
+    srcp_r += src_pitch;
+  }
+}
+
+template<bool is_float>
+AVS_TARGET("sse4.1")
+static void mask_planar_hbd_sse(BYTE *dstp, const BYTE *srcp_g, const BYTE *srcp_b, const BYTE *srcp_r, int dst_pitch, int src_pitch, int width, int height, int bits_per_pixel) {
+  __m128i zero = _mm_setzero_si128();
+  __m128 kb = _mm_set1_ps(0.114f);
+  __m128 kg = _mm_set1_ps(0.587f);
+  __m128 kr = _mm_set1_ps(0.299f);
+  __m128 rounder = _mm_set1_ps(0.5f);
+  __m128i max_pixel_value = _mm_set1_epi16((short)((1 << bits_per_pixel) - 1));
+
+  // 16 bytes per cycle: 8 uint16_t or 4 floats
+  int mod16_width = width * (is_float ? 4 : 2) / 16 * 16;
+  int rowsize = width * (is_float ? 4 : 2);
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < mod16_width; x += 16) {
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp_b+x));
+      __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp_g+x));
+      __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp_r+x));
+
+      if (is_float) {
+        __m128 luma = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_castsi128_ps(b), kb), _mm_mul_ps(_mm_castsi128_ps(g), kg)), _mm_mul_ps(_mm_castsi128_ps(r), kr));
+        _mm_storeu_ps(reinterpret_cast<float*>(dstp+x), luma);
+      } else {
+        __m128 luma_lo = _mm_add_ps(_mm_add_ps(
+          _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero)), kb),
+          _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(g, zero)), kg)),
+          _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(r, zero)), kr));
+        __m128 luma_hi = _mm_add_ps(_mm_add_ps(
+          _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(b, zero)), kb),
+          _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(g, zero)), kg)),
+          _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(r, zero)), kr));
+        __m128i lo = _mm_cvttps_epi32(_mm_add_ps(luma_lo, rounder));
+        __m128i hi = _mm_cvttps_epi32(_mm_add_ps(luma_hi, rounder));
+        __m128i luma = _mm_min_epu16(_mm_packus_epi32(lo, hi), max_pixel_value); // SSE4.1
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x), luma);
+      }
+    }
+
+    for (int x = mod16_width; x < rowsize; x += (is_float ? 4 : 2)) {
+      if (is_float) {
+        float b = *reinterpret_cast<const float*>(srcp_b+x);
+        float g = *reinterpret_cast<const float*>(srcp_g+x);
+        float r = *reinterpret_cast<const float*>(srcp_r+x);
+        *reinterpret_cast<float*>(dstp+x) = b*0.114f + g*0.587f + r*0.299f;
+      } else {
+        float b = *reinterpret_cast<const uint16_t*>(srcp_b+x);
+        float g = *reinterpret_cast<const uint16_t*>(srcp_g+x);
+        float r = *reinterpret_cast<const uint16_t*>(srcp_r+x);
+        *reinterpret_cast<uint16_t*>(dstp+x) = (uint16_t)min((int)(b*0.114f + g*0.587f + r*0.299f + 0.5f), (1 << bits_per_pixel) - 1);
+      }
+    }
+
+    dstp += dst_pitch;
+    srcp_g += src_pitch;
+    srcp_b += src_pitch;
+    srcp_r += src_pitch;
+  }
+}
+
+template<typename pixel_t>
+static void mask_planar_c(BYTE *dstp8, const BYTE *srcp_g8, const BYTE *srcp_b8, const BYTE *srcp_r8, int dst_pitch, int src_pitch, int width, int height, int bits_per_pixel) {
+  const int cyb = int(0.114*32768+0.5);
+  const int cyg = int(0.587*32768+0.5);
+  const int cyr = int(0.299*32768+0.5);
+  const int max_pixel_value = (1 << bits_per_pixel) - 1;
+
+  for (int y = 0; y < height; ++y) {
+    pixel_t *dstp = reinterpret_cast<pixel_t *>(dstp8);
+    const pixel_t *srcp_g = reinterpret_cast<const pixel_t *>(srcp_g8);
+    const pixel_t *srcp_b = reinterpret_cast<const pixel_t *>(srcp_b8);
+    const pixel_t *srcp_r = reinterpret_cast<const pixel_t *>(srcp_r8);
+
+    for (int x = 0; x < width; ++x) {
+      if (sizeof(pixel_t) == 1)
+        dstp[x] = (pixel_t)((cyb*(int)srcp_b[x] + cyg*(int)srcp_g[x] + cyr*(int)srcp_r[x] + 16384) >> 15);
+      else if (sizeof(pixel_t) == 2)
+        dstp[x] = (pixel_t)min((int)((float)srcp_b[x]*0.114f + (float)srcp_g[x]*0.587f + (float)srcp_r[x]*0.299f + 0.5f), max_pixel_value);
+      else
+        dstp[x] = (pixel_t)(srcp_b[x]*0.114f + srcp_g[x]*0.587f + srcp_r[x]*0.299f);
+    }
+
+    dstp8 += dst_pitch;
+    srcp_g8 += src_pitch;
+    srcp_b8 += src_pitch;
+    srcp_r8 += src_pitch;
+  }
+}
+
+static void mask_planar(PVideoFrame &dst, const PVideoFrame &mask, const VideoInfo &vi_mask, int width, int height, IScriptEnvironment* env) {
+  BYTE* dstp = dst->GetWritePtr(PLANAR_A);
+  const int dst_pitch = dst->GetPitch(PLANAR_A);
+  const int pixelsize = vi_mask.ComponentSize();
+  const int bits_per_pixel = vi_mask.BitsPerComponent();
+
+  if (!(vi_mask.IsPlanarRGB() || vi_mask.IsPlanarRGBA())) {
+    // YUV(A) or greyscale mask: luma is used as is
+    env->BitBlt(dstp, dst_pitch, mask->GetReadPtr(PLANAR_Y), mask->GetPitch(PLANAR_Y), width * pixelsize, height);
+    return;
+  }
+
+  const BYTE* srcp_g = mask->GetReadPtr(PLANAR_G);
+  const BYTE* srcp_b = mask->GetReadPtr(PLANAR_B);
+  const BYTE* srcp_r = mask->GetReadPtr(PLANAR_R);
+  const int src_pitch = mask->GetPitch(PLANAR_G);
+
+  const int cpu = env->GetCPUFlags();
+
+  if (pixelsize == 1) {
+    if (cpu & CPUF_SSE2)
+      mask_planar8_sse2(dstp, srcp_g, srcp_b, srcp_r, dst_pitch, src_pitch, width, height,
+                        int(0.114*32768+0.5), int(0.587*32768+0.5), int(0.299*32768+0.5));
+    else
+      mask_planar_c<uint8_t>(dstp, srcp_g, srcp_b, srcp_r, dst_pitch, src_pitch, width, height, bits_per_pixel);
+  }
+  else if (pixelsize == 2) {
+    if (cpu & CPUF_SSE4_1)
+      mask_planar_hbd_sse<false>(dstp, srcp_g, srcp_b, srcp_r, dst_pitch, src_pitch, width, height, bits_per_pixel);
+    else
+      mask_planar_c<uint16_t>(dstp, srcp_g, srcp_b, srcp_r, dst_pitch, src_pitch, width, height, bits_per_pixel);
+  }
+  else {
+    if (cpu & CPUF_SSE4_1) // shares the SSE4.1 build of the 16 bit version
+      mask_planar_hbd_sse<true>(dstp, srcp_g, srcp_b, srcp_r, dst_pitch, src_pitch, width, height, bits_per_pixel);
+    else
+      mask_planar_c<float>(dstp, srcp_g, srcp_b, srcp_r, dst_pitch, src_pitch, width, height, bits_per_pixel);
+  }
+}
+
 PVideoFrame __stdcall Mask::GetFrame(int n, IScriptEnvironment* env)
 {
   PVideoFrame src1 = child1->GetFrame(n, env);
@@ -214,6 +387,11 @@ PVideoFrame __stdcall Mask::GetFrame(int n, IScriptEnvironment* env)
 
   env->MakeWritable(&src1);
 
+  if (vi.IsPlanar()) {
+    mask_planar(src1, src2, child2->GetVideoInfo(), vi.width, vi.height, env);
+    return src1;
+  }
+
   BYTE* src1p = src1->GetWritePtr();
   const BYTE* src2p = src2->GetReadPtr();
 
@@ -257,8 +435,8 @@ AVSValue __cdecl Mask::Create(AVSValue args, void*, IScriptEnvironment* env)
 ColorKeyMask::ColorKeyMask(PClip _child, int _color, int _tolB, int _tolG, int _tolR, IScriptEnvironment *env)
   : GenericVideoFilter(_child), color(_color & 0xffffff), tolB(_tolB & 0xff), tolG(_tolG & 0xff), tolR(_tolR & 0xff)
 {
-  if (!vi.IsRGB32())
-    env->ThrowError("ColorKeyMask: requires RGB32 input");
+  if (!vi.IsRGB32() && !vi.IsPlanarRGBA())
+    env->ThrowError("ColorKeyMask: requires RGB32 or planar RGBA input");
 }
 
 static void colorkeymask_sse2(BYTE* pf, int pitch, int color, int height, int width, int tolB, int tolG, int tolR) {
@@ -345,11 +523,192 @@ static void colorkeymask_c(BYTE* pf, int pitch, int color, int height, int rowsi
   }
 }
 
+// Planar RGBA: color and tolerances are already scaled to the bit depth
+template<typename pixel_t>
+static void colorkeymask_planar_sse2(BYTE* pfa, const BYTE* pfg, const BYTE* pfb, const BYTE* pfr, int pitch, int pitch_a, int rowsize, int height,
+                                     int B, int G, int R, int tolB, int tolG, int tolR) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i colorB, colorG, colorR, toleranceB, toleranceG, toleranceR;
+  if (sizeof(pixel_t) == 1) {
+    colorB = _mm_set1_epi8((char)B); toleranceB = _mm_set1_epi8((char)tolB);
+    colorG = _mm_set1_epi8((char)G); toleranceG = _mm_set1_epi8((char)tolG);
+    colorR = _mm_set1_epi8((char)R); toleranceR = _mm_set1_epi8((char)tolR);
+  } else {
+    colorB = _mm_set1_epi16((short)B); toleranceB = _mm_set1_epi16((short)tolB);
+    colorG = _mm_set1_epi16((short)G); toleranceG = _mm_set1_epi16((short)tolG);
+    colorR = _mm_set1_epi16((short)R); toleranceR = _mm_set1_epi16((short)tolR);
+  }
+
+  int mod16_rowsize = rowsize / 16 * 16;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < mod16_rowsize; x += 16) {
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pfb+x));
+      __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pfg+x));
+      __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pfr+x));
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pfa+x));
+
+      __m128i not_passed;
+      if (sizeof(pixel_t) == 1) {
+        //abs(color - src) - tolerance, zero when inside the tolerance
+        __m128i nb = _mm_subs_epu8(_mm_or_si128(_mm_subs_epu8(colorB, b), _mm_subs_epu8(b, colorB)), toleranceB);
+        __m128i ng = _mm_subs_epu8(_mm_or_si128(_mm_subs_epu8(colorG, g), _mm_subs_epu8(g, colorG)), toleranceG);
+        __m128i nr = _mm_subs_epu8(_mm_or_si128(_mm_subs_epu8(colorR, r), _mm_subs_epu8(r, colorR)), toleranceR);
+        not_passed = _mm_or_si128(_mm_or_si128(nb, ng), nr);
+        not_passed = _mm_cmpeq_epi8(not_passed, zero);
+      } else {
+        __m128i nb = _mm_subs_epu16(_mm_or_si128(_mm_subs_epu16(colorB, b), _mm_subs_epu16(b, colorB)), toleranceB);
+        __m128i ng = _mm_subs_epu16(_mm_or_si128(_mm_subs_epu16(colorG, g), _mm_subs_epu16(g, colorG)), toleranceG);
+        __m128i nr = _mm_subs_epu16(_mm_or_si128(_mm_subs_epu16(colorR, r), _mm_subs_epu16(r, colorR)), toleranceR);
+        not_passed = _mm_or_si128(_mm_or_si128(nb, ng), nr);
+        not_passed = _mm_cmpeq_epi16(not_passed, zero);
+      }
+      // not_passed is now all ones where the key color matched
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(pfa+x), _mm_andnot_si128(not_passed, a));
+    }
+
+    for (int x = mod16_rowsize / sizeof(pixel_t); x < rowsize / (int)sizeof(pixel_t); ++x) {
+      const pixel_t *b = reinterpret_cast<const pixel_t*>(pfb);
+      const pixel_t *g = reinterpret_cast<const pixel_t*>(pfg);
+      const pixel_t *r = reinterpret_cast<const pixel_t*>(pfr);
+      if (IsClose(b[x], B, tolB) && IsClose(g[x], G, tolG) && IsClose(r[x], R, tolR))
+        reinterpret_cast<pixel_t*>(pfa)[x] = 0;
+    }
+
+    pfa += pitch_a;
+    pfg += pitch;
+    pfb += pitch;
+    pfr += pitch;
+  }
+}
+
+static void colorkeymask_planar_float_sse2(BYTE* pfa, const BYTE* pfg, const BYTE* pfb, const BYTE* pfr, int pitch, int pitch_a, int rowsize, int height,
+                                           float B, float G, float R, float tolB, float tolG, float tolR) {
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 colorB = _mm_set1_ps(B), toleranceB = _mm_set1_ps(tolB);
+  __m128 colorG = _mm_set1_ps(G), toleranceG = _mm_set1_ps(tolG);
+  __m128 colorR = _mm_set1_ps(R), toleranceR = _mm_set1_ps(tolR);
+
+  int mod16_rowsize = rowsize / 16 * 16;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < mod16_rowsize; x += 16) {
+      __m128 b = _mm_loadu_ps(reinterpret_cast<const float*>(pfb+x));
+      __m128 g = _mm_loadu_ps(reinterpret_cast<const float*>(pfg+x));
+      __m128 r = _mm_loadu_ps(reinterpret_cast<const float*>(pfr+x));
+      __m128 a = _mm_loadu_ps(reinterpret_cast<const float*>(pfa+x));
+
+      __m128 passed = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(b, colorB), abs_mask), toleranceB);
+      passed = _mm_and_ps(passed, _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(g, colorG), abs_mask), toleranceG));
+      passed = _mm_and_ps(passed, _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(r, colorR), abs_mask), toleranceR));
+
+      _mm_storeu_ps(reinterpret_cast<float*>(pfa+x), _mm_andnot_ps(passed, a));
+    }
+
+    for (int x = mod16_rowsize / 4; x < rowsize / 4; ++x) {
+      const float *b = reinterpret_cast<const float*>(pfb);
+      const float *g = reinterpret_cast<const float*>(pfg);
+      const float *r = reinterpret_cast<const float*>(pfr);
+      if (std::abs(b[x] - B) <= tolB && std::abs(g[x] - G) <= tolG && std::abs(r[x] - R) <= tolR)
+        reinterpret_cast<float*>(pfa)[x] = 0.0f;
+    }
+
+    pfa += pitch_a;
+    pfg += pitch;
+    pfb += pitch;
+    pfr += pitch;
+  }
+}
+
+template<typename pixel_t>
+static void colorkeymask_planar_c(BYTE* pfa, const BYTE* pfg, const BYTE* pfb, const BYTE* pfr, int pitch, int pitch_a, int rowsize, int height,
+                                  int B, int G, int R, int tolB, int tolG, int tolR) {
+  for (int y = 0; y < height; ++y) {
+    const pixel_t *b = reinterpret_cast<const pixel_t*>(pfb);
+    const pixel_t *g = reinterpret_cast<const pixel_t*>(pfg);
+    const pixel_t *r = reinterpret_cast<const pixel_t*>(pfr);
+    pixel_t *a = reinterpret_cast<pixel_t*>(pfa);
+
+    for (int x = 0; x < rowsize / (int)sizeof(pixel_t); ++x) {
+      if (IsClose(b[x], B, tolB) && IsClose(g[x], G, tolG) && IsClose(r[x], R, tolR))
+        a[x] = 0;
+    }
+
+    pfa += pitch_a;
+    pfg += pitch;
+    pfb += pitch;
+    pfr += pitch;
+  }
+}
+
+static void colorkeymask_planar_float_c(BYTE* pfa, const BYTE* pfg, const BYTE* pfb, const BYTE* pfr, int pitch, int pitch_a, int rowsize, int height,
+                                        float B, float G, float R, float tolB, float tolG, float tolR) {
+  for (int y = 0; y < height; ++y) {
+    const float *b = reinterpret_cast<const float*>(pfb);
+    const float *g = reinterpret_cast<const float*>(pfg);
+    const float *r = reinterpret_cast<const float*>(pfr);
+    float *a = reinterpret_cast<float*>(pfa);
+
+    for (int x = 0; x < rowsize / 4; ++x) {
+      if (std::abs(b[x] - B) <= tolB && std::abs(g[x] - G) <= tolG && std::abs(r[x] - R) <= tolR)
+        a[x] = 0.0f;
+    }
+
+    pfa += pitch_a;
+    pfg += pitch;
+    pfb += pitch;
+    pfr += pitch;
+  }
+}
+
 PVideoFrame __stdcall ColorKeyMask::GetFrame(int n, IScriptEnvironment *env)
 {
   PVideoFrame frame = child->GetFrame(n, env);
   env->MakeWritable(&frame);
 
+  if (vi.IsPlanarRGBA())
+  {
+    BYTE* pfa = frame->GetWritePtr(PLANAR_A);
+    const BYTE* pfg = frame->GetReadPtr(PLANAR_G);
+    const BYTE* pfb = frame->GetReadPtr(PLANAR_B);
+    const BYTE* pfr = frame->GetReadPtr(PLANAR_R);
+    const int pitch = frame->GetPitch(PLANAR_G);
+    const int pitch_a = frame->GetPitch(PLANAR_A);
+    const int rowsize = frame->GetRowSize(PLANAR_G);
+    const int pixelsize = vi.ComponentSize();
+    const bool sse2 = !!(env->GetCPUFlags() & CPUF_SSE2);
+
+    const int R = (color >> 16) & 0xff;
+    const int G = (color >> 8) & 0xff;
+    const int B = color & 0xff;
+
+    if (pixelsize == 4) {
+      const float scale = 1.0f / 255.0f;
+      if (sse2)
+        colorkeymask_planar_float_sse2(pfa, pfg, pfb, pfr, pitch, pitch_a, rowsize, vi.height, B*scale, G*scale, R*scale, tolB*scale, tolG*scale, tolR*scale);
+      else
+        colorkeymask_planar_float_c(pfa, pfg, pfb, pfr, pitch, pitch_a, rowsize, vi.height, B*scale, G*scale, R*scale, tolB*scale, tolG*scale, tolR*scale);
+      return frame;
+    }
+
+    // scale the 8 bit key and tolerances to the bit depth
+    const int max_pixel_value = (1 << vi.BitsPerComponent()) - 1;
+    auto scale = [max_pixel_value](int v) { return (v * max_pixel_value + 127) / 255; };
+
+    if (pixelsize == 1) {
+      if (sse2)
+        colorkeymask_planar_sse2<uint8_t>(pfa, pfg, pfb, pfr, pitch, pitch_a, rowsize, vi.height, B, G, R, tolB, tolG, tolR);
+      else
+        colorkeymask_planar_c<uint8_t>(pfa, pfg, pfb, pfr, pitch, pitch_a, rowsize, vi.height, B, G, R, tolB, tolG, tolR);
+    } else {
+      if (sse2)
+        colorkeymask_planar_sse2<uint16_t>(pfa, pfg, pfb, pfr, pitch, pitch_a, rowsize, vi.height, scale(B), scale(G), scale(R), scale(tolB), scale(tolG), scale(tolR));
+      else
+        colorkeymask_planar_c<uint16_t>(pfa, pfg, pfb, pfr, pitch, pitch_a, rowsize, vi.height, scale(B), scale(G), scale(R), scale(tolB), scale(tolG), scale(tolR));
+    }
+    return frame;
+  }
+
   BYTE* pf = frame->GetWritePtr();
   const int pitch = frame->GetPitch();
   const int rowsize = frame->GetRowSize();
@@ -392,8 +751,8 @@ AVSValue __cdecl ColorKeyMask::Create(AVSValue args, void*, IScriptEnvironment*
 ResetMask::ResetMask(PClip _child, IScriptEnvironment* env)
   : GenericVideoFilter(_child)
 {
-  if (!vi.IsRGB32())
-    env->ThrowError("ResetMask: RGB32 data only");
+  if (!vi.IsRGB32() && !vi.IsPlanarRGBA() && !vi.IsYUVA())
+    env->ThrowError("ResetMask: RGB32, planar RGBA or YUVA data only");
 }
 
 
@@ -402,6 +761,31 @@ PVideoFrame ResetMask::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame f = child->GetFrame(n, env);
   env->MakeWritable(&f);
 
+  if (vi.IsPlanar()) {
+    BYTE* pf = f->GetWritePtr(PLANAR_A);
+    const int pitch = f->GetPitch(PLANAR_A);
+    const int height = f->GetHeight(PLANAR_A);
+    const int width = vi.width;
+
+    switch (vi.ComponentSize()) {
+    case 1:
+      for (int y = 0; y < height; ++y, pf += pitch)
+        memset(pf, 255, width);
+      break;
+    case 2: {
+      const uint16_t max_pixel_value = (uint16_t)((1 << vi.BitsPerComponent()) - 1);
+      for (int y = 0; y < height; ++y, pf += pitch)
+        std::fill_n(reinterpret_cast<uint16_t*>(pf), width, max_pixel_value);
+      break;
+    }
+    default:
+      for (int y = 0; y < height; ++y, pf += pitch)
+        std::fill_n(reinterpret_cast<float*>(pf), width, 1.0f);
+      break;
+    }
+    return f;
+  }
+
   BYTE* pf = f->GetWritePtr();
   int pitch = f->GetPitch();
   int rowsize = f->GetRowSize();
@@ -593,7 +977,51 @@ static void invert_frame(BYTE* frame, int pitch, int rowsize, int height, int ma
   }
 }
 
-static void invert_plane(BYTE* frame, int pitch, int rowsize, int height, IScriptEnvironment *env) {
+static void invert_plane_float_sse2(BYTE* frame, int pitch, int width, int height) {
+  __m128 one = _mm_set1_ps(1.0f);
+
+  BYTE* endp = frame + pitch * height;
+
+  while (frame < endp) {
+    __m128 src = _mm_load_ps(reinterpret_cast<const float*>(frame));
+    _mm_store_ps(reinterpret_cast<float*>(frame), _mm_sub_ps(one, src));
+    frame += 16;
+  }
+}
+
+static void invert_plane_float_c(BYTE* frame, int pitch, int width, int height) {
+  for (int y = 0; y < height; ++y) {
+    float* floatptr = reinterpret_cast<float*>(frame);
+
+    for (int x = 0; x < width / 4; ++x) {
+      floatptr[x] = 1.0f - floatptr[x];
+    }
+    frame += pitch;
+  }
+}
+
+static void invert_plane(BYTE* frame, int pitch, int rowsize, int height, int pixelsize, int bits_per_pixel, IScriptEnvironment *env) {
+  if (pixelsize == 2)
+  {
+    // max_pixel_value - x is a plain xor for valid 10-16 bit samples
+    const int max_pixel_value = (1 << bits_per_pixel) - 1;
+    const int mask = max_pixel_value | (max_pixel_value << 16);
+    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(frame, 16))
+      invert_frame_sse2(frame, pitch, rowsize, height, mask);
+    else
+      invert_frame_c(frame, pitch, rowsize, height, mask);
+    return;
+  }
+
+  if (pixelsize == 4)
+  {
+    if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(frame, 16))
+      invert_plane_float_sse2(frame, pitch, rowsize, height);
+    else
+      invert_plane_float_c(frame, pitch, rowsize, height);
+    return;
+  }
+
   if ((env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(frame, 16)) 
   {
     invert_frame_sse2(frame, pitch, rowsize, height, 0xffffffff);
@@ -622,12 +1050,27 @@ PVideoFrame Invert::GetFrame(int n, IScriptEnvironment* env)
   int height = f->GetHeight();
 
   if (vi.IsPlanar()) {
-    if (doY)
-      invert_plane(pf, pitch, f->GetRowSize(PLANAR_Y_ALIGNED), height, env);
-    if (doU)
-      invert_plane(f->GetWritePtr(PLANAR_U), f->GetPitch(PLANAR_U), f->GetRowSize(PLANAR_U_ALIGNED), f->GetHeight(PLANAR_U), env);
-    if (doV)
-      invert_plane(f->GetWritePtr(PLANAR_V), f->GetPitch(PLANAR_V), f->GetRowSize(PLANAR_V_ALIGNED), f->GetHeight(PLANAR_V), env);
+    const int pixelsize = vi.ComponentSize();
+    const int bits_per_pixel = vi.BitsPerComponent();
+
+    if (vi.IsPlanarRGB() || vi.IsPlanarRGBA()) {
+      if (doG)
+        invert_plane(f->GetWritePtr(PLANAR_G), f->GetPitch(PLANAR_G), f->GetRowSize(PLANAR_G_ALIGNED), height, pixelsize, bits_per_pixel, env);
+      if (doB)
+        invert_plane(f->GetWritePtr(PLANAR_B), f->GetPitch(PLANAR_B), f->GetRowSize(PLANAR_B_ALIGNED), height, pixelsize, bits_per_pixel, env);
+      if (doR)
+        invert_plane(f->GetWritePtr(PLANAR_R), f->GetPitch(PLANAR_R), f->GetRowSize(PLANAR_R_ALIGNED), height, pixelsize, bits_per_pixel, env);
+    }
+    else {
+      if (doY)
+        invert_plane(pf, pitch, f->GetRowSize(PLANAR_Y_ALIGNED), height, pixelsize, bits_per_pixel, env);
+      if (doU)
+        invert_plane(f->GetWritePtr(PLANAR_U), f->GetPitch(PLANAR_U), f->GetRowSize(PLANAR_U_ALIGNED), f->GetHeight(PLANAR_U), pixelsize, bits_per_pixel, env);
+      if (doV)
+        invert_plane(f->GetWritePtr(PLANAR_V), f->GetPitch(PLANAR_V), f->GetRowSize(PLANAR_V_ALIGNED), f->GetHeight(PLANAR_V), pixelsize, bits_per_pixel, env);
+    }
+    if (doA && (vi.IsPlanarRGBA() || vi.IsYUVA()))
+      invert_plane(f->GetWritePtr(PLANAR_A), f->GetPitch(PLANAR_A), f->GetRowSize(PLANAR_A_ALIGNED), f->GetHeight(PLANAR_A), pixelsize, bits_per_pixel, env);
   }
   else if (vi.IsYUY2() || vi.IsRGB32()) {
     invert_frame(pf, pitch, rowsize, height, mask, env);
@@ -1182,13 +1625,18 @@ Layer::Layer( PClip _child1, PClip _child2, const char _op[], int _lev, int _x,
   if (vi1.pixel_type != vi2.pixel_type)
     env->ThrowError("Layer: image formats don't match");
 
-  if (! (vi1.IsRGB32() | vi1.IsYUY2()) )
-    env->ThrowError("Layer only support RGB32 and YUY2 formats");
+  if (! (vi1.IsRGB32() | vi1.IsYUY2() | vi1.IsPlanar()) )
+    env->ThrowError("Layer only support RGB32, YUY2 and planar formats");
 
   vi = vi1;
 
   if (vi.IsRGB32()) ofsY = vi.height-vi2.height-ofsY; //RGB is upside down
-  else ofsX = ofsX & 0xFFFFFFFE; //YUV must be aligned on even pixels
+  else if (vi.IsYUY2()) ofsX = ofsX & 0xFFFFFFFE; //YUV must be aligned on even pixels
+  else if (vi.IsPlanar() && !vi.IsY() && !vi.IsPlanarRGB() && !vi.IsPlanarRGBA()) {
+    //planar YUV must be aligned on the chroma subsampling
+    ofsX = ofsX & ~((1 << vi.GetPlaneWidthSubsampling(PLANAR_U)) - 1);
+    ofsY = ofsY & ~((1 << vi.GetPlaneHeightSubsampling(PLANAR_U)) - 1);
+  }
 
   xdest=(ofsX < 0)? 0: ofsX;
   ydest=(ofsY < 0)? 0: ofsY;
@@ -2330,6 +2778,556 @@ static void layer_rgb32_lighten_darken_c(BYTE* dstp, const BYTE* ovrp, int dst_p
 }
 
 
+/* Planar RGB(A), YUV(A) and greyscale; 8-16 bit and float */
+
+enum
+{
+  LAYER_ADD = 0,
+  LAYER_SUBTRACT = 1,
+  LAYER_MUL = 2,
+  LAYER_NEUTRAL = 3 // blend chroma towards grey, YUV with use_chroma=false
+};
+
+typedef void(*LayerPlanarFunction)(BYTE* dstp, const BYTE* ovrp, const BYTE* maskp, int dst_pitch, int overlay_pitch, int mask_pitch, int width, int height, int level, int bits_per_pixel);
+
+// 8 bit: same arithmetic as the RGB32 and YUY2 versions, alpha is 0..256
+template<int mode>
+static __forceinline BYTE layer_planar8_pixel(int dst, int ovr, int alpha) {
+  int target;
+  if (mode == LAYER_ADD)
+    target = ovr;
+  else if (mode == LAYER_SUBTRACT)
+    target = 255 - ovr;
+  else if (mode == LAYER_MUL)
+    target = (ovr * dst) >> 8;
+  else
+    target = 128;
+  return (BYTE)(dst + (((target - dst) * alpha) >> 8));
+}
+
+// 10-16 bit and float: weight is 0..1, integer formats are rounded
+template<typename pixel_t, int mode>
+static __forceinline pixel_t layer_planar_hbd_pixel(float dst, float ovr, float weight, float max_pixel_value, float inv_max_pixel_value, float half) {
+  float target;
+  if (mode == LAYER_ADD)
+    target = ovr;
+  else if (mode == LAYER_SUBTRACT)
+    target = max_pixel_value - ovr;
+  else if (mode == LAYER_MUL)
+    target = ovr * dst * inv_max_pixel_value;
+  else
+    target = half;
+  float result = dst + (target - dst) * weight;
+  if (sizeof(pixel_t) == 4)
+    return (pixel_t)result;
+  return (pixel_t)(int)(result + 0.5f);
+}
+
+template<typename pixel_t, int mode, bool has_alpha>
+static void layer_planar_c(BYTE* dstp8, const BYTE* ovrp8, const BYTE* maskp8, int dst_pitch, int overlay_pitch, int mask_pitch, int width, int height, int level, int bits_per_pixel) {
+  const bool is_float = sizeof(pixel_t) == 4;
+  const float max_pixel_value = is_float ? 1.0f : (float)((1 << bits_per_pixel) - 1);
+  const float inv_max_pixel_value = 1.0f / max_pixel_value;
+  const float half = is_float ? 0.5f : (float)(1 << (bits_per_pixel - 1));
+  const float level_f = level / 257.0f;
+  const float mask_scale = level_f * inv_max_pixel_value;
+
+  for (int y = 0; y < height; ++y) {
+    pixel_t* dstp = reinterpret_cast<pixel_t*>(dstp8);
+    const pixel_t* ovrp = reinterpret_cast<const pixel_t*>(ovrp8);
+    const pixel_t* maskp = reinterpret_cast<const pixel_t*>(maskp8);
+
+    for (int x = 0; x < width; ++x) {
+      if (sizeof(pixel_t) == 1) {
+        int alpha = has_alpha ? (((int)maskp[x] * level + 1) >> 8) : level;
+        dstp[x] = (pixel_t)layer_planar8_pixel<mode>((int)dstp[x], (int)ovrp[x], alpha);
+      } else {
+        float weight = has_alpha ? (float)maskp[x] * mask_scale : level_f;
+        dstp[x] = layer_planar_hbd_pixel<pixel_t, mode>((float)dstp[x], (float)ovrp[x], weight, max_pixel_value, inv_max_pixel_value, half);
+      }
+    }
+
+    dstp8 += dst_pitch;
+    ovrp8 += overlay_pitch;
+    if (has_alpha)
+      maskp8 += mask_pitch;
+  }
+}
+
+template<int mode, bool has_alpha>
+static void layer_planar8_sse2(BYTE* dstp, const BYTE* ovrp, const BYTE* maskp, int dst_pitch, int overlay_pitch, int mask_pitch, int width, int height, int level, int bits_per_pixel) {
+  int mod8_width = width / 8 * 8;
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i level_vector = _mm_set1_epi16((short)level);
+  __m128i v255 = _mm_set1_epi16(255);
+  __m128i v128 = _mm_set1_epi16(128);
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < mod8_width; x+=8) {
+      __m128i src = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dstp+x)), zero);
+      __m128i ovr = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ovrp+x)), zero);
+
+      __m128i alpha;
+      if (has_alpha) {
+        __m128i mask = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(maskp+x)), zero);
+        // (mask * level + 1) >> 8, avg keeps the 17th bit
+        alpha = _mm_mullo_epi16(mask, level_vector);
+        alpha = _mm_srli_epi16(_mm_avg_epu16(alpha, zero), 7);
+      } else {
+        alpha = level_vector;
+      }
+
+      __m128i target;
+      if (mode == LAYER_ADD)
+        target = ovr;
+      else if (mode == LAYER_SUBTRACT)
+        target = _mm_sub_epi16(v255, ovr);
+      else if (mode == LAYER_MUL)
+        target = _mm_srli_epi16(_mm_mullo_epi16(ovr, src), 8);
+      else
+        target = v128;
+
+      //only the low byte of each word is valid, the same as in the RGB32 code
+      __m128i diff = _mm_sub_epi16(target, src);
+      diff = _mm_mullo_epi16(diff, alpha);
+      diff = _mm_srli_epi16(diff, 8);
+
+      __m128i dst = _mm_add_epi8(src, diff);
+      dst = _mm_packus_epi16(dst, zero);
+
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp+x), dst);
+    }
+
+    for (int x = mod8_width; x < width; ++x) {
+      int alpha = has_alpha ? ((maskp[x] * level + 1) >> 8) : level;
+      dstp[x] = layer_planar8_pixel<mode>(dstp[x], ovrp[x], alpha);
+    }
+
+    dstp += dst_pitch;
+    ovrp += overlay_pitch;
+    if (has_alpha)
+      maskp += mask_pitch;
+  }
+}
+
+template<int mode>
+static __forceinline __m128 layer_planar_hbd_core_sse2(const __m128 &src, const __m128 &ovr, const __m128 &weight,
+                                                       const __m128 &max_pixel_value, const __m128 &inv_max_pixel_value, const __m128 &half) {
+  __m128 target;
+  if (mode == LAYER_ADD)
+    target = ovr;
+  else if (mode == LAYER_SUBTRACT)
+    target = _mm_sub_ps(max_pixel_value, ovr);
+  else if (mode == LAYER_MUL)
+    target = _mm_mul_ps(_mm_mul_ps(ovr, src), inv_max_pixel_value);
+  else
+    target = half;
+  return _mm_add_ps(src, _mm_mul_ps(_mm_sub_ps(target, src), weight));
+}
+
+template<int mode, bool has_alpha>
+AVS_TARGET("sse4.1")
+static void layer_planar16_sse41(BYTE* dstp, const BYTE* ovrp, const BYTE* maskp, int dst_pitch, int overlay_pitch, int mask_pitch, int width, int height, int level, int bits_per_pixel) {
+  const float max_pixel_value_f = (float)((1 << bits_per_pixel) - 1);
+  const float inv_max_pixel_value_f = 1.0f / max_pixel_value_f;
+  const float half_f = (float)(1 << (bits_per_pixel - 1));
+  const float level_f = level / 257.0f;
+  const float mask_scale_f = level_f * inv_max_pixel_value_f;
+
+  __m128i zero = _mm_setzero_si128();
+  __m128 max_pixel_value = _mm_set1_ps(max_pixel_value_f);
+  __m128 inv_max_pixel_value = _mm_set1_ps(inv_max_pixel_value_f);
+  __m128 half = _mm_set1_ps(half_f);
+  __m128 level_vector = _mm_set1_ps(level_f);
+  __m128 mask_scale = _mm_set1_ps(mask_scale_f);
+  __m128 rounder = _mm_set1_ps(0.5f);
+  __m128i max_pixel_value_i = _mm_set1_epi16((short)((1 << bits_per_pixel) - 1));
+
+  int mod8_width = width / 8 * 8;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < mod8_width; x+=8) {
+      __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dstp+x*2));
+      __m128i ovr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ovrp+x*2));
+
+      __m128 weight_lo, weight_hi;
+      if (has_alpha) {
+        __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(maskp+x*2));
+        weight_lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(mask, zero)), mask_scale);
+        weight_hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(mask, zero)), mask_scale);
+      } else {
+        weight_lo = weight_hi = level_vector;
+      }
+
+      __m128 result_lo = layer_planar_hbd_core_sse2<mode>(_mm_cvtepi32_ps(_mm_unpacklo_epi16(src, zero)), _mm_cvtepi32_ps(_mm_unpacklo_epi16(ovr, zero)),
+                                                          weight_lo, max_pixel_value, inv_max_pixel_value, half);
+      __m128 result_hi = layer_planar_hbd_core_sse2<mode>(_mm_cvtepi32_ps(_mm_unpackhi_epi16(src, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(ovr, zero)),
+                                                          weight_hi, max_pixel_value, inv_max_pixel_value, half);
+
+      __m128i dst = _mm_packus_epi32(_mm_cvttps_epi32(_mm_add_ps(result_lo, rounder)), _mm_cvttps_epi32(_mm_add_ps(result_hi, rounder)));
+      dst = _mm_min_epu16(dst, max_pixel_value_i);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x*2), dst);
+    }
+
+    uint16_t* dstp16 = reinterpret_cast<uint16_t*>(dstp);
+    const uint16_t* ovrp16 = reinterpret_cast<const uint16_t*>(ovrp);
+    const uint16_t* maskp16 = reinterpret_cast<const uint16_t*>(maskp);
+    for (int x = mod8_width; x < width; ++x) {
+      float weight = has_alpha ? (float)maskp16[x] * mask_scale_f : level_f;
+      dstp16[x] = layer_planar_hbd_pixel<uint16_t, mode>((float)dstp16[x], (float)ovrp16[x], weight, max_pixel_value_f, inv_max_pixel_value_f, half_f);
+    }
+
+    dstp += dst_pitch;
+    ovrp += overlay_pitch;
+    if (has_alpha)
+      maskp += mask_pitch;
+  }
+}
+
+template<int mode, bool has_alpha>
+static void layer_planar_float_sse2(BYTE* dstp, const BYTE* ovrp, const BYTE* maskp, int dst_pitch, int overlay_pitch, int mask_pitch, int width, int height, int level, int bits_per_pixel) {
+  const float level_f = level / 257.0f;
+
+  __m128 max_pixel_value = _mm_set1_ps(1.0f);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 level_vector = _mm_set1_ps(level_f);
+
+  int mod4_width = width / 4 * 4;
+
+  for (int y = 0; y < height; ++y) {
+    float* dstpf = reinterpret_cast<float*>(dstp);
+    const float* ovrpf = reinterpret_cast<const float*>(ovrp);
+    const float* maskpf = reinterpret_cast<const float*>(maskp);
+
+    for (int x = 0; x < mod4_width; x+=4) {
+      __m128 src = _mm_loadu_ps(dstpf+x);
+      __m128 ovr = _mm_loadu_ps(ovrpf+x);
+      __m128 weight = has_alpha ? _mm_mul_ps(_mm_loadu_ps(maskpf+x), level_vector) : level_vector;
+
+      _mm_storeu_ps(dstpf+x, layer_planar_hbd_core_sse2<mode>(src, ovr, weight, max_pixel_value, max_pixel_value, half));
+    }
+
+    for (int x = mod4_width; x < width; ++x) {
+      float weight = has_alpha ? maskpf[x] * level_f : level_f;
+      dstpf[x] = layer_planar_hbd_pixel<float, mode>(dstpf[x], ovrpf[x], weight, 1.0f, 1.0f, 0.5f);
+    }
+
+    dstp += dst_pitch;
+    ovrp += overlay_pitch;
+    if (has_alpha)
+      maskp += mask_pitch;
+  }
+}
+
+template<int mode, bool has_alpha>
+static LayerPlanarFunction get_layer_planar_function(int pixelsize, int cpu) {
+  switch (pixelsize) {
+  case 1:
+    return (cpu & CPUF_SSE2) ? layer_planar8_sse2<mode, has_alpha> : layer_planar_c<uint8_t, mode, has_alpha>;
+  case 2:
+    return (cpu & CPUF_SSE4_1) ? layer_planar16_sse41<mode, has_alpha> : layer_planar_c<uint16_t, mode, has_alpha>;
+  default:
+    return (cpu & CPUF_SSE2) ? layer_planar_float_sse2<mode, has_alpha> : layer_planar_c<float, mode, has_alpha>;
+  }
+}
+
+template<int mode>
+static LayerPlanarFunction get_layer_planar_function(bool has_alpha, int pixelsize, int cpu) {
+  return has_alpha ? get_layer_planar_function<mode, true>(pixelsize, cpu) : get_layer_planar_function<mode, false>(pixelsize, cpu);
+}
+
+static LayerPlanarFunction get_layer_planar_function(int mode, bool has_alpha, int pixelsize, int cpu) {
+  switch (mode) {
+  case LAYER_ADD:      return get_layer_planar_function<LAYER_ADD>(has_alpha, pixelsize, cpu);
+  case LAYER_SUBTRACT: return get_layer_planar_function<LAYER_SUBTRACT>(has_alpha, pixelsize, cpu);
+  case LAYER_MUL:      return get_layer_planar_function<LAYER_MUL>(has_alpha, pixelsize, cpu);
+  default:             return get_layer_planar_function<LAYER_NEUTRAL>(has_alpha, pixelsize, cpu);
+  }
+}
+
+
+template<typename pixel_t>
+static void layer_planar_fast_c(BYTE* dstp8, const BYTE* ovrp8, int dst_pitch, int overlay_pitch, int width, int height) {
+  for (int y = 0; y < height; ++y) {
+    pixel_t* dstp = reinterpret_cast<pixel_t*>(dstp8);
+    const pixel_t* ovrp = reinterpret_cast<const pixel_t*>(ovrp8);
+    for (int x = 0; x < width; ++x) {
+      if (sizeof(pixel_t) == 4)
+        dstp[x] = (dstp[x] + ovrp[x]) * 0.5f;
+      else
+        dstp[x] = (pixel_t)(((int)dstp[x] + (int)ovrp[x] + 1) >> 1);
+    }
+    dstp8 += dst_pitch;
+    ovrp8 += overlay_pitch;
+  }
+}
+
+template<typename pixel_t>
+static void layer_planar_fast_sse2(BYTE* dstp, const BYTE* ovrp, int dst_pitch, int overlay_pitch, int width, int height) {
+  int width_bytes = width * sizeof(pixel_t);
+  int width_mod16 = width_bytes / 16 * 16;
+  __m128 half = _mm_set1_ps(0.5f);
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width_mod16; x+=16) {
+      __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dstp+x));
+      __m128i ovr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ovrp+x));
+      __m128i dst;
+      if (sizeof(pixel_t) == 1)
+        dst = _mm_avg_epu8(src, ovr);
+      else if (sizeof(pixel_t) == 2)
+        dst = _mm_avg_epu16(src, ovr);
+      else
+        dst = _mm_castps_si128(_mm_mul_ps(_mm_add_ps(_mm_castsi128_ps(src), _mm_castsi128_ps(ovr)), half));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp+x), dst);
+    }
+
+    if (width_mod16 < width_bytes) {
+      layer_planar_fast_c<pixel_t>(dstp + width_mod16, ovrp + width_mod16, dst_pitch, overlay_pitch, (width_bytes - width_mod16) / sizeof(pixel_t), 1);
+    }
+
+    dstp += dst_pitch;
+    ovrp += overlay_pitch;
+  }
+}
+
+static void layer_planar_fast(BYTE* dstp, const BYTE* ovrp, int dst_pitch, int overlay_pitch, int width, int height, int pixelsize, IScriptEnvironment* env) {
+  const bool sse2 = !!(env->GetCPUFlags() & CPUF_SSE2);
+  switch (pixelsize) {
+  case 1:
+    if (sse2) layer_planar_fast_sse2<uint8_t>(dstp, ovrp, dst_pitch, overlay_pitch, width, height);
+    else layer_planar_fast_c<uint8_t>(dstp, ovrp, dst_pitch, overlay_pitch, width, height);
+    break;
+  case 2:
+    if (sse2) layer_planar_fast_sse2<uint16_t>(dstp, ovrp, dst_pitch, overlay_pitch, width, height);
+    else layer_planar_fast_c<uint16_t>(dstp, ovrp, dst_pitch, overlay_pitch, width, height);
+    break;
+  default:
+    if (sse2) layer_planar_fast_sse2<float>(dstp, ovrp, dst_pitch, overlay_pitch, width, height);
+    else layer_planar_fast_c<float>(dstp, ovrp, dst_pitch, overlay_pitch, width, height);
+    break;
+  }
+}
+
+
+// Alpha of subsampled YUVA chroma: box average of the covered luma positions
+template<typename pixel_t>
+static void layer_subsample_mask_c(BYTE* dstp8, const BYTE* srcp8, int dst_pitch, int src_pitch, int width, int height, int xshift, int yshift) {
+  const int count = 1 << (xshift + yshift);
+
+  for (int y = 0; y < height; ++y) {
+    pixel_t* dstp = reinterpret_cast<pixel_t*>(dstp8);
+    for (int x = 0; x < width; ++x) {
+      typedef typename std::conditional<sizeof(pixel_t) == 4, float, int>::type sum_t;
+      sum_t sum = 0;
+      for (int j = 0; j < (1 << yshift); ++j) {
+        const pixel_t* srcp = reinterpret_cast<const pixel_t*>(srcp8 + j * src_pitch) + (x << xshift);
+        for (int i = 0; i < (1 << xshift); ++i)
+          sum += srcp[i];
+      }
+      if (sizeof(pixel_t) == 4)
+        dstp[x] = (pixel_t)(sum / count);
+      else
+        dstp[x] = (pixel_t)(((int)sum + count / 2) >> (xshift + yshift));
+    }
+    dstp8 += dst_pitch;
+    srcp8 += src_pitch << yshift;
+  }
+}
+
+
+// RGB with use_chroma=false: all channels are layered with the overlay luma, like RGB32
+template<typename pixel_t, int mode, bool has_alpha>
+static void layer_planarrgb_luma_c(BYTE** dstp, const BYTE** ovrp, const int* dst_pitch, const int* overlay_pitch, int planecount, int width, int height, int level, int bits_per_pixel) {
+  const bool is_float = sizeof(pixel_t) == 4;
+  const int max_pixel_value_i = (1 << bits_per_pixel) - 1;
+  const float max_pixel_value = is_float ? 1.0f : (float)max_pixel_value_i;
+  const float inv_max_pixel_value = 1.0f / max_pixel_value;
+  const float level_f = level / 257.0f;
+  const float mask_scale = level_f * inv_max_pixel_value;
+
+  for (int y = 0; y < height; ++y) {
+    const pixel_t* ovr_g = reinterpret_cast<const pixel_t*>(ovrp[0] + y * overlay_pitch[0]);
+    const pixel_t* ovr_b = reinterpret_cast<const pixel_t*>(ovrp[1] + y * overlay_pitch[1]);
+    const pixel_t* ovr_r = reinterpret_cast<const pixel_t*>(ovrp[2] + y * overlay_pitch[2]);
+    const pixel_t* ovr_a = has_alpha ? reinterpret_cast<const pixel_t*>(ovrp[3] + y * overlay_pitch[3]) : nullptr;
+
+    for (int x = 0; x < width; ++x) {
+      if (sizeof(pixel_t) == 1) {
+        int alpha = has_alpha ? (((int)ovr_a[x] * level + 1) >> 8) : level;
+        int luma = (mode == LAYER_SUBTRACT)
+          ? (cyb * (255 - (int)ovr_b[x]) + cyg * (255 - (int)ovr_g[x]) + cyr * (255 - (int)ovr_r[x])) >> 15
+          : (cyb * (int)ovr_b[x] + cyg * (int)ovr_g[x] + cyr * (int)ovr_r[x]) >> 15;
+        for (int p = 0; p < planecount; ++p) {
+          pixel_t* d = reinterpret_cast<pixel_t*>(dstp[p] + y * dst_pitch[p]) + x;
+          int target = (mode == LAYER_MUL) ? ((luma * (int)*d) >> 8) : luma;
+          *d = (pixel_t)((int)*d + (((target - (int)*d) * alpha) >> 8));
+        }
+      } else {
+        float weight = has_alpha ? (float)ovr_a[x] * mask_scale : level_f;
+        float luma = (mode == LAYER_SUBTRACT)
+          ? (max_pixel_value - ovr_b[x]) * 0.114f + (max_pixel_value - ovr_g[x]) * 0.587f + (max_pixel_value - ovr_r[x]) * 0.299f
+          : ovr_b[x] * 0.114f + ovr_g[x] * 0.587f + ovr_r[x] * 0.299f;
+        for (int p = 0; p < planecount; ++p) {
+          pixel_t* d = reinterpret_cast<pixel_t*>(dstp[p] + y * dst_pitch[p]) + x;
+          *d = layer_planar_hbd_pixel<pixel_t, mode == LAYER_MUL ? LAYER_MUL : LAYER_ADD>((float)*d, luma, weight, max_pixel_value, inv_max_pixel_value, 0.0f);
+          if (!is_float)
+            *d = (pixel_t)min((int)*d, max_pixel_value_i);
+        }
+      }
+    }
+  }
+}
+
+// RGB lighten/darken: decided on the luma of both clips, like RGB32
+template<typename pixel_t, int mode, bool has_alpha>
+static void layer_planarrgb_lighten_darken_c(BYTE** dstp, const BYTE** ovrp, const int* dst_pitch, const int* overlay_pitch, int planecount, int width, int height, int level, int thresh, int bits_per_pixel) {
+  const bool is_float = sizeof(pixel_t) == 4;
+  const float max_pixel_value = is_float ? 1.0f : (float)((1 << bits_per_pixel) - 1);
+  const float inv_max_pixel_value = 1.0f / max_pixel_value;
+  const float level_f = level / 257.0f;
+  const float mask_scale = level_f * inv_max_pixel_value;
+  const float thresh_f = thresh * max_pixel_value / 255.0f;
+
+  for (int y = 0; y < height; ++y) {
+    pixel_t* dst[4];
+    const pixel_t* ovr[4];
+    for (int p = 0; p < planecount; ++p) {
+      dst[p] = reinterpret_cast<pixel_t*>(dstp[p] + y * dst_pitch[p]);
+      ovr[p] = reinterpret_cast<const pixel_t*>(ovrp[p] + y * overlay_pitch[p]);
+    }
+
+    for (int x = 0; x < width; ++x) {
+      if (sizeof(pixel_t) == 1) {
+        int alpha = has_alpha ? (((int)ovr[3][x] * level + 1) >> 8) : level;
+        int luma_ovr = (cyb * (int)ovr[1][x] + cyg * (int)ovr[0][x] + cyr * (int)ovr[2][x]) >> 15;
+        int luma_src = (cyb * (int)dst[1][x] + cyg * (int)dst[0][x] + cyr * (int)dst[2][x]) >> 15;
+
+        if (mode == LIGHTEN)
+          alpha = luma_ovr > thresh + luma_src ? alpha : 0;
+        else
+          alpha = luma_ovr < thresh + luma_src ? alpha : 0;
+
+        for (int p = 0; p < planecount; ++p)
+          dst[p][x] = (pixel_t)((int)dst[p][x] + ((((int)ovr[p][x] - (int)dst[p][x]) * alpha) >> 8));
+      } else {
+        float weight = has_alpha ? (float)ovr[3][x] * mask_scale : level_f;
+        float luma_ovr = ovr[1][x] * 0.114f + ovr[0][x] * 0.587f + ovr[2][x] * 0.299f;
+        float luma_src = dst[1][x] * 0.114f + dst[0][x] * 0.587f + dst[2][x] * 0.299f;
+
+        if (mode == LIGHTEN)
+          weight = luma_ovr > thresh_f + luma_src ? weight : 0.0f;
+        else
+          weight = luma_ovr < thresh_f + luma_src ? weight : 0.0f;
+
+        for (int p = 0; p < planecount; ++p)
+          dst[p][x] = layer_planar_hbd_pixel<pixel_t, LAYER_ADD>((float)dst[p][x], (float)ovr[p][x], weight, max_pixel_value, inv_max_pixel_value, 0.0f);
+      }
+    }
+  }
+}
+
+// YUV lighten/darken: decided on luma like YUY2, subsampled chroma follows its top-left luma sample
+template<typename pixel_t, int mode, bool has_alpha>
+static void layer_planaryuv_lighten_darken_c(BYTE** dstp, const BYTE** ovrp, const int* dst_pitch, const int* overlay_pitch, int planecount, int xshift, int yshift, int width, int height, int level, int thresh, int bits_per_pixel) {
+  const bool is_float = sizeof(pixel_t) == 4;
+  const float max_pixel_value = is_float ? 1.0f : (float)((1 << bits_per_pixel) - 1);
+  const float inv_max_pixel_value = 1.0f / max_pixel_value;
+  const float level_f = level / 257.0f;
+  const float mask_scale = level_f * inv_max_pixel_value;
+  const int thresh_i = sizeof(pixel_t) == 1 ? thresh : (thresh << (bits_per_pixel - 8));
+  const float thresh_f = thresh / 255.0f;
+
+  // chroma first, the decision needs the unmodified luma
+  for (int p = 1; p < 3 && p < planecount; ++p) {
+    for (int y = 0; y < (height >> yshift); ++y) {
+      const pixel_t* dst_y = reinterpret_cast<const pixel_t*>(dstp[0] + (y << yshift) * dst_pitch[0]);
+      const pixel_t* ovr_y = reinterpret_cast<const pixel_t*>(ovrp[0] + (y << yshift) * overlay_pitch[0]);
+      const pixel_t* ovr_a = has_alpha ? reinterpret_cast<const pixel_t*>(ovrp[3] + (y << yshift) * overlay_pitch[3]) : nullptr;
+      pixel_t* dst = reinterpret_cast<pixel_t*>(dstp[p] + y * dst_pitch[p]);
+      const pixel_t* ovr = reinterpret_cast<const pixel_t*>(ovrp[p] + y * overlay_pitch[p]);
+
+      for (int x = 0; x < (width >> xshift); ++x) {
+        const int lx = x << xshift;
+        if (!is_float) {
+          bool pass = (mode == LIGHTEN) ? (thresh_i + (int)ovr_y[lx]) > (int)dst_y[lx] : (thresh_i + (int)dst_y[lx]) > (int)ovr_y[lx];
+          if (!pass)
+            continue;
+        } else {
+          bool pass = (mode == LIGHTEN) ? (thresh_f + ovr_y[lx]) > dst_y[lx] : (thresh_f + dst_y[lx]) > ovr_y[lx];
+          if (!pass)
+            continue;
+        }
+        if (sizeof(pixel_t) == 1) {
+          int alpha = has_alpha ? (((int)ovr_a[lx] * level + 1) >> 8) : level;
+          dst[x] = (pixel_t)((int)dst[x] + ((((int)ovr[x] - (int)dst[x]) * alpha) >> 8));
+        } else {
+          float weight = has_alpha ? (float)ovr_a[lx] * mask_scale : level_f;
+          dst[x] = layer_planar_hbd_pixel<pixel_t, LAYER_ADD>((float)dst[x], (float)ovr[x], weight, max_pixel_value, inv_max_pixel_value, 0.0f);
+        }
+      }
+    }
+  }
+
+  // luma and alpha
+  for (int y = 0; y < height; ++y) {
+    pixel_t* dst_y = reinterpret_cast<pixel_t*>(dstp[0] + y * dst_pitch[0]);
+    const pixel_t* ovr_y = reinterpret_cast<const pixel_t*>(ovrp[0] + y * overlay_pitch[0]);
+    pixel_t* dst_a = has_alpha ? reinterpret_cast<pixel_t*>(dstp[3] + y * dst_pitch[3]) : nullptr;
+    const pixel_t* ovr_a = has_alpha ? reinterpret_cast<const pixel_t*>(ovrp[3] + y * overlay_pitch[3]) : nullptr;
+
+    for (int x = 0; x < width; ++x) {
+      if (!is_float) {
+        bool pass = (mode == LIGHTEN) ? (thresh_i + (int)ovr_y[x]) > (int)dst_y[x] : (thresh_i + (int)dst_y[x]) > (int)ovr_y[x];
+        if (!pass)
+          continue;
+      } else {
+        bool pass = (mode == LIGHTEN) ? (thresh_f + ovr_y[x]) > dst_y[x] : (thresh_f + dst_y[x]) > ovr_y[x];
+        if (!pass)
+          continue;
+      }
+      if (sizeof(pixel_t) == 1) {
+        int alpha = has_alpha ? (((int)ovr_a[x] * level + 1) >> 8) : level;
+        dst_y[x] = (pixel_t)((int)dst_y[x] + ((((int)ovr_y[x] - (int)dst_y[x]) * alpha) >> 8));
+        if (has_alpha)
+          dst_a[x] = (pixel_t)((int)dst_a[x] + ((((int)ovr_a[x] - (int)dst_a[x]) * alpha) >> 8));
+      } else {
+        float weight = has_alpha ? (float)ovr_a[x] * mask_scale : level_f;
+        dst_y[x] = layer_planar_hbd_pixel<pixel_t, LAYER_ADD>((float)dst_y[x], (float)ovr_y[x], weight, max_pixel_value, inv_max_pixel_value, 0.0f);
+        if (has_alpha)
+          dst_a[x] = layer_planar_hbd_pixel<pixel_t, LAYER_ADD>((float)dst_a[x], (float)ovr_a[x], weight, max_pixel_value, inv_max_pixel_value, 0.0f);
+      }
+    }
+  }
+}
+
+template<typename pixel_t, bool has_alpha>
+static void layer_planar_lighten_darken(bool lighten, bool rgb, BYTE** dstp, const BYTE** ovrp, const int* dst_pitch, const int* overlay_pitch, int planecount, int xshift, int yshift, int width, int height, int level, int thresh, int bits_per_pixel) {
+  if (rgb) {
+    if (lighten)
+      layer_planarrgb_lighten_darken_c<pixel_t, LIGHTEN, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, width, height, level, thresh, bits_per_pixel);
+    else
+      layer_planarrgb_lighten_darken_c<pixel_t, DARKEN, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, width, height, level, thresh, bits_per_pixel);
+  } else {
+    if (lighten)
+      layer_planaryuv_lighten_darken_c<pixel_t, LIGHTEN, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+    else
+      layer_planaryuv_lighten_darken_c<pixel_t, DARKEN, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+  }
+}
+
+template<typename pixel_t, bool has_alpha>
+static void layer_planarrgb_luma(int mode, BYTE** dstp, const BYTE** ovrp, const int* dst_pitch, const int* overlay_pitch, int planecount, int width, int height, int level, int bits_per_pixel) {
+  switch (mode) {
+  case LAYER_ADD:      layer_planarrgb_luma_c<pixel_t, LAYER_ADD, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, width, height, level, bits_per_pixel); break;
+  case LAYER_SUBTRACT: layer_planarrgb_luma_c<pixel_t, LAYER_SUBTRACT, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, width, height, level, bits_per_pixel); break;
+  default:             layer_planarrgb_luma_c<pixel_t, LAYER_MUL, has_alpha>(dstp, ovrp, dst_pitch, overlay_pitch, planecount, width, height, level, bits_per_pixel); break;
+  }
+}
+
+
 PVideoFrame __stdcall Layer::GetFrame(int n, IScriptEnvironment* env)
 {
   PVideoFrame src1 = child1->GetFrame(n, env);
@@ -2729,6 +3727,131 @@ PVideoFrame __stdcall Layer::GetFrame(int n, IScriptEnvironment* env)
       }
     }
   }
+  else if (vi.IsPlanar())
+  {
+    const int pixelsize = vi.ComponentSize();
+    const int bits_per_pixel = vi.BitsPerComponent();
+    const int level = clamp(mylevel, 0, 257);
+    const int thresh = T & 0xFF;
+    const int cpu = env->GetCPUFlags();
+    const bool rgb = vi.IsPlanarRGB() || vi.IsPlanarRGBA();
+    const bool has_alpha = vi.IsPlanarRGBA() || vi.IsYUVA();
+    const bool grey = vi.IsY();
+
+    const int planes_yuv[4] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
+    const int planes_rgb[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+    const int *planes = rgb ? planes_rgb : planes_yuv;
+    const int planecount = grey ? 1 : (has_alpha ? 4 : 3);
+
+    const int xshift = (rgb || grey) ? 0 : vi.GetPlaneWidthSubsampling(PLANAR_U);
+    const int yshift = (rgb || grey) ? 0 : vi.GetPlaneHeightSubsampling(PLANAR_U);
+
+    BYTE* dstp[4];
+    const BYTE* ovrp[4];
+    int dst_pitch[4], ovr_pitch[4], xs[4], ys[4];
+    for (int p = 0; p < planecount; ++p) {
+      const int plane = planes[p];
+      const bool is_chroma = !rgb && (p == 1 || p == 2);
+      xs[p] = is_chroma ? xshift : 0;
+      ys[p] = is_chroma ? yshift : 0;
+      dst_pitch[p] = src1->GetPitch(plane);
+      ovr_pitch[p] = src2->GetPitch(plane);
+      dstp[p] = src1->GetWritePtr(plane) + dst_pitch[p] * (ydest >> ys[p]) + (xdest >> xs[p]) * pixelsize;
+      ovrp[p] = src2->GetReadPtr(plane) + ovr_pitch[p] * (ysrc >> ys[p]) + (xsrc >> xs[p]) * pixelsize;
+    }
+
+    if (!lstrcmpi(Op, "Fast"))
+    {
+      for (int p = 0; p < planecount; ++p)
+        layer_planar_fast(dstp[p], ovrp[p], dst_pitch[p], ovr_pitch[p], width >> xs[p], height >> ys[p], pixelsize, env);
+    }
+    else if (!lstrcmpi(Op, "Lighten") || !lstrcmpi(Op, "Darken"))
+    {
+      const bool lighten = !lstrcmpi(Op, "Lighten");
+      if (pixelsize == 1) {
+        if (has_alpha) layer_planar_lighten_darken<uint8_t, true>(lighten, rgb, dstp, ovrp, dst_pitch, ovr_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+        else layer_planar_lighten_darken<uint8_t, false>(lighten, rgb, dstp, ovrp, dst_pitch, ovr_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+      } else if (pixelsize == 2) {
+        if (has_alpha) layer_planar_lighten_darken<uint16_t, true>(lighten, rgb, dstp, ovrp, dst_pitch, ovr_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+        else layer_planar_lighten_darken<uint16_t, false>(lighten, rgb, dstp, ovrp, dst_pitch, ovr_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+      } else {
+        if (has_alpha) layer_planar_lighten_darken<float, true>(lighten, rgb, dstp, ovrp, dst_pitch, ovr_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+        else layer_planar_lighten_darken<float, false>(lighten, rgb, dstp, ovrp, dst_pitch, ovr_pitch, planecount, xshift, yshift, width, height, level, thresh, bits_per_pixel);
+      }
+    }
+    else
+    {
+      const int mode = !lstrcmpi(Op, "Add") ? LAYER_ADD : (!lstrcmpi(Op, "Subtract") ? LAYER_SUBTRACT : LAYER_MUL);
+
+      if (rgb && !chroma)
+      {
+        // every channel is layered with the overlay luma
+        if (pixelsize == 1) {
+          if (has_alpha) layer_planarrgb_luma<uint8_t, true>(mode, dstp, ovrp, dst_pitch, ovr_pitch, planecount, width, height, level, bits_per_pixel);
+          else layer_planarrgb_luma<uint8_t, false>(mode, dstp, ovrp, dst_pitch, ovr_pitch, planecount, width, height, level, bits_per_pixel);
+        } else if (pixelsize == 2) {
+          if (has_alpha) layer_planarrgb_luma<uint16_t, true>(mode, dstp, ovrp, dst_pitch, ovr_pitch, planecount, width, height, level, bits_per_pixel);
+          else layer_planarrgb_luma<uint16_t, false>(mode, dstp, ovrp, dst_pitch, ovr_pitch, planecount, width, height, level, bits_per_pixel);
+        } else {
+          if (has_alpha) layer_planarrgb_luma<float, true>(mode, dstp, ovrp, dst_pitch, ovr_pitch, planecount, width, height, level, bits_per_pixel);
+          else layer_planarrgb_luma<float, false>(mode, dstp, ovrp, dst_pitch, ovr_pitch, planecount, width, height, level, bits_per_pixel);
+        }
+      }
+      else
+      {
+        const BYTE* maskp = has_alpha ? ovrp[3] : nullptr;
+        const int mask_pitch = has_alpha ? ovr_pitch[3] : 0;
+
+        // subsampled chroma of YUVA needs its own alpha
+        BYTE* chroma_maskp = nullptr;
+        int chroma_mask_pitch = 0;
+        IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+        if (has_alpha && !rgb && (xshift || yshift)) {
+          const int chroma_width = width >> xshift;
+          const int chroma_height = height >> yshift;
+          chroma_mask_pitch = AlignNumber(chroma_width * pixelsize, 16);
+          chroma_maskp = static_cast<BYTE*>(env2->Allocate(chroma_mask_pitch * chroma_height, 16, AVS_POOLED_ALLOC));
+          if (!chroma_maskp)
+            env->ThrowError("Layer: Could not reserve memory.");
+          if (pixelsize == 1)
+            layer_subsample_mask_c<uint8_t>(chroma_maskp, maskp, chroma_mask_pitch, mask_pitch, chroma_width, chroma_height, xshift, yshift);
+          else if (pixelsize == 2)
+            layer_subsample_mask_c<uint16_t>(chroma_maskp, maskp, chroma_mask_pitch, mask_pitch, chroma_width, chroma_height, xshift, yshift);
+          else
+            layer_subsample_mask_c<float>(chroma_maskp, maskp, chroma_mask_pitch, mask_pitch, chroma_width, chroma_height, xshift, yshift);
+        }
+
+        for (int p = 0; p < planecount; ++p) {
+          int plane_mode = mode;
+          int plane_level = level;
+          const BYTE* plane_maskp = maskp;
+          int plane_mask_pitch = mask_pitch;
+
+          if (!rgb && (p == 1 || p == 2)) {
+            // chroma follows the YUY2 rules: Mul copies the overlay chroma,
+            // without use_chroma the chroma is pulled towards grey
+            if (chroma)
+              plane_mode = (mode == LAYER_MUL) ? LAYER_ADD : mode;
+            else {
+              plane_mode = LAYER_NEUTRAL;
+              if (mode == LAYER_MUL)
+                plane_level = level / 2;
+            }
+            if (chroma_maskp) {
+              plane_maskp = chroma_maskp;
+              plane_mask_pitch = chroma_mask_pitch;
+            }
+          }
+
+          LayerPlanarFunction layer_fn = get_layer_planar_function(plane_mode, has_alpha, pixelsize, cpu);
+          layer_fn(dstp[p], ovrp[p], plane_maskp, dst_pitch[p], ovr_pitch[p], plane_mask_pitch, width >> xs[p], height >> ys[p], plane_level, bits_per_pixel);
+        }
+
+        if (chroma_maskp)
+          env2->Free(chroma_maskp);
+      }
+    }
+  }
   return src1;
 }
 
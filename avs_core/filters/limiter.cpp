@@ -92,7 +92,7 @@ Limiter::Limiter(PClip _child, int _min_luma, int _max_luma, int _min_chroma, in
   max_luma(_max_luma),
   min_chroma(_min_chroma),
   max_chroma(_max_chroma),
-  show(enum SHOW(_show))
+  show(SHOW(_show))
 {
   if (!vi.IsYUV())
       env->ThrowError("Limiter: Source must be YUV");
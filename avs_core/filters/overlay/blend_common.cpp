@@ -106,6 +106,7 @@ __forceinline __m128i overlay_blend_opaque_sse2_core(const __m128i& p1, const __
   return _mm_or_si128(r1, r2);
 }
 
+AVS_TARGET("sse4.1")
 __forceinline __m128i overlay_blend_opaque_sse41_core(const __m128i& p1, const __m128i& p2, const __m128i& mask) {
   return _mm_blendv_epi8(p1, p2, mask);
 }
@@ -476,7 +477,6 @@ void overlay_blend_sse2_plane_masked_opacity(BYTE *p1, const BYTE *p2, const BYT
  ********* Mode: Lighten/Darken ********
  ***************************************/
 
-typedef __m128i (OverlaySseBlendOpaque)(const __m128i&, const __m128i&, const __m128i&);
 typedef __m128i (OverlaySseCompare)(const __m128i&, const __m128i&, const __m128i&);
 #ifdef X86_32
 typedef   __m64 (OverlayMmxCompare)(const __m64&, const __m64&, const __m64&);
@@ -559,8 +559,8 @@ __forceinline void overlay_darklighten_mmx(BYTE *p1Y, BYTE *p1U, BYTE *p1V, cons
 }
 #endif
 
-template <OverlaySseBlendOpaque blend, OverlaySseCompare compare, OverlayCCompare compare_c>
-__forceinline void overlay_darklighten_sse(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
+template <OverlaySseCompare compare, OverlayCCompare compare_c>
+__forceinline void overlay_darklighten_sse2(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
   __m128i zero = _mm_setzero_si128();
 
   int wMod16 = (width/16) * 16;
@@ -575,21 +575,74 @@ __forceinline void overlay_darklighten_sse(BYTE *p1Y, BYTE *p1U, BYTE *p1V, cons
       __m128i cmp_result = compare(p1_y, p2_y, zero);
 
       // Process U Plane
-      __m128i result_y = blend(p1_y, p2_y, cmp_result);
+      __m128i result_y = overlay_blend_opaque_sse2_core(p1_y, p2_y, cmp_result);
       _mm_storeu_si128(reinterpret_cast<__m128i*>(p1Y+x), result_y);
 
       // Process U plane
       __m128i p1_u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1U+x));
       __m128i p2_u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2U+x));
       
-      __m128i result_u = blend(p1_u, p2_u, cmp_result);
+      __m128i result_u = overlay_blend_opaque_sse2_core(p1_u, p2_u, cmp_result);
       _mm_storeu_si128(reinterpret_cast<__m128i*>(p1U+x), result_u);
 
       // Process V plane
       __m128i p1_v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1V+x));
       __m128i p2_v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2V+x));
       
-      __m128i result_v = blend(p1_v, p2_v, cmp_result);
+      __m128i result_v = overlay_blend_opaque_sse2_core(p1_v, p2_v, cmp_result);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p1V+x), result_v);
+    }
+
+    // Leftover value
+    for (int x = wMod16; x < width; x++) {
+      int mask = compare_c(p1Y[x], p2Y[x]);
+      p1Y[x] = overlay_blend_opaque_c_core(p1Y[x], p2Y[x], mask);
+      p1U[x] = overlay_blend_opaque_c_core(p1U[x], p2U[x], mask);
+      p1V[x] = overlay_blend_opaque_c_core(p1V[x], p2V[x], mask);
+    }
+
+    p1Y += p1_pitch;
+    p1U += p1_pitch;
+    p1V += p1_pitch;
+
+    p2Y += p2_pitch;
+    p2U += p2_pitch;
+    p2V += p2_pitch;
+  }
+}
+
+template <OverlaySseCompare compare, OverlayCCompare compare_c>
+AVS_TARGET("sse4.1")
+__forceinline void overlay_darklighten_sse41(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
+  __m128i zero = _mm_setzero_si128();
+
+  int wMod16 = (width/16) * 16;
+  
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < wMod16; x+=16) {
+      // Load Y Plane
+      __m128i p1_y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1Y+x));
+      __m128i p2_y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2Y+x));
+
+      // Compare
+      __m128i cmp_result = compare(p1_y, p2_y, zero);
+
+      // Process U Plane
+      __m128i result_y = overlay_blend_opaque_sse41_core(p1_y, p2_y, cmp_result);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p1Y+x), result_y);
+
+      // Process U plane
+      __m128i p1_u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1U+x));
+      __m128i p2_u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2U+x));
+      
+      __m128i result_u = overlay_blend_opaque_sse41_core(p1_u, p2_u, cmp_result);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p1U+x), result_u);
+
+      // Process V plane
+      __m128i p1_v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1V+x));
+      __m128i p2_v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2V+x));
+      
+      __m128i result_v = overlay_blend_opaque_sse41_core(p1_v, p2_v, cmp_result);
       _mm_storeu_si128(reinterpret_cast<__m128i*>(p1V+x), result_v);
     }
 
@@ -662,16 +715,18 @@ void overlay_lighten_mmx(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const
 #endif
 
 void overlay_darken_sse2(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
-  overlay_darklighten_sse<overlay_blend_opaque_sse2_core, overlay_darken_sse_cmp, overlay_darken_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
+  overlay_darklighten_sse2<overlay_darken_sse_cmp, overlay_darken_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
 }
 void overlay_lighten_sse2(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
-  overlay_darklighten_sse<overlay_blend_opaque_sse2_core, overlay_lighten_sse_cmp, overlay_lighten_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
+  overlay_darklighten_sse2<overlay_lighten_sse_cmp, overlay_lighten_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
 }
 
+AVS_TARGET("sse4.1")
 void overlay_darken_sse41(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
-  overlay_darklighten_sse<overlay_blend_opaque_sse41_core, overlay_darken_sse_cmp, overlay_darken_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
+  overlay_darklighten_sse41<overlay_darken_sse_cmp, overlay_darken_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
 }
+AVS_TARGET("sse4.1")
 void overlay_lighten_sse41(BYTE *p1Y, BYTE *p1U, BYTE *p1V, const BYTE *p2Y, const BYTE *p2U, const BYTE *p2V, int p1_pitch, int p2_pitch, int width, int height) {
-  overlay_darklighten_sse<overlay_blend_opaque_sse41_core, overlay_lighten_sse_cmp, overlay_lighten_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
+  overlay_darklighten_sse41<overlay_lighten_sse_cmp, overlay_lighten_c_cmp>(p1Y, p1U, p1V, p2Y, p2U, p2V, p1_pitch, p2_pitch, width, height);
 }
 
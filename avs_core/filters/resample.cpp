@@ -63,14 +63,29 @@ __forceinline __m128i simd_load_unaligned(const __m128i* adr)
   return _mm_loadu_si128(adr);
 }
 
+// The loaders below are used by the SSE2 and SSSE3 resizers alike. gcc only
+// inlines the SSE3 and SSE4.1 intrinsics into functions built for those, so
+// the instructions are written out there.
 __forceinline __m128i simd_load_unaligned_sse3(const __m128i* adr)
 {
+#ifdef __GNUC__
+  __m128i result;
+  __asm__("lddqu %1, %0" : "=x"(result) : "m"(*adr));
+  return result;
+#else
   return _mm_lddqu_si128(adr);
+#endif
 }
 
 __forceinline __m128i simd_load_streaming(const __m128i* adr)
 {
+#ifdef __GNUC__
+  __m128i result;
+  __asm__("movntdqa %1, %0" : "=x"(result) : "m"(*adr));
+  return result;
+#else
   return _mm_stream_load_si128(const_cast<__m128i*>(adr));
+#endif
 }
 
 /***************************************
@@ -101,7 +116,7 @@ static void resize_v_c_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src
 {
   int filter_size = program->filter_size;
 
-  typedef std::conditional < std::is_floating_point<pixel_t>::value, float, short>::type coeff_t;
+  typedef typename std::conditional < std::is_floating_point<pixel_t>::value, float, short>::type coeff_t;
   coeff_t *current_coeff;
 
   if (!std::is_floating_point<pixel_t>::value)
@@ -125,7 +140,7 @@ static void resize_v_c_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src
 
     for (int x = 0; x < width; x++) {
       // todo: check whether int result is enough for 16 bit samples (can an int overflow because of 16384 scale or really need __int64?)
-      std::conditional < sizeof(pixel_t) == 1, int, std::conditional < sizeof(pixel_t) == 2, __int64, float>::type >::type result;
+      typename std::conditional < sizeof(pixel_t) == 1, int, typename std::conditional < sizeof(pixel_t) == 2, __int64, float>::type >::type result;
       result = 0;
       for (int i = 0; i < filter_size; i++) {
         result += (src_ptr+pitch_table[i] / sizeof(pixel_t))[x] * current_coeff[i];
@@ -350,6 +365,7 @@ static void resize_v_sse2_planar(BYTE* dst, const BYTE* src, int dst_pitch, int
 }
 
 template<SSELoader load>
+AVS_TARGET("ssse3")
 static void resize_v_ssse3_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, const int* pitch_table, const void* storage)
 {
   int filter_size = program->filter_size;
@@ -486,7 +502,7 @@ template<typename pixel_t>
 static void resize_h_c_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height) {
   int filter_size = program->filter_size;
 
-  typedef std::conditional < std::is_floating_point<pixel_t>::value, float, short>::type coeff_t;
+  typedef typename std::conditional < std::is_floating_point<pixel_t>::value, float, short>::type coeff_t;
   coeff_t *current_coeff;
 
   if (!std::is_floating_point<pixel_t>::value)
@@ -510,7 +526,7 @@ static void resize_h_c_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src
     int begin = program->pixel_offset[x];
     for (int y = 0; y < height; y++) {
       // todo: check whether int result is enough for 16 bit samples (can an int overflow because of 16384 scale or really need __int64?)
-      std::conditional < sizeof(pixel_t) == 1, int, std::conditional < sizeof(pixel_t) == 2, __int64, float>::type >::type result;
+      typename std::conditional < sizeof(pixel_t) == 1, int, typename std::conditional < sizeof(pixel_t) == 2, __int64, float>::type >::type result;
       result = 0;
       for (int i = 0; i < filter_size; i++) {
         result += (src0+y*src_pitch)[(begin+i)] * current_coeff[i];
@@ -525,6 +541,7 @@ static void resize_h_c_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src
   }
 }
 
+AVS_TARGET("ssse3")
 static void resizer_h_ssse3_generic(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height) {
   int filter_size = AlignNumber(program->filter_size, 8) / 8;
   __m128i zero = _mm_setzero_si128();
@@ -603,6 +620,7 @@ static void resizer_h_ssse3_generic(BYTE* dst, const BYTE* src, int dst_pitch, i
   }
 }
 
+AVS_TARGET("ssse3")
 static void resizer_h_ssse3_8(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height) {
   int filter_size = AlignNumber(program->filter_size, 8) / 8;
 
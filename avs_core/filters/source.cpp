@@ -36,7 +36,12 @@
 #include "../core/internal.h"
 #include "../convert/convert.h"
 #include "transform.h"
+#include "text-overlay.h"
+#ifdef AVS_WINDOWS
 #include "AviSource/avi_source.h"
+#else
+#include <sys/stat.h>
+#endif
 
 #define PI 3.1415926535897932384626433832795
 #include <ctime>
@@ -416,9 +421,6 @@ static AVSValue __cdecl Create_BlankClip(AVSValue args, void*, IScriptEnvironmen
 /********************************************************************
 ********************************************************************/
 
-// in text-overlay.cpp
-extern bool GetTextBoundingBox(const char* text, const char* fontname,
-  int size, bool bold, bool italic, int align, int* width, int* height);
 
 
 PClip Create_MessageClip(const char* message, int width, int height, int pixel_type, bool shrink,
@@ -1039,15 +1041,24 @@ AVSValue __cdecl Create_SegmentedSource(AVSValue args, void* use_directshow, ISc
       extension = "";
     for (int j = 0; j < 100; ++j) {
       char filename[260];
-      wsprintf(filename, "%s.%02d.%s", basename, j, extension);
+      snprintf(filename, sizeof(filename), "%s.%02d.%s", basename, j, extension);
+#ifdef AVS_WINDOWS
       if (GetFileAttributes(filename) != (DWORD)-1) {   // check if file exists
+#else
+      struct stat st;
+      if (stat(filename, &st) == 0) {   // check if file exists
+#endif
           PClip clip;
         try {
           if (use_directshow) {
             inv_args[0] = filename;
             clip = env->Invoke("DirectShowSource",AVSValue(inv_args, inv_args_count)).AsClip();
           } else {
+#ifdef AVS_WINDOWS
             clip =  (IClip*)(new AVISource(filename, bAudio, pixel_type, fourCC, vtrack, atrack, AVISource::MODE_NORMAL, env));
+#else
+            env->ThrowError("AVISource is not available on this platform.");
+#endif
           }
           result = !result ? clip : new_Splice(result, clip, false, env);
         } catch (const AvisynthError &e) {
@@ -1203,11 +1214,13 @@ AVSValue __cdecl Create_Version(AVSValue args, void*, IScriptEnvironment* env) {
 
 
 extern const AVSFunction Source_filters[] = {
+#ifdef AVS_WINDOWS
   { "AVISource",     BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", AVISource::Create, (void*) AVISource::MODE_NORMAL },
   { "AVIFileSource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", AVISource::Create, (void*) AVISource::MODE_AVIFILE },
   { "WAVSource",     BUILTIN_FUNC_PREFIX, "s+", AVISource::Create, (void*) AVISource::MODE_WAV },
   { "OpenDMLSource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", AVISource::Create, (void*) AVISource::MODE_OPENDML },
   { "SegmentedAVISource", BUILTIN_FUNC_PREFIX, "s+[audio]b[pixel_type]s[fourCC]s[vtrack]i[atrack]i", Create_SegmentedSource, (void*)0 },
+#endif
   { "SegmentedDirectShowSource", BUILTIN_FUNC_PREFIX, 
 // args               0      1      2       3       4            5          6         7            8
                      "s+[fps]f[seek]b[audio]b[video]b[convertfps]b[seekzero]b[timeout]i[pixel_type]s",
@@ -42,6 +42,7 @@
 #include <avs/minmax.h>
 #include <emmintrin.h>
 
+#ifdef AVS_WINDOWS
 
 
 static HFONT LoadFont(const char name[], int size, bool bold, bool italic, int width=0, int angle=0) 
@@ -1325,9 +1326,14 @@ std::string GetCpuMsg(IScriptEnvironment * env)
   if (flags & CPUF_SSSE3)
     ss << "SSSE3 ";
 
-  if (flags & CPUF_AVX)
+  if (flags & CPUF_AVX2)
+      ss << "AVX2 ";
+  else if (flags & CPUF_AVX)
       ss << "AVX ";
 
+  if (flags & CPUF_FMA3)
+      ss << "FMA3 ";
+
   if (flags & CPUF_3DNOW_EXT)
     ss << "3DNOW_EXT";
   else if (flags & CPUF_3DNOW)
@@ -2360,3 +2366,38 @@ void ApplyMessage( PVideoFrame* frame, const VideoInfo& vi, const char* message,
   }
 }
 
+#else // AVS_WINDOWS
+
+// The text filters render with GDI, there is no font engine on the other
+// platforms yet. Only the helpers the rest of the core calls are provided.
+
+extern const AVSFunction Text_filters[] = {
+  { 0 }
+};
+
+bool GetTextBoundingBox( const char* text, const char* fontname, int size, bool bold,
+                         bool italic, int align, int* width, int* height )
+{
+  // Estimate from the longest line, with the average glyph of a proportional
+  // font at a bit over half the height
+  int lines = 1, line_chars = 0, max_chars = 0;
+  for (const char* p = text; *p; ++p) {
+    if (*p == '\n') {
+      ++lines;
+      line_chars = 0;
+    }
+    else
+      max_chars = max(max_chars, ++line_chars);
+  }
+  *width = max_chars * size * 11 / 20;
+  *height = lines * size;
+  return true;
+}
+
+void ApplyMessage( PVideoFrame* frame, const VideoInfo& vi, const char* message, int size,
+                   int textcolor, int halocolor, int bgcolor, IScriptEnvironment* env )
+{
+  // Nothing is drawn, the frame is left as it is
+}
+
+#endif // AVS_WINDOWS
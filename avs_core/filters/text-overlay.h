@@ -40,6 +40,8 @@
 #include <cstdio>
 #include <stdint.h>
 
+#ifdef AVS_WINDOWS
+
 
 /********************************************************************
 ********************************************************************/
@@ -237,6 +239,15 @@ private:
 
 
 
+#else
+
+// GDI text alignment flags
+#define TA_TOP    0
+#define TA_CENTER 6
+
+#endif // AVS_WINDOWS
+
+
 /**** Helper functions ****/
 
 void ApplyMessage( PVideoFrame* frame, const VideoInfo& vi, const char* message, int size, 
@@ -261,6 +261,8 @@ enum {
 
   AVS_CACHE_GET_AUDIO_POLICY=70, // Get the current audio policy.
   AVS_CACHE_GET_AUDIO_SIZE=71, // Get the current audio cache size.
+  AVS_CACHE_GET_AUDIO_HITS=72, // Get the number of audio requests served from the cache.
+  AVS_CACHE_GET_AUDIO_MISSES=73, // Get the number of audio requests that had to read from the child.
 
   AVS_CACHE_PREFETCH_FRAME=100, // Queue request to prefetch frame N.
   AVS_CACHE_PREFETCH_GO=101, // Action video prefetches.
@@ -686,6 +688,40 @@ AVSC_API(int, avs_get_audio)(AVS_Clip *, void * buf,
 AVSC_API(int, avs_set_cache_hints)(AVS_Clip *,
                                    int cachehints, int frame_range);
 
+/////////////////////////////////////////////////////////////////////
+//
+// AVS_FrameBatch
+//
+// Fetches many frames without blocking per frame.  When the script ends
+// in Prefetch(), the requested frames are queued on its worker threads
+// (as many at a time as Prefetch keeps in flight) and returned in the
+// order they complete.  Otherwise each avs_poll_frame/avs_wait_frame call
+// computes the next frame in request order on the calling thread.
+//
+
+typedef struct AVS_FrameBatch AVS_FrameBatch;
+
+AVSC_API(AVS_FrameBatch *, avs_request_frames)(AVS_Clip *, const int * frames, int count);
+// returns 0 on error, see avs_clip_get_error
+// The batch must be released with avs_release_frame_batch
+
+AVSC_API(AVS_FrameBatch *, avs_request_frame_range)(AVS_Clip *, int first, int count);
+
+AVSC_API(int, avs_poll_frame)(AVS_FrameBatch *, int * n, AVS_VideoFrame * * frame);
+// returns 1 and sets *n and *frame if a requested frame has completed,
+// 0 if none has yet, -1 once every requested frame has been returned.
+// *frame is 0 if that frame failed, see avs_frame_batch_get_error.
+// Returned frames must be released with avs_release_video_frame
+
+AVSC_API(int, avs_wait_frame)(AVS_FrameBatch *, int * n, AVS_VideoFrame * * frame);
+// as avs_poll_frame, but blocks until a frame completes instead of returning 0
+
+AVSC_API(const char *, avs_frame_batch_get_error)(AVS_FrameBatch *);
+// error of the frame last returned, 0 if it succeeded
+
+AVSC_API(void, avs_release_frame_batch)(AVS_FrameBatch *);
+// waits for frames still being computed; frames not yet returned are dropped
+
 // This is the callback type used by avs_add_function
 typedef AVS_Value (AVSC_CC * AVS_ApplyFunc)
                         (AVS_ScriptEnvironment *, AVS_Value args, void * user_data);
@@ -747,8 +783,8 @@ enum {
   AVS_CPUF_SSE4_1     = 0x400,
 //AVS_CPUF_AVX        = 0x800,   //  Sandy Bridge, Bulldozer
   AVS_CPUF_SSE4_2    = 0x1000,   //  Nehalem
-//AVS_CPUF_AVX2      = 0x2000,   //  Haswell
-//AVS_CPUF_AVX512    = 0x4000,   //  Knights Landing
+  AVS_CPUF_AVX2      = 0x2000,   //  Haswell
+  AVS_CPUF_FMA3      = 0x4000,   //  Haswell, Piledriver
 };
 
 
@@ -931,6 +967,13 @@ struct AVS_Library {
   AVSC_DECLARE_FUNC(avs_component_size);
   AVSC_DECLARE_FUNC(avs_bits_per_component);
 
+  AVSC_DECLARE_FUNC(avs_request_frames);
+  AVSC_DECLARE_FUNC(avs_request_frame_range);
+  AVSC_DECLARE_FUNC(avs_poll_frame);
+  AVSC_DECLARE_FUNC(avs_wait_frame);
+  AVSC_DECLARE_FUNC(avs_frame_batch_get_error);
+  AVSC_DECLARE_FUNC(avs_release_frame_batch);
+
 };
 
 #undef AVSC_DECLARE_FUNC
@@ -1032,6 +1075,13 @@ AVSC_INLINE AVS_Library * avs_load_library() {
   AVSC_LOAD_FUNC(avs_component_size);
   AVSC_LOAD_FUNC(avs_bits_per_component);
 
+  AVSC_LOAD_FUNC(avs_request_frames);
+  AVSC_LOAD_FUNC(avs_request_frame_range);
+  AVSC_LOAD_FUNC(avs_poll_frame);
+  AVSC_LOAD_FUNC(avs_wait_frame);
+  AVSC_LOAD_FUNC(avs_frame_batch_get_error);
+  AVSC_LOAD_FUNC(avs_release_frame_batch);
+
 
 
 #undef __AVSC_STRINGIFY
@@ -52,4 +52,26 @@
 #   error Unsupported CPU architecture.
 #endif
 
+#if   defined(_WIN32)
+#   define AVS_WINDOWS
+#elif defined(__linux__)
+#   define AVS_LINUX
+#   define AVS_POSIX
+#else
+#   error Operating system unsupported.
+#endif
+
+// Marks a function that uses instructions beyond the baseline its file is
+// compiled for; the caller checks the CPU flags. MSVC takes any intrinsic
+// anywhere, gcc and clang have to be told.
+#if defined(__GNUC__)
+#   define AVS_TARGET(isa) __attribute__((__target__(isa)))
+#else
+#   define AVS_TARGET(isa)
+#endif
+
+#ifdef AVS_POSIX
+#   include <avs/posix.h>
+#endif
+
 #endif //AVS_CONFIG_H
\ No newline at end of file
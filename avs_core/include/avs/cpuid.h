@@ -51,10 +51,15 @@ enum {
   CPUF_SSE4_1       = 0x400,   //  Penryn, Wolfdale, Yorkfield  
   CPUF_AVX          = 0x800,   //  Sandy Bridge, Bulldozer
   CPUF_SSE4_2       = 0x1000,  //  Nehalem
+  CPUF_AVX2         = 0x2000,  //  Haswell
+  CPUF_FMA3         = 0x4000,  //  Haswell, Piledriver
 };
 
 #ifdef BUILDING_AVSCORE
 int GetCPUFlags();
+// Hides the extensions not in new_flags from GetCPUFlags, process wide.
+// Lets the C and older SIMD paths be used and tested on newer CPUs.
+void SetMaxCPU(int new_flags);
 #endif
 
 #endif // AVSCORE_CPUID_H
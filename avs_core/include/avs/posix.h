@@ -0,0 +1,177 @@
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef AVSCORE_POSIX_H
+#define AVSCORE_POSIX_H
+
+// The MSVC keywords and the few Win32 types and functions the interfaces
+// and the core use, for the platforms that have neither.
+// Included by avs/config.h, don't include it directly.
+
+#ifdef AVS_POSIX
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+
+#ifdef X86_32
+#define __stdcall __attribute__((__stdcall__))
+#define __cdecl   __attribute__((__cdecl__))
+#else
+#define __stdcall
+#define __cdecl
+#endif
+
+#define __declspec(x) AVS_DECLSPEC_##x
+#define AVS_DECLSPEC_noreturn  __attribute__((__noreturn__))
+#define AVS_DECLSPEC_dllexport __attribute__((__visibility__("default")))
+#define AVS_DECLSPEC_dllimport
+#define AVS_DECLSPEC_align(n)  __attribute__((__aligned__(n)))
+
+#define __single_inheritance
+#define __forceinline inline __attribute__((__always_inline__))
+#define _inline inline
+#define __int8  char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+
+typedef int BOOL;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef unsigned int UINT;
+typedef void* HANDLE;
+typedef void* HMODULE;
+
+#define TRUE  1
+#define FALSE 0
+
+#define MAX_PATH PATH_MAX
+#define _MAX_PATH PATH_MAX
+
+#define _stricmp  strcasecmp
+#define _strcmpi  strcasecmp
+#define _strnicmp strncasecmp
+#define lstrcmpi  strcasecmp
+#define lstrcmp   strcmp
+#define lstrlen   strlen
+#define _strdup   strdup
+#define _snprintf snprintf
+#define _vsnprintf vsnprintf
+
+#define InterlockedIncrement(x) __sync_add_and_fetch((x), 1)
+#define InterlockedDecrement(x) __sync_sub_and_fetch((x), 1)
+
+#define Int32x32To64(a, b)   ((__int64)(int32_t)(a) * (__int64)(int32_t)(b))
+#define UInt32x32To64(a, b)  ((unsigned __int64)(uint32_t)(a) * (unsigned __int64)(uint32_t)(b))
+#define Int64ShrlMod32(a, b) ((unsigned __int64)(a) >> (b))
+
+// a*b/c with a 64 bit intermediate, rounded half away from zero, -1 when the
+// result does not fit
+static inline int MulDiv(int number, int numerator, int denominator)
+{
+  if (denominator == 0)
+    return -1;
+  __int64 x = (__int64)number * numerator;
+  x += ((x < 0) == (denominator < 0) ? 1 : -1) * (__int64)(denominator / 2);
+  x /= denominator;
+  return (x > INT_MAX || x < INT_MIN) ? -1 : (int)x;
+}
+
+static inline char* _strupr(char* s)
+{
+  for (char* p = s; *p; ++p)
+    if (*p >= 'a' && *p <= 'z')
+      *p -= 'a' - 'A';
+  return s;
+}
+
+static inline char* _strlwr(char* s)
+{
+  for (char* p = s; *p; ++p)
+    if (*p >= 'A' && *p <= 'Z')
+      *p += 'a' - 'A';
+  return s;
+}
+
+static inline char* _strrev(char* s)
+{
+  for (char *p = s, *q = s + strlen(s) - 1; p < q; ++p, --q) {
+    char c = *p;
+    *p = *q;
+    *q = c;
+  }
+  return s;
+}
+
+// Unlike realpath, works for files that don't exist yet. absPath must not be NULL.
+static inline char* _fullpath(char* absPath, const char* relPath, size_t maxLength)
+{
+  size_t len = 0;
+  if (relPath[0] != '/') {
+    if (getcwd(absPath, maxLength) == NULL)
+      return NULL;
+    len = strlen(absPath);
+    if (len == 0 || absPath[len-1] != '/')
+      absPath[len++] = '/';
+  }
+  if (len + strlen(relPath) >= maxLength)
+    return NULL;
+  strcpy(absPath + len, relPath);
+  return absPath;
+}
+
+#if !defined(__cplusplus) && defined(__STRICT_ANSI__)
+// Strict ISO C modes hide the POSIX parts of <stdlib.h> unless the includer
+// defined _POSIX_C_SOURCE before its first system header
+int posix_memalign(void** memptr, size_t alignment, size_t size);
+#endif
+
+static inline void* _aligned_malloc(size_t size, size_t alignment)
+{
+  void* p;
+  return posix_memalign(&p, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) ? NULL : p;
+}
+
+static inline void _aligned_free(void* p)
+{
+  free(p);
+}
+
+#endif // AVS_POSIX
+
+#endif // AVSCORE_POSIX_H
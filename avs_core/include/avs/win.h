@@ -40,12 +40,18 @@
   #define _WIN32_WINNT  _WIN32_WINNT_WS03
 #endif
 
+#include <avs/config.h>
+
+#ifdef AVS_WINDOWS
+
 #define WIN32_LEAN_AND_MEAN
 #define STRICT
 #define NOMINMAX
 
 #include <windows.h>
 
+#endif
+
 // Provision for UTF-8 max 4 bytes per code point
 #define AVS_MAX_PATH MAX_PATH*4
 
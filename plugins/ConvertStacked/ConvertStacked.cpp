@@ -35,27 +35,107 @@
 // ConvertNativeToStacked, ConvertStackedToNative 2016 by pinterf
 
 #include <avisynth.h>
-#include <avs/alignment.h>
+#include <avs/cpuid.h>
 #include <cstdint>
 #include <emmintrin.h>
+#include "ConvertStacked.h"
+
+
+void to_stacked_c(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift)
+{
+    for (int x = 0; x < width; ++x) {
+        const uint16_t out = (uint16_t)(srcp[x] << shift);
+        msb[x] = out >> 8;
+        lsb[x] = (uint8_t)out;
+    }
+}
+
+
+void to_stacked_sse2(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift)
+{
+    const __m128i masklo = _mm_set1_epi16(0x00FF);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    // read 32bytes from src, write 16bytes to msb and lsb
+    for (; x + 16 <= width; x += 16) {
+        const __m128i data16_1 = _mm_sll_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp + x)), count);     // 8 words ABCDEFGH
+        const __m128i data16_2 = _mm_sll_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(srcp + x + 8)), count); // 8 words
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(msb + x), _mm_packus_epi16(_mm_srli_epi16(data16_1, 8), _mm_srli_epi16(data16_2, 8))); // ABCDEFGH Hi
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lsb + x), _mm_packus_epi16(_mm_and_si128(data16_1, masklo), _mm_and_si128(data16_2, masklo))); // ABCDEFGH Lo
+    }
+    if (x < width)
+        to_stacked_c(srcp + x, msb + x, lsb + x, width - x, shift);
+}
+
+
+void from_stacked_c(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width)
+{
+    for (int x = 0; x < width; ++x) {
+        dstp[x] = msb[x] << 8 | lsb[x];
+    }
+}
+
+
+void from_stacked_sse2(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width)
+{
+    int x = 0;
+    // Read 16 bytes from msb and lsb, write 32bytes to dst.
+    for (; x + 16 <= width; x += 16) {
+        const __m128i data_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(msb + x)); // 16 bytes
+        const __m128i data_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lsb + x));
+        // Interleaves the lower 8 signed or unsigned 8-bit integers in a with the lower 8 signed or unsigned 8-bit integers in b.
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp + x), _mm_unpacklo_epi8(data_lo, data_hi));
+        // Interleaves the higher 8 signed or unsigned 8-bit integers in a with the lower 8 signed or unsigned 8-bit integers in b.
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dstp + x + 8), _mm_unpackhi_epi8(data_lo, data_hi));
+    }
+    if (x < width)
+        from_stacked_c(msb + x, lsb + x, dstp + x, width - x);
+}
+
+
+// The 8 bit format holding the planes of a 10 to 16 bit YUV or Y clip,
+// CS_UNKNOWN for other clips
+static int StackedPixelType(const VideoInfo& vi)
+{
+    if (vi.ComponentSize() != 2 || !vi.IsPlanar() || vi.IsRGB() || vi.IsYUVA())
+        return VideoInfo::CS_UNKNOWN;
+    if (vi.IsY()) return VideoInfo::CS_Y8;
+    if (vi.Is420()) return VideoInfo::CS_YV12;
+    if (vi.Is422()) return VideoInfo::CS_YV16;
+    if (vi.Is444()) return VideoInfo::CS_YV24;
+    return VideoInfo::CS_UNKNOWN;
+}
+
 
 class ConvertToStacked : public GenericVideoFilter
 {
 public:
 
-    ConvertToStacked(PClip src, IScriptEnvironment* env) : GenericVideoFilter(src)
+    // bits: the bit depth the stacked samples get, at least the one of the
+    // input. Samples are shifted up to it while they are split, so 10 to 14
+    // bit clips go to stacked 16 bit without a separate conversion.
+    ConvertToStacked(PClip src, int bits, IScriptEnvironment* env) : GenericVideoFilter(src)
     {
+        const int src_bits = vi.BitsPerComponent();
+        vi.pixel_type = StackedPixelType(vi);
+        if (vi.pixel_type == VideoInfo::CS_UNKNOWN)
+            env->ThrowError("ConvertToStacked: Input clip must be native 10 to 16 bit: YUV420, YUV422, YUV444 or Y");
 
-        if (vi.IsColorSpace(VideoInfo::CS_YUV420P16)) vi.pixel_type = VideoInfo::CS_YV12;
-        else if (vi.IsColorSpace(VideoInfo::CS_YUV422P16)) vi.pixel_type = VideoInfo::CS_YV16;
-        else if (vi.IsColorSpace(VideoInfo::CS_YUV444P16)) vi.pixel_type = VideoInfo::CS_YV24;
-        else if (vi.IsColorSpace(VideoInfo::CS_Y16)) vi.pixel_type = VideoInfo::CS_Y8;
-        else env->ThrowError("ConvertToStacked: Input clip must be native 16 bit: YUV420P16, YUV422P16, YUV444P16, Y16");
+        if (bits == 0)
+            bits = src_bits;
+        if (bits < src_bits || bits > 16)
+            env->ThrowError("ConvertToStacked: bits must be between %d and 16", src_bits);
+        shift = bits - src_bits;
 
         vi.height = vi.height << 1; // * 2 stacked
                                     // back from native 16 bit to stacked 8 bit
 
-        return;
+        const int cpu = env->GetCPUFlags();
+        to_stacked = to_stacked_c;
+        if (cpu & CPUF_SSE2)
+            to_stacked = to_stacked_sse2;
+        if (cpu & CPUF_AVX2)
+            to_stacked = to_stacked_avx2;
     }
 
     PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env)
@@ -76,40 +156,12 @@ public:
             const int width = dst->GetRowSize(plane);
             uint8_t* lsb = msb + dst_pitch*height;
 
-            bool use_sse2 = (env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(msb, 16) && IsPtrAligned(srcp, 16);
-
-            if (use_sse2)
-            {
-                // read 32bytes from src, write 16bytes to msb and lsb.
-                // pitch is aligned at least 32 bytes. Thus, an access violation does not happen.
-                for (int y = 0; y < height; ++y) {
-                    for (int x = 0; x < width; x += 16) {
-                        __m128i data16_1, data16_2;
-                        __m128i masklo = _mm_set1_epi16(0x00FF);
-                        // no gain when sse4.1 _mm_stream_load_si128 is used
-                        data16_1 = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + x));       // 16 bytes, 8 words ABCDEFGH
-                        data16_2 = _mm_load_si128(reinterpret_cast<const __m128i*>(srcp + x + 8));   // 16 bytes, 8 words
-                        _mm_stream_si128(reinterpret_cast<__m128i*>(msb + x), _mm_packus_epi16(_mm_srli_epi16(data16_1, 8), _mm_srli_epi16(data16_2, 8))); // ABCDEFGH Hi
-                        _mm_stream_si128(reinterpret_cast<__m128i*>(lsb + x), _mm_packus_epi16(_mm_and_si128(data16_1, masklo), _mm_and_si128(data16_2, masklo))); // ABCDEFGH Lo
-                    }
-                    srcp += src_pitch;
-                    msb += dst_pitch;
-                    lsb += dst_pitch;
-                } // y
-            }
-            else
-            {
-                for (int y = 0; y < height; ++y) {
-                    for (int x = 0; x < width; ++x) {
-                        const uint16_t out = srcp[x];
-                        msb[x] = out >> 8;
-                        lsb[x] = (uint8_t)out;
-                    }
-
-                    srcp += src_pitch;
-                    msb += dst_pitch;
-                    lsb += dst_pitch;
-                }
+            // Both halves are written straight from the source, row by row
+            for (int y = 0; y < height; ++y) {
+                to_stacked(srcp, msb, lsb, width, shift);
+                srcp += src_pitch;
+                msb += dst_pitch;
+                lsb += dst_pitch;
             }
         }
         return dst;
@@ -120,13 +172,18 @@ public:
         return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
     }
 
-    static AVSValue __cdecl ConvertToStacked::Create(AVSValue args, void*, IScriptEnvironment* env)
+    static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env)
     {
         PClip clip = args[0].AsClip();
+        int bits = args[1].AsInt(0);
         /*if (clip->GetVideoInfo().IsY8())
         return clip;*/
-        return new ConvertToStacked(clip, env);
+        return new ConvertToStacked(clip, bits, env);
     }
+
+private:
+    int shift;
+    ToStackedFunc to_stacked;
 };
 
 
@@ -134,7 +191,7 @@ class ConvertFromStacked : public GenericVideoFilter
 {
 public:
 
-    ConvertFromStacked::ConvertFromStacked(PClip src, int bits, IScriptEnvironment* env) : GenericVideoFilter(src)
+    ConvertFromStacked(PClip src, int bits, IScriptEnvironment* env) : GenericVideoFilter(src)
     {
         if (bits == 10 && vi.IsYV12())
             vi.pixel_type = VideoInfo::CS_YUV420P10;
@@ -172,17 +229,22 @@ public:
 
         vi.height = vi.height >> 1; // div 2 non stacked
 
-        return;
+        const int cpu = env->GetCPUFlags();
+        from_stacked = from_stacked_c;
+        if (cpu & CPUF_SSE2)
+            from_stacked = from_stacked_sse2;
+        if (cpu & CPUF_AVX2)
+            from_stacked = from_stacked_avx2;
     }
 
-    PVideoFrame __stdcall ConvertFromStacked::GetFrame(int n, IScriptEnvironment* env)
+    PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env)
     {
         PVideoFrame src = child->GetFrame(n, env);
 
         PVideoFrame dst = env->NewVideoFrame(vi);
 
         const int planes[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
-        const int plane_count = vi.IsColorSpace(VideoInfo::CS_Y16) ? 1 : 3;
+        const int plane_count = vi.IsY() ? 1 : 3;
         for (int p = 0; p < plane_count; ++p) {
             const int plane = planes[p];
             const uint8_t* msb = src->GetReadPtr(plane);
@@ -193,37 +255,11 @@ public:
             const int width = src->GetRowSize(plane);
             const uint8_t* lsb = msb + src_pitch*height;
 
-            bool use_sse2 = (env->GetCPUFlags() & CPUF_SSE2) && IsPtrAligned(msb, 16) && IsPtrAligned(dstp, 16);
-
-            if (use_sse2)
-            {
-                // pf my very first intrinsic, hey
-                for (int y = 0; y < height; ++y) {
-                    // Read 16 bytes from msb and lsb, write 32bytes to dst.
-                    // pitch is aligned at least 32bytes. Thus, we don't have to care about buffer over run.
-                    for (int x = 0; x < width; x += 16) {
-                        __m128i data_hi, data_lo;
-                        data_hi = _mm_load_si128(reinterpret_cast<const __m128i*>(msb + x)); // 16 bytes
-                        data_lo = _mm_load_si128(reinterpret_cast<const __m128i*>(lsb + x));
-                        // Interleaves the lower 8 signed or unsigned 8-bit integers in a with the lower 8 signed or unsigned 8-bit integers in b.
-                        _mm_stream_si128(reinterpret_cast<__m128i*>(dstp + x), _mm_unpacklo_epi8(data_lo, data_hi));
-                        // Interleaves the higher 8 signed or unsigned 8-bit integers in a with the lower 8 signed or unsigned 8-bit integers in b.
-                        _mm_stream_si128(reinterpret_cast<__m128i*>(dstp + x + 8), _mm_unpackhi_epi8(data_lo, data_hi));
-                    }
-                    msb += src_pitch;
-                    lsb += src_pitch;
-                    dstp += dst_pitch;
-                }
-            }
-            else {
-                for (int y = 0; y < height; ++y) {
-                    for (int x = 0; x < width; ++x) {
-                        dstp[x] = msb[x] << 8 | lsb[x];
-                    }
-                    msb += src_pitch;
-                    lsb += src_pitch;
-                    dstp += dst_pitch;
-                }
+            for (int y = 0; y < height; ++y) {
+                from_stacked(msb, lsb, dstp, width);
+                msb += src_pitch;
+                lsb += src_pitch;
+                dstp += dst_pitch;
             }
         }
         return dst;
@@ -235,13 +271,16 @@ public:
     }
 
 
-    static AVSValue __cdecl ConvertFromStacked::Create(AVSValue args, void*, IScriptEnvironment* env)
+    static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env)
     {
         PClip clip = args[0].AsClip();
         int bits = args[1].AsInt(16);
 
         return new ConvertFromStacked(clip, bits, env);
     }
+
+private:
+    FromStackedFunc from_stacked;
 };
 
 
@@ -318,11 +357,11 @@ public:
 
     ConvertToDoubleWidth(PClip src, IScriptEnvironment* env) : GenericVideoFilter(src)
     {
-        if (vi.IsColorSpace(VideoInfo::CS_YUV420P16)) vi.pixel_type = VideoInfo::CS_YV12;
-        else if (vi.IsColorSpace(VideoInfo::CS_YUV422P16)) vi.pixel_type = VideoInfo::CS_YV16;
-        else if (vi.IsColorSpace(VideoInfo::CS_YUV444P16)) vi.pixel_type = VideoInfo::CS_YV24;
-        else if (vi.IsColorSpace(VideoInfo::CS_Y16)) vi.pixel_type = VideoInfo::CS_Y8;
-        else env->ThrowError("ConvertToDoubleWidth: Input clip must be 16bit format");
+        // The samples are passed on as they are, ConvertFromDoubleWidth
+        // with the same bits restores the clip
+        vi.pixel_type = StackedPixelType(vi);
+        if (vi.pixel_type == VideoInfo::CS_UNKNOWN)
+            env->ThrowError("ConvertToDoubleWidth: Input clip must be native 10 to 16 bit: YUV420, YUV422, YUV444 or Y");
 
         vi.width *= 2;
     }
@@ -345,12 +384,12 @@ public:
 };
 
 
-static const AVS_Linkage * AVS_linkage = 0;
+const AVS_Linkage * AVS_linkage = 0;
 extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScriptEnvironment* env, const AVS_Linkage* const vectors) {
     AVS_linkage = vectors;
 
     env->AddFunction("ConvertFromStacked", "c[bits]i", ConvertFromStacked::Create, 0);
-    env->AddFunction("ConvertToStacked", "c", ConvertToStacked::Create, 0);
+    env->AddFunction("ConvertToStacked", "c[bits]i", ConvertToStacked::Create, 0);
     env->AddFunction("ConvertFromDoubleWidth", "c[bits]i", ConvertFromDoubleWidth::Create, 0);
     env->AddFunction("ConvertToDoubleWidth", "c", ConvertToDoubleWidth::Create, 0);
 
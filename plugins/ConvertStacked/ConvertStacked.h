@@ -0,0 +1,57 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef __ConvertStacked_H__
+#define __ConvertStacked_H__
+
+#include <cstdint>
+
+// Row kernels. They take any alignment and width; the SIMD ones do whole
+// vectors and leave the rest of the row to the C version.
+
+// Splits width samples into their high and low bytes, after shifting them
+// left by shift bits.
+typedef void (*ToStackedFunc)(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift);
+// Joins width high and low bytes into samples.
+typedef void (*FromStackedFunc)(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width);
+
+void to_stacked_c(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift);
+void to_stacked_sse2(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift);
+void to_stacked_avx2(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift);
+
+void from_stacked_c(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width);
+void from_stacked_sse2(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width);
+void from_stacked_avx2(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width);
+
+#endif // __ConvertStacked_H__
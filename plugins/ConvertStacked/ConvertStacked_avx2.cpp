@@ -0,0 +1,75 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// AVX2 kernels, only to be used when CPUF_AVX2 is set.
+// This file is compiled with AVX2 enabled (see CMakeLists.txt).
+
+#include "ConvertStacked.h"
+#include <immintrin.h>
+
+
+void to_stacked_avx2(const uint16_t* srcp, uint8_t* msb, uint8_t* lsb, int width, int shift)
+{
+    const __m256i masklo = _mm256_set1_epi16(0x00FF);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m256i data16_1 = _mm256_sll_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcp + x)), count);
+        const __m256i data16_2 = _mm256_sll_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcp + x + 16)), count);
+        // packus works within 128 bit lanes, the permute puts the quadwords in order
+        const __m256i hi = _mm256_packus_epi16(_mm256_srli_epi16(data16_1, 8), _mm256_srli_epi16(data16_2, 8));
+        const __m256i lo = _mm256_packus_epi16(_mm256_and_si256(data16_1, masklo), _mm256_and_si256(data16_2, masklo));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(msb + x), _mm256_permute4x64_epi64(hi, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lsb + x), _mm256_permute4x64_epi64(lo, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    if (x < width)
+        to_stacked_c(srcp + x, msb + x, lsb + x, width - x, shift);
+}
+
+
+void from_stacked_avx2(const uint8_t* msb, const uint8_t* lsb, uint16_t* dstp, int width)
+{
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m256i data_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(msb + x));
+        const __m256i data_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lsb + x));
+        // unpack works within 128 bit lanes: bytes 0-7 and 16-23, 8-15 and 24-31
+        const __m256i words_lo = _mm256_unpacklo_epi8(data_lo, data_hi);
+        const __m256i words_hi = _mm256_unpackhi_epi8(data_lo, data_hi);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dstp + x), _mm256_permute2x128_si256(words_lo, words_hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dstp + x + 16), _mm256_permute2x128_si256(words_lo, words_hi, 0x31));
+    }
+    if (x < width)
+        from_stacked_c(msb + x, lsb + x, dstp + x, width - x);
+}
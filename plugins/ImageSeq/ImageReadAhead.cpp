@@ -0,0 +1,208 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+#include "ImageReadAhead.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+
+ImageReadAhead::ImageReadAhead(LoadFunc _load, void* _owner, int threads, int _depth, int _num_frames)
+ : load(_load), owner(_owner), depth(_depth), num_frames(_num_frames), last(-1), stride(1), quit(false)
+{
+  slots.resize(depth);
+  for (size_t i = 0; i < slots.size(); ++i) {
+    slots[i].n = -1;
+    slots[i].state = kFree;
+    slots[i].priority = 0;
+    slots[i].stale = false;
+  }
+
+  for (int i = 0; i < threads; ++i)
+    workers.push_back(thread(&ImageReadAhead::ThreadProc, this));
+}
+
+
+ImageReadAhead::~ImageReadAhead()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    quit = true;
+  }
+  work_cond.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+}
+
+
+ImageReadAhead::Slot* ImageReadAhead::FindSlot(int n)
+{
+  for (size_t i = 0; i < slots.size(); ++i)
+    if (slots[i].state != kFree && slots[i].state != kInUse && slots[i].n == n)
+      return &slots[i];
+  return NULL;
+}
+
+
+ImageReadSlot* ImageReadAhead::Fetch(int n)
+{
+  unique_lock<mutex> guard(lock);
+
+  Slot* s = FindSlot(n);
+  if (s && (s->stale || s->state == kQueued)) {
+    // Not started yet: the caller is about to load it anyway
+    if (s->state == kQueued)
+      s->state = kFree;
+    s = NULL;
+  }
+
+  // Follow the access pattern
+  const int step = n - last;
+  stride = (step != 0 && abs(step) <= 8) ? step : 1;
+  last = n;
+  Schedule(n, s);
+  work_cond.notify_all();
+
+  if (!s)
+    return NULL;
+
+  while (s->state == kLoading)
+    done_cond.wait(guard);
+
+  if (s->state != kReady || s->n != n)
+    return NULL;
+
+  s->state = kInUse;
+  return &s->image;
+}
+
+
+void ImageReadAhead::Release(ImageReadSlot* image)
+{
+  {
+    lock_guard<mutex> guard(lock);
+    for (size_t i = 0; i < slots.size(); ++i)
+      if (&slots[i].image == image)
+        slots[i].state = kFree;
+  }
+  work_cond.notify_one();
+}
+
+
+// Replaces the read-ahead window with the depth images following n,
+// leaving alone the slot that is about to be handed out for n.
+// Called with the lock held.
+void ImageReadAhead::Schedule(int n, Slot* current)
+{
+  vector<int> wanted;
+  for (int k = 1; k <= depth; ++k) {
+    const int next = n + stride * k;
+    if (next < 0 || next >= num_frames)
+      break;
+    wanted.push_back(next);
+  }
+
+  for (size_t i = 0; i < slots.size(); ++i) {
+    Slot& s = slots[i];
+    if (s.state == kFree || s.state == kInUse || &s == current)
+      continue;
+
+    vector<int>::iterator it = find(wanted.begin(), wanted.end(), s.n);
+    if (it != wanted.end()) {
+      s.priority = int(it - wanted.begin());
+      s.stale = false;
+    }
+    else if (s.state == kLoading)
+      s.stale = true;
+    else
+      s.state = kFree;
+  }
+
+  for (size_t j = 0; j < wanted.size(); ++j) {
+    Slot* s = FindSlot(wanted[j]);
+    if (s && !s->stale)
+      continue;
+
+    size_t i;
+    for (i = 0; i < slots.size(); ++i)
+      if (slots[i].state == kFree)
+        break;
+    if (i >= slots.size())
+      break;
+
+    Slot& fs = slots[i];
+    fs.n = wanted[j];
+    fs.priority = int(j);
+    fs.stale = false;
+    fs.state = kQueued;
+  }
+}
+
+
+void ImageReadAhead::ThreadProc()
+{
+  unique_lock<mutex> guard(lock);
+
+  while (!quit) {
+    Slot* next = NULL;
+    for (size_t i = 0; i < slots.size(); ++i) {
+      Slot& s = slots[i];
+      if (s.state == kQueued && (!next || s.priority < next->priority))
+        next = &s;
+    }
+
+    if (!next) {
+      work_cond.wait(guard);
+      continue;
+    }
+
+    next->state = kLoading;
+    const int n = next->n;
+
+    guard.unlock();
+    load(owner, n, next->image);
+    guard.lock();
+
+    if (next->stale) {
+      next->stale = false;
+      next->state = kFree;
+    }
+    else
+      next->state = kReady;
+
+    done_cond.notify_all();
+  }
+}
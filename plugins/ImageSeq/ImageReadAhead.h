@@ -0,0 +1,111 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef __Image_Read_Ahead_H__
+#define __Image_Read_Ahead_H__
+
+#include <avs/win.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct ImageReadSlot
+/**
+  * One prefetched image: the file itself for the native formats, the
+  * decoded raster for DevIL
+ **/
+{
+  std::vector<BYTE> data;
+  int width, height;  // of a DevIL raster
+  std::string error;  // why the image could not be loaded, empty if fine
+  bool quiet;         // only show error with info=true
+};
+
+
+class ImageReadAhead
+/**
+  * Loads the images expected after the current one on worker threads.
+  * The frames that will be requested next are extrapolated from the last
+  * two requests: a stride of up to 8 frames either way is followed,
+  * anything else is taken as a seek before reading forward.
+ **/
+{
+public:
+  // Fills slot with image n, called on the worker threads
+  typedef void (*LoadFunc)(void* owner, int n, ImageReadSlot& slot);
+
+  // depth: images loaded ahead, num_frames: frames that can be requested
+  ImageReadAhead(LoadFunc load, void* owner, int threads, int depth, int num_frames);
+  ~ImageReadAhead();
+
+  // Returns image n if it was prefetched, waiting while it is being loaded,
+  // or NULL when the caller has to load it itself; an image that is only
+  // queued is taken back for that. Either way the images expected after n
+  // are queued. A returned slot must be handed back with Release().
+  ImageReadSlot* Fetch(int n);
+  void Release(ImageReadSlot* image);
+
+private:
+  enum { kFree, kQueued, kLoading, kReady, kInUse };
+
+  struct Slot {
+    ImageReadSlot image;
+    int n;
+    int state;
+    int priority;
+    bool stale;  // no longer wanted while it was being loaded
+  };
+
+  Slot* FindSlot(int n);
+  void Schedule(int n, Slot* current);
+  void ThreadProc();
+
+  const LoadFunc load;
+  void * const owner;
+  const int depth;
+  const int num_frames;
+  int last, stride;
+
+  std::vector<Slot> slots;
+  std::mutex lock;
+  std::condition_variable work_cond;
+  std::condition_variable done_cond;
+  std::vector<std::thread> workers;
+  bool quit;
+};
+
+#endif // __Image_Read_Ahead_H__
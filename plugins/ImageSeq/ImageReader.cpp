@@ -36,18 +36,191 @@
 
 #include <avisynth.h>
 #include "ImageSeq.h"
+#include "ImageReadAhead.h"
 #include <algorithm>
 #include <sstream>
+#include <cstdlib>
+#include <stdint.h>
 
 #define TEXT_COLOR 0xf0f080
 
 using namespace std;
 
 
+class RasterInput
+/**
+  * Where a native image comes from: the file itself, so that the raster
+  * is read straight into the frame, or a copy of it prefetched into memory
+ **/
+{
+public:
+  RasterInput(const char * filename) : file(filename, ios::binary), mem(NULL), size(0), pos(0) {}
+  RasterInput(const vector<BYTE> & data) : mem(data.data()), size(data.size()), pos(0) {}
+
+  bool is_open() const { return mem || file.is_open(); }
+
+  void read(void * dst, size_t count)
+  {
+    if (!mem) {
+      file.read(reinterpret_cast<char *>(dst), count);
+      return;
+    }
+    count = min(count, size - min(pos, size));
+    memcpy(dst, mem + pos, count);
+    pos += count;
+  }
+
+  void seek(size_t offset)
+  {
+    if (mem)
+      pos = offset;
+    else
+      file.seekg(offset, ios::beg);
+  }
+
+  void skip(size_t count)
+  {
+    if (mem)
+      pos += count;
+    else
+      file.seekg(count, ios::cur);
+  }
+
+  int get()
+  {
+    if (mem)
+      return pos < size ? mem[pos++] : -1;
+    return file.get();
+  }
+
+private:
+  ifstream file;
+  const BYTE * mem;
+  size_t size, pos;
+};
+
+
+// Parses the header of a binary PGM (P5) or PPM (P6) file, leaving the
+// input at the start of the raster.
+static bool readPNMHeader(RasterInput & input, int & type, int & width, int & height, int & maxval)
+{
+  if (input.get() != 'P')
+    return false;
+  type = input.get();
+  if (type != '5' && type != '6')
+    return false;
+
+  int values[3];
+  for (int i=0; i < 3; ++i)
+  {
+    int c = input.get();
+    for (;;) {
+      if (c == '#')
+        while (c != '\n' && c != -1)
+          c = input.get();
+      else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        c = input.get();
+      else
+        break;
+    }
+    if (c < '0' || c > '9')
+      return false;
+    values[i] = 0;
+    while (c >= '0' && c <= '9' && values[i] < 100000000) {
+      values[i] = values[i] * 10 + (c - '0');
+      c = input.get();
+    }
+    // a single whitespace character ends the header
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+      return false;
+  }
+
+  width = values[0];
+  height = values[1];
+  maxval = values[2];
+  return width > 0 && height > 0 && maxval > 0 && maxval < 65536;
+}
+
+
+// DevIL's raw layout: width, height and depth as little-endian 32 bit
+// values, then bytes per pixel and bytes per channel.
+static bool readRawHeader(RasterInput & input, int & width, int & height, int & channels, int & bytes)
+{
+  BYTE header[14];
+  memset(header, 0, sizeof header);
+  input.read(header, sizeof header);
+
+  unsigned dims[3];
+  for (int i=0; i < 3; ++i)
+    dims[i] = header[4*i] | (header[4*i+1] << 8) | (header[4*i+2] << 16) | (unsigned(header[4*i+3]) << 24);
+
+  width = int(dims[0]);
+  height = int(dims[1]);
+  channels = header[12];
+  bytes = header[13];
+  return width > 0 && height > 0 && dims[2] == 1;
+}
+
+
+// The pixel types that can be requested, 0 for anything else. Samples
+// keep their full range: 16 bit ones are 0..65535, float ones 0..1.
+static int pixelTypeFromName(const char * name)
+{
+  static const struct { const char * name; int pixel_type; } types[] = {
+    { "rgb",     VideoInfo::CS_BGR32 },
+    { "rgb24",   VideoInfo::CS_BGR24 },
+    { "rgb32",   VideoInfo::CS_BGR32 },
+    { "rgb48",   VideoInfo::CS_BGR48 },
+    { "rgb64",   VideoInfo::CS_BGR64 },
+    { "y8",      VideoInfo::CS_Y8 },
+    { "y16",     VideoInfo::CS_Y16 },
+    { "y32",     VideoInfo::CS_Y32 },
+    { "rgbp",    VideoInfo::CS_RGBP },
+    { "rgbp16",  VideoInfo::CS_RGBP16 },
+    { "rgbps",   VideoInfo::CS_RGBPS },
+    { "rgbap",   VideoInfo::CS_RGBAP },
+    { "rgbap16", VideoInfo::CS_RGBAP16 },
+    { "rgbaps",  VideoInfo::CS_RGBAPS },
+  };
+  for (size_t i=0; i < sizeof(types) / sizeof(types[0]); ++i)
+    if (!lstrcmpi(name, types[i].name))
+      return types[i].pixel_type;
+  return 0;
+}
+
+
+// Interleaved samples of one row, R G B (A), into planes G B R (A)
+template<typename T>
+static void splitRow(BYTE * const * dst, const BYTE * src, const int channels, const int width)
+{
+  const T * s = reinterpret_cast<const T *>(src);
+  T * g = reinterpret_cast<T *>(dst[0]);
+  T * b = reinterpret_cast<T *>(dst[1]);
+  T * r = reinterpret_cast<T *>(dst[2]);
+  T * a = reinterpret_cast<T *>(dst[3]);
+  for (int x=0; x < width; ++x, s += channels) {
+    r[x] = s[0];
+    g[x] = s[1];
+    b[x] = s[2];
+    if (channels == 4)
+      a[x] = s[3];
+  }
+}
+
+
+// PNM stores 16 bit samples big-endian
+static void swapBytes16(BYTE * p, const int count)
+{
+  for (int i=0; i < count; ++i, p += 2)
+    std::swap(p[0], p[1]);
+}
+
+
 ImageReader::ImageReader(const char * _base_name, const int _start, const int _end,
                          const double _fps, bool _use_DevIL, bool _info, const char * _pixel,
                          bool _animation, IScriptEnvironment* env)
- : start(_start), use_DevIL(_use_DevIL), info(_info), animation(_animation), framecopies(0)
+ : start(_start), use_DevIL(_use_DevIL), info(_info), animation(_animation), framecopies(0),
+   native(NATIVE_BMP), readahead(0)
 {
   if (DevIL_Version == 0) // Init the DevIL.dll version
     DevIL_Version = ilGetInteger(IL_VERSION_NUM);
@@ -141,7 +314,35 @@ ImageReader::ImageReader(const char * _base_name, const int _start, const int _e
       }
     }
     else {
-      use_DevIL = true; // Not a BMP, give it to DevIL
+      // Binary PGM/PPM and raw files that map directly onto the requested
+      // pixel type are read natively too, anything else is left to DevIL
+      const char * ext = strrchr(_base_name, '.');
+      const int pixel_type = pixelTypeFromName(_pixel);
+      int type, width, height, maxval, channels, bytes;
+      RasterInput input(filename);
+
+      if (readPNMHeader(input, type, width, height, maxval) && (maxval == 255 || maxval == 65535) &&
+          pixel_type == (maxval == 255 ? (type == '5' ? VideoInfo::CS_Y8 : VideoInfo::CS_BGR24)
+                                       : (type == '5' ? VideoInfo::CS_Y16 : VideoInfo::CS_BGR48)))
+      {
+        native = NATIVE_PNM;
+        vi.width = width;
+        vi.height = height;
+        vi.pixel_type = pixel_type;
+      }
+      else if (ext && !lstrcmpi(ext, ".raw") && (input.seek(0), readRawHeader(input, width, height, channels, bytes)) &&
+               (bytes == 1 || bytes == 2) && (channels == 1 || channels == 3 || channels == 4) &&
+               pixel_type == (channels == 1 ? (bytes == 1 ? VideoInfo::CS_Y8 : VideoInfo::CS_Y16) :
+                              channels == 3 ? (bytes == 1 ? VideoInfo::CS_BGR24 : VideoInfo::CS_BGR48) :
+                                              (bytes == 1 ? VideoInfo::CS_BGR32 : VideoInfo::CS_BGR64)))
+      {
+        native = NATIVE_RAW;
+        vi.width = width;
+        vi.height = height;
+        vi.pixel_type = pixel_type;
+      }
+      else
+        use_DevIL = true; // Not a type we read, give it to DevIL
     }
   }
 
@@ -170,21 +371,13 @@ ImageReader::ImageReader(const char * _base_name, const int _start, const int _e
     vi.width = ilGetInteger(IL_IMAGE_WIDTH);
     vi.height = ilGetInteger(IL_IMAGE_HEIGHT);
 
-    if (!lstrcmpi(_pixel, "rgb")) {
-      vi.pixel_type = VideoInfo::CS_BGR32;
-    }
-    else if (!lstrcmpi(_pixel, "rgb32")) {
-      vi.pixel_type = VideoInfo::CS_BGR32;
-    }
-    else if (!lstrcmpi(_pixel, "rgb24")) {
-      vi.pixel_type = VideoInfo::CS_BGR24;
-    }
-    else if (!lstrcmpi(_pixel, "y8")) {
-      vi.pixel_type = VideoInfo::CS_Y8;
-    }
-    else {
+    // DevIL converts to whatever sample type is asked for, so 16 bit and
+    // float images are delivered without going through 8 bits
+    vi.pixel_type = pixelTypeFromName(_pixel);
+    if (vi.pixel_type == 0) {
       LeaveCriticalSection(&FramesCriticalSection);
-      env->ThrowError("ImageReader: supports the following pixel types: RGB24, RGB32 or Y8");
+      env->ThrowError("ImageReader: supports the following pixel types: RGB24, RGB32, RGB48, RGB64, "
+                      "Y8, Y16, Y32, RGBP, RGBP16, RGBPS, RGBAP, RGBAP16 or RGBAPS");
     }
 
     if (animation) {
@@ -225,8 +418,8 @@ ImageReader::ImageReader(const char * _base_name, const int _start, const int _e
     {
       should_flip = true;
     }
-    // flip back for Y8
-    if (vi.IsY8()) {
+    // flip back for Y and planar RGB, their rows are stored top-down
+    if (vi.IsPlanar()) {
         should_flip = !should_flip;
     }
   }
@@ -238,11 +431,24 @@ ImageReader::ImageReader(const char * _base_name, const int _start, const int _e
     else
       framecopies = vi.num_frames;
   }
+
+  // Load the following images while the current one is being processed.
+  // DevIL can only decode one image at a time, native files are read by
+  // a few threads; at most 256MB is held ahead.
+  if (framecopies <= 1) {
+    const int threads = use_DevIL ? 1 : max(1, min((int)thread::hardware_concurrency(), 4));
+    const int frame_size = max(vi.BMPSize(), 1);
+    const int depth = max(1, min(2*threads, (256 << 20) / frame_size));
+    readahead = new ImageReadAhead(loadImage, this, threads, depth, vi.num_frames);
+  }
 }
 
 
 ImageReader::~ImageReader()
 {
+  // Stop loading before DevIL goes away
+  delete readahead;
+
   if (use_DevIL) {
     EnterCriticalSection(&FramesCriticalSection);
     ilShutDown();
@@ -253,6 +459,104 @@ ImageReader::~ImageReader()
   }
 }
 
+void ImageReader::loadImage(void * owner, int n, ImageReadSlot & image)
+{
+  ImageReader * reader = static_cast<ImageReader *>(owner);
+
+  char name[MAX_PATH + 1];
+  _snprintf(name, (sizeof name)-1, reader->base_name, n+reader->start);
+  name[MAX_PATH] = '\0';
+
+  if (reader->use_DevIL) {
+    reader->loadDevIL(name, n, image);
+    return;
+  }
+
+  // Native formats: the whole file, the raster is unpacked by GetFrame
+  image.error.clear();
+  image.quiet = false;
+  image.data.clear();
+  ifstream file(name, ios::binary);
+  if (!file.is_open()) {
+    image.error = "ImageReader: cannot open file";
+    image.quiet = true;
+    return;
+  }
+  file.seekg(0, ios::end);
+  const streamoff size = file.tellg();
+  file.seekg(0, ios::beg);
+  if (size > 0) {
+    image.data.resize(size_t(size));
+    file.read(reinterpret_cast<char *>(image.data.data()), size);
+    image.data.resize(size_t(file.gcount()));
+  }
+}
+
+
+void ImageReader::loadDevIL(const char * name, int n, ImageReadSlot & image)
+{
+  image.width = image.height = 0;
+  image.quiet = false;
+
+  EnterCriticalSection(&FramesCriticalSection);
+
+  // Setup
+  ILuint myImage=0;
+  ilGenImages(1, &myImage);
+  ilBindImage(myImage);
+
+  ILenum err = IL_NO_ERROR;
+  ostringstream ss;
+
+  if (ilLoadImage(name) == IL_FALSE) {
+    err = ilGetError();
+    ss << "ImageReader: error '" << getErrStr(err) << "' in DevIL library\n"
+          "opening file \"" << name << "\"\n"
+          "DevIL version " << DevIL_Version << ".";
+    image.quiet = (err == IL_COULD_NOT_OPEN_FILE);
+  }
+  else if (animation && ilActiveImage(n) == IL_FALSE) { // load image N from file
+    err = ilGetError();
+    ss << "ImageSourceAnim: error '" << getErrStr(err) << "' in DevIL library\n"
+          "processing image " << n << " from file \"" << name << "\"\n"
+          "DevIL version " << DevIL_Version << ".";
+    image.quiet = true;
+  }
+  else if (!animation && ilGetInteger(IL_IMAGE_HEIGHT) != vi.height) {
+    ss << "ImageReader: images must have identical heights";
+  }
+  else if (!animation && ilGetInteger(IL_IMAGE_WIDTH) != vi.width) {
+    ss << "ImageReader: images must have identical widths";
+  }
+  else {
+    // The whole raster at once, rows in DevIL's order, in the sample type
+    // of the clip. Planar RGB is fetched as RGB(A) and split by GetFrame.
+    const int channels = vi.NumComponents();
+    const ILenum il_format = vi.IsY() ? IL_LUMINANCE : vi.IsPlanar() ? (channels == 4 ? IL_RGBA : IL_RGB)
+                                                                     : (channels == 4 ? IL_BGRA : IL_BGR);
+    const ILenum il_type = vi.ComponentSize() == 4 ? IL_FLOAT : (vi.ComponentSize() == 2 ? IL_UNSIGNED_SHORT : IL_UNSIGNED_BYTE);
+    image.width = min(vi.width, ilGetInteger(IL_IMAGE_WIDTH));
+    image.height = min(vi.height, ilGetInteger(IL_IMAGE_HEIGHT));
+    image.data.resize(image.width * image.height * channels * vi.ComponentSize());
+    ilCopyPixels(0, 0, 0, image.width, image.height, 1, il_format, il_type, image.data.data());
+
+    // Get errors if any
+    err = ilGetError();
+    if (err != IL_NO_ERROR)
+      ss << "ImageReader: error '" << getErrStr(err) << "' in DevIL library\n"
+            "reading file \"" << name << "\"\n"
+            "DevIL version " << DevIL_Version << ".";
+  }
+
+  // Cleanup
+  ilDeleteImages(1, &myImage);
+
+  LeaveCriticalSection(&FramesCriticalSection);
+
+  image.error = ss.str();
+}
+
+
 /*  Notes to clear thinking!
 
   vi.num_frames = end-start+1
@@ -263,214 +567,257 @@ ImageReader::~ImageReader()
 
 PVideoFrame ImageReader::GetFrame(int n, IScriptEnvironment* env)
 {
-  ILenum err = IL_NO_ERROR;
-
   PVideoFrame frame = env->NewVideoFrame(vi);
   BYTE * dstPtr = frame->GetWritePtr();
-  BYTE * const WritePtr = dstPtr;
 
   const int pitch = frame->GetPitch();
-  const int row_size = frame->GetRowSize();
   const int height = frame->GetHeight();
-  const int width = vi.width;
 
   _snprintf(filename, (sizeof filename)-1, base_name, n+start);
 
+  // Prefetched, or else loaded now
+  ImageReadSlot * prefetched = readahead ? readahead->Fetch(n) : NULL;
+
   if (use_DevIL)  /* read using DevIL */
   {
-    EnterCriticalSection(&FramesCriticalSection);
-
-    // Setup
-    ILuint myImage=0;
-    ilGenImages(1, &myImage);
-    ilBindImage(myImage);
-
-    if (ilLoadImage(filename) == IL_FALSE) {
-      // Get errors if any
-      err = ilGetError();
+    ImageReadSlot local;
+    ImageReadSlot & image = prefetched ? *prefetched : local;
+    if (!prefetched)
+      loadDevIL(filename, n, local);
 
-      // Cleanup
-      ilDeleteImages(1, &myImage);
-
-      LeaveCriticalSection(&FramesCriticalSection);
-
-      memset(WritePtr, 0, pitch * height);  // Black frame
-      if ((info) || (err != IL_COULD_NOT_OPEN_FILE)) {
-        ostringstream ss;
-        ss << "ImageReader: error '" << getErrStr(err) << "' in DevIL library\n"
-		      "opening file \"" << filename << "\"\n"
-              "DevIL version " << DevIL_Version << ".";
-        env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-      }
+    if (!image.error.empty())
+    {
+      BlankFrame(frame);
+      if (info || !image.quiet)
+        env->ApplyMessage(&frame, vi, image.error.c_str(), vi.width/4, TEXT_COLOR, 0, 0);
+      if (prefetched)
+        readahead->Release(prefetched);
       return frame;
     }
 
-    if (animation) {
-      if (ilActiveImage(n) == IL_FALSE) { // load image N from file
-        // Get errors if any
-        err = ilGetError();
-
-        // Cleanup
-        ilDeleteImages(1, &myImage);
+    const int channels = vi.NumComponents();
+    const int linesize_image = image.width * channels * vi.ComponentSize();
 
-        LeaveCriticalSection(&FramesCriticalSection);
-
-        memset(WritePtr, 0, pitch * height);  // Black frame
-        if (info) {
-          ostringstream ss;
-          ss << "ImageSourceAnim: error '" << getErrStr(err) << "' in DevIL library\n"
-                "processing image " << n << " from file \"" << filename << "\"\n"
-                "DevIL version " << DevIL_Version << ".";
-          env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-        }
-        return frame;
-      }
-    }
-    else {
-      // Check some parameters
-      if (ilGetInteger(IL_IMAGE_HEIGHT) != height)
-      {
-        // Cleanup
-        ilDeleteImages(1, &myImage);
+    // Images smaller than the clip are padded with black at the right
+    // and at the bottom
+    if (image.width < vi.width || image.height < vi.height)
+      BlankFrame(frame);
 
-        LeaveCriticalSection(&FramesCriticalSection);
+    if (!vi.IsPlanar())
+      dstPtr += pitch * (height-image.height);
 
-        memset(WritePtr, 0, pitch * height);
-        env->ApplyMessage(&frame, vi, "ImageReader: images must have identical heights", vi.width/4, TEXT_COLOR, 0, 0);
-        return frame;
-      }
+    if (vi.IsPlanar() && !vi.IsY())
+    {
+      const int planes[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+      BYTE * dst[4] = { 0, 0, 0, 0 };
+      for (int p=0; p < channels; ++p)
+        dst[p] = frame->GetWritePtr(planes[p]);
 
-      if (ilGetInteger(IL_IMAGE_WIDTH) != width)
+      for (int y=0; y<image.height; ++y)
       {
-        // Cleanup
-        ilDeleteImages(1, &myImage);
-
-        LeaveCriticalSection(&FramesCriticalSection);
-
-        memset(WritePtr, 0, pitch * height);
-        env->ApplyMessage(&frame, vi, "ImageReader: images must have identical widths", vi.width/4, TEXT_COLOR, 0, 0);
-        return frame;
+        const int src_y = should_flip ? image.height-1-y : y;
+        const BYTE * srcPtr = image.data.data() + src_y * linesize_image;
+        if (vi.ComponentSize() == 1)
+          splitRow<BYTE>(dst, srcPtr, channels, image.width);
+        else if (vi.ComponentSize() == 2)
+          splitRow<uint16_t>(dst, srcPtr, channels, image.width);
+        else
+          splitRow<float>(dst, srcPtr, channels, image.width);
+        for (int p=0; p < channels; ++p)
+          dst[p] += frame->GetPitch(planes[p]);
       }
     }
-
-    const ILenum il_format = vi.IsY8() ? IL_LUMINANCE : ( vi.IsRGB32() ? IL_BGRA : IL_BGR );
-    const ILenum linesize = width * ( vi.IsY8() ? 1 : ( vi.IsRGB32() ? 4 : 3 ) );
-    const int height_image = min(height, ilGetInteger(IL_IMAGE_HEIGHT));
-    const int width_image = min(width, ilGetInteger(IL_IMAGE_WIDTH));
-    const ILenum linesize_image = width_image * ( vi.IsY8() ? 1 : ( vi.IsRGB32() ? 4 : 3 ) );
-
-    if (!vi.IsY8()) {
-      // fill bottom with black pixels
-      memset(dstPtr, 0, pitch * (height-height_image));
-      dstPtr += pitch * (height-height_image);
-    }
-
-    // Copy raster to AVS frame
-////if (ilGetInteger(IL_ORIGIN_MODE) == IL_ORIGIN_UPPER_LEFT, IL_ORIGIN_LOWER_LEFT ???
-    if (should_flip)
+    else
     {
-      // Copy upside down
-      for (int y=height_image-1; y>=0; --y)
+      // Copy raster to AVS frame
+////if (ilGetInteger(IL_ORIGIN_MODE) == IL_ORIGIN_UPPER_LEFT, IL_ORIGIN_LOWER_LEFT ???
+      for (int y=0; y<image.height; ++y)
       {
-        if (ilCopyPixels(0, y, 0, width_image, 1, 1, il_format, IL_UNSIGNED_BYTE, dstPtr) > linesize)
-          break; // Try not to spew all over memory
-        memset(dstPtr+linesize_image, 0, linesize-linesize_image);
+        // Copy upside down when should_flip
+        const int src_y = should_flip ? image.height-1-y : y;
+        memcpy(dstPtr, image.data.data() + src_y * linesize_image, linesize_image);
         dstPtr += pitch;
       }
     }
+  }
+  else {  /* read natively */
+    bool ok;
+    if (prefetched && !prefetched->error.empty()) {
+      if (info)
+        BlankApplyMessage(frame, prefetched->error.c_str(), env);
+      else
+        BlankFrame(frame);
+      ok = false;
+    }
+    else if (prefetched) {
+      RasterInput input(prefetched->data);
+      ok = readNative(input, frame, env);
+    }
     else {
-      // Copy right side up
-      for (int y=0; y<height_image; ++y)
-      {
-        if (ilCopyPixels(0, y, 0, width_image, 1, 1, il_format, IL_UNSIGNED_BYTE, dstPtr) > linesize)
-          break; // Try not to spew all over memory
-        memset(dstPtr+linesize_image, 0, linesize-linesize_image);
-        dstPtr += pitch;
-      }
+      // Straight from the file into the frame
+      RasterInput input(filename);
+      ok = readNative(input, frame, env);
     }
 
-    if (vi.IsY8()) {
-      // fill bottom with black pixels
-      memset(dstPtr, 0, pitch * (height-height_image));
+    if (!ok) {
+      if (prefetched)
+        readahead->Release(prefetched);
+      return frame;
     }
+  }
 
-    // Get errors if any
-    err = ilGetError();
-
-    // Cleanup
-    ilDeleteImages(1, &myImage);
-
-    LeaveCriticalSection(&FramesCriticalSection);
+  if (prefetched)
+    readahead->Release(prefetched);
 
-    if (err != IL_NO_ERROR)
-    {
-      memset(WritePtr, 0, pitch * height);
-      ostringstream ss;
-      ss << "ImageReader: error '" << getErrStr(err) << "' in DevIL library\n"
-            "reading file \"" << filename << "\"\n"
+  if (info) {
+    // overlay on video output: progress indicator
+    ostringstream text;
+    text << "Frame " << n << ".\n"
+            "Read from \"" << filename << "\"\n"
             "DevIL version " << DevIL_Version << ".";
-      env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-      return frame;
-    }
+    env->ApplyMessage(&frame, vi, text.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
   }
-  else {  /* treat as ebmp  */
-    // Open file, ensure it has the expected properties
-    ifstream file(filename, ios::binary);
-    if (!checkProperties(file, frame, env)) {
-      file.close();
-      return frame;
-    }
 
-    // Seek past padding
-    file.seekg (fileHeader.bfOffBits, ios::beg);
+  return frame;
+}
+
 
-    // Read in raster
-    if (vi.IsY8())
+bool ImageReader::readNative(RasterInput & input, PVideoFrame & frame, IScriptEnvironment * env)
+{
+  BYTE * dstPtr = frame->GetWritePtr();
+  const int pitch = frame->GetPitch();
+  const int row_size = frame->GetRowSize();
+  const int height = frame->GetHeight();
+
+  if (!input.is_open())
+  {
+    if (info)
+      BlankApplyMessage(frame, "ImageReader: cannot open file", env);
+    else
+      BlankFrame(frame);
+
+    return false;
+  }
+
+  if (native == NATIVE_PNM)
+  {
+    const int bytes = vi.ComponentSize();
+    int type, width, image_height, maxval;
+    if (!readPNMHeader(input, type, width, image_height, maxval) || maxval != (bytes == 2 ? 65535 : 255) ||
+        type != (vi.IsY() ? '5' : '6'))
     {
-      // read upside down
-      BYTE * endPtr = dstPtr + pitch * (height-1);
-      fileRead(file, endPtr, -pitch, row_size, height);
+      BlankApplyMessage(frame, "ImageReader: invalid PGM/PPM file or different type", env);
+      return false;
     }
-    else
+    if (width != vi.width || image_height != vi.height)
     {
-      fileRead(file, dstPtr, pitch, row_size, height);
+      BlankApplyMessage(frame, "ImageReader: images must have identical sizes", env);
+      return false;
+    }
 
-      if (vi.IsPlanar())
+    if (vi.IsY()) {
+      fileRead(input, dstPtr, pitch, row_size, height, 0);
+      if (bytes == 2)
+        for (int y=0; y<height; ++y)
+          swapBytes16(dstPtr + pitch * y, vi.width);
+    }
+    else {
+      // PPM is top-down RGB, turn it into bottom-up BGR in place
+      fileRead(input, dstPtr + pitch * (height-1), -pitch, row_size, height, 0);
+      for (int y=0; y<height; ++y)
       {
-        dstPtr = frame->GetWritePtr(PLANAR_U);
-        const int pitchUV = frame->GetPitch(PLANAR_U);
-        const int row_sizeUV = frame->GetRowSize(PLANAR_U);
-        const int heightUV = frame->GetHeight(PLANAR_U);
-        fileRead(file, dstPtr, pitchUV, row_sizeUV, heightUV);
-
-        dstPtr = frame->GetWritePtr(PLANAR_V);
-        fileRead(file, dstPtr, pitchUV, row_sizeUV, heightUV);
+        BYTE * p = dstPtr + pitch * y;
+        if (bytes == 2) {
+          swapBytes16(p, 3 * vi.width);
+          uint16_t * p16 = reinterpret_cast<uint16_t *>(p);
+          for (int x=0; x<3*vi.width; x+=3)
+            std::swap(p16[x], p16[x+2]);
+        }
+        else {
+          for (int x=0; x<row_size; x+=3)
+            std::swap(p[x], p[x+2]);
+        }
       }
     }
+    return true;
+  }
 
-    file.close();
+  if (native == NATIVE_RAW)
+  {
+    int width, image_height, channels, bytes;
+    if (!readRawHeader(input, width, image_height, channels, bytes) ||
+        bytes != vi.ComponentSize() || channels != vi.NumComponents())
+    {
+      BlankApplyMessage(frame, "ImageReader: invalid raw file or different type", env);
+      return false;
+    }
+    if (width != vi.width || image_height != vi.height)
+    {
+      BlankApplyMessage(frame, "ImageReader: images must have identical sizes", env);
+      return false;
+    }
+
+    // Rows in the order of the frame that was written
+    fileRead(input, dstPtr, pitch, row_size, height, 0);
+    return true;
   }
 
-  if (info) {
-    // overlay on video output: progress indicator
-    ostringstream text;
-    text << "Frame " << n << ".\n"
-            "Read from \"" << filename << "\"\n"
-            "DevIL version " << DevIL_Version << ".";
-    env->ApplyMessage(&frame, vi, text.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
+  // (E)BMP: ensure it has the expected properties
+  if (!checkProperties(input, frame, env))
+    return false;
+
+  // Seek past padding
+  input.seek(fileHeader.bfOffBits);
+
+  // Read in raster, BMP rows are padded to mod-4
+  const int padding = (4 - (row_size % 4)) % 4;
+  if (vi.IsY8())
+  {
+    // read upside down
+    BYTE * endPtr = dstPtr + pitch * (height-1);
+    fileRead(input, endPtr, -pitch, row_size, height, padding);
   }
+  else
+  {
+    fileRead(input, dstPtr, pitch, row_size, height, padding);
 
-  return frame;
+    if (vi.IsPlanar())
+    {
+      dstPtr = frame->GetWritePtr(PLANAR_U);
+      const int pitchUV = frame->GetPitch(PLANAR_U);
+      const int row_sizeUV = frame->GetRowSize(PLANAR_U);
+      const int heightUV = frame->GetHeight(PLANAR_U);
+      const int paddingUV = (4 - (row_sizeUV % 4)) % 4;
+      fileRead(input, dstPtr, pitchUV, row_sizeUV, heightUV, paddingUV);
+
+      dstPtr = frame->GetWritePtr(PLANAR_V);
+      fileRead(input, dstPtr, pitchUV, row_sizeUV, heightUV, paddingUV);
+    }
+  }
+  return true;
 }
 
 
-void ImageReader::fileRead(istream & file, BYTE * dstPtr, const int pitch, const int row_size, const int height)
+// Reads height rows of row_size bytes, each followed by padding bytes in
+// the file. Where the padding fits in the pitch it is read along with the
+// row, so that a plane whose rows match the file layout takes one read.
+void ImageReader::fileRead(RasterInput & input, BYTE * dstPtr, const int pitch, const int row_size, const int height, const int padding)
 {
-  int padding = (4 - (row_size % 4)) % 4;
+  if (pitch == row_size + padding)
+  {
+    input.read(dstPtr, size_t(pitch) * height);
+    return;
+  }
+
+  const bool spill = row_size + padding <= abs(pitch);
   for (int y=0; y<height; ++y)
   {
-    file.read( reinterpret_cast<char *> (dstPtr), row_size);
-    file.seekg(padding, ios_base::cur);
+    if (spill)
+      input.read(dstPtr, row_size + padding);
+    else {
+      input.read(dstPtr, row_size);
+      input.skip(padding);
+    }
     dstPtr += pitch;
   }
 }
@@ -480,8 +827,14 @@ void ImageReader::BlankFrame(PVideoFrame & frame)
 {
   const int size = frame->GetPitch() * frame->GetHeight();
 
-  if (vi.IsRGB() || vi.IsY8()) {
+  if (vi.IsRGB() || vi.IsY()) {
     memset(frame->GetWritePtr(), 0, size); // Black frame
+
+    if (vi.IsPlanar() && !vi.IsY()) {
+      const int planes[3] = { PLANAR_B, PLANAR_R, PLANAR_A };
+      for (int p=0; p < vi.NumComponents()-1; ++p)
+        memset(frame->GetWritePtr(planes[p]), 0, frame->GetPitch(planes[p]) * frame->GetHeight(planes[p]));
+    }
   }
   else {
     memset(frame->GetWritePtr(), 128, size); // Grey frame
@@ -504,7 +857,7 @@ void ImageReader::BlankApplyMessage(PVideoFrame & frame, const char * text, IScr
 }
 
 
-bool ImageReader::checkProperties(ifstream & file, PVideoFrame & frame, IScriptEnvironment * env)
+bool ImageReader::checkProperties(RasterInput & file, PVideoFrame & frame, IScriptEnvironment * env)
 {
   if (!file.is_open())
   {
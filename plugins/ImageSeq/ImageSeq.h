@@ -41,6 +41,9 @@
 #include <fstream>
 
 
+struct ImageWriteJob;
+class ImageWriteQueue;
+
 class ImageWriter : public GenericVideoFilter 
 /**
   * Class to write video as a sequence of images
@@ -50,9 +53,15 @@ public:
   ImageWriter(PClip _child, const char * _base_name, const int _start, const int _end, const char * _ext, bool _info, IScriptEnvironment* env);
   ~ImageWriter();
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+  int __stdcall SetCacheHints(int cachehints, int frame_range) {
+    return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+  }
 
 private:
-  void fileWrite(std::ostream & file, const BYTE * srcPtr, const int pitch, const int row_size, const int height);
+  // How the files are made; everything but DEVIL is written natively
+  enum WriteMode { WRITE_EBMP, WRITE_BMP, WRITE_PPM, WRITE_PGM, WRITE_RAW, WRITE_DEVIL };
+
+  void pack(ImageWriteJob & job, const PVideoFrame & frame);
 
   bool info;
   
@@ -61,11 +70,18 @@ private:
   int start;
   int end;
 
+  WriteMode mode;
+  ImageWriteQueue * queue;
+
   BITMAPFILEHEADER fileHeader;
   BITMAPINFOHEADER infoHeader;
 };
 
 
+struct ImageReadSlot;
+class ImageReadAhead;
+class RasterInput;
+
 class ImageReader : public IClip
 /**
   * Class to read image sequences into video buffers
@@ -87,16 +103,23 @@ public:
   int  framecopies;
  
 private:
-  void fileRead(std::istream & file, BYTE * dstPtr, const int pitch, const int row_size, const int height);
+  // Formats read without DevIL
+  enum NativeFormat { NATIVE_BMP, NATIVE_PNM, NATIVE_RAW };
+
+  static void loadImage(void * owner, int n, ImageReadSlot & image);
+  void loadDevIL(const char * name, int n, ImageReadSlot & image);
+  bool readNative(RasterInput & input, PVideoFrame & frame, IScriptEnvironment * env);
+  void fileRead(RasterInput & input, BYTE * dstPtr, const int pitch, const int row_size, const int height, const int padding);
   void BlankFrame(PVideoFrame & frame);
   void BlankApplyMessage(PVideoFrame & frame, const char * text, IScriptEnvironment * env);
-  bool checkProperties(std::ifstream & file, PVideoFrame & frame, IScriptEnvironment * env);
+  bool checkProperties(RasterInput & file, PVideoFrame & frame, IScriptEnvironment * env);
 
   char base_name[MAX_PATH + 1];
   const int start;
   bool use_DevIL;
   bool info;
   bool animation;
+  NativeFormat native;
 
   VideoInfo vi;
 
@@ -105,6 +128,8 @@ private:
       
   BITMAPFILEHEADER fileHeader;
   BITMAPINFOHEADER infoHeader;
+
+  ImageReadAhead * readahead;
 };
 
 
@@ -0,0 +1,174 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+#include <avisynth.h>
+#include "ImageSeq.h"
+#include "ImageWriteQueue.h"
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+
+ImageWriteQueue::ImageWriteQueue(int threads, int depth)
+ : quit(false)
+{
+  for (int i = 0; i < depth; ++i) {
+    ImageWriteJob* job = new ImageWriteJob();
+    all.push_back(job);
+    spare.push_back(job);
+  }
+  for (int i = 0; i < threads; ++i)
+    workers.push_back(thread(&ImageWriteQueue::ThreadProc, this));
+}
+
+
+ImageWriteQueue::~ImageWriteQueue()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    quit = true;
+  }
+  work_cond.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+
+  for (size_t i = 0; i < all.size(); ++i)
+    delete all[i];
+}
+
+
+ImageWriteJob* ImageWriteQueue::Acquire()
+{
+  unique_lock<mutex> guard(lock);
+  space_cond.wait(guard, [this] { return !spare.empty(); });
+  ImageWriteJob* job = spare.back();
+  spare.pop_back();
+  return job;
+}
+
+
+void ImageWriteQueue::Submit(ImageWriteJob* job)
+{
+  {
+    lock_guard<mutex> guard(lock);
+    pending.push_back(job);
+  }
+  work_cond.notify_one();
+}
+
+
+bool ImageWriteQueue::TakeError(string& msg)
+{
+  lock_guard<mutex> guard(lock);
+  if (error.empty())
+    return false;
+  msg.swap(error);
+  error.clear();
+  return true;
+}
+
+
+void ImageWriteQueue::ThreadProc()
+{
+  unique_lock<mutex> guard(lock);
+  for (;;) {
+    // Queued images are still written when quitting
+    work_cond.wait(guard, [this] { return quit || !pending.empty(); });
+    if (pending.empty())
+      return;
+
+    ImageWriteJob* job = pending.front();
+    pending.pop_front();
+
+    guard.unlock();
+    string msg;
+    const bool ok = Write(*job, msg);
+    guard.lock();
+
+    if (!ok && error.empty())
+      error = msg;
+    spare.push_back(job);
+    space_cond.notify_one();
+  }
+}
+
+
+bool ImageWriteQueue::Write(ImageWriteJob& job, string& msg)
+{
+  if (!job.use_DevIL) {
+    ofstream file(job.filename.c_str(), ios::out | ios::trunc | ios::binary);
+    if (file)
+      file.write(reinterpret_cast<const char *>( job.data.data() ), job.data.size());
+    if (!file) {
+      msg = "ImageWriter: could not write file '" + job.filename + "'";
+      return false;
+    }
+    return true;
+  }
+
+  // DevIL keeps the bound image in global state
+  EnterCriticalSection(&FramesCriticalSection);
+
+  ILuint myImage=0;
+  ilGenImages(1, &myImage);
+  ilBindImage(myImage);
+
+  // The raster is packed, so it is handed over in one go
+  if (IL_TRUE == ilTexImage(job.width, job.height, 1, job.channels, job.format, job.type, job.data.data())) {
+    // DevIL writer fails if the file exists, so delete first
+    DeleteFile(job.filename.c_str());
+
+    // Save to disk (format automatically inferred from extension)
+    ilSaveImage(job.filename.c_str());
+  }
+
+  ILenum err = ilGetError();
+
+  ilDeleteImages(1, &myImage);
+
+  LeaveCriticalSection(&FramesCriticalSection);
+
+  if (err != IL_NO_ERROR)
+  {
+    ostringstream ss;
+    ss << "ImageWriter: error '" << getErrStr(err) << "' in DevIL library\n"
+          "writing file \"" << job.filename << "\"\n"
+          "DevIL version " << DevIL_Version << ".";
+    msg = ss.str();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,98 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#ifndef __Image_Write_Queue_H__
+#define __Image_Write_Queue_H__
+
+#include "il.h"
+#include <avs/win.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct ImageWriteJob
+/**
+  * One image waiting to be written. Native formats carry the complete file
+  * in data, DevIL formats carry the packed raster and its description.
+ **/
+{
+  std::string filename;
+  std::vector<BYTE> data;
+
+  bool use_DevIL;
+  int width, height;
+  ILubyte channels;
+  ILenum format, type;
+};
+
+
+class ImageWriteQueue
+/**
+  * Bounded queue of images written by background threads, so that
+  * ImageWriter::GetFrame only has to copy the frame
+ **/
+{
+public:
+  // depth: images that may be waiting or in progress at one time
+  ImageWriteQueue(int threads, int depth);
+  ~ImageWriteQueue();  // writes everything still queued
+
+  // Returns an unused job, waiting while the queue is full. Its data
+  // buffer keeps the size it had, so it can be filled without reallocating.
+  ImageWriteJob* Acquire();
+  void Submit(ImageWriteJob* job);
+
+  // Hands out the first error of a background write since the last call.
+  bool TakeError(std::string& msg);
+
+private:
+  void ThreadProc();
+  static bool Write(ImageWriteJob& job, std::string& error);
+
+  std::mutex lock;
+  std::condition_variable work_cond;   // a job was submitted, or quit
+  std::condition_variable space_cond;  // a job became free
+  std::deque<ImageWriteJob*> pending;
+  std::vector<ImageWriteJob*> spare;
+  std::vector<ImageWriteJob*> all;
+  bool quit;
+  std::string error;
+  std::vector<std::thread> workers;
+};
+
+#endif // __Image_Write_Queue_H__
@@ -36,17 +36,52 @@
 
 #include <avisynth.h>
 #include "ImageSeq.h"
+#include "ImageWriteQueue.h"
 #include <algorithm>
 #include <sstream>
+#include <cstdio>
+#include <stdint.h>
 
 #define TEXT_COLOR 0xf0f080
 
 using namespace std;
 
 
+// Copies height rows of row_size bytes, bottom row first when flip is set,
+// and zeros pad bytes after each row. Returns the end of the written data.
+static BYTE * packRows(BYTE * dstPtr, const BYTE * srcPtr, int pitch, const int row_size,
+                       const int height, const int pad, bool flip)
+{
+  if (flip) {
+    srcPtr += pitch * (height-1);
+    pitch = -pitch;
+  }
+  for (int y=0; y < height; ++y)
+  {
+    memcpy(dstPtr, srcPtr, row_size);
+    memset(dstPtr + row_size, 0, pad);
+    dstPtr += row_size + pad;
+    srcPtr += pitch;
+  }
+  return dstPtr;
+}
+
+
+// Interleaves one row of the given planes, e.g. B G R (A) for DevIL or
+// R G B for PPM
+template<typename T>
+static void mergeRow(BYTE * dstPtr, const BYTE * const * srcPtr, const int planes, const int width)
+{
+  T * dst = reinterpret_cast<T *>(dstPtr);
+  for (int x=0; x < width; ++x)
+    for (int p=0; p < planes; ++p)
+      *dst++ = reinterpret_cast<const T *>(srcPtr[p])[x];
+}
+
+
 ImageWriter::ImageWriter(PClip _child, const char * _base_name, const int _start, const int _end,
                          const char * _ext, bool _info, IScriptEnvironment* env)
- : GenericVideoFilter(_child), ext(_ext), info(_info)
+ : GenericVideoFilter(_child), ext(_ext), info(_info), queue(0)
 {
   // Make sure we have an absolute path.
   DWORD len = GetFullPathName(_base_name, 0, base_name, NULL);
@@ -59,14 +94,41 @@ ImageWriter::ImageWriter(PClip _child, const char * _base_name, const int _start
     strcat(base_name, "%06d.%s"); // Append default formating
   }
 
+  const bool is_y16 = vi.IsY() && vi.BitsPerComponent() == 16;
+  const bool is_rgb8 = vi.IsRGB24() || vi.IsRGB32();
+  const bool is_rgb16 = vi.IsRGB48() || vi.IsRGB64();
+  // Planar RGB(A) with samples DevIL and PPM can take as they are
+  const bool is_planar_rgb = (vi.IsPlanarRGB() || vi.IsPlanarRGBA()) &&
+                             (vi.BitsPerComponent() == 8 || vi.BitsPerComponent() == 16 || vi.BitsPerComponent() == 32);
+  const bool is_y32 = vi.IsY() && vi.BitsPerComponent() == 32;
+
+  // Formats with a simple layout are written natively when the clip maps
+  // onto them directly, anything else goes through DevIL.
   if (!lstrcmpi(ext, "ebmp"))
+    mode = WRITE_EBMP;
+  else if (!lstrcmpi(ext, "bmp") && (is_rgb8 || vi.IsY8()))
+    mode = WRITE_BMP;
+  else if (!lstrcmpi(ext, "ppm") && (is_rgb8 || is_rgb16 || (is_planar_rgb && vi.ComponentSize() <= 2)))
+    mode = WRITE_PPM;
+  else if (!lstrcmpi(ext, "pgm") && (vi.IsY8() || is_y16))
+    mode = WRITE_PGM;
+  else if (!lstrcmpi(ext, "raw") && (is_rgb8 || is_rgb16 || vi.IsY8() || is_y16))
+    mode = WRITE_RAW;
+  else
+    mode = WRITE_DEVIL;
+
+  if (mode == WRITE_EBMP || mode == WRITE_BMP)
   {
+    const bool palette = mode == WRITE_BMP && vi.IsY8();
+
     // construct file header
     fileHeader.bfType = ('M' << 8) + 'B'; // I hate little-endian
     fileHeader.bfSize = vi.BMPSize(); // includes 4-byte padding
     fileHeader.bfReserved1 = 0;
     fileHeader.bfReserved2 = 0;
     fileHeader.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+    if (palette)
+      fileHeader.bfOffBits += 256 * sizeof(RGBQUAD); // greyscale palette
     fileHeader.bfSize += fileHeader.bfOffBits;
 
     // construct info header
@@ -79,12 +141,12 @@ ImageWriter::ImageWriter(PClip _child, const char * _base_name, const int _start
     infoHeader.biSizeImage = fileHeader.bfSize - fileHeader.bfOffBits;
     infoHeader.biXPelsPerMeter = 0;
     infoHeader.biYPelsPerMeter = 0;
-    infoHeader.biClrUsed = 0;
+    infoHeader.biClrUsed = palette ? 256 : 0;
     infoHeader.biClrImportant = 0;
   }
-  else {
-    if (!(vi.IsY8()||vi.IsRGB()))
-      env->ThrowError("ImageWriter: DevIL requires RGB or Y8 input");
+  else if (mode == WRITE_DEVIL) {
+    if (!(is_rgb8 || is_rgb16 || is_planar_rgb || vi.IsY8() || is_y16 || is_y32))
+      env->ThrowError("ImageWriter: DevIL requires RGB24/32/48/64, 8, 16 bit or float planar RGB(A), Y8, Y16 or Y32 input");
 
     if (InterlockedIncrement(&refcount) == 1) {
       if (!InitializeCriticalSectionAndSpinCount(&FramesCriticalSection, 1000) ) {
@@ -111,12 +173,22 @@ ImageWriter::ImageWriter(PClip _child, const char * _base_name, const int _start
     end = _end;
 
   end = max(end, start);
+
+  // DevIL can only encode one image at a time, native files are written
+  // by a few threads. Twice as many frames as writers may be in flight.
+  int threads = 1;
+  if (mode != WRITE_DEVIL)
+    threads = max(1, min((int)thread::hardware_concurrency(), 4));
+  queue = new ImageWriteQueue(threads, 2*threads);
 }
 
 
 ImageWriter::~ImageWriter()
 {
-  if (!!lstrcmpi(ext, "ebmp")) {
+  // Finish writing before DevIL goes away
+  delete queue;
+
+  if (mode == WRITE_DEVIL) {
     EnterCriticalSection(&FramesCriticalSection);
     ilShutDown();
     LeaveCriticalSection(&FramesCriticalSection);
@@ -132,142 +204,223 @@ PVideoFrame ImageWriter::GetFrame(int n, IScriptEnvironment* env)
 {
   PVideoFrame frame = child->GetFrame(n, env);
 
+  ostringstream text;
+
   // check bounds
   if ((n<start)||(n>end))
   {
-    if (info) {
-      ostringstream ss;
-      ss << "ImageWriter: frame " << n << " not in range";
-      env->MakeWritable(&frame);
-      env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-    }
-    return frame;
+    if (info)
+      text << "ImageWriter: frame " << n << " not in range";
   }
-
-  // construct filename
-  char filename[MAX_PATH + 1];
-  _snprintf(filename, MAX_PATH, base_name, n, ext, 0, 0);
-  filename[MAX_PATH] = '\0';
-
-  if (!lstrcmpi(ext, "ebmp"))  /* Use internal 'ebmp' writer */
+  else
   {
-    // initialize file object
-    ofstream file(filename, ios::out | ios::trunc | ios::binary);
-    if (!file)
-    {
-      ostringstream ss;
-      ss << "ImageWriter: could not create file '" << filename << "'";
-      env->MakeWritable(&frame);
-      env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-      return frame;
-    }
+    // construct filename
+    char filename[MAX_PATH + 1];
+    _snprintf(filename, MAX_PATH, base_name, n, ext, 0, 0);
+    filename[MAX_PATH] = '\0';
 
-    // write headers
-    file.write(reinterpret_cast<const char *>( &fileHeader ), sizeof(BITMAPFILEHEADER));
-    file.write(reinterpret_cast<const char *>( &infoHeader ), sizeof(BITMAPINFOHEADER));
+    // The frame is copied once into the job, the queue does the rest
+    ImageWriteJob* job = queue->Acquire();
+    job->filename = filename;
+    pack(*job, frame);
+    queue->Submit(job);
 
-    // write raster
-    const BYTE * srcPtr = frame->GetReadPtr();
-    int pitch = frame->GetPitch();
-    int row_size = frame->GetRowSize();
-    int height = frame->GetHeight();
-
-    if (vi.IsY8())
-    {
-      // write upside down
-      const BYTE * endPtr = srcPtr + pitch * (height-1);
-      fileWrite(file, endPtr, -pitch, row_size, height);
-    }
-    else
-    {
-      fileWrite(file, srcPtr, pitch, row_size, height);
+    // overlay on video output: progress indicator
+    if (info)
+      text << "Frame " << n << " queued for: " << filename;
+  }
 
-      if (vi.IsPlanar())
-      {
-        srcPtr = frame->GetReadPtr(PLANAR_U);
-        pitch = frame->GetPitch(PLANAR_U);
-        row_size = frame->GetRowSize(PLANAR_U);
-        height = frame->GetHeight(PLANAR_U);
-        fileWrite(file, srcPtr, pitch, row_size, height);
-
-        srcPtr = frame->GetReadPtr(PLANAR_V);
-        fileWrite(file, srcPtr, pitch, row_size, height);
-      }
-    }
+  // Files are written in the background, so a failure shows up on a
+  // frame after the one that could not be written.
+  string error;
+  if (queue->TakeError(error))
+    text.str(error);
 
-    // clean up
-    file.close();
+  if (!text.str().empty()) {
+    env->MakeWritable(&frame);
+    env->ApplyMessage(&frame, vi, text.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
   }
-  else { /* Use DevIL library */
-    EnterCriticalSection(&FramesCriticalSection);
 
-    // Set up DevIL
-    ILuint myImage=0;
-    ilGenImages(1, &myImage); // Initialize 1 image structure
-    ilBindImage(myImage);     // Set this as the current image
+  return frame;
+}
 
-    const ILenum il_format = vi.IsY8() ? IL_LUMINANCE : ( vi.IsRGB32() ? IL_BGRA : IL_BGR );
 
-    // Set image parameters
-    if (IL_TRUE == ilTexImage(vi.width, vi.height, 1, ILubyte(vi.BitsPerPixel() / 8), il_format, IL_UNSIGNED_BYTE, NULL)) {
+void ImageWriter::pack(ImageWriteJob & job, const PVideoFrame & frame)
+{
+  const BYTE * srcPtr = frame->GetReadPtr();
+  const int pitch = frame->GetPitch();
+  const int row_size = frame->GetRowSize();
+  const int height = frame->GetHeight();
+
+  // Rows of packed RGB frames are stored bottom-up
+  const bool bottom_up = vi.IsRGB() && !vi.IsPlanar();
+  const bool planar_rgb = vi.IsRGB() && vi.IsPlanar();
+
+  job.use_DevIL = (mode == WRITE_DEVIL);
 
-      // Program actual image raster
-      const BYTE * srcPtr = frame->GetReadPtr();
-      int pitch = frame->GetPitch();
-      for (int y=0; y<vi.height; ++y)
+  switch (mode)
+  {
+  case WRITE_EBMP:
+  case WRITE_BMP:
+    {
+      // BMP rows are padded to mod-4
+      const int pad = (4 - (row_size % 4)) % 4;
+      int pitchUV = 0, row_sizeUV = 0, heightUV = 0, padUV = 0;
+      if (vi.IsPlanar() && !vi.IsY8())
       {
-        ilSetPixels(0, y, 0, vi.width, 1, 1, il_format, IL_UNSIGNED_BYTE, (void*) srcPtr);
-        srcPtr += pitch;
+        pitchUV = frame->GetPitch(PLANAR_U);
+        row_sizeUV = frame->GetRowSize(PLANAR_U);
+        heightUV = frame->GetHeight(PLANAR_U);
+        padUV = (4 - (row_sizeUV % 4)) % 4;
       }
 
-      // DevIL writer fails if the file exists, so delete first
-      DeleteFile(filename);
+      job.data.resize(fileHeader.bfOffBits + (row_size + pad) * height + 2 * (row_sizeUV + padUV) * heightUV);
+      BYTE * dstPtr = job.data.data();
+      memcpy(dstPtr, &fileHeader, sizeof(BITMAPFILEHEADER));
+      dstPtr += sizeof(BITMAPFILEHEADER);
+      memcpy(dstPtr, &infoHeader, sizeof(BITMAPINFOHEADER));
+      dstPtr += sizeof(BITMAPINFOHEADER);
+
+      if (infoHeader.biClrUsed) {
+        for (int i=0; i < 256; ++i) {
+          const RGBQUAD grey = { BYTE(i), BYTE(i), BYTE(i), 0 };
+          memcpy(dstPtr, &grey, sizeof(RGBQUAD));
+          dstPtr += sizeof(RGBQUAD);
+        }
+      }
+
+      // BMP rows are bottom-up; only Y8 is stored the other way round
+      dstPtr = packRows(dstPtr, srcPtr, pitch, row_size, height, pad, vi.IsY8());
 
-      // Save to disk (format automatically inferred from extension)
-      ilSaveImage(filename);
+      if (heightUV)
+      {
+        dstPtr = packRows(dstPtr, frame->GetReadPtr(PLANAR_U), pitchUV, row_sizeUV, heightUV, padUV, false);
+        packRows(dstPtr, frame->GetReadPtr(PLANAR_V), pitchUV, row_sizeUV, heightUV, padUV, false);
+      }
     }
+    break;
 
-    // Get errors if any
-    ILenum err = ilGetError();
+  case WRITE_PPM:
+  case WRITE_PGM:
+    {
+      // Binary PNM: top-down rows of RGB or grey samples, 16 bit ones big-endian
+      const int bytes = vi.ComponentSize();
+      const int samples = (mode == WRITE_PPM) ? 3 : 1;
+      char header[64];
+      const int header_size = sprintf(header, "P%c\n%d %d\n%d\n", (mode == WRITE_PPM) ? '6' : '5',
+                                      vi.width, vi.height, bytes == 2 ? 65535 : 255);
+
+      const int out_row = vi.width * samples * bytes;
+      job.data.resize(header_size + out_row * height);
+      BYTE * dstPtr = job.data.data();
+      memcpy(dstPtr, header, header_size);
+      dstPtr += header_size;
+
+      if (mode == WRITE_PGM && bytes == 1) {
+        packRows(dstPtr, srcPtr, pitch, row_size, height, 0, bottom_up);
+        break;
+      }
 
-    // Clean up
-    ilDeleteImages(1, &myImage);
+      if (planar_rgb) {
+        const int planes[3] = { PLANAR_R, PLANAR_G, PLANAR_B };
+        for (int y=0; y < height; ++y)
+        {
+          const BYTE * rows[3];
+          for (int p=0; p < 3; ++p)
+            rows[p] = frame->GetReadPtr(planes[p]) + frame->GetPitch(planes[p]) * y;
+          if (bytes == 1)
+            mergeRow<BYTE>(dstPtr, rows, 3, vi.width);
+          else {
+            mergeRow<uint16_t>(dstPtr, rows, 3, vi.width);
+            for (int x=0; x < out_row; x+=2)
+              std::swap(dstPtr[x], dstPtr[x+1]);
+          }
+          dstPtr += out_row;
+        }
+        break;
+      }
 
-    LeaveCriticalSection(&FramesCriticalSection);
+      // BGR(A) to RGB and/or byte swapping, one row at a time
+      const int step = vi.BytesFromPixels(1) / bytes;
+      for (int y=0; y < height; ++y)
+      {
+        const BYTE * row = srcPtr + pitch * (bottom_up ? height-1-y : y);
+        if (bytes == 1) {
+          for (int x=0; x < vi.width; ++x) {
+            dstPtr[0] = row[2];
+            dstPtr[1] = row[1];
+            dstPtr[2] = row[0];
+            dstPtr += 3;
+            row += step;
+          }
+        }
+        else {
+          const uint16_t * row16 = reinterpret_cast<const uint16_t *>(row);
+          for (int x=0; x < vi.width; ++x) {
+            for (int c=0; c < samples; ++c) {
+              const uint16_t v = row16[samples == 3 ? 2-c : 0];
+              dstPtr[0] = BYTE(v >> 8);
+              dstPtr[1] = BYTE(v);
+              dstPtr += 2;
+            }
+            row16 += step;
+          }
+        }
+      }
+    }
+    break;
 
-    if (err != IL_NO_ERROR)
+  case WRITE_RAW:
     {
-      ostringstream ss;
-      ss << "ImageWriter: error '" << getErrStr(err) << "' in DevIL library\n"
-	        "writing file \"" << filename << "\"\n"
-            "DevIL version " << DevIL_Version << ".";
-      env->MakeWritable(&frame);
-      env->ApplyMessage(&frame, vi, ss.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-      return frame;
+      // DevIL's raw layout: width, height and depth as little-endian 32 bit
+      // values, bytes per pixel and per channel, then the rows as stored.
+      const int channels = vi.BytesFromPixels(1) / vi.ComponentSize();
+      job.data.resize(14 + row_size * height);
+      BYTE * dstPtr = job.data.data();
+      const uint32_t dims[3] = { uint32_t(vi.width), uint32_t(vi.height), 1 };
+      for (int i=0; i < 3; ++i)
+        for (int b=0; b < 4; ++b)
+          *dstPtr++ = BYTE(dims[i] >> (8*b));
+      *dstPtr++ = BYTE(channels);
+      *dstPtr++ = BYTE(vi.ComponentSize());
+      packRows(dstPtr, srcPtr, pitch, row_size, height, 0, false);
     }
-  }
-
-  if (info) {
-    // overlay on video output: progress indicator
-    ostringstream text;
-    text << "Frame " << n << " written to: " << filename;
-    env->MakeWritable(&frame);
-    env->ApplyMessage(&frame, vi, text.str().c_str(), vi.width/4, TEXT_COLOR, 0, 0);
-  }
-
-  return frame;
-}
+    break;
 
+  case WRITE_DEVIL:
+    {
+      // The raster in the row order of the frame, as ilSetPixels got it row by row
+      job.width = vi.width;
+      job.height = vi.height;
+      job.channels = ILubyte(vi.NumComponents());
+      job.format = vi.IsY() ? IL_LUMINANCE : (job.channels == 4 ? IL_BGRA : IL_BGR);
+      job.type = vi.ComponentSize() == 4 ? IL_FLOAT : (vi.ComponentSize() == 2 ? IL_UNSIGNED_SHORT : IL_UNSIGNED_BYTE);
+
+      if (!planar_rgb) {
+        job.data.resize(row_size * height);
+        packRows(job.data.data(), srcPtr, pitch, row_size, height, 0, false);
+        break;
+      }
 
-void ImageWriter::fileWrite(ostream & file, const BYTE * srcPtr, const int pitch, const int row_size, const int height)
-{
-  int dummy = 0;
-  int padding = (4 - (row_size % 4)) % 4;
-
-  for(int i=0; i < height; ++i)
-  {
-    file.write(reinterpret_cast<const char *>( srcPtr ), row_size);
-    file.write(reinterpret_cast<char *>( &dummy ), padding); // pad with 0's to mod-4
-    srcPtr += pitch;
+      // Planar RGB is interleaved to BGR(A), bottom row first like packed RGB
+      const int planes[4] = { PLANAR_B, PLANAR_G, PLANAR_R, PLANAR_A };
+      const int out_row = vi.width * job.channels * vi.ComponentSize();
+      job.data.resize(out_row * height);
+      BYTE * dstPtr = job.data.data();
+      for (int y=0; y < height; ++y)
+      {
+        const BYTE * rows[4];
+        for (int p=0; p < job.channels; ++p)
+          rows[p] = frame->GetReadPtr(planes[p]) + frame->GetPitch(planes[p]) * (height-1-y);
+        if (vi.ComponentSize() == 1)
+          mergeRow<BYTE>(dstPtr, rows, job.channels, vi.width);
+        else if (vi.ComponentSize() == 2)
+          mergeRow<uint16_t>(dstPtr, rows, job.channels, vi.width);
+        else
+          mergeRow<float>(dstPtr, rows, job.channels, vi.width);
+        dstPtr += out_row;
+      }
+    }
+    break;
   }
 }
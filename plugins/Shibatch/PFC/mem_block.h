@@ -181,7 +181,7 @@ template<class T>
 class mem_block_fastalloc : public mem_block_t<T>
 {
 public:
-	mem_block_fastalloc(unsigned initsize=0) {set_mem_logic(mem_block::ALLOC_FAST_DONTGODOWN);if (initsize) prealloc(initsize);}
+	mem_block_fastalloc(unsigned initsize=0) {this->set_mem_logic(mem_block::ALLOC_FAST_DONTGODOWN);if (initsize) this->prealloc(initsize);}
 };
 
 #if 0
@@ -14,7 +14,9 @@
 
 #include <malloc.h>
 
+#ifdef WIN32
 #include <tchar.h>
+#endif
 #include <stdio.h>
 
 #include <assert.h>
@@ -43,6 +45,16 @@
 
 #define tabsize(x) (sizeof(x)/sizeof(*x))
 
+#ifndef WIN32
+// Only the memory blocks are built outside of Windows, see CMakeLists.txt
+typedef unsigned int UINT;
+typedef unsigned int DWORD;
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include "bit_array.h"
+#include "mem_block.h"
+#else
 #include "bit_array.h"
 //#include "critsec.h"
 #include "mem_block.h"
@@ -56,4 +68,5 @@
 #include "byte_order_helper.h"
 #include "other.h"
 #include "chainlist.h"
+#endif
 #endif //___PFC_H___
\ No newline at end of file
@@ -0,0 +1,378 @@
+/******************************************************
+  FFT block convolution for the Shibatch audio filters
+*******************************************************/
+
+#include "fftconv.h"
+#include <avs/minmax.h>
+#include <emmintrin.h>
+#include <malloc.h>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+
+static const double PI2 = 6.283185307179586476925286766559;
+
+static float* alloc_floats(int count)
+{
+	float* p = (float*)_aligned_malloc(sizeof(float)*count, 64);
+	memset(p, 0, sizeof(float)*count);
+	return p;
+}
+
+
+/******************************************
+ *******   Reference kernels        *******
+ *****************************************/
+
+// One radix-2 Stockham stage of m/2 butterflies; s is the butterfly span of
+// the previous stages. The twiddle of butterfly j is tr/ti[j rounded down to
+// a multiple of s].
+static void fftconv_stage_c(const float* xr, const float* xi, float* yr, float* yi,
+                            const float* tr, const float* ti, int half, int s)
+{
+	for (int j = 0; j < half; j++) {
+		const int q = j & (s-1);
+		const int o = 2*j - q;
+		const float wr = tr[j-q], wi = ti[j-q];
+		const float ar = xr[j], ai = xi[j];
+		const float br = xr[j+half], bi = xi[j+half];
+		const float dr = ar - br, di = ai - bi;
+
+		yr[o] = ar + br;
+		yi[o] = ai + bi;
+		yr[o+s] = dr*wr - di*wi;
+		yi[o+s] = dr*wi + di*wr;
+	}
+}
+
+// Turns the complex transform Z of the even/odd samples into the real
+// spectrum X for bins k and m-k, multiplies with H and turns the result back
+// into the form the inverse complex transform needs. With w = exp(-2*pi*i*k/n):
+//   X[k] = E + w*O,  X[m-k] = conj(E - w*O),  E = Z[k] + conj(Z[m-k]),  O = -i*(Z[k] - conj(Z[m-k]))
+// and the same backwards. The factor 4 this leaves is part of H. Bin j = m
+// is read from Z[0] and not written back.
+static inline void spectrum_pair(float* zr, float* zi, const float* hr, const float* hi,
+                                 float wr, float wi, int k, int j, int m)
+{
+	const int jz = j == m ? 0 : j;
+	const float er = zr[k] + zr[jz], ei = zi[k] - zi[jz];
+	const float or_ = zi[k] + zi[jz], oi = zr[jz] - zr[k];
+	const float wor = wr*or_ - wi*oi, woi = wr*oi + wi*or_;
+
+	const float xkr = er + wor, xki = ei + woi;
+	const float xjr = er - wor, xji = woi - ei;
+
+	const float ykr = xkr*hr[k] - xki*hi[k], yki = xkr*hi[k] + xki*hr[k];
+	const float yjr = xjr*hr[j] - xji*hi[j], yji = xjr*hi[j] + xji*hr[j];
+
+	const float epr = ykr + yjr, epi = yki - yji;
+	const float dpr = ykr - yjr, dpi = yki + yji;
+	const float opr = dpr*wr + dpi*wi, opi = dpi*wr - dpr*wi;
+
+	if (j != m) {
+		zr[j] = epr + opi;
+		zi[j] = opr - epi;
+	}
+	zr[k] = epr - opi;
+	zi[k] = epi + opr;
+}
+
+
+/******************************************
+ *******   SSE2 kernels             *******
+ *****************************************/
+
+void fftconv_stage_sse2(const float* xr, const float* xi, float* yr, float* yi,
+                        const float* tr, const float* ti, int half, int s)
+{
+	for (int j = 0; j < half; j += 4) {
+		__m128 wr, wi;
+		if (s >= 4) {
+			wr = _mm_set1_ps(tr[j & ~(s-1)]);
+			wi = _mm_set1_ps(ti[j & ~(s-1)]);
+		} else {
+			wr = _mm_loadu_ps(tr + j);
+			wi = _mm_loadu_ps(ti + j);
+			if (s == 2) {
+				wr = _mm_shuffle_ps(wr, wr, _MM_SHUFFLE(2,2,0,0));
+				wi = _mm_shuffle_ps(wi, wi, _MM_SHUFFLE(2,2,0,0));
+			}
+		}
+
+		const __m128 ar = _mm_loadu_ps(xr + j), ai = _mm_loadu_ps(xi + j);
+		const __m128 br = _mm_loadu_ps(xr + j + half), bi = _mm_loadu_ps(xi + j + half);
+		const __m128 dr = _mm_sub_ps(ar, br), di = _mm_sub_ps(ai, bi);
+		const __m128 sr = _mm_add_ps(ar, br), si = _mm_add_ps(ai, bi);
+		const __m128 pr = _mm_sub_ps(_mm_mul_ps(dr, wr), _mm_mul_ps(di, wi));
+		const __m128 pi = _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr));
+
+		if (s >= 4) {
+			const int o = 2*j - (j & (s-1));
+			_mm_storeu_ps(yr + o, sr);
+			_mm_storeu_ps(yi + o, si);
+			_mm_storeu_ps(yr + o + s, pr);
+			_mm_storeu_ps(yi + o + s, pi);
+		} else if (s == 2) {
+			_mm_storeu_ps(yr + 2*j,     _mm_movelh_ps(sr, pr));
+			_mm_storeu_ps(yr + 2*j + 4, _mm_movehl_ps(pr, sr));
+			_mm_storeu_ps(yi + 2*j,     _mm_movelh_ps(si, pi));
+			_mm_storeu_ps(yi + 2*j + 4, _mm_movehl_ps(pi, si));
+		} else {
+			_mm_storeu_ps(yr + 2*j,     _mm_unpacklo_ps(sr, pr));
+			_mm_storeu_ps(yr + 2*j + 4, _mm_unpackhi_ps(sr, pr));
+			_mm_storeu_ps(yi + 2*j,     _mm_unpacklo_ps(si, pi));
+			_mm_storeu_ps(yi + 2*j + 4, _mm_unpackhi_ps(si, pi));
+		}
+	}
+}
+
+static inline __m128 reverse_ps(__m128 v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0,1,2,3));
+}
+
+// spectrum_pair() for k..k+3 and the mirrored bins m-k-3..m-k
+int fftconv_spectrum_sse2(float* zr, float* zi, const float* hr, const float* hi,
+                          const float* wr, const float* wi, int m)
+{
+	int k;
+	for (k = 1; k + 4 <= m/2; k += 4) {
+		const int j = m - k - 3;
+		const __m128 zkr = _mm_loadu_ps(zr + k), zki = _mm_loadu_ps(zi + k);
+		const __m128 zjr = reverse_ps(_mm_loadu_ps(zr + j)), zji = reverse_ps(_mm_loadu_ps(zi + j));
+		const __m128 vwr = _mm_loadu_ps(wr + k), vwi = _mm_loadu_ps(wi + k);
+
+		const __m128 er = _mm_add_ps(zkr, zjr), ei = _mm_sub_ps(zki, zji);
+		const __m128 or_ = _mm_add_ps(zki, zji), oi = _mm_sub_ps(zjr, zkr);
+		const __m128 wor = _mm_sub_ps(_mm_mul_ps(vwr, or_), _mm_mul_ps(vwi, oi));
+		const __m128 woi = _mm_add_ps(_mm_mul_ps(vwr, oi), _mm_mul_ps(vwi, or_));
+
+		const __m128 xkr = _mm_add_ps(er, wor), xki = _mm_add_ps(ei, woi);
+		const __m128 xjr = _mm_sub_ps(er, wor), xji = _mm_sub_ps(woi, ei);
+
+		const __m128 hkr = _mm_loadu_ps(hr + k), hki = _mm_loadu_ps(hi + k);
+		const __m128 hjr = reverse_ps(_mm_loadu_ps(hr + j)), hji = reverse_ps(_mm_loadu_ps(hi + j));
+		const __m128 ykr = _mm_sub_ps(_mm_mul_ps(xkr, hkr), _mm_mul_ps(xki, hki));
+		const __m128 yki = _mm_add_ps(_mm_mul_ps(xkr, hki), _mm_mul_ps(xki, hkr));
+		const __m128 yjr = _mm_sub_ps(_mm_mul_ps(xjr, hjr), _mm_mul_ps(xji, hji));
+		const __m128 yji = _mm_add_ps(_mm_mul_ps(xjr, hji), _mm_mul_ps(xji, hjr));
+
+		const __m128 epr = _mm_add_ps(ykr, yjr), epi = _mm_sub_ps(yki, yji);
+		const __m128 dpr = _mm_sub_ps(ykr, yjr), dpi = _mm_add_ps(yki, yji);
+		const __m128 opr = _mm_add_ps(_mm_mul_ps(dpr, vwr), _mm_mul_ps(dpi, vwi));
+		const __m128 opi = _mm_sub_ps(_mm_mul_ps(dpi, vwr), _mm_mul_ps(dpr, vwi));
+
+		_mm_storeu_ps(zr + k, _mm_sub_ps(epr, opi));
+		_mm_storeu_ps(zi + k, _mm_add_ps(epi, opr));
+		_mm_storeu_ps(zr + j, reverse_ps(_mm_add_ps(epr, opi)));
+		_mm_storeu_ps(zi + j, reverse_ps(_mm_sub_ps(opr, epi)));
+	}
+	return k;
+}
+
+
+/******************************************
+ *******   RealFFT                  *******
+ *****************************************/
+
+RealFFT::RealFFT(int bits, int cpu)
+{
+	n = 1 << bits;
+	m = n / 2;
+
+	tr = alloc_floats(m/2);
+	ti = alloc_floats(m/2);
+	for (int k = 0; k < m/2; k++) {
+		tr[k] = (float)cos(PI2*k/m);
+		ti[k] = (float)-sin(PI2*k/m);
+	}
+
+	wr = alloc_floats(m/2+1);
+	wi = alloc_floats(m/2+1);
+	for (int k = 0; k <= m/2; k++) {
+		wr[k] = (float)cos(PI2*k/n);
+		wi[k] = (float)-sin(PI2*k/n);
+	}
+
+	buf = alloc_floats(4*m);
+
+	if ((cpu & CPUF_AVX2) && (cpu & CPUF_FMA3)) {
+		stage = fftconv_stage_avx2;
+		spectrum = fftconv_spectrum_avx2;
+	} else if (cpu & CPUF_SSE2) {
+		stage = fftconv_stage_sse2;
+		spectrum = fftconv_spectrum_sse2;
+	} else {
+		stage = fftconv_stage_c;
+		spectrum = NULL;
+	}
+}
+
+RealFFT::~RealFFT()
+{
+	_aligned_free(tr);
+	_aligned_free(ti);
+	_aligned_free(wr);
+	_aligned_free(wi);
+	_aligned_free(buf);
+}
+
+// Complex transform of the m values in re/im, using wre/wim as the second
+// buffer. On return re/im point to the result.
+void RealFFT::transform(float*& re, float*& im, float*& wre, float*& wim)
+{
+	for (int s = 1; s < m; s *= 2) {
+		stage(re, im, wre, wim, tr, ti, m/2, s);
+		std::swap(re, wre);
+		std::swap(im, wim);
+	}
+}
+
+void RealFFT::Convolve(float* x, const float* spec)
+{
+	float *re = buf, *im = buf + m, *wre = buf + 2*m, *wim = buf + 3*m;
+	const float *hr = spec, *hi = spec + m + 1;
+	int k;
+
+	for (k = 0; k < m; k++) {
+		re[k] = x[2*k];
+		im[k] = x[2*k+1];
+	}
+
+	transform(re, im, wre, wim);
+
+	k = spectrum ? spectrum(re, im, hr, hi, wr, wi, m) : 1;
+	for (; k < m/2; k++)
+		spectrum_pair(re, im, hr, hi, wr[k], wi[k], k, m-k, m);
+	spectrum_pair(re, im, hr, hi, wr[0], wi[0], 0, m, m);
+	spectrum_pair(re, im, hr, hi, wr[m/2], wi[m/2], m/2, m/2, m);
+
+	// The inverse transform is the forward one with real and imaginary
+	// parts exchanged on the way in and out.
+	transform(im, re, wim, wre);
+
+	for (k = 0; k < m; k++) {
+		x[2*k] = re[k];
+		x[2*k+1] = im[k];
+	}
+}
+
+void RealFFT::Spectrum(const float* h, float* spec)
+{
+	float *re = buf, *im = buf + m, *wre = buf + 2*m, *wim = buf + 3*m;
+	float *hr = spec, *hi = spec + m + 1;
+	const float scale = 0.25f / m;  // the factor 4 of spectrum_pair() and 1/m of the inverse
+
+	for (int k = 0; k < m; k++) {
+		re[k] = h[2*k];
+		im[k] = h[2*k+1];
+	}
+
+	transform(re, im, wre, wim);
+
+	for (int k = 0; k <= m/2; k++) {
+		const int j = m - k, jz = k ? j : 0;
+		const double er = 0.5*(re[k] + re[jz]), ei = 0.5*(im[k] - im[jz]);
+		const double or_ = 0.5*(im[k] + im[jz]), oi = 0.5*(re[jz] - re[k]);
+		const double c = cos(PI2*k/n), s = -sin(PI2*k/n);
+		const double wor = c*or_ - s*oi, woi = c*oi + s*or_;
+
+		hr[j] = (float)((er - wor)*scale);
+		hi[j] = (float)((woi - ei)*scale);
+		hr[k] = (float)((er + wor)*scale);
+		hi[k] = (float)((ei + woi)*scale);
+	}
+}
+
+
+/******************************************
+ *******   FFTConvolver             *******
+ *****************************************/
+
+FFTConvolver::FFTConvolver(int bits, int _taps, int _channels, int cpu)
+  : fft(bits, cpu), taps(_taps), channels(_channels), block((1 << bits) - _taps + 1)
+{
+	const int n = fft.Size();
+
+	work = alloc_floats(n);
+	pending = alloc_floats(block*channels);
+	for (int ch = 0; ch < channels; ch++) {
+		hist.push_back(alloc_floats(n));
+		spec.push_back(alloc_floats(fft.SpectrumSize()));
+	}
+	filled = 0;
+}
+
+FFTConvolver::~FFTConvolver()
+{
+	for (int ch = 0; ch < channels; ch++) {
+		_aligned_free(hist[ch]);
+		_aligned_free(spec[ch]);
+	}
+	_aligned_free(work);
+	_aligned_free(pending);
+}
+
+void FFTConvolver::SetResponse(int channel, const float* h)
+{
+	memset(work, 0, sizeof(float)*fft.Size());
+	memcpy(work, h, sizeof(float)*taps);
+	fft.Spectrum(work, spec[channel]);
+}
+
+void FFTConvolver::Reset()
+{
+	for (int ch = 0; ch < channels; ch++)
+		memset(hist[ch], 0, sizeof(float)*fft.Size());
+	memset(pending, 0, sizeof(SFLOAT)*block*channels);
+	filled = 0;
+}
+
+void FFTConvolver::Process(const SFLOAT* in, SFLOAT* out, int frames)
+{
+	const int n = fft.Size();
+
+	while (frames > 0) {
+		const int count = min(frames, block - filled);
+
+		for (int ch = 0; ch < channels; ch++) {
+			float* dst = hist[ch] + n - block + filled;
+			const SFLOAT* src = in + ch;
+			for (int i = 0; i < count; i++, src += channels)
+				dst[i] = *src;
+		}
+		if (out) {
+			memcpy(out, pending + filled*channels, sizeof(SFLOAT)*count*channels);
+			out += count*channels;
+		}
+
+		in += count*channels;
+		frames -= count;
+		filled += count;
+
+		if (filled == block) {
+			processBlock();
+			filled = 0;
+		}
+	}
+}
+
+// Filters the full history of every channel. The first taps-1 results of the
+// circular convolution wrap around, the remaining block ones are the output.
+void FFTConvolver::processBlock()
+{
+	const int n = fft.Size();
+
+	for (int ch = 0; ch < channels; ch++) {
+		memcpy(work, hist[ch], sizeof(float)*n);
+		fft.Convolve(work, spec[ch]);
+
+		const float* src = work + n - block;
+		SFLOAT* dst = pending + ch;
+		for (int i = 0; i < block; i++, dst += channels)
+			*dst = src[i];
+
+		memmove(hist[ch], hist[ch] + block, sizeof(float)*(n - block));
+	}
+}
@@ -0,0 +1,110 @@
+/******************************************************
+  FFT block convolution for the Shibatch audio filters
+
+  RealFFT is a real-input FFT of 2^n points, computed as a complex FFT
+  of half the size on the interleaved even/odd samples. The complex FFT
+  is a radix-2 Stockham transform working on split (separate real and
+  imaginary) arrays, so that every butterfly stage runs on contiguous
+  vectors, with all twiddle factors computed up front.
+
+  FFTConvolver filters interleaved multichannel audio with one FIR per
+  channel using overlap-save. All channels are processed in one pass.
+*******************************************************/
+
+#ifndef _FFTCONV_H_
+#define _FFTCONV_H_
+
+#include <avisynth.h>
+#include <vector>
+
+
+class RealFFT
+{
+public:
+	// bits: log2 of the transform size, at least 6.
+	// cpu: env->GetCPUFlags(), selects the SSE2 or AVX2/FMA kernels.
+	RealFFT(int bits, int cpu);
+	~RealFFT();
+
+	int Size() const {return n;}
+
+	// Transforms the n samples in x, multiplies with the spectrum spec made
+	// by Spectrum() and transforms back, leaving the n samples of the
+	// circular convolution in x. Not reentrant, the work buffers are shared.
+	void Convolve(float* x, const float* spec);
+
+	// Makes the spectrum for Convolve() from the n samples in h. The scale
+	// of the inverse transform is folded into it.
+	void Spectrum(const float* h, float* spec);
+
+	// Floats needed for a spectrum.
+	int SpectrumSize() const {return 2*(m+1);}
+
+	typedef void (*StageFunc)(const float* xr, const float* xi, float* yr, float* yi,
+	                          const float* tr, const float* ti, int half, int s);
+	typedef int (*SpectrumFunc)(float* zr, float* zi, const float* hr, const float* hi,
+	                            const float* wr, const float* wi, int m);
+
+private:
+	void transform(float*& re, float*& im, float*& wre, float*& wim);
+
+	int n,m;        // real and complex transform sizes
+	float *tr,*ti;  // stage twiddles exp(-2*pi*i*k/m), k < m/2
+	float *wr,*wi;  // split twiddles exp(-2*pi*i*k/n), k <= m/2
+	float *buf;     // two pairs of split work arrays
+
+	StageFunc stage;
+	SpectrumFunc spectrum;
+};
+
+
+class FFTConvolver
+{
+public:
+	// Filters with FIRs of up to taps coefficients, using transforms of
+	// 2^bits points; taps must be below 2^bits.
+	FFTConvolver(int bits, int taps, int channels, int cpu);
+	~FFTConvolver();
+
+	// Sets the FIR of one channel, taps coefficients. Channels without one
+	// are silent.
+	void SetResponse(int channel, const float* h);
+
+	// Clears the history and the pending output.
+	void Reset();
+
+	// Filters frames of interleaved input. The output lags the input by
+	// Latency() frames; out may be NULL to drop it.
+	void Process(const SFLOAT* in, SFLOAT* out, int frames);
+
+	int Latency() const {return block;}
+
+private:
+	void processBlock();
+
+	RealFFT fft;
+	const int taps, channels;
+	const int block;  // new samples per transform
+
+	std::vector<float*> hist;  // per channel, the last transform size input samples
+	std::vector<float*> spec;  // per channel spectrum
+	float* work;
+	SFLOAT* pending;  // interleaved output of the last block
+	int filled;       // frames of the current block that were fed
+};
+
+
+// Kernels, the SSE2 ones are in fftconv.cpp, the AVX2/FMA ones in
+// fftconv_avx2.cpp. A stage kernel needs half to be a multiple of the
+// vector width; a spectrum kernel processes whole vectors starting at k=1
+// and returns where it stopped.
+void fftconv_stage_sse2(const float* xr, const float* xi, float* yr, float* yi,
+                        const float* tr, const float* ti, int half, int s);
+int fftconv_spectrum_sse2(float* zr, float* zi, const float* hr, const float* hi,
+                          const float* wr, const float* wi, int m);
+void fftconv_stage_avx2(const float* xr, const float* xi, float* yr, float* yi,
+                        const float* tr, const float* ti, int half, int s);
+int fftconv_spectrum_avx2(float* zr, float* zi, const float* hr, const float* hi,
+                          const float* wr, const float* wi, int m);
+
+#endif
@@ -0,0 +1,113 @@
+/******************************************************
+  FFT block convolution for the Shibatch audio filters
+
+  AVX2/FMA kernels, only to be used when CPUF_AVX2 and CPUF_FMA3 are set.
+  This file is compiled with AVX2 and FMA enabled (see CMakeLists.txt).
+*******************************************************/
+
+#include "fftconv.h"
+#include <immintrin.h>
+
+
+void fftconv_stage_avx2(const float* xr, const float* xi, float* yr, float* yi,
+                        const float* tr, const float* ti, int half, int s)
+{
+	for (int j = 0; j < half; j += 8) {
+		__m256 wr, wi;
+		if (s >= 8) {
+			wr = _mm256_broadcast_ss(tr + (j & ~(s-1)));
+			wi = _mm256_broadcast_ss(ti + (j & ~(s-1)));
+		} else {
+			wr = _mm256_loadu_ps(tr + j);
+			wi = _mm256_loadu_ps(ti + j);
+			if (s == 2) {
+				wr = _mm256_shuffle_ps(wr, wr, _MM_SHUFFLE(2,2,0,0));
+				wi = _mm256_shuffle_ps(wi, wi, _MM_SHUFFLE(2,2,0,0));
+			} else if (s == 4) {
+				wr = _mm256_shuffle_ps(wr, wr, 0);
+				wi = _mm256_shuffle_ps(wi, wi, 0);
+			}
+		}
+
+		const __m256 ar = _mm256_loadu_ps(xr + j), ai = _mm256_loadu_ps(xi + j);
+		const __m256 br = _mm256_loadu_ps(xr + j + half), bi = _mm256_loadu_ps(xi + j + half);
+		const __m256 dr = _mm256_sub_ps(ar, br), di = _mm256_sub_ps(ai, bi);
+		const __m256 sr = _mm256_add_ps(ar, br), si = _mm256_add_ps(ai, bi);
+		const __m256 pr = _mm256_fmsub_ps(dr, wr, _mm256_mul_ps(di, wi));
+		const __m256 pi = _mm256_fmadd_ps(dr, wi, _mm256_mul_ps(di, wr));
+
+		if (s >= 8) {
+			const int o = 2*j - (j & (s-1));
+			_mm256_storeu_ps(yr + o, sr);
+			_mm256_storeu_ps(yi + o, si);
+			_mm256_storeu_ps(yr + o + s, pr);
+			_mm256_storeu_ps(yi + o + s, pi);
+			continue;
+		}
+
+		// Interleave runs of s values of the sums and the differences. The
+		// unpacks work within 128 bit lanes, the permutes put the lanes in order.
+		__m256 lor, hir, loi, hii;
+		if (s == 4) {
+			lor = sr; hir = pr; loi = si; hii = pi;
+		} else if (s == 2) {
+			lor = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(sr), _mm256_castps_pd(pr)));
+			hir = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(sr), _mm256_castps_pd(pr)));
+			loi = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(si), _mm256_castps_pd(pi)));
+			hii = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(si), _mm256_castps_pd(pi)));
+		} else {
+			lor = _mm256_unpacklo_ps(sr, pr);
+			hir = _mm256_unpackhi_ps(sr, pr);
+			loi = _mm256_unpacklo_ps(si, pi);
+			hii = _mm256_unpackhi_ps(si, pi);
+		}
+		_mm256_storeu_ps(yr + 2*j,     _mm256_permute2f128_ps(lor, hir, 0x20));
+		_mm256_storeu_ps(yr + 2*j + 8, _mm256_permute2f128_ps(lor, hir, 0x31));
+		_mm256_storeu_ps(yi + 2*j,     _mm256_permute2f128_ps(loi, hii, 0x20));
+		_mm256_storeu_ps(yi + 2*j + 8, _mm256_permute2f128_ps(loi, hii, 0x31));
+	}
+}
+
+static inline __m256 reverse_ps(__m256 v)
+{
+	return _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7,6,5,4,3,2,1,0));
+}
+
+// See spectrum_pair() in fftconv.cpp, this does k..k+7 and m-k-7..m-k.
+int fftconv_spectrum_avx2(float* zr, float* zi, const float* hr, const float* hi,
+                          const float* wr, const float* wi, int m)
+{
+	int k;
+	for (k = 1; k + 8 <= m/2; k += 8) {
+		const int j = m - k - 7;
+		const __m256 zkr = _mm256_loadu_ps(zr + k), zki = _mm256_loadu_ps(zi + k);
+		const __m256 zjr = reverse_ps(_mm256_loadu_ps(zr + j)), zji = reverse_ps(_mm256_loadu_ps(zi + j));
+		const __m256 vwr = _mm256_loadu_ps(wr + k), vwi = _mm256_loadu_ps(wi + k);
+
+		const __m256 er = _mm256_add_ps(zkr, zjr), ei = _mm256_sub_ps(zki, zji);
+		const __m256 or_ = _mm256_add_ps(zki, zji), oi = _mm256_sub_ps(zjr, zkr);
+		const __m256 wor = _mm256_fmsub_ps(vwr, or_, _mm256_mul_ps(vwi, oi));
+		const __m256 woi = _mm256_fmadd_ps(vwr, oi, _mm256_mul_ps(vwi, or_));
+
+		const __m256 xkr = _mm256_add_ps(er, wor), xki = _mm256_add_ps(ei, woi);
+		const __m256 xjr = _mm256_sub_ps(er, wor), xji = _mm256_sub_ps(woi, ei);
+
+		const __m256 hkr = _mm256_loadu_ps(hr + k), hki = _mm256_loadu_ps(hi + k);
+		const __m256 hjr = reverse_ps(_mm256_loadu_ps(hr + j)), hji = reverse_ps(_mm256_loadu_ps(hi + j));
+		const __m256 ykr = _mm256_fmsub_ps(xkr, hkr, _mm256_mul_ps(xki, hki));
+		const __m256 yki = _mm256_fmadd_ps(xkr, hki, _mm256_mul_ps(xki, hkr));
+		const __m256 yjr = _mm256_fmsub_ps(xjr, hjr, _mm256_mul_ps(xji, hji));
+		const __m256 yji = _mm256_fmadd_ps(xjr, hji, _mm256_mul_ps(xji, hjr));
+
+		const __m256 epr = _mm256_add_ps(ykr, yjr), epi = _mm256_sub_ps(yki, yji);
+		const __m256 dpr = _mm256_sub_ps(ykr, yjr), dpi = _mm256_add_ps(yki, yji);
+		const __m256 opr = _mm256_fmadd_ps(dpr, vwr, _mm256_mul_ps(dpi, vwi));
+		const __m256 opi = _mm256_fmsub_ps(dpi, vwr, _mm256_mul_ps(dpr, vwi));
+
+		_mm256_storeu_ps(zr + k, _mm256_sub_ps(epr, opi));
+		_mm256_storeu_ps(zi + k, _mm256_add_ps(epi, opr));
+		_mm256_storeu_ps(zr + j, reverse_ps(_mm256_add_ps(epr, opi)));
+		_mm256_storeu_ps(zi + j, reverse_ps(_mm256_sub_ps(opr, epi)));
+	}
+	return k;
+}
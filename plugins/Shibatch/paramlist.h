@@ -1,3 +1,6 @@
+#ifndef _PARAMLIST_H_
+#define _PARAMLIST_H_
+
 #include <cstdio>
 #include <stdlib.h>
 #include <string.h>
@@ -116,3 +119,5 @@ public:
 	    }
 	}
 };
+
+#endif // _PARAMLIST_H_
@@ -34,6 +34,7 @@
 
 #include "ssrc-convert.h"
 #include <avs/win.h>
+#include <avs/minmax.h>
 
 
 /******************************************
@@ -42,10 +43,8 @@
 
 
 SSRC::SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env)
-  : GenericVideoFilter(_child), target_rate(_target_rate), fast(_fast)
+  : GenericVideoFilter(_child), target_rate(_target_rate), fast(_fast), srcbuffer(0), completion(0)
 {
-  srcbuffer = 0;  // If constructor should return
-
   if ((target_rate==vi.audio_samples_per_second)||(vi.audio_samples_per_second==0)) {
 		skip_conversion=true;
 		return;
@@ -56,23 +55,46 @@ SSRC::SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env)
 
   factor = double(target_rate) / vi.audio_samples_per_second;
   vi.num_audio_samples = (vi.num_audio_samples * target_rate + vi.audio_samples_per_second - 1) / vi.audio_samples_per_second; // Ceil
- 
-  res = SSRC_create(source_rate, target_rate, vi.AudioChannels(), 2,1, fast);
+
+  const int nch = vi.AudioChannels();
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+
+  // Every channel is filtered independently, so for multichannel material
+  // each one gets its own resampler and they are fed in parallel.
+  const bool split = nch > 1 && env2->GetProperty(AEP_THREADPOOL_THREADS) > 0;
+
+  Resampler_base* res = SSRC_create(source_rate, target_rate, split ? 1 : nch, 2,1, fast);
 
   if (!res)
     env->ThrowError("SSRC: could not resample between the two samplerates.");
 
+  period = res->GetPeriod();
+  period_out = period * target_rate / source_rate;
+  preroll_out = ((__int64)res->GetPreroll() * target_rate + source_rate - 1) / source_rate;
+  delete res;
+
   input_samples = source_rate;  // We convert one second of input per loop.
   vi.audio_samples_per_second = target_rate;
-  srcbuffer = new SFLOAT[vi.AudioChannels() * input_samples];
+  srcbuffer = new SFLOAT[nch * input_samples];
 
-  for(int i=0; i<vi.AudioChannels() * input_samples; i++)  // We stuff one second into the input (preroll)
-    srcbuffer[i] = 0.0f;
+  channels.resize(split ? nch : 1);
+  for (size_t i = 0; i < channels.size(); i++) {
+    channels[i].res = 0;
+    if (split)
+      channels[i].in.resize(input_samples);
+  }
+  if (split)
+    completion = env2->NewCompletion(nch);
 
-  next_sample = -target_rate;
-  inputReadOffset = 0;
-  res->Write(srcbuffer, input_samples * vi.AudioChannels());
+  reset(0, env);
+}
 
+SSRC::~SSRC() {
+  for (size_t i = 0; i < channels.size(); i++)
+    delete channels[i].res;
+  if (completion)
+    completion->Destroy();
+  delete[] srcbuffer;
 }
 
  /***************************************
@@ -81,85 +103,146 @@ SSRC::SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env)
  * loud click in the very beginning of the sample.
  *   Therefore we preroll a second of audio whenever 
  * a new instance is created.
+ * - The resampler state repeats every 'period'
+ * input samples, so an instance started at a
+ * multiple of the period (still with the second
+ * of preroll in front) delivers exactly the same
+ * samples as one that has run from the start,
+ * once 'preroll_out' samples have been dropped.
  ****************************************/
 
 
-void __stdcall SSRC::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+// Starts over with fresh resamplers at the given multiple of the period.
+void SSRC::reset(__int64 period_index, IScriptEnvironment* env)
 {
-  if (skip_conversion) {
-		child->GetAudio(buf, start, count, env);
-		return;
-	}
+  const int nch = vi.AudioChannels();
 
-  count *= vi.AudioChannels();   // This is how SSRC keeps count. We'll do the same
+  for (size_t i = 0; i < channels.size(); i++) {
+    delete channels[i].res;
+    channels[i].res = SSRC_create(source_rate, target_rate, completion ? 1 : nch, 2, 1, fast);
+  }
 
-  if (start != next_sample) {  // Reset on seek
-    bool skip_restart = false;
+  inputReadOffset = period_index * period - source_rate;
+  next_sample = period_index * period_out - target_rate;
+}
 
-    if (start > next_sample) { // Don't seek if within 10 sek, but skip
-      if ((next_sample + input_samples * 10) > start) {
-        skip_restart = true;
-      }
-    }
 
-    if (!skip_restart)  { 
-      inputReadOffset = (start * source_rate / target_rate) -  input_samples;  // Floor, Reset at new read position minus ONE second.
-      res = SSRC_create(source_rate, target_rate, vi.AudioChannels(), 2, 1, fast);
-      _RPT2(0, "SSRC: Resetting position. Next_sample: %d. Start:%d.!\n", (int)next_sample, (int)start);
-      next_sample = start - target_rate;
-    }
-  }
+AVSValue SSRC::WriteChannel(IScriptEnvironment2*, void* data)
+{
+  Channel* c = static_cast<Channel*>(data);
+  c->res->Write(&c->in[0], (int)c->in.size());
+  return AVSValue();
+}
 
 
-  int ssrc_samples_tbr = int(count)*sizeof(SFLOAT);  // count in bytes
-  bool buffer_full = false;
+// Feeds the next input_samples samples to the resamplers. Input before the
+// start of the clip is silence.
+void SSRC::feed(IScriptEnvironment* env)
+{
+  const int nch = vi.AudioChannels();
+
+  if (inputReadOffset + input_samples <= 0) {
+    memset(srcbuffer, 0, nch * input_samples * sizeof(SFLOAT));
+  } else if (inputReadOffset < 0) {
+    const int zeros = int(-inputReadOffset);
+    memset(srcbuffer, 0, nch * zeros * sizeof(SFLOAT));
+    child->GetAudio(srcbuffer + nch * zeros, 0, input_samples - zeros, env);
+  } else {
+    child->GetAudio(srcbuffer, inputReadOffset, input_samples, env);
+  }
+  inputReadOffset += input_samples;
 
+  if (!completion) {
+    channels[0].res->Write(srcbuffer, input_samples * nch);
+    return;
+  }
 
-  if (next_sample < start) { // Skip
-    int skip_count = int(start - next_sample) * vi.AudioChannels();
-    _RPT1(0,"SSRC: Skipping %u samples", skip_count);
-    int skip_nsamples = skip_count*sizeof(SFLOAT);  // count in bytes
-    do {
-      int ssrc_samples_av;
-      res->GetBuffer(&ssrc_samples_av);
+  for (int ch = 0; ch < nch; ch++) {
+    const SFLOAT* src = srcbuffer + ch;
+    SFLOAT* dst = &channels[ch].in[0];
+    for (int i = 0; i < input_samples; i++, src += nch)
+      dst[i] = *src;
+  }
 
-      if (ssrc_samples_av < skip_nsamples) {  // We don't have enough bytes - feed more.
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+  for (int ch = 0; ch < nch; ch++)
+    env2->ParallelJob(WriteChannel, &channels[ch], completion);
+  completion->Wait();
+  try {
+    for (int ch = 0; ch < nch; ch++)
+      completion->Get(ch);  // rethrows an exception from the job
+  }
+  catch (...) {
+    completion->Reset();
+    throw;
+  }
+  completion->Reset();
+}
 
-        child->GetAudio(srcbuffer, inputReadOffset, input_samples, env);
-        inputReadOffset += input_samples;
 
-        res->Write(srcbuffer, input_samples * vi.AudioChannels());
+// Reads count samples from the resamplers into dst, or drops them if dst is NULL.
+void SSRC::drain(SFLOAT* dst, __int64 count, IScriptEnvironment* env)
+{
+  const int nch = vi.AudioChannels();
+  const int stride = completion ? 1 : nch;  // values per sample in each resampler
+
+  while (count > 0) {
+    int avail;
+    channels[0].res->GetBuffer(&avail);
+    avail /= stride;
+    for (size_t i = 1; i < channels.size(); i++) {
+      int size;
+      channels[i].res->GetBuffer(&size);
+      avail = min(avail, size);
+    }
 
-      } else {  // Now we have enough data
-        res->Read(skip_count);
-        next_sample += start;
-        buffer_full = true;
-      }
-    } while (!buffer_full);
+    if (avail == 0) {  // We don't have enough samples - feed more.
+      feed(env);
+      continue;
+    }
 
-    buffer_full = false;
+    const int n = (int)min<__int64>(avail, count);
+    if (dst) {
+      int size;
+      if (!completion) {
+        memcpy(dst, channels[0].res->GetBuffer(&size), n * nch * sizeof(SFLOAT));
+      } else {
+        for (int ch = 0; ch < nch; ch++) {
+          const SFLOAT* src = channels[ch].res->GetBuffer(&size);
+          for (int i = 0; i < n; i++)
+            dst[i * nch + ch] = src[i];
+        }
+      }
+      dst += n * nch;
+    }
+    for (size_t i = 0; i < channels.size(); i++)
+      channels[i].res->Read(n * stride);
+    count -= n;
   }
+}
 
 
-  do {
-    int ssrc_samples_av;
-    SFLOAT* ssrc_samples = res->GetBuffer(&ssrc_samples_av);
-
-    if (ssrc_samples_av < ssrc_samples_tbr) {  // We don't have enough bytes - feed more.
-
-      child->GetAudio(srcbuffer, inputReadOffset, input_samples, env);
-      inputReadOffset += input_samples;
-      res->Write(srcbuffer, input_samples * vi.AudioChannels());
+void __stdcall SSRC::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+{
+  if (skip_conversion) {
+		child->GetAudio(buf, start, count, env);
+		return;
+	}
 
-    } else {  // Now we have enough data
+  if (start != next_sample) {  // Seek
+    // Restart at the last period boundary that leaves room for the preroll,
+    // unless skipping ahead from the current position is less work.
+    __int64 period_index = max<__int64>(0, (start + target_rate - preroll_out) / period_out);
 
-      env->BitBlt((BYTE*)buf, ssrc_samples_tbr, (BYTE*)ssrc_samples, ssrc_samples_tbr, ssrc_samples_tbr , 1);
-      res->Read((unsigned int)count);
-      buffer_full = true;
+    if (start < next_sample || period_index * period_out - target_rate > next_sample) {
+      _RPT2(0, "SSRC: Resetting position. Next_sample: %d. Start:%d.!\n", (int)next_sample, (int)start);
+      reset(period_index, env);
     }
+  }
 
-  } while (!buffer_full);
-  next_sample = start + (count/vi.AudioChannels());
+  drain(NULL, start - next_sample, env);  // Skip
+  drain((SFLOAT*)buf, count, env);
+  next_sample = start + count;
 
 }
 
@@ -38,6 +38,7 @@
 typedef float REAL;
 
 #include <avisynth.h>
+#include <vector>
 #include "ssrc.h"
 
 
@@ -51,30 +52,42 @@ class SSRC : public GenericVideoFilter
 {
 public:
   SSRC(PClip _child, int _target_rate, bool _fast, IScriptEnvironment* env);
-  ~SSRC() {
-     delete res;
-     delete[] srcbuffer;
-    }
+  ~SSRC();
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
 private:
+  // One resampler per channel when the channels are converted on worker
+  // threads, otherwise a single resampler for all channels.
+  struct Channel {
+    Resampler_base* res;
+    std::vector<SFLOAT> in;
+  };
+
+  static AVSValue WriteChannel(IScriptEnvironment2*, void* data);
+
+  void reset(__int64 period_index, IScriptEnvironment* env);
+  void feed(IScriptEnvironment* env);
+  void drain(SFLOAT* dst, __int64 count, IScriptEnvironment* env);
+
   const int target_rate;
   int source_rate;
-  int srcbuffer_size;
   bool skip_conversion;
   double factor;
   int input_samples;
   bool fast;
 
+  __int64 period, period_out;   // restart granularity, in input and output samples
+  __int64 preroll_out;          // output samples to discard after a restart
+
   SFLOAT* srcbuffer;
   __int64 next_sample;
   __int64 inputReadOffset;
 
-	Resampler_base * res;
+  std::vector<Channel> channels;
+  IJobCompletion* completion;   // NULL when all channels share one resampler
 
 };
 
 
 #endif  // __SSRC_Audio_H__
-
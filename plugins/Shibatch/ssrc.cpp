@@ -158,7 +158,7 @@ void Resampler_i_base<REAL>::make_inbuf(int nsmplread, int inbuflen, REAL_inout*
 	size_t	ClearSize = toberead - nsmplread;
 
 	if(ClearSize) {
-		memset(inbuf + InbufBase + MaxLoop, 0, ClearSize * nch * sizeof REAL);
+		memset(inbuf + InbufBase + MaxLoop, 0, ClearSize * nch * sizeof(REAL));
 	}
 }
 
@@ -197,6 +197,13 @@ unsigned int Resampler_base::GetLatency()
 template<class REAL>
 class Upsampler : public Resampler_i_base<REAL>
 {
+  // the members of the dependent base, for two phase name lookup
+  typedef Resampler_i_base<REAL> base;
+  using typename base::CONFIG;
+  using base::nch; using base::sfrq; using base::dfrq; using base::gain; using base::peak;
+  using base::AA; using base::DF; using base::FFTFIRLEN; using base::period; using base::preroll;
+  using base::make_inbuf; using base::make_outbuf; using base::__output;
+
   __int64 fs1;
   int frqgcd,osf,fs2;
   REAL **stage1,*stage2;
@@ -293,6 +300,9 @@ public:
 		stage1 = (REAL**)_aligned_malloc(sizeof(REAL *)*n1y, 64);
 		stage1[0] = (REAL*)_aligned_malloc(sizeof(REAL)*n1x*n1y, 64);
 
+		// row 0 needs clearing too: its last tap is past the end of the filter
+		for(j=0;j<n1x;j++) stage1[0][j] = 0;
+
 		for(i=1;i<n1y;i++) {
 		  stage1[i] = &(stage1[0][n1x*i]);
 		  for(j=0;j<n1x;j++) stage1[i][j] = 0;
@@ -366,6 +376,9 @@ public:
 		inbuf  = (REAL*)_aligned_malloc(nch*(n2b2+n1x)*sizeof(REAL), 64);
 		outbuf = (REAL*)_aligned_malloc(sizeof(REAL)*nch*(n2b2/osf+1), 64);
 
+		// the first block reads inbuflen samples of history
+		memset(inbuf, 0, nch*(n2b2+n1x)*sizeof(REAL));
+
 		s1p = 0;
 		rp  = 0;
 		ds  = 0;
@@ -378,6 +391,19 @@ public:
 
 		sumread = sumwrite = 0;
 
+		// Each block filters n2b2 samples at fs2; find the number of blocks
+		// after which all phase counters are back where they started.
+		{
+		  __int64 t = n2b2;
+		  const __int64 rpstep = n2b2 * (sfrq / frqgcd) / osf;
+
+		  while (t % (n1y*osf) != 0 || t % osf != 0 || (t*sfrq) % fs2 != 0 || (t/n2b2*rpstep) % (fs1/sfrq) != 0)
+			t += n2b2;
+
+		  period = (unsigned int)(t*sfrq/fs2);
+		  preroll = 4*(n2b2*sfrq/fs2+n1x+1);
+		}
+
 	}
 
 
@@ -616,6 +642,13 @@ public:
 template<class REAL>
 class Downsampler : public Resampler_i_base<REAL>
 {
+  // the members of the dependent base, for two phase name lookup
+  typedef Resampler_i_base<REAL> base;
+  using typename base::CONFIG;
+  using base::nch; using base::sfrq; using base::dfrq; using base::gain;
+  using base::AA; using base::DF; using base::FFTFIRLEN; using base::period; using base::preroll;
+  using base::make_inbuf; using base::make_outbuf; using base::__output;
+
 private:
   int frqgcd,osf,fs1,fs2;
   REAL *stage1,**stage2;
@@ -772,6 +805,9 @@ public:
     stage2 = (REAL**)_aligned_malloc(sizeof(REAL *)*n2y, 64);
     stage2[0] = (REAL*)_aligned_malloc(sizeof(REAL)*n2x*n2y, 64);
 
+    // row 0 needs clearing too: its last tap is past the end of the filter
+    for(j=0;j<n2x;j++) stage2[0][j] = 0;
+
     for(i=1;i<n2y;i++) {
       stage2[i] = &(stage2[0][n2x*i]);
       for(j=0;j<n2x;j++) stage2[i][j] = 0;
@@ -807,11 +843,12 @@ public:
     buf2 = (REAL**)_aligned_malloc(sizeof(REAL *)*nch, 64);
     for(i=0;i<nch;i++) {
       buf2[i] = (REAL*)_aligned_malloc(sizeof(REAL)*(n2x+1+n1b2), 64);
-      for(j=0;j<n2x+n1b2;j++) buf2[i][j] = 0;
+      for(j=0;j<n2x+1+n1b2;j++) buf2[i][j] = 0;
     }
 
     //rawoutbuf = (unsigned char*)malloc(dbps*nch*((double)n1b2*sfrq/dfrq+1));
     inbuf = (REAL*)_aligned_malloc(nch*(n1b2/osf+osf+1)*sizeof(REAL), 64);
+    memset(inbuf, 0, nch*(n1b2/osf+osf+1)*sizeof(REAL));
     outbuf = (REAL*)_aligned_malloc(sizeof(REAL)*nch*((double)n1b2*sfrq/dfrq+1), 64);
 
     op = outbuf;
@@ -830,6 +867,18 @@ public:
 
     sumread = sumwrite = 0;
 
+    // Each block filters n1b2 samples at fs1; find the number of blocks
+    // after which all phase counters are back where they started.
+    {
+      __int64 t = n1b2;
+
+      while (t % osf != 0 || (t*dfrq) % fs1 != 0 || (t*dfrq/fs1) % n2y != 0 || (t*dfrq/fs1*(fs2/dfrq)) % (fs2/fs1) != 0)
+        t += n1b2;
+
+      period = (unsigned int)(t/osf);
+      preroll = 4*(n1b2/osf+1)+n2x;
+    }
+
 
 
   };
@@ -1036,6 +1085,7 @@ Resampler_base::Resampler_base(const CONFIG & c)
 	nch=c.nch;
 	sfrq=c.sfrq;
 	dfrq=c.dfrq;
+	period=preroll=0;
 	
 	double noiseamp = 0.18;
 	//double att=0;
@@ -1043,7 +1093,7 @@ Resampler_base::Resampler_base(const CONFIG & c)
 
 }
 
-Resampler_base * Resampler_base::Create(CONFIG & c)
+Resampler_base * Resampler_base::Create(const CONFIG & c)
 {
 	if (!CanResample(c.sfrq,c.dfrq)) return 0;
 
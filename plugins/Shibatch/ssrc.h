@@ -86,6 +86,8 @@ protected:
 	double AA,DF;
 	int FFTFIRLEN;
 
+	unsigned int period,preroll;
+
 public:
 	double GetPeak() {return peak;}//havent tested if this actually still works
 	
@@ -99,9 +101,16 @@ public:
 
 	_inline unsigned int GetDataInInbuf() {return in.Size();}
 
+	// Input samples (per channel) after which the block structure repeats. A
+	// new instance that is fed the same input from a multiple of GetPeriod()
+	// samples later produces bit-identical output, once it has been fed
+	// GetPreroll() samples.
+	_inline unsigned int GetPeriod() {return period;}
+	_inline unsigned int GetPreroll() {return preroll;}
+
 	virtual ~Resampler_base() {}
 
-	static Resampler_base * Create(CONFIG & c);
+	static Resampler_base * Create(const CONFIG & c);
 };
 
 #define SSRC_create(sfrq,dfrq,nch,dither,pdf,fast) \
@@ -22,8 +22,9 @@ Copyright 
 *******************************************************/
 
 #include <math.h>
-#include "supereq.h"
 #include "paramlist.h"
+#include "supereq.h"
+#include "fftconv.h"
 #include <vector>
 #include <avs/minmax.h>
 #include <avisynth.h>
@@ -53,25 +54,21 @@ static void setup_bands(const eq_config & src,double dst[N_BANDS])
 class AVSsupereq : public GenericVideoFilter 
 {
 private:
-	std::vector<supereq_base*> eqs;
 	paramlist paramroot;
 	eq_config my_eq;
 
-  int dstbuffer_size;
-  int dst_samples_filled;
+  FFTConvolver* conv;
+  int taps;
+  int input_samples;
 
-  SFLOAT* dstbuffer;
-  SFLOAT* passbuffer;
+  SFLOAT* srcbuffer;
   __int64 next_sample;
   __int64 inputReadOffset;
 
 public:
 AVSsupereq(PClip _child, const char* filename, IScriptEnvironment* env)
-: GenericVideoFilter(_child)
+: GenericVideoFilter(_child), conv(0), srcbuffer(0)
 {
-  const unsigned last_nch   = (unsigned)vi.AudioChannels();
-  const unsigned last_srate = (unsigned)vi.audio_samples_per_second;
-  
   FILE *settingsfile;
   settingsfile = fopen(filename, "r");		
   
@@ -88,150 +85,98 @@ AVSsupereq(PClip _child, const char* filename, IScriptEnvironment* env)
     env->ThrowError("SuperEQ: Could not open file");
   }
   
-  unsigned n;
-  for(n=0;n<last_nch;n++)
-    eqs.push_back(new supereq<float>);
-  double bands[N_BANDS];
-  //    my_eq = cfg_eq;
-  setup_bands(my_eq,bands);
-  for(n=0;n<last_nch;n++)
-    eqs[n]->equ_makeTable(bands,&paramroot,(double)last_srate);
-
-  dstbuffer = new SFLOAT[last_srate * last_nch];  // Our buffer can minimum contain one second.
-  passbuffer = new SFLOAT[last_srate];  // Our buffer can minimum contain one second.
-  dstbuffer_size = last_srate;
-
-  next_sample = 0;  // Next output sample
-  inputReadOffset = 0;  // Next input sample
-  dst_samples_filled = 0;
+  init(env);
 }
 
 AVSsupereq(PClip _child, int* values, IScriptEnvironment* env)
-: GenericVideoFilter(_child)
+: GenericVideoFilter(_child), conv(0), srcbuffer(0)
 {
-  const unsigned last_nch   = (unsigned)vi.AudioChannels();
-  const unsigned last_srate = (unsigned)vi.audio_samples_per_second;
-  
   unsigned n;
   for(n=0; n<N_BANDS; n++) {
       my_eq.bands[n] = (-values[n]+20);
   }
   
-  for(n=0; n<last_nch; n++)
-    eqs.push_back(new supereq<float>);
+  init(env);
+}
+private:
 
+// Designs the FIR and sets up one convolver for all channels.
+void init(IScriptEnvironment* env)
+{
+  const int last_nch   = vi.AudioChannels();
+  const int last_srate = vi.audio_samples_per_second;
+
+  supereq<float> eq;
   double bands[N_BANDS];
   //    my_eq = cfg_eq;
   setup_bands(my_eq, bands);
 
-  for(n=0; n<last_nch; n++)
-    eqs[n]->equ_makeTable(bands, &paramroot, (double)last_srate);
+  taps = eq.taps();
+  std::vector<float> ires(taps);
+  eq.equ_makeTable(bands, &paramroot, (double)last_srate, &ires[0]);
+
+  conv = new FFTConvolver(eq.fftbits(), taps, last_nch, env->GetCPUFlags());
+  for (int n = 0; n < last_nch; n++)
+    conv->SetResponse(n, &ires[0]);
 
-  dstbuffer = new SFLOAT[last_srate * last_nch];  // Our buffer can minimum contain one second.
-  passbuffer = new SFLOAT[last_srate];  // Our buffer can minimum contain one second.
-  dstbuffer_size = last_srate;
+  input_samples = last_srate;  // We filter at most one second per loop.
+  srcbuffer = new SFLOAT[last_srate * last_nch];
 
-  next_sample = 0;  // Next output sample
-  inputReadOffset = 0;  // Next input sample
-  dst_samples_filled = 0;
+  restart(0);
 }
-private:
 
-void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+// Positions the convolver for output from start. The FIR is centred on its
+// middle tap, so output sample t needs the input from t-taps/2 to t+taps/2;
+// reading starts that far back and the convolver's output before start is
+// skipped.
+void restart(__int64 start)
 {
-  const unsigned last_nch   = (unsigned)vi.AudioChannels();
-  const unsigned last_srate = (unsigned)vi.audio_samples_per_second;
-
-  if (start != next_sample) {  // Reset on seek
-    inputReadOffset = start;  // Reset at new read position.
-    dst_samples_filled=0;
-
-    for (size_t i = 0; i < eqs.size(); ++i)
-      delete eqs[i];
-    eqs.clear();
-
-    unsigned n;
-    for(n=0;n<last_nch;n++)
-      eqs.push_back(new supereq<float>);
-    double bands[N_BANDS];
-    setup_bands(my_eq,bands);
-    for(n=0;n<last_nch;n++)
-      eqs[n]->equ_makeTable(bands,&paramroot,(double)last_srate);
-  }
+  conv->Reset();
+  inputReadOffset = start - (taps - 1 - taps/2);
+  next_sample = inputReadOffset - conv->Latency() - taps/2;
+}
 
-  bool buffer_full = false;
-  int samples_filled = 0;
-
-  do {
-    // Empty buffer if something is still left.
-    if (dst_samples_filled) {
-      int copysamples = min((int)count-samples_filled, dst_samples_filled);
-      // Copy finished samples
-      int pitch = copysamples*last_nch*sizeof(SFLOAT);
-      env->BitBlt((BYTE*)buf+samples_filled*last_nch*sizeof(SFLOAT), pitch,
-        (BYTE*)dstbuffer, pitch,
-        pitch, 1
-      );
-      dst_samples_filled -= copysamples;
-
-      if (dst_samples_filled) { // Move non-used samples
-        memcpy(dstbuffer, &dstbuffer[copysamples*last_nch], dst_samples_filled*sizeof(SFLOAT)*last_nch);
-      }
-      samples_filled += copysamples;
-      if (samples_filled >= count)
-        buffer_full = true;
+// Filters the next count samples into dst, or drops them if dst is NULL.
+void filter(SFLOAT* dst, __int64 count, IScriptEnvironment* env)
+{
+  const int last_nch = vi.AudioChannels();
+
+  while (count > 0) {
+    const int n = (int)min<__int64>(count, input_samples);
+
+    // Input before the start of the clip is silence
+    if (inputReadOffset + n <= 0) {
+      memset(srcbuffer, 0, n * last_nch * sizeof(SFLOAT));
+    } else if (inputReadOffset < 0) {
+      const int zeros = int(-inputReadOffset);
+      memset(srcbuffer, 0, zeros * last_nch * sizeof(SFLOAT));
+      child->GetAudio(srcbuffer + zeros * last_nch, 0, n - zeros, env);
+    } else {
+      child->GetAudio(srcbuffer, inputReadOffset, n, env);
     }
-    // If buffer empty - refill
-    if (dst_samples_filled<=0) {
-      // Feed new samples to filter
-      child->GetAudio(dstbuffer, inputReadOffset, last_srate, env);
-      inputReadOffset += last_srate;
-
-      {for (unsigned n=0; n<last_nch; n++) { // Copies n channels to separate buffers to individual filters
-        SFLOAT *db = dstbuffer + n;
-        for (unsigned s=0, r=0; s<last_srate; s++, r+=last_nch)
-          passbuffer[s] = db[r];
-
-        eqs[n]->write_samples(passbuffer, last_srate);
-      }}
-
-      // Read back samples from filter
-      int samples_out = 0;
-      {for (unsigned n=0; n<last_nch; n++) { // Copies back samples from individual filters
-        SFLOAT *data_out = eqs[n]->get_output(&samples_out);
-        // Check temp buffer size
-        if (dstbuffer_size < samples_out) {
-          if (n) { // Extremely unlikely but if it happens we need to transcribe the old buf.
-            SFLOAT *db = new SFLOAT[samples_out*last_nch];
-            if (dstbuffer_size) {
-              memcpy(db, dstbuffer, dstbuffer_size*sizeof(SFLOAT)*last_nch);
-              delete[] dstbuffer;
-			}
-            dstbuffer = db;
-            dstbuffer_size = samples_out;
-          }
-          else {
-            if (dstbuffer_size)
-              delete[] dstbuffer;
-            dstbuffer = new SFLOAT[samples_out*last_nch];
-            dstbuffer_size = samples_out;
-          }
-        }
-        SFLOAT *db = dstbuffer + n;
-        for (int s=0, r=0; s<samples_out; s++, r+=last_nch)
-          db[r] = data_out[s];
-      }}
-      dst_samples_filled = samples_out;
-    }  
-  } while (!buffer_full);
-  next_sample += count;
+    inputReadOffset += n;
+
+    conv->Process(srcbuffer, dst, n);
+    if (dst)
+      dst += n * last_nch;
+    count -= n;
+  }
+}
+
+void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+{
+  // Reset on seek, unless skipping ahead is less work
+  if (start < next_sample || start - next_sample > conv->Latency() + taps)
+    restart(start);
+
+  filter(NULL, start - next_sample, env);  // Skip
+  filter((SFLOAT*)buf, count, env);
+  next_sample = start + count;
 }
 	~AVSsupereq()
 	{
-    delete[] dstbuffer;
-    delete[] passbuffer;
-    for (size_t i = 0; i < eqs.size(); ++i)
-      delete eqs[i];
+    delete[] srcbuffer;
+    delete conv;
 	}
 
 
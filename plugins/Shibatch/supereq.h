@@ -25,33 +25,19 @@ Copyright 
 #define _SUPEREQ_H_
 
 #include <avisynth.h>
-#include <malloc.h>
+#include <math.h>
 #include <cstring>
-#include "PFC/mem_block.h"
+#include "paramlist.h"
 
-typedef SFLOAT audio_sample;
-typedef audio_sample REAL_inout;
-
-#include "fft.h"
+#define PI 3.1415926535897932384626433832795
 
 AVSValue __cdecl Create_SuperEq(AVSValue args, void*, IScriptEnvironment* env);
 AVSValue __cdecl Create_SuperEqCustom(AVSValue args, void*, IScriptEnvironment* env);
 
 
-class _declspec(novtable) supereq_base
-{
-public:
-	virtual void equ_makeTable(double *bc,class paramlist *param,double fs);
-	virtual void equ_clearbuf();
-
-	virtual void write_samples(audio_sample*buf,int nsamples);
-	virtual audio_sample * get_output(int *nsamples);
-	virtual int samples_buffered();
-	virtual ~supereq_base() {};
-};
-
+// Designs the equalizer FIR; the filtering itself is done by FFTConvolver.
 template<class REAL>
-class supereq : public supereq_base
+class supereq
 {
 public:
 	enum {NBANDS = 17};
@@ -62,50 +48,10 @@ private:
 		M=15
 	};
 
-	int rfft_ipsize,rfft_wsize;
-	int *rfft_ip;
-	REAL *rfft_w;
-
-  
 	REAL fact[M+1];
 	REAL aa;
 	REAL iza;
-	REAL *lires,*lires1,*lires2,*irest;
-	REAL *fsamples;
-	REAL *ditherbuf;
-	volatile int chg_ires,cur_ires;
-	int winlen,winlenbit,tabsize,nbufsamples;
-	int firstframe;
-
-	mem_block_t<REAL> inbuf,outbuf;
-	mem_block_t<audio_sample> done;
-	int samples_done;
-
-	void rfft(int n,int isign,REAL x[])
-	{
-		int newipsize,newwsize;
-
-		if (n == 0) {
-			free(rfft_ip); rfft_ip = NULL; rfft_ipsize = 0;
-			free(rfft_w);  rfft_w  = NULL; rfft_wsize  = 0;
-			return;
-		}
-
-		newipsize = 2+sqrt((float)(n/2));
-		if (newipsize > rfft_ipsize) {
-			rfft_ipsize = newipsize;
-			rfft_ip = mem_ops<int>::realloc_block(rfft_ip,rfft_ipsize);
-			rfft_ip[0] = 0;
-		}
-
-		newwsize = n/2;
-		if (newwsize > rfft_wsize) {
-			rfft_wsize = newwsize;
-			rfft_w = mem_ops<REAL>::realloc_block(rfft_w,rfft_wsize);
-		}
-
-		fft<REAL>::rdft(n,isign,x,rfft_ip,rfft_w);
-	}
+	int winlen,winlenbit;
 
 	REAL izero(REAL x)
 	{
@@ -128,27 +74,8 @@ private:
 	{
 		  int i,j;
 
-		  if (lires1 != NULL)   free(lires1);
-		  if (lires2 != NULL)   free(lires2);
-		  if (irest != NULL)    free(irest);
-		  if (fsamples != NULL) free(fsamples);
-
 		  winlen = (1 << (wb-1))-1;
 		  winlenbit = wb;
-		  tabsize  = 1 << wb;
-
-		  lires1   = mem_ops<REAL>::alloc_zeromem(tabsize);
-		  lires2   = mem_ops<REAL>::alloc_zeromem(tabsize);
-		  irest    = mem_ops<REAL>::alloc_zeromem(tabsize);
-		  fsamples = mem_ops<REAL>::alloc_zeromem(tabsize);
-		  inbuf.set_size(winlen);
-		  inbuf.zeromemory();
-		  outbuf.set_size(tabsize);
-		  outbuf.zeromemory();
-
-		  lires = lires1;
-		  cur_ires = 1;
-		  chg_ires = 1;
 
 		  for(i=0;i<=M;i++)
 			{
@@ -290,35 +217,23 @@ static const double bands[NBANDS] = { // Half octave spacing, i.e. *=sqrt(2.0)
 public:
 	supereq(int wb=14)
 	{
-		firstframe=1;
-		rfft_ipsize = 0;
-		rfft_wsize=0;
-		rfft_ip = NULL;
-		rfft_w = NULL;
-
 		aa = 96;
 		memset(fact,0,sizeof(fact));
 		iza=0;
-		lires=0;
-		lires1=0;
-		lires2=0;
-		irest=0;
-		fsamples=0;
-		ditherbuf=0;
-		chg_ires=0;
-		cur_ires=0;
 		winlen=0;
 		winlenbit=0;
-		tabsize=0;
-		nbufsamples=0;
-		samples_done=0;
 		equ_init(wb);
 	}
 
-	void equ_makeTable(double *bc,class paramlist *param,double fs)
+	// Number of FIR coefficients, and log2 of the transform size that fits it
+	int taps() const {return winlen;}
+	int fftbits() const {return winlenbit;}
+
+	// Computes the taps() coefficients of the FIR for the band gains bc
+	// into ires. The filter is symmetric around its centre tap taps()/2.
+	void equ_makeTable(double *bc,class paramlist *param,double fs,float *ires)
 	{
-		int i,cires = cur_ires;
-		REAL *nires;
+		int i;
 
 		if (fs <= 0) return;
 
@@ -329,138 +244,7 @@ public:
 		process_param(bc,param,param2,fs,0);
 
 		for(i=0;i<winlen;i++)
-			irest[i] = hn(i-winlen/2,param2,fs)*win(i-winlen/2,winlen);
-
-		for(;i<tabsize;i++)
-			irest[i] = 0;
-
-		rfft(tabsize,1,irest);
-
-		nires = cires == 1 ? lires2 : lires1;
-
-		for(i=0;i<tabsize;i++)
-			nires[i] = irest[i];
-
-
-		chg_ires = cires == 1 ? 2 : 1;
-
-	}
-
-	void equ_clearbuf()
-	{
-		firstframe = 1;
-		samples_done = 0;
-		nbufsamples = 0;
-	}
-
-	void write_samples(audio_sample*buf,int nsamples)
-	{
-		int i,p;
-		REAL *ires;
-
-		if (chg_ires) {
-			cur_ires = chg_ires;
-			lires = cur_ires == 1 ? lires1 : lires2;
-			chg_ires = 0;
-		}
-
-		p = 0;
-
-		int flush_length = 0;
-
-		if (!buf)//flush
-		{
-			if (nbufsamples==0) return;
-			flush_length = nbufsamples;
-			nsamples = winlen - nbufsamples;
-		}
-
-		while(nbufsamples+nsamples >= winlen)
-		{
-			if (buf)
-			{
-				for(i=0;i<winlen-nbufsamples;i++)
-					inbuf[nbufsamples+i] = (REAL)buf[i+p];
-			}
-			else
-			{
-				for(i=0;i<winlen-nbufsamples;i++)
-					inbuf[nbufsamples+i]=0;
-			}
-
-			for(i=winlen;i<tabsize;i++)
-				outbuf[i-winlen] = outbuf[i];
-
-
-			p += winlen-nbufsamples;
-			nsamples -= winlen-nbufsamples;
-			nbufsamples = 0;
-
-			ires = lires;
-			for(i=0;i<winlen;i++)
-				fsamples[i] = inbuf[i];
-
-			for(i=winlen;i<tabsize;i++)
-				fsamples[i] = 0;
-
-			rfft(tabsize,1,fsamples);
-
-			fsamples[0] = ires[0]*fsamples[0];
-			fsamples[1] = ires[1]*fsamples[1]; 
-
-			for(i=1;i<tabsize/2;i++)
-			{
-				REAL re,im;
-				re = ires[i*2  ]*fsamples[i*2] - ires[i*2+1]*fsamples[i*2+1];
-				im = ires[i*2+1]*fsamples[i*2] + ires[i*2  ]*fsamples[i*2+1];
-
-				fsamples[i*2  ] = re;
-				fsamples[i*2+1] = im;
-			}
-			rfft(tabsize,-1,fsamples);
-
-			for(i=0;i<winlen;i++) outbuf[i] += fsamples[i]/tabsize*2;
-
-			for(i=winlen;i<tabsize;i++) outbuf[i] = fsamples[i]/tabsize*2;
-
-			int out_length = flush_length>0 ? flush_length+winlen/2 : winlen;
-
-			done.check_size(samples_done + out_length);
-
-			for(i=firstframe ? winlen/2 : 0;i<out_length;i++)
-			{
-				done[samples_done++]=outbuf[i];
-			}
-			firstframe=0;
-		}
-
-		if (buf)
-		{
-			for(i=0;i<nsamples;i++)
-			{
-				inbuf[nbufsamples+i] = (REAL)buf[i+p];
-			}
-			p += nsamples;
-		}
-		nbufsamples += nsamples;
-	}
-
-	audio_sample * get_output(int *nsamples)
-	{
-		*nsamples = samples_done;
-		samples_done = 0;
-		return done.get_ptr();
-	}
-	
-	int samples_buffered() {return nbufsamples;}
-	
-	~supereq()
-	{
-		if (lires1) free(lires1);
-		if (lires2) free(lires2);
-		if (irest) free(irest);
-		if (fsamples) free(fsamples);
-		rfft(0,0,NULL);
+			ires[i] = hn(i-winlen/2,param2,fs)*win(i-winlen/2,winlen);
 	}
 };
 
@@ -759,7 +759,12 @@ TDStretch * TDStretch::newInstance()
 
 
 #ifdef SOUNDTOUCH_ALLOW_SSE
-    if (uExtensions & SUPPORT_SSE)
+    if (uExtensions & SUPPORT_AVX2)
+    {
+        // AVX2 + FMA support
+        return ::new TDStretchAVX2;
+    }
+    else if (uExtensions & SUPPORT_SSE)
     {
         // SSE support
         return ::new TDStretchSSE;
@@ -4,8 +4,8 @@
 /// while maintaining the original pitch by using a time domain WSOLA-like method 
 /// with several performance-increasing tweaks.
 ///
-/// Note : MMX/SSE optimized functions reside in separate, platform-specific files 
-/// 'mmx_optimized.cpp' and 'sse_optimized.cpp'
+/// Note : MMX/SSE/AVX2 optimized functions reside in separate, platform-specific files 
+/// 'mmx_optimized.cpp', 'sse_optimized.cpp' and 'avx2_optimized.cpp'
 ///
 /// Author        : Copyright (c) Olli Parviainen
 /// Author e-mail : oparviai 'at' iki.fi
@@ -275,6 +275,17 @@ public:
         double calcCrossCorrAccumulate(const float *mixingPos, const float *compare, double &norm);
     };
 
+    /// Class that implements AVX2/FMA optimized routines for floating point samples type.
+    class TDStretchAVX2 : public TDStretch
+    {
+    protected:
+        double calcCrossCorr(const float *mixingPos, const float *compare, double &norm);
+        double calcCrossCorrAccumulate(const float *mixingPos, const float *compare, double &norm);
+        virtual void overlapStereo(float *output, const float *input) const;
+        virtual void overlapMono(float *output, const float *input) const;
+        virtual void overlapMulti(float *output, const float *input) const;
+    };
+
 #endif /// SOUNDTOUCH_ALLOW_SSE
 
 }
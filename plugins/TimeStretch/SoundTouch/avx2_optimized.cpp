@@ -0,0 +1,205 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// AVX2/FMA optimized routines for Haswell, Excavator and later CPUs. Like
+/// sse_optimized.cpp, all AVX2 optimized functions are gathered into this
+/// single source code file.
+///
+/// This file is compiled with the AVX2 and FMA instruction sets enabled (see
+/// CMakeLists.txt); nothing in here may be called unless detectCPUextensions()
+/// reports SUPPORT_AVX2.
+///
+/// Unlike the SSE routines, these use unaligned loads and evaluate every
+/// candidate position: on CPUs that have AVX2 an unaligned load costs the same
+/// as an aligned one, so there is no reason to skip odd stereo offsets.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "cpu_detect.h"
+#include "STTypes.h"
+
+using namespace soundtouch;
+
+#ifdef SOUNDTOUCH_ALLOW_SSE
+
+// AVX2 routines available only with float sample type
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// implementation of AVX2 optimized functions of class 'TDStretchAVX2'
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "TDStretch.h"
+#include <immintrin.h>
+#include <math.h>
+
+// Sums the eight lanes of v
+static inline float hsum256(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+
+// Calculates cross correlation of two buffers
+double TDStretchAVX2::calcCrossCorr(const float *pV1, const float *pV2, double &anorm)
+{
+    int i;
+    const int count = channels * overlapLength;
+    __m256 vSum0, vSum1, vNorm0, vNorm1;
+
+    // ensure overlapLength is divisible by 8
+    assert((overlapLength % 8) == 0);
+
+    vSum0 = vSum1 = vNorm0 = vNorm1 = _mm256_setzero_ps();
+
+    // Two independent accumulator pairs hide the FMA latency
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m256 vTemp0 = _mm256_loadu_ps(pV1 + i);
+        __m256 vTemp1 = _mm256_loadu_ps(pV1 + i + 8);
+        vSum0  = _mm256_fmadd_ps(vTemp0, _mm256_loadu_ps(pV2 + i), vSum0);
+        vSum1  = _mm256_fmadd_ps(vTemp1, _mm256_loadu_ps(pV2 + i + 8), vSum1);
+        vNorm0 = _mm256_fmadd_ps(vTemp0, vTemp0, vNorm0);
+        vNorm1 = _mm256_fmadd_ps(vTemp1, vTemp1, vNorm1);
+    }
+    if (i < count)
+    {
+        __m256 vTemp0 = _mm256_loadu_ps(pV1 + i);
+        vSum0  = _mm256_fmadd_ps(vTemp0, _mm256_loadu_ps(pV2 + i), vSum0);
+        vNorm0 = _mm256_fmadd_ps(vTemp0, vTemp0, vNorm0);
+    }
+
+    float norm = hsum256(_mm256_add_ps(vNorm0, vNorm1));
+    anorm = norm;
+
+    return (double)hsum256(_mm256_add_ps(vSum0, vSum1)) / sqrt(norm < 1e-9 ? 1.0 : norm);
+}
+
+
+// Update cross-correlation by accumulating "norm" coefficient by previously calculated value
+double TDStretchAVX2::calcCrossCorrAccumulate(const float *pV1, const float *pV2, double &norm)
+{
+    int i;
+    const int count = channels * overlapLength;
+    __m256 vSum0, vSum1;
+
+    // cancel first normalizer tap from previous round
+    for (i = 1; i <= channels; i ++)
+    {
+        norm -= pV1[-i] * pV1[-i];
+    }
+
+    vSum0 = vSum1 = _mm256_setzero_ps();
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        vSum0 = _mm256_fmadd_ps(_mm256_loadu_ps(pV1 + i),     _mm256_loadu_ps(pV2 + i),     vSum0);
+        vSum1 = _mm256_fmadd_ps(_mm256_loadu_ps(pV1 + i + 8), _mm256_loadu_ps(pV2 + i + 8), vSum1);
+    }
+    if (i < count)
+    {
+        vSum0 = _mm256_fmadd_ps(_mm256_loadu_ps(pV1 + i), _mm256_loadu_ps(pV2 + i), vSum0);
+    }
+
+    // update normalizer with last samples of this round
+    for (i = count - channels; i < count; i ++)
+    {
+        norm += pV1[i] * pV1[i];
+    }
+
+    return (double)hsum256(_mm256_add_ps(vSum0, vSum1)) / sqrt(norm < 1e-9 ? 1.0 : norm);
+}
+
+
+// Overlaps samples in 'midBuffer' with the samples in 'pInput'. The weight
+// of each frame is computed from its index rather than accumulated, so that
+// the result does not depend on how the loop is vectorized.
+void TDStretchAVX2::overlapStereo(float *pOutput, const float *pInput) const
+{
+    const __m256 vScale = _mm256_set1_ps(1.0f / (float)overlapLength);
+    const __m256 vStep = _mm256_set1_ps(4.0f);
+    __m256 vFrame = _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+
+    // 2 * overlapLength is a multiple of 16
+    for (int i = 0; i < 2 * overlapLength; i += 8)
+    {
+        __m256 vMid = _mm256_loadu_ps(pMidBuffer + i);
+        __m256 vIn  = _mm256_loadu_ps(pInput + i);
+        // out = in * f1 + mid * (1 - f1)
+        _mm256_storeu_ps(pOutput + i, _mm256_fmadd_ps(_mm256_sub_ps(vIn, vMid), _mm256_mul_ps(vFrame, vScale), vMid));
+        vFrame = _mm256_add_ps(vFrame, vStep);
+    }
+}
+
+
+void TDStretchAVX2::overlapMono(float *pOutput, const float *pInput) const
+{
+    const __m256 vScale = _mm256_set1_ps(1.0f / (float)overlapLength);
+    const __m256 vStep = _mm256_set1_ps(8.0f);
+    __m256 vFrame = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (int i = 0; i < overlapLength; i += 8)
+    {
+        __m256 vMid = _mm256_loadu_ps(pMidBuffer + i);
+        __m256 vIn  = _mm256_loadu_ps(pInput + i);
+        _mm256_storeu_ps(pOutput + i, _mm256_fmadd_ps(_mm256_sub_ps(vIn, vMid), _mm256_mul_ps(vFrame, vScale), vMid));
+        vFrame = _mm256_add_ps(vFrame, vStep);
+    }
+}
+
+
+// Overlaps samples in 'midBuffer' with the samples in 'input'. Each frame is
+// processed in groups of eight channels, the last group with a masked load.
+void TDStretchAVX2::overlapMulti(float *pOutput, const float *pInput) const
+{
+    const float fScale = 1.0f / (float)overlapLength;
+    const int full = channels & ~7;
+    const int rest = channels & 7;
+    const __m256i vMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(rest), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+    for (int i2 = 0; i2 < overlapLength; i2 ++)
+    {
+        const __m256 vF1 = _mm256_set1_ps((float)i2 * fScale);
+        const int base = i2 * channels;
+        int c;
+
+        for (c = 0; c < full; c += 8)
+        {
+            __m256 vMid = _mm256_loadu_ps(pMidBuffer + base + c);
+            __m256 vIn  = _mm256_loadu_ps(pInput + base + c);
+            _mm256_storeu_ps(pOutput + base + c, _mm256_fmadd_ps(_mm256_sub_ps(vIn, vMid), vF1, vMid));
+        }
+        if (rest)
+        {
+            __m256 vMid = _mm256_maskload_ps(pMidBuffer + base + c, vMask);
+            __m256 vIn  = _mm256_maskload_ps(pInput + base + c, vMask);
+            _mm256_maskstore_ps(pOutput + base + c, vMask, _mm256_fmadd_ps(_mm256_sub_ps(vIn, vMid), vF1, vMid));
+        }
+    }
+}
+
+#endif // SOUNDTOUCH_ALLOW_SSE
@@ -50,6 +50,7 @@
 #define SUPPORT_ALTIVEC     0x0004
 #define SUPPORT_SSE         0x0008
 #define SUPPORT_SSE2        0x0010
+#define SUPPORT_AVX2        0x0020  ///< AVX2 and FMA3, with OS support for the YMM state
 
 /// Checks which instruction set extensions are supported by the CPU.
 ///
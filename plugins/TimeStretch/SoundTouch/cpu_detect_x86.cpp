@@ -45,10 +45,10 @@
 
 #if defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS)
 
-   #if defined(__GNUC__) && defined(__i386__)
+   #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
        // gcc
        #include "cpuid.h"
-   #elif defined(_M_IX86)
+   #elif defined(_M_IX86) || defined(_M_X64)
        // windows non-gcc
        #include <intrin.h>
    #endif
@@ -56,6 +56,13 @@
    #define bit_MMX     (1 << 23)
    #define bit_SSE     (1 << 25)
    #define bit_SSE2    (1 << 26)
+
+   // cpuid leaf 1 ecx
+   #define bit_FMA3    (1 << 12)
+   #define bit_OSXSAVE (1 << 27)
+   #define bit_AVX    (1 << 28)
+   // cpuid leaf 7 ebx
+   #define bit_AVX2   (1 << 5)
 #endif
 
 
@@ -76,16 +83,60 @@ void disableExtensions(uint dwDisableMask)
 
 
 
+#if defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS) && \
+    ((defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))) || defined(_M_IX86) || defined(_M_X64))
+
+/// Returns SUPPORT_AVX2 if the CPU has AVX2 and FMA3 and the OS saves the
+/// YMM registers on context switches, otherwise 0.
+static uint detectAVX2(void)
+{
+    unsigned int ecx1, ebx7, xcr0;
+
+#if defined(__GNUC__)
+    uint eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, 0) < 7) return 0;
+    __cpuid(1, eax, ebx, ecx, edx);
+    ecx1 = ecx;
+    if ((ecx1 & (bit_OSXSAVE | bit_AVX | bit_FMA3)) != (bit_OSXSAVE | bit_AVX | bit_FMA3)) return 0;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ebx7 = ebx;
+    __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    xcr0 = eax;
+#else
+    int reg[4] = {-1};
+
+    __cpuid(reg, 0);
+    if ((unsigned int)reg[0] < 7) return 0;
+    __cpuid(reg, 1);
+    ecx1 = (unsigned int)reg[2];
+    if ((ecx1 & (bit_OSXSAVE | bit_AVX | bit_FMA3)) != (bit_OSXSAVE | bit_AVX | bit_FMA3)) return 0;
+    __cpuidex(reg, 7, 0);
+    ebx7 = (unsigned int)reg[1];
+    xcr0 = (unsigned int)_xgetbv(0);
+#endif
+
+    // XMM and YMM state must both be enabled by the OS
+    if ((xcr0 & 6) != 6) return 0;
+
+    return (ebx7 & bit_AVX2) ? SUPPORT_AVX2 : 0;
+}
+
+#endif
+
+
 /// Checks which instruction set extensions are supported by the CPU.
 uint detectCPUextensions(void)
 {
 /// If building for a 64bit system (no Itanium) and the user wants optimizations.
-/// Return the OR of SUPPORT_{MMX,SSE,SSE2}. 11001 or 0x19.
+/// Return the OR of SUPPORT_{MMX,SSE,SSE2}. 11001 or 0x19, plus SUPPORT_AVX2 if available.
 /// Keep the _dwDisabledISA test (2 more operations, could be eliminated).
 #if ((defined(__GNUC__) && defined(__x86_64__)) \
     || defined(_M_X64))  \
     && defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS)
-    return 0x19 & ~_dwDisabledISA;
+    if (_dwDisabledISA == 0xffffffff) return 0;
+
+    return (0x19 | detectAVX2()) & ~_dwDisabledISA;
 
 /// If building for a 32bit system and the user wants optimizations.
 /// Keep the _dwDisabledISA test (2 more operations, could be eliminated).
@@ -124,6 +175,8 @@ uint detectCPUextensions(void)
 
 #endif
 
+    res = res | detectAVX2();
+
     return res & ~_dwDisabledISA;
 
 #else
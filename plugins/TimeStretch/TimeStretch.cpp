@@ -37,62 +37,149 @@
 
 
 #include <vector>
+#include <cmath>
+#include <cstdlib>
 #include <avisynth.h>
+#include <avs/cpuid.h>
 #include <avs/minmax.h>
 #include "SoundTouch/SoundTouch.h"
+#include "SoundTouch/cpu_detect.h"
 
 
 #define BUFFERSIZE 8192
 
+// Output is produced in fixed segments of SEGMENT_SECONDS, each by its own
+// SoundTouch instance.  An instance starts a short pre-roll before its
+// segment so it is in steady state by then, and runs a few milliseconds
+// past the end of its segment to be crossfaded into the next one.  Every
+// output sample thus depends only on its segment and the one before: seeks
+// are sample exact and repeatable, and re-priming after a seek costs at
+// most two segments.
+#define SEGMENT_SECONDS 30
+
+// Two instances find different overlap positions, so their outputs are
+// offset by up to a seek window.  The next segment is crossfaded in at the
+// offset that correlates best with the previous one, and then eased back
+// to its own timing over ALIGN_RAMP samples per sample of offset.  The
+// pitch moves by 1/ALIGN_RAMP on average meanwhile.
+#define ALIGN_RAMP 64
+
 using namespace soundtouch;
 
 
+// SoundTouch picks its kernels from CPUID whenever an instance is created,
+// this hides what SetMaxCPU took away from it.  The mask is global to the
+// library, as the SetMaxCPU level is to the process.
+static void selectExtensions(IScriptEnvironment* env)
+{
+  const int cpu = env->GetCPUFlags();
+  uint disabled = 0;
+  if (!(cpu & CPUF_MMX))
+    disabled |= SUPPORT_MMX;
+  if (!(cpu & CPUF_3DNOW))
+    disabled |= SUPPORT_3DNOW;
+  if (!(cpu & CPUF_SSE))
+    disabled |= SUPPORT_SSE;
+  if (!(cpu & CPUF_SSE2))
+    disabled |= SUPPORT_SSE2;
+  if (!(cpu & CPUF_AVX2) || !(cpu & CPUF_FMA3))
+    disabled |= SUPPORT_AVX2;
+  disableExtensions(disabled);
+}
+
+
 class AVSsoundtouch : public GenericVideoFilter 
 {
 private:
-  SoundTouch* sampler;
+  // A run of adjacent channels stretched by one SoundTouch instance.  With
+  // channelgroup > 0 each group finds its own overlap positions, and the
+  // groups are fed in parallel on the ThreadPool.
+  struct Group {
+    SoundTouch* sampler;
+    int first, channels;
+    std::vector<SFLOAT> in;   // deinterleaved input, only used with several groups
+    std::vector<SFLOAT> out;
+    int out_offset, out_count;
+
+    Group() : sampler(new SoundTouch()), first(0), channels(0), out_offset(0), out_count(0) {}
+    ~Group() { delete sampler; }
+  };
+
+  struct Chain {
+    std::vector<Group*> groups;
+    IJobCompletion* completion;  // NULL when the groups are fed on the calling thread
+    __int64 segment;
+    __int64 pos;          // output position of the next sample read
+    __int64 input_pos;    // next input sample to feed
+
+    Chain() : completion(0), segment(0), pos(0), input_pos(0) {}
+    ~Chain() {
+      if (completion)
+        completion->Destroy();
+      for (size_t i = 0; i < groups.size(); i++)
+        delete groups[i];
+    }
+  };
+
+  Chain* chain;             // segment currently being played
+  std::vector<SFLOAT> inbuffer;
+  std::vector<SFLOAT> head; // output over the first head_len samples of head_segment, see spliceSegment
+  int head_len;
+  __int64 head_segment;
+
+  float tempo, rate, pitch;
+  AVSValue settings[5];
+  int group_channels;
 
-  int dst_samples_filled;
+  __int64 segment_len;      // all in output samples
+  __int64 preroll;
+  int xfade;
+  int seekwin;              // largest offset searched between two segments
+  int max_head;             // largest head_len
 
-  SFLOAT* dstbuffer;
-  __int64 next_sample;
-  __int64 inputReadOffset;
   long double sample_multiplier; // 64bit mantissa!
 
 public:
 static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
 
-AVSsoundtouch(PClip _child, float _tempo, float _rate, float _pitch, const AVSValue* args, IScriptEnvironment* env)
-: GenericVideoFilter(_child)
+AVSsoundtouch(PClip _child, float _tempo, float _rate, float _pitch, const AVSValue* args, int _group_channels, IScriptEnvironment* env)
+: GenericVideoFilter(_child), chain(0), head_len(0), head_segment(-1)
 {
-  _tempo /= 100.0f;
-  _rate  /= 100.0f;
-  _pitch /= 100.0f;
+  tempo = _tempo / 100.0f;
+  rate  = _rate  / 100.0f;
+  pitch = _pitch / 100.0f;
 
-  dstbuffer = new SFLOAT[BUFFERSIZE * vi.AudioChannels()];
+  for (int i = 0; i < 5; i++)
+    settings[i] = args[i];
 
-  sample_multiplier  = _tempo / _pitch;  // Do it the same way the library does it!
-  sample_multiplier *= _pitch * _rate;
+  if (_group_channels < 0)
+    env->ThrowError("TimeStretch: channelgroup must not be negative.");
+  group_channels = (_group_channels == 0 || _group_channels > vi.AudioChannels()) ? vi.AudioChannels() : _group_channels;
 
-  sampler = new SoundTouch();
+  sample_multiplier  = tempo / pitch;  // Do it the same way the library does it!
+  sample_multiplier *= pitch * rate;
 
-  sampler->setRate(_rate);
-  sampler->setTempo(_tempo);
-  sampler->setPitch(_pitch);
-  sampler->setChannels(vi.AudioChannels());
-  sampler->setSampleRate(vi.audio_samples_per_second);
-  setSettings(sampler, args, env);
+  inbuffer.resize(BUFFERSIZE * vi.AudioChannels());
 
-  vi.num_audio_samples = (__int64)(vi.num_audio_samples / sample_multiplier);
+  // Size pre-roll and crossfade from the processing parameters.
+  selectExtensions(env);
+  SoundTouch probe;
+  setupSampler(&probe, vi.AudioChannels(), env);
 
-  next_sample = 0;  // Next output sample
-  inputReadOffset = 0;  // Next input sample
-  dst_samples_filled = 0;
+  const int sps = vi.audio_samples_per_second;
+  segment_len = (__int64)sps * SEGMENT_SECONDS;
+  preroll = max(sps / 4, 4 * probe.getSetting(SETTING_NOMINAL_OUTPUT_SEQUENCE) + probe.getSetting(SETTING_AA_FILTER_LENGTH));
+  preroll = min(preroll, segment_len / 2);
+  xfade = max(64, (int)((__int64)probe.getSetting(SETTING_OVERLAP_MS) * sps / 1000));
+  const int seek_ms = probe.getSetting(SETTING_SEEKWINDOW_MS);  // 0 is automatic, at most 25 ms
+  seekwin = (int)min((__int64)(seek_ms ? seek_ms : 25) * sps / 1000, preroll / 2);
+  max_head = xfade + (int)min((__int64)seekwin * ALIGN_RAMP, segment_len / 4) + seekwin + 2;
 
+  vi.num_audio_samples = (__int64)(vi.num_audio_samples / sample_multiplier);
 }
 
-static void AVSsoundtouch::setSettings(SoundTouch* sampler, const AVSValue* args, IScriptEnvironment* env)
+static void setSettings(SoundTouch* sampler, const AVSValue* args, IScriptEnvironment* env)
 {
 
   if (args[0].Defined()) sampler->setSetting(SETTING_SEQUENCE_MS,   args[0].AsInt());
@@ -114,63 +201,279 @@ static void AVSsoundtouch::setSettings(SoundTouch* sampler, const AVSValue* args
   
 }
 
-void __stdcall AVSsoundtouch::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+void setupSampler(SoundTouch* sampler, int channels, IScriptEnvironment* env)
+{
+  sampler->setRate(rate);
+  sampler->setTempo(tempo);
+  sampler->setPitch(pitch);
+  sampler->setChannels(channels);
+  sampler->setSampleRate(vi.audio_samples_per_second);
+  setSettings(sampler, settings, env);
+}
+
+Chain* openChain(__int64 segment, IScriptEnvironment* env)
+{
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+  const int channels = vi.AudioChannels();
+  Chain* c = new Chain();
+  try {
+    selectExtensions(env);
+    for (int first = 0; first < channels; first += group_channels) {
+      Group* g = new Group();
+      c->groups.push_back(g);
+      g->first = first;
+      g->channels = min(group_channels, channels - first);
+      setupSampler(g->sampler, g->channels, env);
+      g->out.resize(BUFFERSIZE * g->channels);
+      if (group_channels < channels)
+        g->in.resize(BUFFERSIZE * g->channels);
+    }
+    if (c->groups.size() > 1 && env2->GetProperty(AEP_THREADPOOL_THREADS) > 0)
+      c->completion = env2->NewCompletion(c->groups.size());
+  }
+  catch (...) {
+    delete c;
+    throw;
+  }
+  c->segment = segment;
+  c->pos = segment ? segment * segment_len - preroll : 0;
+  c->input_pos = (__int64)(sample_multiplier * c->pos);
+  return c;
+}
+
+static AVSValue FeedGroup(IScriptEnvironment2*, void* data)
+{
+  Group* g = static_cast<Group*>(data);
+  g->sampler->putSamples(&g->in[0], BUFFERSIZE);
+  return AVSValue();
+}
+
+// Feeds the next BUFFERSIZE input samples to every group of the chain.
+void feedChain(Chain* c, IScriptEnvironment* env)
 {
+  const int channels = vi.AudioChannels();
 
-  if (start != next_sample) {  // Reset on seek
-    sampler->clear();
-    next_sample = start;
-    inputReadOffset = (__int64)(sample_multiplier * start);  // Reset at new read position (NOT sample exact :( ).
-    dst_samples_filled=0;
+  child->GetAudio(&inbuffer[0], c->input_pos, BUFFERSIZE, env);
+  c->input_pos += BUFFERSIZE;
+
+  if (c->groups.size() == 1) {
+    c->groups[0]->sampler->putSamples(&inbuffer[0], BUFFERSIZE);
+    return;
+  }
+
+  for (size_t i = 0; i < c->groups.size(); i++) {
+    Group* g = c->groups[i];
+    const SFLOAT* src = &inbuffer[g->first];
+    SFLOAT* dst = &g->in[0];
+    for (int n = 0; n < BUFFERSIZE; n++, src += channels, dst += g->channels)
+      for (int ch = 0; ch < g->channels; ch++)
+        dst[ch] = src[ch];
+  }
+
+  if (!c->completion) {
+    for (size_t i = 0; i < c->groups.size(); i++)
+      FeedGroup(NULL, c->groups[i]);
+    return;
   }
 
-  bool buffer_full = false;
-  int samples_filled = 0;
-
-  do {
-    // Empty buffer if something is still left.
-    if (dst_samples_filled) {
-      int copysamples = min((int)count-samples_filled, dst_samples_filled);
-      // Copy finished samples
-      if (copysamples) { 
-        memcpy((BYTE*)buf+vi.BytesFromAudioSamples(samples_filled), (BYTE*)dstbuffer, (size_t)vi.BytesFromAudioSamples(copysamples));
-        samples_filled += copysamples;
-
-        dst_samples_filled -= copysamples;
-        // Move non-used samples
-        memcpy(dstbuffer, &dstbuffer[copysamples*vi.AudioChannels()], (size_t)vi.BytesFromAudioSamples(dst_samples_filled));
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+  for (size_t i = 0; i < c->groups.size(); i++)
+    env2->ParallelJob(FeedGroup, c->groups[i], c->completion);
+  c->completion->Wait();
+  try {
+    for (size_t i = 0; i < c->groups.size(); i++)
+      c->completion->Get(i);  // rethrows an exception from the job
+  }
+  catch (...) {
+    c->completion->Reset();
+    throw;
+  }
+  c->completion->Reset();
+}
+
+// Reads count samples from the chain into dst, or drops them if dst is NULL.
+void readChain(Chain* c, SFLOAT* dst, __int64 count, IScriptEnvironment* env)
+{
+  const int channels = vi.AudioChannels();
+
+  while (count > 0) {
+    // The groups get the same input, take what all of them have ready
+    int ready = BUFFERSIZE;
+    for (size_t i = 0; i < c->groups.size(); i++) {
+      Group* g = c->groups[i];
+      if (!g->out_count) {
+        g->out_offset = 0;
+        g->out_count = g->sampler->receiveSamples(&g->out[0], BUFFERSIZE);
+      }
+      ready = min(ready, g->out_count);
+    }
+    if (!ready) {  // Feed new samples to filter
+      feedChain(c, env);
+      continue;
+    }
+
+    int n = (int)min((__int64)ready, count);
+    for (size_t i = 0; i < c->groups.size(); i++) {
+      Group* g = c->groups[i];
+      if (dst) {
+        const SFLOAT* src = &g->out[g->out_offset * g->channels];
+        if (g->channels == channels) {
+          memcpy(dst, src, n * channels * sizeof(SFLOAT));
+        }
+        else {
+          SFLOAT* d = dst + g->first;
+          for (int k = 0; k < n; k++, src += g->channels, d += channels)
+            for (int ch = 0; ch < g->channels; ch++)
+              d[ch] = src[ch];
+        }
       }
-      if (samples_filled >= count)
-        buffer_full = true;
+      g->out_offset += n;
+      g->out_count -= n;
+    }
+    if (dst)
+      dst += n * channels;
+    c->pos += n;
+    count -= n;
+  }
+}
+
+// Offset within [-seekwin, seekwin] at which cur best continues prev, cur
+// holding seekwin more samples than prev on either side.
+int seekBestOffset(const SFLOAT* prev, const SFLOAT* cur, int count)
+{
+  const int channels = vi.AudioChannels();
+  const int n = count * channels;
+  int best = 0;
+  double best_corr = -1e30;
+  for (int offset = -seekwin; offset <= seekwin; offset++) {
+    const SFLOAT* c = cur + (seekwin + offset) * channels;
+    double corr = 0, norm = 0;
+    for (int i = 0; i < n; i++) {
+      corr += (double)prev[i] * c[i];
+      norm += (double)c[i] * c[i];
+    }
+    if (norm > 0)
+      corr /= sqrt(norm);
+    // Prefer the smallest offset among equal ones, e.g. in silence
+    if (corr > best_corr + 1e-9 || (corr > best_corr - 1e-9 && abs(offset) < abs(best))) {
+      best_corr = corr;
+      best = offset;
     }
+  }
+  return best;
+}
 
-    // If buffer empty - refill
-    if (dst_samples_filled==0) {
-      // Read back samples from filter
-      int samples_out = 0;
-      int gotsamples = 0;
-      do {
-        gotsamples = sampler->receiveSamples(&dstbuffer[vi.BytesFromAudioSamples(samples_out)], BUFFERSIZE - samples_out);
-        samples_out += gotsamples;
-      } while (gotsamples > 0);
-
-      dst_samples_filled = samples_out;
-
-      if (!dst_samples_filled) {  // We didn't get any samples
-          // Feed new samples to filter
-        child->GetAudio(dstbuffer, inputReadOffset, BUFFERSIZE, env);
-        inputReadOffset += BUFFERSIZE;
-        sampler->putSamples(dstbuffer, BUFFERSIZE);
-      } // End if no samples
-    } // end if empty buffer
-  } while (!buffer_full);
-  next_sample += count;
+// Renders the first head_len samples of a segment.  The previous segment's
+// chain is crossfaded into this one's at the best matching offset, the
+// offset then eases back to zero so that the rest of the segment is this
+// chain's output as is.  Leaves chain at the end of the head.
+void spliceSegment(__int64 segment, IScriptEnvironment* env)
+{
+  const int channels = vi.AudioChannels();
+  const __int64 seg_start = segment * segment_len;
+  const int margin = seekwin + 2;  // the interpolation reads one sample before and two past
+
+  // The previous segment's chain runs into this one for the crossfade.
+  std::vector<SFLOAT> tail(xfade * channels);
+  Chain* prev = chain;
+  if (!prev || prev->segment != segment - 1 || prev->pos > seg_start)
+    prev = openChain(segment - 1, env);
+  try {
+    readChain(prev, NULL, seg_start - prev->pos, env);
+    readChain(prev, &tail[0], xfade, env);
+  }
+  catch (...) {
+    if (prev != chain)
+      delete prev;
+    throw;
+  }
+  if (prev != chain)
+    delete prev;
+
+  delete chain;
+  chain = 0;
+  chain = openChain(segment, env);
+
+  // cur[i] is this chain's sample seg_start - margin + i
+  std::vector<SFLOAT> cur((xfade + 2 * margin) * channels);
+  readChain(chain, NULL, seg_start - margin - chain->pos, env);
+  readChain(chain, &cur[0], xfade + 2 * margin, env);
+
+  const int offset = seekBestOffset(&tail[0], &cur[(margin - seekwin) * channels], xfade);
+  const int ramp = (int)min((__int64)abs(offset) * ALIGN_RAMP, segment_len / 4);
+
+  cur.resize((xfade + ramp + 2 * margin) * channels);
+  readChain(chain, &cur[(xfade + 2 * margin) * channels], ramp, env);
+
+  head_len = xfade + ramp + margin;
+  head.resize(head_len * channels);
+
+  for (int i = 0; i < xfade; i++) {
+    const float w = (i + 0.5f) / xfade;
+    const SFLOAT* t = &tail[i * channels];
+    const SFLOAT* c = &cur[(margin + offset + i) * channels];
+    SFLOAT* d = &head[i * channels];
+    for (int ch = 0; ch < channels; ch++)
+      d[ch] = t[ch] + (c[ch] - t[ch]) * w;
+  }
+
+  for (int i = 0; i < ramp; i++) {
+    // raised cosine from offset down to zero, cubic interpolation in between
+    const double pos = margin + xfade + i + offset * (0.5 + 0.5 * cos(3.14159265358979 * (i + 0.5) / ramp));
+    const int k = (int)floor(pos);
+    const float f = (float)(pos - k);
+    const SFLOAT* c = &cur[(k - 1) * channels];
+    SFLOAT* d = &head[(xfade + i) * channels];
+    for (int ch = 0; ch < channels; ch++) {
+      const float y0 = c[ch], y1 = c[ch + channels], y2 = c[ch + 2 * channels], y3 = c[ch + 3 * channels];
+      d[ch] = y1 + 0.5f * f * (y2 - y0 + f * (2.0f * y0 - 5.0f * y1 + 4.0f * y2 - y3 + f * (3.0f * (y1 - y2) + y3 - y0)));
+    }
+  }
+
+  memcpy(&head[(xfade + ramp) * channels], &cur[(margin + xfade + ramp) * channels], margin * channels * sizeof(SFLOAT));
+  head_segment = segment;
+}
+
+void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env)
+{
+  const int channels = vi.AudioChannels();
+  SFLOAT* dst = (SFLOAT*)buf;
+  __int64 pos = start;
+  const __int64 end = start + count;
+
+  while (pos < end) {
+    const __int64 segment = pos / segment_len;
+    const __int64 seg_start = segment * segment_len;
+
+    if (segment > 0 && pos < seg_start + max_head) {
+      if (head_segment != segment)
+        spliceSegment(segment, env);
+      if (pos < seg_start + head_len) {
+        const __int64 n = min(end - pos, seg_start + head_len - pos);
+        memcpy(dst, &head[(pos - seg_start) * channels], (size_t)n * channels * sizeof(SFLOAT));
+        dst += n * channels;
+        pos += n;
+        continue;
+      }
+    }
+
+    const __int64 n = min(end - pos, seg_start + segment_len - pos);
+    if (!chain || chain->segment != segment || chain->pos > pos) {  // Reset on seek
+      delete chain;
+      chain = 0;
+      chain = openChain(segment, env);
+    }
+    readChain(chain, NULL, pos - chain->pos, env);
+    readChain(chain, dst, n, env);
+
+    dst += n * channels;
+    pos += n;
+  }
 }
 
 ~AVSsoundtouch()
 {
-    delete[] dstbuffer;
-    delete sampler;
+    delete chain;
 }
 
 
@@ -194,6 +497,7 @@ AVSValue __cdecl Create_SoundTouch(AVSValue args, void*, IScriptEnvironment* env
 			args[2].AsFloatf(100.0f), 
 			args[3].AsFloatf(100.0f), 
 			&args[4],
+			args[9].AsInt(0),
 			env
 		);
 
@@ -206,7 +510,7 @@ extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScri
 	AVS_linkage = vectors;
 
   // clip, base filename, start, end, image format/extension, info
-  env->AddFunction("TimeStretch", "c[tempo]f[rate]f[pitch]f[sequence]i[seekwindow]i[overlap]i[quickseek]b[aa]i", Create_SoundTouch, 0);
+  env->AddFunction("TimeStretch", "c[tempo]f[rate]f[pitch]f[sequence]i[seekwindow]i[overlap]i[quickseek]b[aa]i[channelgroup]i", Create_SoundTouch, 0);
 
   return "`TimeStretch' Changes tempo, pitch, and/or playback rate of audio.";
 }
@@ -53,7 +53,21 @@ static int CPUCheckForExtensions()
   if (xgetbv_supported && avx_supported)
   {
     if ((_xgetbv(_XCR_XFEATURE_ENABLED_MASK) & 0x6ull) == 0x6ull)
-      result |= CPUF_AVX;   
+    {
+      result |= CPUF_AVX;
+      if (IS_BIT_SET(cpuinfo[2], 12))
+        result |= CPUF_FMA3;
+
+      // AVX2 is reported in the extended features leaf
+      int cpuinfo_ext[4];
+      __cpuid(cpuinfo, 0);
+      if (cpuinfo[0] >= 7)
+      {
+        __cpuidex(cpuinfo_ext, 7, 0);
+        if (IS_BIT_SET(cpuinfo_ext[1], 5))
+          result |= CPUF_AVX2;
+      }
+    }
   }
 #endif
 
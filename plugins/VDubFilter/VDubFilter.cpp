@@ -274,6 +274,9 @@ struct FilterVTbls {
 enum {
   FILTERPARAM_SWAP_BUFFERS  = 0x00000001L,
   FILTERPARAM_NEEDS_LAST    = 0x00000002L,
+  // V13+: the output depends only on the current input frame and the config,
+  // so several instances can run on different frames at the same time.
+  FILTERPARAM_PURE_TRANSFORM = 0x00000010L,
 };
 
 ///////////////////
@@ -335,6 +338,7 @@ typedef struct FilterModule {
   const char*            avisynth_function_name;
   int                    preroll;
   FilterDefinitionList*  fdl;
+  volatile long          instances; // filter instances using the module
 } FilterModule;
 
 typedef struct FilterDefinition {
@@ -587,6 +591,9 @@ class VirtualdubFilterProxy : public GenericVideoFilter {
   FilterActivation fa;
   DummyFilterPreview fp;
   int expected_frame_number;
+  bool two_buffers;
+  bool direct;         // the filter works on the AviSynth frames themselves
+  bool pure_transform; // instances can run in parallel
 
   void CallStartProc() {
     if (fd->startProc) {
@@ -640,11 +647,16 @@ public:
     SetVFBitmap(src, &vbDst);
 
     long flags = fd->paramProc ? fd->paramProc(&fa, &g_filterFuncs) : FILTERPARAM_SWAP_BUFFERS;
-    bool two_buffers = !!(flags & FILTERPARAM_SWAP_BUFFERS);
+    two_buffers = !!(flags & FILTERPARAM_SWAP_BUFFERS);
     bool needs_last = !!(flags & FILTERPARAM_NEEDS_LAST);
     bool src_needs_hdc = (vbSrc.dwFlags & VFBitmap::NEEDS_HDC);
     bool dst_needs_hdc = (vbDst.dwFlags & VFBitmap::NEEDS_HDC);
 
+    // The previous source frame and GDI access need the buffers owned here,
+    // everything else can be handed the child's and the output frames.
+    direct = !needs_last && !src_needs_hdc && !dst_needs_hdc;
+    pure_transform = (flags & FILTERPARAM_PURE_TRANSFORM) && !needs_last;
+
     if (src_needs_hdc || dst_needs_hdc) {
 //      throw AvisynthError("VirtualdubFilterProxy: HDC not supported");
       vbSrc.hdc = vbDst.hdc = vbLast.hdc = GetDC(NULL);
@@ -664,6 +676,15 @@ public:
 
     CallStartProc();
     expected_frame_number = 0;
+    InterlockedIncrement(&fdl->fm->instances);
+  }
+
+  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+    // Unless the filter says otherwise it may keep state from frame to frame,
+    // so all frames have to go through the one instance, in order.
+    if (cachehints == CACHE_GET_MTMODE)
+      return pure_transform ? MT_MULTI_INSTANCE : MT_SERIALIZED;
+    return 0;
   }
 
   void SetVFBitmap(const PVideoFrame& pvf, VFBitmap* pvb) {
@@ -680,21 +701,44 @@ public:
     pvb->hdc = 0;
   }
 
+  void RunProc(int n) {
+    fsi.lCurrentSourceFrame = fsi.lCurrentFrame = n;
+    fsi.lDestFrameMS = fsi.lSourceFrameMS = MulDiv(n, fsi.lMicrosecsPerFrame, 1000);
+
+    fd->runProc(&fa, &g_filterFuncs);
+  }
+
   PVideoFrame FilterFrame(int n, IScriptEnvironment* env, bool in_preroll) {
+    PVideoFrame _src = child->GetFrame(n, env);
+
+    if (direct) {
+      // A filter working in place needs a writable source, so does one with
+      // two buffers that doesn't promise to leave its source alone.
+      if (!two_buffers || !pure_transform)
+        env->MakeWritable(&_src);
+      PVideoFrame _dst = two_buffers ? env->NewVideoFrame(vi) : _src;
+      // The filter may have kept the layout it was started with.
+      if (_src->GetPitch() == src->GetPitch() && _dst->GetPitch() == (dst?dst:src)->GetPitch()) {
+        vbSrc.data = (Pixel*)_src->GetReadPtr();
+        vbDst.data = (Pixel*)_dst->GetReadPtr();
+        RunProc(n);
+        if (in_preroll)
+          return 0;
+        return _dst;
+      }
+      vbSrc.data = (Pixel*)src->GetReadPtr();
+      vbDst.data = (Pixel*)(dst?dst:src)->GetReadPtr();
+    }
+
     if (last) {
       env->BitBlt(last->GetWritePtr(), last->GetPitch(), src->GetReadPtr(), src->GetPitch(),
         last->GetRowSize(), last->GetHeight());
     }
-    {
-      PVideoFrame _src = child->GetFrame(n, env);
-      env->BitBlt(src->GetWritePtr(), src->GetPitch(), _src->GetReadPtr(), _src->GetPitch(),
-        src->GetRowSize(), src->GetHeight());
-    }
+    env->BitBlt(src->GetWritePtr(), src->GetPitch(), _src->GetReadPtr(), _src->GetPitch(),
+      src->GetRowSize(), src->GetHeight());
+    _src = 0;
 
-    fsi.lCurrentSourceFrame = fsi.lCurrentFrame = n;
-    fsi.lDestFrameMS = fsi.lSourceFrameMS = MulDiv(n, fsi.lMicrosecsPerFrame, 1000);
-
-    fd->runProc(&fa, &g_filterFuncs);
+    RunProc(n);
 
     if (in_preroll) {
       return 0;
@@ -772,7 +816,14 @@ public:
 
   ~VirtualdubFilterProxy() {
     CallEndProc();
-	FreeFilterModule(fdl->fm);
+    if (fa.filter_data) {
+      if (fd->deinitProc)
+        fd->deinitProc(&fa, &g_filterFuncs);
+      delete[] (char*)fa.filter_data;
+    }
+    // Every instance uses the module, only the last one may free it.
+    if (InterlockedDecrement(&fdl->fm->instances) == 0)
+      FreeFilterModule(fdl->fm);
     if (vbSrc.hdc)
       ReleaseDC(NULL, vbSrc.hdc);
   }
@@ -865,6 +916,7 @@ AVSValue __cdecl LoadVirtualdubPlugin(AVSValue args, void*, IScriptEnvironment*
   fm->next = loaded_modules;
   fm->prev = 0;
   fm->fdl = 0;
+  fm->instances = 0;
 
   int ver_hi = VIRTUALDUB_FILTERDEF_VERSION;
   int ver_lo = VIRTUALDUB_FILTERDEF_COMPATIBLE;
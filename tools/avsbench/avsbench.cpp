@@ -0,0 +1,183 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+// avsbench: opens a script, pulls its frames (and optionally its audio) as
+// fast as possible and reports the throughput. No display, no encoder, so
+// the timings are the ones of the filter chain alone.
+//
+//   avsbench [-t threads] [-n frames] [-a] [-m min_fps] [-p plugin]... script.avs
+//
+//   -t  wraps the clip in Prefetch(threads) when threads > 1
+//   -n  pulls at most this many frames (default all)
+//   -a  also pulls the audio of the pulled frames
+//   -m  exits with status 2 when the frame rate is below min_fps
+//   -p  loads a plugin before the script, may be repeated
+//
+// The exit status is 0 on success, 1 on errors and 2 on a too low frame rate,
+// so the runner can be used from CTest for performance regression tests.
+
+#include <avisynth.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+const AVS_Linkage* AVS_linkage = 0;
+
+
+static void usage()
+{
+  fprintf(stderr, "Usage: avsbench [-t threads] [-n frames] [-a] [-m min_fps] [-p plugin]... script.avs\n");
+}
+
+
+struct BenchResult
+{
+  int frames;
+  __int64 samples;
+  double seconds;
+};
+
+
+static BenchResult run(IScriptEnvironment* env, const char* script, const std::vector<std::string>& plugins,
+                       int threads, int max_frames, bool audio)
+{
+  for (const std::string& plugin : plugins)
+    env->Invoke("LoadPlugin", AVSValue(plugin.c_str()));
+
+  AVSValue result = env->Invoke("Import", AVSValue(script));
+  if (!result.IsClip())
+    env->ThrowError("avsbench: the script did not return a clip");
+  PClip clip = result.AsClip();
+
+  if (threads > 1) {
+    AVSValue args[2] = { clip, threads };
+    clip = env->Invoke("Prefetch", AVSValue(args, 2)).AsClip();
+  }
+
+  const VideoInfo& vi = clip->GetVideoInfo();
+  const int frames = (max_frames >= 0 && max_frames < vi.num_frames) ? max_frames : vi.num_frames;
+  audio = audio && vi.HasAudio();
+
+  std::vector<char> audio_buffer;
+  if (audio)
+    audio_buffer.resize((size_t)(vi.AudioSamplesFromFrames(1) + 1) * vi.BytesPerAudioSample());
+
+  BenchResult r = { 0, 0, 0.0 };
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int n = 0; n < frames; ++n) {
+    if (vi.HasVideo())
+      clip->GetFrame(n, env);
+    if (audio) {
+      const __int64 first = vi.AudioSamplesFromFrames(n);
+      const __int64 count = vi.AudioSamplesFromFrames(n + 1) - first;
+      clip->GetAudio(audio_buffer.data(), first, count, env);
+      r.samples += count;
+    }
+    ++r.frames;
+  }
+
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return r;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int threads = 1;
+  int max_frames = -1;
+  bool audio = false;
+  double min_fps = 0.0;
+  std::vector<std::string> plugins;
+  const char* script = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (!strcmp(argv[i], "-t") && has_value)
+      threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && has_value)
+      max_frames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-a"))
+      audio = true;
+    else if (!strcmp(argv[i], "-m") && has_value)
+      min_fps = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-p") && has_value)
+      plugins.push_back(argv[++i]);
+    else if (argv[i][0] != '-' && !script)
+      script = argv[i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (!script || threads < 1) {
+    usage();
+    return 1;
+  }
+
+  IScriptEnvironment* env = CreateScriptEnvironment(AVISYNTH_INTERFACE_VERSION);
+  if (!env) {
+    fprintf(stderr, "avsbench: cannot create the script environment\n");
+    return 1;
+  }
+  AVS_linkage = env->GetAVSLinkage();
+
+  int status = 0;
+  try {
+    const BenchResult r = run(env, script, plugins, threads, max_frames, audio);
+    const double fps = r.seconds > 0.0 ? r.frames / r.seconds : 0.0;
+
+    printf("%s: %d frames in %.3f s, %.2f fps, %d thread(s)\n", script, r.frames, r.seconds, fps, threads);
+    if (r.samples > 0)
+      printf("%s: %lld audio samples, %.0f samples/s\n", script, (long long)r.samples,
+             r.seconds > 0.0 ? r.samples / r.seconds : 0.0);
+
+    if (fps < min_fps) {
+      fprintf(stderr, "avsbench: %.2f fps is below the minimum of %.2f fps\n", fps, min_fps);
+      status = 2;
+    }
+  }
+  catch (const AvisynthError& err) {
+    fprintf(stderr, "avsbench: %s\n", err.msg);
+    status = 1;
+  }
+
+  env->DeleteScriptEnvironment();
+  return status;
+}
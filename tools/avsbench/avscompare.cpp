@@ -0,0 +1,297 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+// avscompare: renders two scripts and compares their output sample by
+// sample, for the equality tests of the SIMD paths and of fused filters.
+//
+//   avscompare [-n frames] [-a] [-e window] [-d max_diff] [-p plugin]... [-c level] a.avs [-c level] b.avs
+//
+//   -n  compares at most this many frames (default all)
+//   -a  also compares the audio of these frames
+//   -e  compares the peak level of the audio over windows of this many
+//       samples instead of the samples, e.g. for time stretched tones
+//   -d  largest difference that still passes, in sample units (default 0)
+//   -p  loads a plugin before each script, may be repeated
+//   -c  runs the next script under SetMaxCPU(level), e.g. none, sse2, avx2
+//
+// Each script runs in its own environment, one after the other, since the
+// CPU level applies to the whole process. The exit status is 0 when the
+// outputs match, 1 on errors and 2 on differences.
+
+#include <avisynth.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+const AVS_Linkage* AVS_linkage = 0;
+
+
+static void usage()
+{
+  fprintf(stderr, "Usage: avscompare [-n frames] [-a] [-e window] [-d max_diff] [-p plugin]... [-c level] a.avs [-c level] b.avs\n");
+}
+
+
+struct Rendered
+{
+  VideoInfo vi;
+  std::vector<std::vector<BYTE>> frames;  // the rows of all planes, without padding
+  std::vector<BYTE> audio;
+};
+
+
+static void render(const char* script, const char* cpu_level, const std::vector<std::string>& plugins,
+                   int max_frames, bool audio, Rendered& out)
+{
+  IScriptEnvironment* env = CreateScriptEnvironment(AVISYNTH_INTERFACE_VERSION);
+  if (!env)
+    throw AvisynthError("cannot create the script environment");
+  AVS_linkage = env->GetAVSLinkage();
+
+  try {
+    env->Invoke("SetMaxCPU", AVSValue(cpu_level));
+    for (const std::string& plugin : plugins)
+      env->Invoke("LoadPlugin", AVSValue(plugin.c_str()));
+
+    AVSValue result = env->Invoke("Import", AVSValue(script));
+    if (!result.IsClip())
+      env->ThrowError("%s did not return a clip", script);
+    PClip clip = result.AsClip();
+
+    const VideoInfo& vi = clip->GetVideoInfo();
+    out.vi = vi;
+    const int frames = (max_frames >= 0 && max_frames < vi.num_frames) ? max_frames : vi.num_frames;
+
+    static const int planes_yuv[] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
+    static const int planes_rgb[] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+    const int* planes = vi.IsPlanarRGB() || vi.IsPlanarRGBA() ? planes_rgb : planes_yuv;
+    const int num_planes = !vi.IsPlanar() || vi.IsY() ? 1 : vi.IsYUVA() || vi.IsPlanarRGBA() ? 4 : 3;
+
+    if (vi.HasVideo()) {
+      for (int n = 0; n < frames; ++n) {
+        PVideoFrame frame = clip->GetFrame(n, env);
+        std::vector<BYTE> data;
+        for (int p = 0; p < num_planes; ++p) {
+          const int plane = vi.IsPlanar() ? planes[p] : 0;
+          const BYTE* srcp = frame->GetReadPtr(plane);
+          const int row_size = frame->GetRowSize(plane);
+          for (int y = 0; y < frame->GetHeight(plane); ++y, srcp += frame->GetPitch(plane))
+            data.insert(data.end(), srcp, srcp + row_size);
+        }
+        out.frames.push_back(data);
+      }
+    }
+
+    if (audio && vi.HasAudio()) {
+      const __int64 count = vi.HasVideo() ? vi.AudioSamplesFromFrames(frames) : vi.num_audio_samples;
+      out.audio.resize((size_t)count * vi.BytesPerAudioSample());
+      clip->GetAudio(out.audio.data(), 0, count, env);
+    }
+  }
+  catch (...) {
+    env->DeleteScriptEnvironment();
+    throw;
+  }
+  env->DeleteScriptEnvironment();
+}
+
+
+// Sample at index i of a buffer of bytes_per_sample wide samples
+static double sample_at(const BYTE* data, size_t i, int bytes_per_sample, bool is_float)
+{
+  const BYTE* p = data + i * bytes_per_sample;
+  switch (bytes_per_sample) {
+  case 1: return *p;
+  case 2: return *reinterpret_cast<const uint16_t*>(p);
+  case 3: return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+  default:
+    return is_float ? *reinterpret_cast<const float*>(p) : *reinterpret_cast<const int32_t*>(p);
+  }
+}
+
+
+// Largest magnitude of each channel over windows of window samples, as floats
+static std::vector<BYTE> peak_envelope(const std::vector<BYTE>& data, int channels, int bytes_per_sample, bool is_float,
+                                       int window)
+{
+  const size_t samples = data.size() / bytes_per_sample / channels;
+  const size_t windows = (samples + window - 1) / window;
+  std::vector<BYTE> out(windows * channels * sizeof(float));
+  float* peaks = reinterpret_cast<float*>(out.data());
+  for (size_t i = 0; i < samples; ++i) {
+    float* p = peaks + i / window * channels;
+    for (int ch = 0; ch < channels; ++ch) {
+      const float v = (float)std::fabs(sample_at(data.data(), i * channels + ch, bytes_per_sample, is_float));
+      if (v > p[ch])
+        p[ch] = v;
+    }
+  }
+  return out;
+}
+
+
+struct Difference
+{
+  double max_diff;
+  __int64 count;
+  __int64 total;
+  __int64 first;  // index of the first differing sample, -1 if none
+};
+
+
+static void compare(const std::vector<BYTE>& a, const std::vector<BYTE>& b, int bytes_per_sample, bool is_float,
+                    Difference& d)
+{
+  const size_t samples = a.size() / bytes_per_sample;
+  for (size_t i = 0; i < samples; ++i) {
+    const double diff = std::fabs(sample_at(a.data(), i, bytes_per_sample, is_float) - sample_at(b.data(), i, bytes_per_sample, is_float));
+    if (diff > 0) {
+      if (d.first < 0)
+        d.first = d.total + i;
+      d.count++;
+      if (diff > d.max_diff)
+        d.max_diff = diff;
+    }
+  }
+  d.total += samples;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int max_frames = -1;
+  bool audio = false;
+  int window = 0;
+  double max_diff = 0.0;
+  std::vector<std::string> plugins;
+  const char* scripts[2] = { 0, 0 };
+  const char* levels[2] = { "avx2", "avx2" };
+  const char* next_level = "avx2";
+  int num_scripts = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (!strcmp(argv[i], "-n") && has_value)
+      max_frames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-a"))
+      audio = true;
+    else if (!strcmp(argv[i], "-e") && has_value)
+      window = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-d") && has_value)
+      max_diff = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-p") && has_value)
+      plugins.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && has_value)
+      next_level = argv[++i];
+    else if (argv[i][0] != '-' && num_scripts < 2) {
+      levels[num_scripts] = next_level;
+      scripts[num_scripts++] = argv[i];
+      next_level = "avx2";
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (num_scripts != 2) {
+    usage();
+    return 1;
+  }
+
+  Rendered out[2];
+  try {
+    for (int i = 0; i < 2; ++i)
+      render(scripts[i], levels[i], plugins, max_frames, audio, out[i]);
+  }
+  catch (const AvisynthError& err) {
+    fprintf(stderr, "avscompare: %s\n", err.msg);
+    return 1;
+  }
+
+  const VideoInfo& va = out[0].vi;
+  const VideoInfo& vb = out[1].vi;
+  if (va.HasVideo() != vb.HasVideo() || va.HasAudio() != vb.HasAudio() ||
+      (va.HasVideo() && (va.width != vb.width || va.height != vb.height || !va.IsSameColorspace(vb) || va.num_frames != vb.num_frames)) ||
+      (va.HasAudio() && (va.SampleType() != vb.SampleType() || va.AudioChannels() != vb.AudioChannels() || va.num_audio_samples != vb.num_audio_samples))) {
+    fprintf(stderr, "avscompare: %s and %s have different formats\n", scripts[0], scripts[1]);
+    return 2;
+  }
+
+  int status = 0;
+  if (va.HasVideo()) {
+    Difference d = { 0.0, 0, 0, -1 };
+    int first_frame = -1;
+    for (size_t n = 0; n < out[0].frames.size(); ++n) {
+      compare(out[0].frames[n], out[1].frames[n], va.ComponentSize(), va.ComponentSize() == 4, d);
+      if (first_frame < 0 && d.first >= 0)
+        first_frame = (int)n;
+    }
+    printf("video: %lld of %lld samples differ, max difference %g", (long long)d.count, (long long)d.total, d.max_diff);
+    if (first_frame >= 0)
+      printf(", first in frame %d", first_frame);
+    printf(" (%s at %s, %s at %s)\n", scripts[0], levels[0], scripts[1], levels[1]);
+    if (d.max_diff > max_diff)
+      status = 2;
+  }
+  if (audio && va.HasAudio()) {
+    Difference d = { 0.0, 0, 0, -1 };
+    if (window > 0) {
+      const int channels = va.AudioChannels();
+      const int bytes_per_sample = va.BytesPerChannelSample();
+      const bool is_float = va.IsSampleType(SAMPLE_FLOAT);
+      compare(peak_envelope(out[0].audio, channels, bytes_per_sample, is_float, window),
+              peak_envelope(out[1].audio, channels, bytes_per_sample, is_float, window), sizeof(float), true, d);
+      printf("audio: %lld of %lld windows differ, max difference %g", (long long)d.count, (long long)d.total, d.max_diff);
+    }
+    else {
+      compare(out[0].audio, out[1].audio, va.BytesPerChannelSample(), va.IsSampleType(SAMPLE_FLOAT), d);
+      printf("audio: %lld of %lld samples differ, max difference %g", (long long)d.count, (long long)d.total, d.max_diff);
+    }
+    if (d.first >= 0)
+      printf(", first at sample %lld", (long long)(d.first / va.AudioChannels() * (window > 0 ? window : 1)));
+    printf("\n");
+    if (d.max_diff > max_diff)
+      status = 2;
+  }
+
+  fflush(stdout);
+  if (status)
+    fprintf(stderr, "avscompare: the difference exceeds %g\n", max_diff);
+  return status;
+}
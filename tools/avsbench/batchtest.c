@@ -0,0 +1,258 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+/* batchtest: a C host fetching frames through the AVS_FrameBatch calls,
+ * once from a script ending in Prefetch() and once without a prefetcher.
+ * The frames come from a C filter of its own, frame n is flat with luma
+ * 4 * n and frame 7 fails. Covers
+ * avs_request_frames and avs_request_frame_range with frames out of range
+ * and repeated, avs_poll_frame and avs_wait_frame, error propagation,
+ * invalid requests and releasing a batch with frames still in flight.
+ *
+ *   batchtest
+ *
+ * The exit status is 0 when all checks pass and 2 otherwise.
+ */
+
+#include <avisynth_c.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define NUM_FRAMES 40
+#define FAILING_FRAME 7
+
+static int failures = 0;
+
+
+static void fail(const char *what, const char *detail, int n)
+{
+  fprintf(stderr, "batchtest: %s: %s (frame %d)\n", what, detail, n);
+  failures++;
+}
+
+
+/* BatchFrames(clip): flat frames with luma 4 * n, frame 7 fails */
+static AVS_VideoFrame * AVSC_CC batch_frames_get_frame(AVS_FilterInfo *fi, int n)
+{
+  AVS_VideoFrame *frame;
+  BYTE *dstp;
+  int y;
+
+  if (n == FAILING_FRAME) {
+    fi->error = "frame 7 fails";
+    return 0;
+  }
+  frame = avs_new_video_frame(fi->env, &fi->vi);
+  dstp = avs_get_write_ptr_p(frame, AVS_PLANAR_Y);
+  for (y = 0; y < avs_get_height_p(frame, AVS_PLANAR_Y); y++, dstp += avs_get_pitch_p(frame, AVS_PLANAR_Y))
+    memset(dstp, n * 4, avs_get_row_size_p(frame, AVS_PLANAR_Y));
+  return frame;
+}
+
+
+static AVS_Value AVSC_CC batch_frames_create(AVS_ScriptEnvironment *env, AVS_Value args, void *user_data)
+{
+  AVS_FilterInfo *fi;
+  AVS_Value v;
+  AVS_Clip *clip = avs_new_c_filter(env, &fi, avs_array_elt(args, 0), 1);
+
+  (void)user_data;
+  fi->get_frame = batch_frames_get_frame;
+  avs_set_to_clip(&v, clip);
+  avs_release_clip(clip);
+  return v;
+}
+
+
+static AVS_Clip *open_script(AVS_ScriptEnvironment *env, int prefetch)
+{
+  AVS_Value result;
+  AVS_Clip *clip;
+
+  result = avs_invoke(env, "Eval", avs_new_value_string(prefetch
+    ? "BlankClip(length=40, width=64, height=48, pixel_type=\"YV12\").BatchFrames().Prefetch(4)"
+    : "BlankClip(length=40, width=64, height=48, pixel_type=\"YV12\").BatchFrames()"), 0);
+  if (!avs_is_clip(result)) {
+    fprintf(stderr, "batchtest: %s\n", avs_is_error(result) ? avs_as_error(result) : "the script did not return a clip");
+    avs_release_value(result);
+    return 0;
+  }
+  clip = avs_take_clip(result, env);
+  avs_release_value(result);
+  return clip;
+}
+
+
+/* Checks frame n as returned by a batch, which requested requested */
+static void check_frame(AVS_FrameBatch *b, const char *what, int requested, int n, AVS_VideoFrame *frame)
+{
+  const int clamped = n < 0 ? 0 : n >= NUM_FRAMES ? NUM_FRAMES - 1 : n;
+  const char *error = avs_frame_batch_get_error(b);
+
+  if (n != requested)
+    fail(what, "returned another frame number", n);
+  if (clamped == FAILING_FRAME) {
+    if (frame)
+      fail(what, "the failing frame was returned", n);
+    if (!error || !strstr(error, "frame 7 fails"))
+      fail(what, "the error of the failing frame was lost", n);
+  }
+  else if (!frame || error)
+    fail(what, error ? error : "no frame", n);
+  else if (avs_get_read_ptr_p(frame, AVS_PLANAR_Y)[0] != clamped * 4)
+    fail(what, "wrong content", n);
+  if (frame)
+    avs_release_video_frame(frame);
+}
+
+
+/* Fetches frames[0..count) through the batch b and checks that each comes
+ * back once; poll spins on avs_poll_frame instead of waiting */
+static void fetch_all(AVS_FrameBatch *b, const char *what, const int *frames, int count, int poll)
+{
+  int pending[64];
+  int i, n, status;
+  AVS_VideoFrame *frame;
+
+  memcpy(pending, frames, count * sizeof(int));
+  for (;;) {
+    status = poll ? avs_poll_frame(b, &n, &frame) : avs_wait_frame(b, &n, &frame);
+    if (status == 0)
+      continue;
+    if (status < 0)
+      break;
+    for (i = 0; i < count && pending[i] != n; i++)
+      ;
+    if (i == count) {
+      fail(what, "returned a frame not requested or twice", n);
+      if (frame)
+        avs_release_video_frame(frame);
+      continue;
+    }
+    check_frame(b, what, pending[i], n, frame);
+    pending[i] = pending[--count];
+  }
+  if (count)
+    fail(what, "frames were not returned", pending[0]);
+  if (avs_poll_frame(b, &n, &frame) != -1 || avs_wait_frame(b, &n, &frame) != -1)
+    fail(what, "frames after the end", -1);
+}
+
+
+static void run(AVS_ScriptEnvironment *env, int prefetch)
+{
+  static const int scattered[] = { 5, -3, 39, 100, FAILING_FRAME, 5, 12, 0, 38 };
+  const int count = (int)(sizeof(scattered) / sizeof(scattered[0]));
+  int range[NUM_FRAMES];
+  int i, n;
+  AVS_VideoFrame *frame;
+  AVS_FrameBatch *b;
+  AVS_Clip *clip = open_script(env, prefetch);
+
+  if (!clip) {
+    failures++;
+    return;
+  }
+  printf("batchtest: %s\n", prefetch ? "with Prefetch" : "without prefetcher");
+
+  for (i = 0; i < NUM_FRAMES; i++)
+    range[i] = i;
+  b = avs_request_frame_range(clip, 0, NUM_FRAMES);
+  if (b) {
+    fetch_all(b, "range, waiting", range, NUM_FRAMES, 0);
+    avs_release_frame_batch(b);
+  }
+  else
+    fail("range, waiting", avs_clip_get_error(clip), -1);
+
+  b = avs_request_frames(clip, scattered, count);
+  if (b) {
+    fetch_all(b, "scattered, polling", scattered, count, 1);
+    avs_release_frame_batch(b);
+  }
+  else
+    fail("scattered, polling", avs_clip_get_error(clip), -1);
+
+  /* released with most frames still queued or being computed */
+  b = avs_request_frame_range(clip, 0, NUM_FRAMES);
+  if (b) {
+    for (i = 0; i < 3; i++) {
+      if (avs_wait_frame(b, &n, &frame) != 1)
+        fail("released early", "no frame", i);
+      else if (frame)
+        avs_release_video_frame(frame);
+    }
+    avs_release_frame_batch(b);
+  }
+  else
+    fail("released early", avs_clip_get_error(clip), -1);
+  b = avs_request_frame_range(clip, 10, 20);
+  if (b)
+    avs_release_frame_batch(b);
+
+  /* empty and invalid requests */
+  b = avs_request_frames(clip, 0, 0);
+  if (!b || avs_wait_frame(b, &n, &frame) != -1)
+    fail("empty", "did not end right away", -1);
+  if (b)
+    avs_release_frame_batch(b);
+  if (avs_request_frames(clip, 0, 3) || !avs_clip_get_error(clip))
+    fail("no frame list", "was accepted", -1);
+  if (avs_request_frame_range(clip, 0, -1) || !avs_clip_get_error(clip))
+    fail("negative count", "was accepted", -1);
+
+  avs_release_clip(clip);
+}
+
+
+int main(void)
+{
+  AVS_ScriptEnvironment *env = avs_create_script_environment(AVISYNTH_INTERFACE_VERSION);
+
+  if (!env) {
+    fprintf(stderr, "batchtest: cannot create the script environment\n");
+    return 2;
+  }
+  avs_add_function(env, "BatchFrames", "c", batch_frames_create, 0);
+  run(env, 1);
+  run(env, 0);
+  avs_delete_script_environment(env);
+
+  if (failures)
+    return 2;
+  printf("batchtest: all checks pass\n");
+  return 0;
+}
@@ -0,0 +1,238 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+// cachetest: reads the audio of a generated clip through the core Cache in
+// patterns that exercise its window (overlapping, misaligned, backward,
+// larger than the window and past both ends) and compares every request
+// sample for sample with the same request to the uncached clip.
+//
+//   cachetest
+//
+// The exit status is 0 when all requests match, 1 on errors and 2 on
+// differences.
+
+#include <avisynth.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+
+const AVS_Linkage* AVS_linkage = 0;
+
+
+// Audio only clip whose samples are a hash of their position, with the
+// silence outside of it that the Cache has to reproduce. Also asks the
+// Cache for an audio mode, as filters do through CACHE_GETCHILD_AUDIO_MODE.
+class HashAudio : public IClip
+{
+  VideoInfo vi;
+  int audio_mode;
+  int audio_size;
+
+public:
+  HashAudio(int sample_type, int channels, __int64 samples, int _audio_mode, int _audio_size) :
+    audio_mode(_audio_mode), audio_size(_audio_size)
+  {
+    memset(&vi, 0, sizeof(vi));
+    vi.audio_samples_per_second = 48000;
+    vi.sample_type = sample_type;
+    vi.nchannels = channels;
+    vi.num_audio_samples = samples;
+  }
+
+  void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment*)
+  {
+    const int bps = vi.BytesPerChannelSample();
+    BYTE* dst = static_cast<BYTE*>(buf);
+    for (__int64 i = 0; i < count; ++i) {
+      for (int ch = 0; ch < vi.nchannels; ++ch, dst += bps) {
+        const __int64 n = start + i;
+        const unsigned int h = n < 0 || n >= vi.num_audio_samples ? 0 : (unsigned int)(n * 2654435761u + ch * 40503u + 1);
+        if (vi.sample_type == SAMPLE_FLOAT) {
+          const float f = h ? (float)(int)h / 2147483648.0f : 0.0f;
+          memcpy(dst, &f, sizeof(f));
+        }
+        else
+          memcpy(dst, &h, bps);
+      }
+    }
+  }
+
+  int __stdcall SetCacheHints(int cachehints, int)
+  {
+    if (cachehints == CACHE_GET_MTMODE)
+      return MT_NICE_FILTER;
+    if (cachehints == CACHE_GETCHILD_AUDIO_MODE)
+      return audio_mode;
+    if (cachehints == CACHE_GETCHILD_AUDIO_SIZE)
+      return audio_size;
+    return 0;
+  }
+
+  const VideoInfo& __stdcall GetVideoInfo() { return vi; }
+  PVideoFrame __stdcall GetFrame(int, IScriptEnvironment*) { return 0; }
+  bool __stdcall GetParity(int) { return false; }
+
+  // HashAudio(sample_type, channels, samples, audio_mode, audio_size), also
+  // handing the instance to the caller through user_data, since the clip
+  // Invoke returns is the Cache in front of it
+  static AVSValue __cdecl Create(AVSValue args, void* user_data, IScriptEnvironment*)
+  {
+    PClip clip = new HashAudio(args[0].AsInt(), args[1].AsInt(), args[2].AsInt(), args[3].AsInt(), args[4].AsInt());
+    *static_cast<PClip*>(user_data) = clip;
+    return clip;
+  }
+};
+
+
+struct Request
+{
+  __int64 start;
+  __int64 count;
+};
+
+
+// The request patterns, for a clip of samples samples and a cache window of
+// about window samples
+static std::vector<Request> requests(__int64 samples, __int64 window)
+{
+  std::vector<Request> r;
+  // overlapping linear reads, as from a resampler asking for some history
+  for (__int64 s = 0; s + window / 2 < samples; s += window / 3)
+    r.push_back({ s, window / 2 });
+  // misaligned sizes and steps
+  for (__int64 s = 7, c = 1; s < samples; s += 613, c = c * 5 % 997 + 1)
+    r.push_back({ s, c });
+  // backward
+  for (__int64 s = samples - window / 4; s > -window; s -= window / 5)
+    r.push_back({ s, window / 4 + 3 });
+  // larger than the window, linear and jumping back into it
+  for (__int64 s = 0; s < samples; s += window) {
+    r.push_back({ s, window * 3 + 11 });
+    r.push_back({ s + window / 2, window / 3 });
+  }
+  // past both ends, and not touching the clip at all
+  r.push_back({ -window / 2, window });
+  r.push_back({ samples - window / 2, window });
+  r.push_back({ -3 * window, window });
+  r.push_back({ samples + window, window });
+  r.push_back({ -window, samples + 2 * window });
+  // random, repeatable
+  unsigned int seed = 12345;
+  for (int i = 0; i < 2000; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    const __int64 s = (__int64)(seed >> 8) % (samples + window) - window / 2;
+    seed = seed * 1103515245u + 12345u;
+    r.push_back({ s, 1 + (__int64)(seed >> 8) % (window * 3 / 2) });
+  }
+  return r;
+}
+
+
+static bool check(IScriptEnvironment* env, PClip& child, int sample_type, int channels, int audio_mode, int audio_size)
+{
+  const int samples = 100000;
+  const AVSValue args[5] = { sample_type, channels, samples, audio_mode, audio_size };
+  PClip cache = env->Invoke("HashAudio", AVSValue(args, 5)).AsClip();
+  if (cache->SetCacheHints(CACHE_IS_CACHE_REQ, 0) != CACHE_IS_CACHE_ANS)
+    env->ThrowError("HashAudio is not cached");
+  if (audio_mode != CACHE_AUDIO_NOTHING && cache->SetCacheHints(CACHE_GET_AUDIO_POLICY, 0) != audio_mode)
+    env->ThrowError("the cache did not take audio mode %d", audio_mode);
+
+  const VideoInfo& vi = child->GetVideoInfo();
+  const int bps = vi.BytesPerAudioSample();
+  const __int64 window = audio_size > 0 ? audio_size / bps : 4096;
+  const std::vector<Request> r = requests(samples, window);
+
+  std::vector<BYTE> a, b;
+  int failures = 0;
+  for (size_t i = 0; i < r.size(); ++i) {
+    a.assign((size_t)r[i].count * bps, 0xAA);
+    b.assign((size_t)r[i].count * bps, 0x55);
+    cache->GetAudio(a.data(), r[i].start, r[i].count, env);
+    child->GetAudio(b.data(), r[i].start, r[i].count, env);
+    if (a != b && failures++ < 5)
+      fprintf(stderr, "cachetest: mode %d, %d channels of type %d: request %d (start %lld, count %lld) differs\n",
+              audio_mode, channels, sample_type, (int)i, (long long)r[i].start, (long long)r[i].count);
+  }
+  // the caching modes have to have served some of it
+  if (audio_mode != CACHE_AUDIO_NOTHING && cache->SetCacheHints(CACHE_GET_AUDIO_HITS, 0) == 0) {
+    fprintf(stderr, "cachetest: mode %d, %d channels of type %d: no request was served from the cache\n",
+            audio_mode, channels, sample_type);
+    failures++;
+  }
+  child = 0;
+  return failures == 0;
+}
+
+
+int main()
+{
+  IScriptEnvironment* env = CreateScriptEnvironment(AVISYNTH_INTERFACE_VERSION);
+  if (!env) {
+    fprintf(stderr, "cachetest: cannot create the script environment\n");
+    return 1;
+  }
+  AVS_linkage = env->GetAVSLinkage();
+
+  // explicit windows of a few thousand samples, auto mode from its initial
+  // size, auto mode off at start and no caching at all
+  static const struct { int mode; int size; } modes[] = {
+    { CACHE_AUDIO, 16384 }, { CACHE_AUDIO_AUTO, 0 }, { CACHE_AUDIO_NONE, 0 }, { CACHE_AUDIO_NOTHING, 0 },
+  };
+  static const struct { int type; int channels; } formats[] = {
+    { SAMPLE_INT16, 2 }, { SAMPLE_INT24, 3 }, { SAMPLE_FLOAT, 6 },
+  };
+
+  PClip child;
+  env->AddFunction("HashAudio", "iiiii", HashAudio::Create, &child);
+
+  int status = 0;
+  try {
+    for (const auto& m : modes)
+      for (const auto& f : formats)
+        if (!check(env, child, f.type, f.channels, m.mode, m.size))
+          status = 2;
+  }
+  catch (const AvisynthError& err) {
+    fprintf(stderr, "cachetest: %s\n", err.msg);
+    status = 1;
+  }
+  child = 0;
+  env->DeleteScriptEnvironment();
+  if (status == 0)
+    printf("cachetest: all requests match\n");
+  return status;
+}
@@ -0,0 +1,109 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+/* plugintest: a C host loading C++ plugins. Unlike the C++ tools it does
+ * not define an AVS_linkage of its own, so each plugin has to store the
+ * vectors it gets in its own AVS_linkage and not in one of the core.
+ * A script then runs a filter of each plugin and all of its frames and
+ * audio are fetched.
+ *
+ *   plugintest plugin...
+ *
+ * The exit status is 0 when the plugins load and run, 1 on errors.
+ */
+
+#include <avisynth_c.h>
+#include <stdio.h>
+
+
+static const char script[] =
+  "a = Tone(length=1, samplerate=48000, channels=2).SSRC(44100).TimeStretch(tempo=150)\n"
+  "v = BlankClip(length=10, width=64, height=48, pixel_type=\"YV12\").ConvertTo16bit()\n"
+  "AudioDub(v.ConvertToStacked().ConvertFromStacked(), a)\n";
+
+
+int main(int argc, char **argv)
+{
+  AVS_ScriptEnvironment *env = avs_create_script_environment(AVISYNTH_INTERFACE_VERSION);
+  AVS_Value result;
+  AVS_Clip *clip;
+  const AVS_VideoInfo *vi;
+  AVS_VideoFrame *frame;
+  const char *error = 0;
+  float samples[4096];
+  INT64 start;
+  int i, n;
+
+  if (!env) {
+    fprintf(stderr, "plugintest: cannot create the script environment\n");
+    return 1;
+  }
+  for (i = 1; i < argc; i++) {
+    result = avs_invoke(env, "LoadPlugin", avs_new_value_string(argv[i]), 0);
+    if (avs_is_error(result)) {
+      fprintf(stderr, "plugintest: %s\n", avs_as_error(result));
+      return 1;
+    }
+    avs_release_value(result);
+  }
+
+  result = avs_invoke(env, "Eval", avs_new_value_string(script), 0);
+  if (!avs_is_clip(result)) {
+    fprintf(stderr, "plugintest: %s\n", avs_is_error(result) ? avs_as_error(result) : "the script did not return a clip");
+    return 1;
+  }
+  clip = avs_take_clip(result, env);
+  avs_release_value(result);
+  vi = avs_get_video_info(clip);
+
+  for (n = 0; n < vi->num_frames && !error; n++) {
+    frame = avs_get_frame(clip, n);
+    error = avs_clip_get_error(clip);
+    if (frame)
+      avs_release_video_frame(frame);
+  }
+  for (start = 0; start < vi->num_audio_samples && !error; start += 2048) {
+    avs_get_audio(clip, samples, start, 2048);
+    error = avs_clip_get_error(clip);
+  }
+  if (error)
+    fprintf(stderr, "plugintest: %s\n", error);
+  else
+    printf("plugintest: %d frames and %d audio samples\n", vi->num_frames, (int)vi->num_audio_samples);
+
+  avs_release_clip(clip);
+  avs_delete_script_environment(env);
+  return error ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+
+// readaheadtest: drives the AVISource read-ahead (AVIReadAhead) over two
+// temporary segment files, with reads in the scheduled order, out of order,
+// after the window moved on or was rescheduled, and past the end of a file.
+// A Fetch may always decline with -1, the caller then reads the chunk
+// itself; whatever it does return has to be the data at the requested
+// position.
+//
+//   readaheadtest temp_path
+//
+// The exit status is 0 when all reads check out, 1 on errors and 2 on wrong
+// data or when nothing at all was read ahead.
+
+#include "ReadAhead.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static const long kFileSize = 1 << 18;
+static const long kSlotSize = 1 << 14;
+
+static int failures = 0;
+static int served = 0;
+
+
+static unsigned char byte_at(int segment, int64_t offset)
+{
+  return (unsigned char)((offset * 2654435761u + segment * 40503u) >> 13);
+}
+
+
+// Index position of offset in segment
+static int64_t position(int segment, int64_t offset)
+{
+  return ((int64_t)segment << 48) + offset;
+}
+
+
+// Gives the worker time to get through the queue
+static void settle()
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+
+// Fetches key, which was scheduled at pos with len bytes; expect_data is
+// false when the chunk must not be served
+static void fetch(AVIReadAhead& ra, const char* what, long key, int64_t pos, long len, bool expect_data = true)
+{
+  std::vector<unsigned char> buf(len);
+  const long actual = ra.Fetch(key, buf.data(), len);
+  if (actual < 0)
+    return;
+
+  if (!expect_data || actual != len) {
+    fprintf(stderr, "readaheadtest: %s: key %ld was served with %ld bytes\n", what, key, actual);
+    failures++;
+    return;
+  }
+  for (long i = 0; i < len; ++i) {
+    if (buf[i] != byte_at((int)(pos >> 48), (pos & 0x0000FFFFFFFFFFFFLL) + i)) {
+      fprintf(stderr, "readaheadtest: %s: key %ld differs at byte %ld\n", what, key, i);
+      failures++;
+      return;
+    }
+  }
+  served++;
+}
+
+
+int main(int argc, char* argv[])
+{
+  if (argc != 2) {
+    fprintf(stderr, "Usage: readaheadtest temp_path\n");
+    return 1;
+  }
+
+  std::vector<std::string> paths;
+  for (int segment = 0; segment < 2; ++segment) {
+    paths.push_back(std::string(argv[1]) + "." + std::to_string(segment));
+    std::vector<unsigned char> data(kFileSize);
+    for (long i = 0; i < kFileSize; ++i)
+      data[i] = byte_at(segment, i);
+    FILE* f = fopen(paths.back().c_str(), "wb");
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+      fprintf(stderr, "readaheadtest: cannot write %s\n", paths.back().c_str());
+      return 1;
+    }
+    fclose(f);
+  }
+
+  {
+    AVIReadAhead ra(paths, 8, kSlotSize);
+    if (!ra.IsOpen()) {
+      fprintf(stderr, "readaheadtest: cannot open the segments\n");
+      return 1;
+    }
+
+    // Sequential chunks of odd sizes over both segments, with a window of
+    // the next four scheduled before each read
+    std::vector<AVIReadAhead::Request> chunks;
+    for (int segment = 0; segment < 2; ++segment) {
+      int64_t offset = 0;
+      for (long key = 0, len = 1000; offset + len <= kFileSize; ++key, len = len * 7 % kSlotSize + 1) {
+        chunks.push_back({ segment * 1000 + key, position(segment, offset), len });
+        offset += len;
+      }
+    }
+    const int sequential_start = served;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      ra.Schedule(&chunks[i], (int)std::min<size_t>(4, chunks.size() - i));
+      settle();
+      fetch(ra, "sequential", chunks[i].key, chunks[i].pos, chunks[i].len);
+    }
+    if (served == sequential_start) {
+      fprintf(stderr, "readaheadtest: sequential: nothing was read ahead\n");
+      failures++;
+    }
+
+    // The same window, consumed out of order
+    for (size_t i = 0; i + 4 <= chunks.size(); i += 4) {
+      ra.Schedule(&chunks[i], 4);
+      settle();
+      static const int order[4] = { 3, 1, 0, 2 };
+      for (int k : order)
+        fetch(ra, "reordered", chunks[i + k].key, chunks[i + k].pos, chunks[i + k].len);
+    }
+
+    // Chunks that dropped out of the window, chunks rescheduled at another
+    // position and fetches of another length are not served
+    {
+      ra.Schedule(&chunks[0], 4);
+      settle();
+      ra.Schedule(&chunks[4], 4);
+      settle();
+      for (int k = 0; k < 4; ++k)
+        fetch(ra, "dropped", chunks[k].key, chunks[k].pos, chunks[k].len, false);
+      for (int k = 4; k < 8; ++k)
+        fetch(ra, "after dropped", chunks[k].key, chunks[k].pos, chunks[k].len);
+
+      AVIReadAhead::Request moved[2] = { chunks[10], chunks[11] };
+      ra.Schedule(moved, 2);
+      moved[0].pos = position(1, 5000);
+      moved[1].pos = position(0, 77);
+      ra.Schedule(moved, 2);
+      settle();
+      for (int k = 0; k < 2; ++k)
+        fetch(ra, "moved", moved[k].key, moved[k].pos, moved[k].len);
+
+      ra.Schedule(&chunks[12], 1);
+      settle();
+      fetch(ra, "other length", chunks[12].key, chunks[12].pos, chunks[12].len - 1, false);
+    }
+
+    // A chunk running past the end of the file, one past the end, one
+    // larger than a slot and one in a segment that does not exist
+    {
+      const AVIReadAhead::Request bad[4] = {
+        { 9001, position(1, kFileSize - 100), 1000 },
+        { 9002, position(0, kFileSize + 10), 100 },
+        { 9003, position(0, 0), kSlotSize + 1 },
+        { 9004, position(2, 0), 100 },
+      };
+      ra.Schedule(bad, 4);
+      settle();
+      for (const AVIReadAhead::Request& r : bad)
+        fetch(ra, "past the end", r.key, r.pos, r.len, false);
+
+      // the slots are usable again afterwards
+      const AVIReadAhead::Request tail = { 9005, position(1, kFileSize - 100), 100 };
+      ra.Schedule(&tail, 1);
+      settle();
+      const int tail_start = served;
+      fetch(ra, "tail", tail.key, tail.pos, tail.len);
+      if (served == tail_start) {
+        fprintf(stderr, "readaheadtest: tail: the last bytes of the file were not read ahead\n");
+        failures++;
+      }
+    }
+
+    // Rescheduling while the worker is busy, without settling
+    for (int round = 0; round < 200; ++round) {
+      const size_t i = (size_t)(round * 37) % (chunks.size() - 6);
+      ra.Schedule(&chunks[i], 6);
+      for (int k = 5; k >= 0; k -= 2)
+        fetch(ra, "busy", chunks[i + k].key, chunks[i + k].pos, chunks[i + k].len);
+    }
+  }
+
+  for (const std::string& path : paths)
+    remove(path.c_str());
+
+  if (failures)
+    return 2;
+  printf("readaheadtest: %d chunks read ahead and checked\n", served);
+  return 0;
+}